@@ -74,7 +74,7 @@ public:
     int sendCommand(const std::string& command) {
         if (hSerial == INVALID_HANDLE_VALUE) {
             std::cerr << "Invalid handle. Port is not open." << std::endl;
-            return DEVICE_ERR; // ȷ DEVICE_ERR
+            return DEVICE_ERR; // 确保定义了 DEVICE_ERR
         }
 
         std::vector<uint8_t> buffer(command.begin(), command.end());
@@ -149,7 +149,7 @@ public:
         }
     }
 
-    int setCurrent(float current) //Ҫһ»ظʲô
+    int setCurrent(float current) //这里需要看一下回复是什么。
     {
         std::ostringstream ss;
         ss << "SETCURRENT=" << std::fixed << std::setprecision(2) << current << "\r\n";
@@ -159,27 +159,27 @@ public:
     }
 
     int getStatus() {
-        // STATUS
+        // 发送STATUS命令
         sendCommand("STATUS");
 
-        // ȡӦ
+        // 读取响应
         std::string response = readResponse();
 
-        // ȷӦΪգǷЧ16ǰ׺
+        // 确保响应不为空，并检查是否包含有效的16进制前缀
         if (response.empty() || response.substr(0, 2) != "0x") {
             std::cerr << "Invalid or empty response received." << std::endl;
-            return DEVICE_ERR; // 
+            return DEVICE_ERR; // 错误代码
         }
 
-        // Խ״̬
+        // 尝试解析状态码
         try {
-            // 16ַתΪ
+            // 将16进制字符串转换为整数
             unsigned long statusCode = std::stoul(response, nullptr, 16);
             return static_cast<int>(statusCode);
         }
         catch (const std::exception& e) {
             std::cerr << "Error parsing status response: " << e.what() << std::endl;
-            return DEVICE_ERR; // 
+            return DEVICE_ERR; // 错误代码
         }
     }
     int reset() {
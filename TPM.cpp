@@ -13,6 +13,8 @@
 #include "pthread.h"
 #include "semaphore.h"
 #include "../include/TraceLog.h"
+#include "LogMacros.h"
+#include "StageTrace.h"
 
 const char* g_HubDeviceName = "TPM";
 const char* g_DeviceNameNIDAQHub = "NIDAQHub";
@@ -39,6 +41,7 @@ const int ERR_NONUNIFORM_CHANNEL_VOLTAGE_RANGES = 2005;
 const int ERR_VOLTAGE_RANGE_EXCEEDS_DEVICE_LIMITS = 2006;
 const int ERR_UNKNOWN_PINS_PER_PORT = 2007;
 const int ERR_INVALID_REQUEST = 2008;
+const int ERR_CHANGE_DETECTION_IN_USE = 2009;
 
 ///////////////////////////////////////////////////////////////////////////////////
 ///   adapter Essential component
@@ -101,7 +104,7 @@ MODULE_API MM::Device* CreateDevice(const char* deviceName)
 MODULE_API void DeleteDevice(MM::Device* pDevice)
 {
     if (pDevice != nullptr) {
-        // ָָ kcDAQ ͵Ķʱɾ
+        // 仅当指针指向 kcDAQ 类型的对象时才删除
         if (dynamic_cast<kcDAQ*>(pDevice) != nullptr) {
             std::cout << "kcDAQ Device don't deleted" << std::endl;
         }
@@ -126,8 +129,10 @@ NIDAQHub::NIDAQHub() :
     minVolts_(0.0),
     maxVolts_(5.0),
     sampleRateHz_(10000.0),
+    niEventInput_("None"),
     aoTask_(0),
     doTask_(0),
+    eventTask_(0),
     doHub8_(0),
     doHub16_(0),
     doHub32_(0)
@@ -240,6 +245,11 @@ int NIDAQHub::Initialize()
         // do not return an error to allow the user to switch the triggerport to something that works
     }
 
+    pAct = new CPropertyAction(this, &NIDAQHub::OnEventInput);
+    err = CreateStringProperty("EventTriggerInput", niEventInput_.c_str(), false, pAct);
+    if (err != DEVICE_OK)
+        return err;
+
     initialized_ = true;
     return DEVICE_OK;
 }
@@ -251,6 +261,7 @@ int NIDAQHub::Shutdown()
         return DEVICE_OK;
 
     int err = StopTask(aoTask_);
+    StopTask(eventTask_);
 
     physicalAOChannels_.clear();
     aoChannelSequences_.clear();
@@ -372,6 +383,103 @@ int NIDAQHub::SwitchTriggerPortToReadMode()
 }
 
 
+int NIDAQHub::StartEventInputTask()
+{
+    int err = StopTask(eventTask_);
+    if (err != DEVICE_OK)
+        return err;
+    if (niEventInput_.empty() || niEventInput_ == "None")
+        return DEVICE_OK;
+
+    // Change detection is a single resource per device, DO blanking/sequencing uses it as well
+    if (IsDOChangeDetectionRunning())
+        return ReportChangeDetectionConflict("DO blanking/sequencing");
+
+    // Rising edges on the line raise change detection events; the callback drains the sample
+    // and flags the event, the disk thread picks it up with the next buffer.
+    // The buffer only has to absorb edges that arrive before the callback runs.
+    const uInt64 eventBufferSamples = 1000;
+    int32 nierr = DAQmxCreateTask((niDeviceName_ + "EventInputTask").c_str(), &eventTask_);
+    if (nierr != 0)
+        return TranslateNIError(nierr);
+    nierr = DAQmxCreateDIChan(eventTask_, niEventInput_.c_str(), "eventIn", DAQmx_Val_ChanPerLine);
+    if (nierr == 0)
+        nierr = DAQmxCfgChangeDetectionTiming(eventTask_, niEventInput_.c_str(), NULL, DAQmx_Val_ContSamps, eventBufferSamples);
+    if (nierr == 0)
+        nierr = DAQmxRegisterSignalEvent(eventTask_, DAQmx_Val_ChangeDetectionEvent, 0, OnEventInputEdge, this);
+    if (nierr == 0)
+        nierr = DAQmxRegisterDoneEvent(eventTask_, 0, OnEventInputDone, this);
+    if (nierr == 0)
+        nierr = DAQmxStartTask(eventTask_);
+    if (nierr != 0)
+    {
+        LogMessage(GetNIDetailedErrorForMostRecentCall().c_str());
+        StopTask(eventTask_);
+        // another task (possibly in another process) holds the change detection resource
+        if (nierr == DAQmxErrorPALResourceReserved || nierr == DAQmxErrorResourceReservedWithConflictingSettings)
+            return ReportChangeDetectionConflict("another task");
+        return TranslateNIError(nierr);
+    }
+    LogMessage("Started event input task on " + niEventInput_, true);
+
+    return DEVICE_OK;
+}
+
+
+int32 CVICALLBACK NIDAQHub::OnEventInputEdge(TaskHandle taskHandle, int32 /* signalID */, void* callbackData)
+{
+    // Every change detection event stores a sample; read them all so the buffer never overflows
+    // (an overflow stops the task). Several edges may be drained by one callback.
+    NIDAQHub* hub = static_cast<NIDAQHub*>(callbackData);
+    uInt8 lines[64];
+    uInt32 available = 0;
+    int32 nierr = DAQmxGetReadAvailSampPerChan(taskHandle, &available);
+    while (nierr == 0 && available > 0)
+    {
+        int32 read = 0;
+        int32 bytesPerSample = 0;
+        int32 count = (int32)std::min<uInt32>(available, sizeof(lines));
+        nierr = DAQmxReadDigitalLines(taskHandle, count, 0, DAQmx_Val_GroupByChannel, lines, sizeof(lines), &read, &bytesPerSample, NULL);
+        if (read <= 0)
+            break;
+        available -= (uInt32)read;
+    }
+    if (nierr != 0)
+        hub->LogMessage("Event input read failed: " + GetNIError(nierr));
+
+    ThreadFileToDisk::Ins().m_preTriggerPing.Trigger(PreTriggerGate::SOURCE_EXTERNAL);
+    return 0;
+}
+
+
+int32 CVICALLBACK NIDAQHub::OnEventInputDone(TaskHandle /* taskHandle */, int32 status, void* callbackData)
+{
+    // A continuous task only finishes on its own after an error; report it instead of stopping silently
+    NIDAQHub* hub = static_cast<NIDAQHub*>(callbackData);
+    if (status != 0)
+        hub->LogMessage("Event input task on " + hub->niEventInput_ + " stopped, external events are no longer recorded: " + GetNIError(status));
+    return 0;
+}
+
+
+bool NIDAQHub::IsDOChangeDetectionRunning() const
+{
+    return (doHub8_ && doHub8_->IsChangeDetectionRunning())
+        || (doHub16_ && doHub16_->IsChangeDetectionRunning())
+        || (doHub32_ && doHub32_->IsChangeDetectionRunning());
+}
+
+
+int NIDAQHub::ReportChangeDetectionConflict(const std::string& user)
+{
+    std::string msg = "Change detection on " + niDeviceName_ + " is in use by " + user +
+        "; EventTriggerInput and DO blanking/sequencing can not run at the same time";
+    LogMessage(msg);
+    SetErrorText(ERR_CHANGE_DETECTION_IN_USE, msg.c_str());
+    return ERR_CHANGE_DETECTION_IN_USE;
+}
+
+
 int NIDAQHub::IsSequencingEnabled(bool& flag) const
 {
     flag = sequencingEnabled_;
@@ -927,6 +1035,23 @@ int NIDAQHub::OnTriggerInputPort(MM::PropertyBase* pProp, MM::ActionType eAct)
 }
 
 
+int NIDAQHub::OnEventInput(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(niEventInput_.c_str());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        std::string line;
+        pProp->Get(line);
+        niEventInput_ = line;
+        return StartEventInputTask();
+    }
+    return DEVICE_OK;
+}
+
+
 int NIDAQHub::OnSampleRate(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
     if (eAct == MM::BeforeGet)
@@ -1041,18 +1166,18 @@ int NIDAQDOHub<Tuint>::StartDOBlankingAndOrSequenceWithoutTrigger(const std::str
     }
     hub_->LogMessage("Created DO channel for: " + port, true);
 
-    int32 number = num * 2; // ÿضӦ
+    int32 number = num * 2; // 每个上升沿对应两个样本点
     boost::scoped_array<Tuint> samples;
     samples.reset(new Tuint[number]);
 
-    // ź
+    // 生成信号序列
     for (int i = 0; i < num; ++i)
     {
-        samples.get()[2 * i] = blankOnLow ? pos : 0;       // һ
-        samples.get()[2 * i + 1] = blankOnLow ? 0 : pos;  // ڶ㣬
+        samples.get()[2 * i] = blankOnLow ? pos : 0;       // 第一个样本点
+        samples.get()[2 * i + 1] = blankOnLow ? 0 : pos;  // 第二个样本点，产生上升沿
     }
 
-    double sampleRateHz = hub_->sampleRateHz_;  // ڲʱӵƵ
+    double sampleRateHz = hub_->sampleRateHz_;  // 这里设置内部时钟的频率
     nierr = DAQmxCfgSampClkTiming(doTask_, "", 2 * sampleRateHz, DAQmx_Val_Rising, DAQmx_Val_ContSamps, number);
     if (nierr != 0)
     {
@@ -1114,6 +1239,10 @@ int NIDAQDOHub<Tuint>::StartDOBlankingAndOrSequence(const std::string& port, con
     if (err != DEVICE_OK)
         return err;
 
+    // The hub's event input task holds the device's change detection
+    if (hub_->eventTask_)
+        return hub_->ReportChangeDetectionConflict("EventTriggerInput " + hub_->niEventInput_);
+
     int32 nierr = DAQmxCreateTask("DIChangeTask", &diTask_);
     if (nierr != 0)
     {
@@ -1407,22 +1536,41 @@ kcDAQ::kcDAQ() :
     smaplerate(1000.0),
     channelcount(4.0),
     data1({ 0,0 }),
-    repetitionfrequency(800)
+    repetitionfrequency(800),
+    datarate(0),
+    poolbudget(16000),
+    bufferseconds(4),
+    rawringmb(0),
+    compress(0),
+    compressthreads(4),
+    eventrecord(0),
+    pretrigseconds(2),
+    posttrigseconds(5),
+    eventchannel(0),
+    eventlevel(0),
+    replayrate(0),
+    waitmode(WaitStrategy::MODE_SPIN),
+    waitspincount(WaitStrategy::DEFAULT_SPIN_COUNT),
+    waityieldcount(WaitStrategy::DEFAULT_YIELD_COUNT),
+    waitmaxsleep(WaitStrategy::DEFAULT_MAX_SLEEP_MS),
+    pollThreadRunning_(false)
 {
     InitializeDefaultErrorMessages();
-    pthread_mutex_init(&mutex_, NULL);  // ʼ
+    pthread_mutex_init(&mutex_, NULL);  // 初始化互斥锁
 }
 
 STXDMA_CARDINFO pstCardInfo;
 kcDAQ::~kcDAQ()
 {
-    pthread_mutex_destroy(&mutex_);  // ٻ
+    pthread_mutex_destroy(&mutex_);  // 销毁互斥锁
 }
 
 int kcDAQ::Initialize()
 {
     if (initialized_)
         return DEVICE_OK;
+    // 采集线程中的日志只进入记录环，由后台线程写文件
+    pLog->StartAsync();
     initializeTheadtoDisk();
     int err = QTXdmaOpenBoard(&pstCardInfo, 0);
     QT_BoardGetCardInfo();
@@ -1430,7 +1578,7 @@ int kcDAQ::Initialize()
     QT_BoardSetTransmitMode(0, 0);
     QT_BoardSetInterruptClear();
     QT_BoardSetSoftReset();
-    // ͨƫ
+    // 调节通道偏置
     CPropertyAction* pAct = new CPropertyAction(this, &kcDAQ::OnOffset);
     err = CreateFloatProperty("Channel1 offset", offset1, false, pAct);
     if (err != DEVICE_OK)
@@ -1444,50 +1592,149 @@ int kcDAQ::Initialize()
     err = CreateFloatProperty("Channel4 offset", offset4, false, pAct);
     if (err != DEVICE_OK)
         return err;
-    // Ԥ
+    // 预触发
     pAct = new CPropertyAction(this, &kcDAQ::OnPreTrigLength);
     err = CreateFloatProperty("Pre Trigger Length", pretriglength, false, pAct);
-    // ֡ͷʹ
+    // 帧头使能
     pAct = new CPropertyAction(this, &kcDAQ::OnFrameHeader);
     err = CreateIntegerProperty("Frame header", frameheader, false, pAct);
     SetPropertyLimits("Frame header", 0, 1);
-    // ʱģʽ
+    // 时钟模式
     pAct = new CPropertyAction(this, &kcDAQ::OnClockMode);
     err = CreateIntegerProperty("Clock Mode", clockmode, false, pAct);
     SetPropertyLimits("Clock Mode", 0, 2);
-    // ģʽ
+    // 触发模式
     pAct = new CPropertyAction(this, &kcDAQ::OnTriggerMode);
     err = CreateIntegerProperty("Trigger Mode", triggermode, false, pAct);
     SetPropertyLimits("Trigger Mode", 0, 7);
-    // ڲ崥
-    /// 
+    // 内部脉冲触发设置
+    /// 脉冲周期
     pAct = new CPropertyAction(this, &kcDAQ::OnPulsePeriod);
     err = CreateFloatProperty("Pulse Period", pulseperiod, false, pAct);
-    /// 
+    /// 脉冲宽度
     pAct = new CPropertyAction(this, &kcDAQ::OnPulseWidth);
     err = CreateFloatProperty("Pulse Width", pulsewidth, false, pAct);
-    // ͨ
-    /// 
+    // 通道触发设置
+    /// 触发迟滞
     pAct = new CPropertyAction(this, &kcDAQ::OnArmHysteresis);
     err = CreateFloatProperty("Arm Hysteresis", armhysteresis, true, pAct);
-    /// ͨ
+    /// 触发通道
     pAct = new CPropertyAction(this, &kcDAQ::OnTriggerChannel);
     err = CreateFloatProperty("Trigger Channel", triggerchannel, true, pAct);
     SetPropertyLimits("Trigger Channel", 1, 4);
-    /// ֵ
+    /// 上升沿阈值
     pAct = new CPropertyAction(this, &kcDAQ::OnRasingCodevalue);
     err = CreateFloatProperty("Rasing Codevalue", rasingcodevalue, true, pAct);
-    /// ½ֵ
+    /// 下降沿阈值
     pAct = new CPropertyAction(this, &kcDAQ::OnFallingCodevalue);
     err = CreateFloatProperty("Falling Codevalue", fallingcodevalue, true, pAct);
-    // δʱ
+    // 单次触发段时长
     pAct = new CPropertyAction(this, &kcDAQ::OnSegmentDuration);
     err = CreateFloatProperty("Segment Duration", segmentduration, false, pAct);
     SetPropertyLimits("Segment Duration", 0, 536870.904);
-    // Ƶ
+    // 触发频率
     pAct = new CPropertyAction(this, &kcDAQ::OnRepetitionFrequency);
     err = CreateFloatProperty("Repetition Frequency", repetitionfrequency, false, pAct);
     SetPropertyLimits("Repetition Frequency", 800, 99999999999);
+    // 缓存池内存预算
+    pAct = new CPropertyAction(this, &kcDAQ::OnPoolBudget);
+    err = CreateFloatProperty("Pool Budget(MB)", poolbudget, false, pAct);
+    SetPropertyLimits("Pool Budget(MB)", 256, 262144);
+    // 缓存池可缓冲的时长
+    pAct = new CPropertyAction(this, &kcDAQ::OnBufferSeconds);
+    err = CreateFloatProperty("Buffer Seconds", bufferseconds, false, pAct);
+    SetPropertyLimits("Buffer Seconds", 0.1, 600);
+    // 原始数据环，供在线读取最新数据；0为不创建，写盘线程不额外拷贝
+    pAct = new CPropertyAction(this, &kcDAQ::OnRawRing);
+    err = CreateIntegerProperty("Raw Ring(MB)", rawringmb, false, pAct);
+    SetPropertyLimits("Raw Ring(MB)", 0, 65536);
+    // 写盘前无损压缩，默认关闭以保持原始数据格式；压缩比和单线程编码速度只读
+    pAct = new CPropertyAction(this, &kcDAQ::OnCompression);
+    err = CreateProperty("Compression", compress ? "On" : "Off", MM::String, false, pAct);
+    AddAllowedValue("Compression", "Off");
+    AddAllowedValue("Compression", "On");
+    err = CreateIntegerProperty("Compress Threads", compressthreads, false, pAct);
+    SetPropertyLimits("Compress Threads", 1, 32);
+    err = CreateFloatProperty("Compress Ratio", 0, true, pAct);
+    err = CreateFloatProperty("Codec(MB/s)", 0, true, pAct);
+    // 离线回放录制的原始文件
+    pAct = new CPropertyAction(this, &kcDAQ::OnReplayFile);
+    err = CreateProperty("Replay File", "", MM::String, false, pAct);
+    pAct = new CPropertyAction(this, &kcDAQ::OnReplayRate);
+    err = CreateFloatProperty("Replay Rate(MB/s)", replayrate, false, pAct);
+    SetPropertyLimits("Replay Rate(MB/s)", 0, 100000);
+    pAct = new CPropertyAction(this, &kcDAQ::OnReplay);
+    err = CreateProperty("Replay", "Off", MM::String, false, pAct);
+    AddAllowedValue("Replay", "Off");
+    AddAllowedValue("Replay", "On");
+    AddAllowedValue("Replay", "Loop");
+    // 按通道拆分原始文件，写入文件路径后执行，输出到同目录下 <文件名>_ch<n>.bin
+    pAct = new CPropertyAction(this, &kcDAQ::OnSplitFile);
+    err = CreateProperty("Split File", "", MM::String, false, pAct);
+    // 寄存器访问跟踪，写入文件路径后导出：.txt解码为文本，其他扩展名为二进制(RegTrace::DecodeFile离线解码)
+    pAct = new CPropertyAction(this, &kcDAQ::OnRegTrace);
+    err = CreateProperty("Register Trace", RegTrace::Ins().IsEnabled() ? "On" : "Off", MM::String, false, pAct);
+    AddAllowedValue("Register Trace", "Off");
+    AddAllowedValue("Register Trace", "On");
+    err = CreateProperty("Register Trace Dump", "", MM::String, false, pAct);
+    // 寄存器影子缓存，值未变化的配置寄存器读写不访问板卡；排查硬件问题时可关闭
+    pAct = new CPropertyAction(this, &kcDAQ::OnRegCache);
+    err = CreateProperty("Register Cache", RegShadow::Ins().IsEnabled() ? "On" : "Off", MM::String, false, pAct);
+    AddAllowedValue("Register Cache", "Off");
+    AddAllowedValue("Register Cache", "On");
+    // 流水线阶段跟踪，写入文件路径后导出Chrome trace JSON(chrome://tracing 或 ui.perfetto.dev 打开)
+    pAct = new CPropertyAction(this, &kcDAQ::OnStageTrace);
+    err = CreateProperty("Stage Trace", StageTrace::IsEnabled() ? "On" : "Off", MM::String, false, pAct);
+    AddAllowedValue("Stage Trace", "Off");
+    AddAllowedValue("Stage Trace", "On");
+    err = CreateProperty("Stage Trace Export", "", MM::String, false, pAct);
+    // 运行期日志级别，高于该级别的LOG_PRINTF不求值参数
+    pAct = new CPropertyAction(this, &kcDAQ::OnLogLevel);
+    err = CreateIntegerProperty("Log Level", pLog->GetLogLevel(), false, pAct);
+    SetPropertyLimits("Log Level", 1, 5);
+    // 等中断线程的等待策略：Spin延迟最低但占满一个核，Adaptive先自旋再让出最后休眠
+    pAct = new CPropertyAction(this, &kcDAQ::OnWaitStrategy);
+    err = CreateProperty("Wait Strategy", WaitStrategy::ModeName(waitmode), MM::String, false, pAct);
+    for (int i = WaitStrategy::MODE_SPIN; i <= WaitStrategy::MODE_ADAPTIVE; i++)
+        AddAllowedValue("Wait Strategy", WaitStrategy::ModeName(i));
+    err = CreateIntegerProperty("Wait Spin Count", waitspincount, false, pAct);
+    SetPropertyLimits("Wait Spin Count", 0, 1000000);
+    err = CreateIntegerProperty("Wait Yield Count", waityieldcount, false, pAct);
+    SetPropertyLimits("Wait Yield Count", 0, 100000);
+    err = CreateIntegerProperty("Wait Max Sleep(ms)", waitmaxsleep, false, pAct);
+    SetPropertyLimits("Wait Max Sleep(ms)", 1, 100);
+    err = CreateFloatProperty("Wake Latency p50(us)", 0, true, pAct);
+    err = CreateFloatProperty("Wake Latency p99(us)", 0, true, pAct);
+    err = CreateFloatProperty("Wake Latency Max(us)", 0, true, pAct);
+    err = CreateFloatProperty("Polls Per Wait", 0, true, pAct);
+    // 事件触发记录：只写事件前后的数据
+    pAct = new CPropertyAction(this, &kcDAQ::OnEventRecord);
+    err = CreateProperty("Event Record", "Off", MM::String, false, pAct);
+    AddAllowedValue("Event Record", "Off");
+    AddAllowedValue("Event Record", "On");
+    err = CreateFloatProperty("Pre Trigger Seconds", pretrigseconds, false, pAct);
+    SetPropertyLimits("Pre Trigger Seconds", 0, 600);
+    err = CreateFloatProperty("Post Trigger Seconds", posttrigseconds, false, pAct);
+    SetPropertyLimits("Post Trigger Seconds", 0, 3600);
+    err = CreateIntegerProperty("Event Threshold Channel", eventchannel, false, pAct);
+    SetPropertyLimits("Event Threshold Channel", 0, 4);
+    err = CreateIntegerProperty("Event Threshold Level", eventlevel, false, pAct);
+    SetPropertyLimits("Event Threshold Level", -32768, 32767);
+    err = CreateProperty("Software Trigger", "Idle", MM::String, false, pAct);
+    AddAllowedValue("Software Trigger", "Idle");
+    AddAllowedValue("Software Trigger", "Fire");
+    err = CreateIntegerProperty("Event Count", 0, true, pAct);
+    // 流水线运行统计(只读)
+    pAct = new CPropertyAction(this, &kcDAQ::OnPipelineStats);
+    err = CreateFloatProperty("Ingest(MB/s)", 0, true, pAct);
+    err = CreateFloatProperty("Writer(MB/s)", 0, true, pAct);
+    err = CreateIntegerProperty("Pool Free", 0, true, pAct);
+    err = CreateIntegerProperty("Pool Available", 0, true, pAct);
+    err = CreateIntegerProperty("Pool InUse HighWater", 0, true, pAct);
+    err = CreateIntegerProperty("Pool Available HighWater", 0, true, pAct);
+    err = CreateIntegerProperty("Pool Exhausted", 0, true, pAct);
+    err = CreateIntegerProperty("Dropped Blocks", 0, true, pAct);
+    err = CreateFloatProperty("Ring Overwritten(MB)", 0, true, pAct);
     initialized_ = true;
     return DEVICE_OK;
 }
@@ -1497,9 +1744,19 @@ int kcDAQ::Shutdown()
     if (!initialized_)
         return DEVICE_OK;
     int err = 0;
+    replay_.Stop();
     err = QT_BoardSetADCStop();
+    StopPollIntr();
     err = QT_BoardSetTransmitMode(0, 0);
+    //卸载前写完剩余数据并关闭数据文件
+    ThreadFileToDisk::Ins().m_preTriggerPing.RequestDrain();
+    ThreadFileToDisk::Ins().StopPing();
+    sequenceRunning_ = false;
     err = QTXdmaCloseBoard(&pstCardInfo);
+    // 重新打开板卡时从硬件重新读取
+    RegShadow::Ins().InvalidateAll();
+    // 在卸载前写完剩余日志并回到同步模式
+    pLog->StopAsync();
     initialized_ = false;
     return DEVICE_OK;
 }
@@ -1509,7 +1766,7 @@ void kcDAQ::GetName(char* name) const
     CDeviceUtils::CopyLimitedString(name, g_DeviceNameDAQ);
 }
 
-// ֲ
+// 粗糙
 int kcDAQ::SetGateOpen(bool open)
 {
     gateOpen_ = open;
@@ -1549,31 +1806,51 @@ int kcDAQ::GetDASequenceMaxLength(long& maxLength) const
 
 int kcDAQ::StartDASequence()
 {
-    //DMA
+    if (sequenceRunning_)
+        StopDASequence();
+    replay_.Stop();
+    //回放留下的写盘线程先写完并关闭文件，所有缓存归还后才能调整缓存池
+    ThreadFileToDisk::Ins().StopPing();
+    //按本次采集参数调整缓存池，失败时沿用原来的缓存池
+    ResizePool();
+    ConfigureEventRecord();
+    //DMA参数设置
     QT_BoardSetFifoMultiDMAParameter(once_trig_bytes, data1.DMATotolbytes);
-    //DMAģʽ
+    //记录本次采集的配置，写入数据文件头
+    uint32_t segmentsPerBlock = once_trig_bytes ? (uint32_t)(data1.DMATotolbytes / once_trig_bytes) : 0;
+    ThreadFileToDisk::Ins().set_container(true, BuildConfigSnapshot(), (uint32_t)once_trig_bytes, segmentsPerBlock);
+    //DMA传输模式设置
     QT_BoardSetTransmitMode(1, 0);
-    //ʹPCIEж
+    //使能PCIE中断
     QT_BoardSetInterruptSwitch();
-    ////ݲɼ߳
+    ////数据采集线程
     //pthread_t data_collect;
     //pthread_create(&data_collect, NULL, DatacollectEntry, &data1);
 
 
 
-    //ADCʼɼ
+    //等待策略在线程启动前设置，统计只反映本次采集；上一次的中断等待线程须已退出
+    StopPollIntr();
+    gatherWait_.SetMode((int)waitmode, (int)waitspincount, (int)waityieldcount, (DWORD)waitmaxsleep);
+    gatherWait_.ResetStats();
+    gatherWait_.ResetCancel();
+
+    //写盘线程在第一块数据到达时按本次配置创建文件
+    ThreadFileToDisk::Ins().StartPing();
+
+    //ADC开始采集
     QT_BoardSetADCStart();
 
-    // ж߳
-    pthread_t wait_intr_c2h_0;
+    // 等中断线程
     ThreadParams* params = new ThreadParams{ this };
-    int ret = pthread_create(&wait_intr_c2h_0, NULL, PollIntrEntry, static_cast<void*>(params));
+    int ret = pthread_create(&pollThread_, NULL, PollIntrEntry, static_cast<void*>(params));
     if (ret != 0) {
-        delete params;  // ̴߳ʧܣͷŲ
+        delete params;  // 如果线程创建失败，释放参数
         return DEVICE_ERR;
     }
+    pollThreadRunning_ = true;
 
-    ////ж߳
+    ////等中断线程
     //pthread_t wait_intr_c2h_0;
     //pthread_create(&wait_intr_c2h_0, NULL, PollIntrEntry, NULL);
     sequenceRunning_ = true;
@@ -1584,8 +1861,19 @@ int kcDAQ::StopDASequence()
 {
     QT_BoardSetADCStop();
     printf("set adc stop......\n");
+    //中断等待线程退出后才停止写盘线程，它交付的缓存都能写完
+    StopPollIntr();
     QT_BoardSetTransmitMode(0, 0);
     printf("set DMA stop......\n");
+    //未触发事件而保留的预触发缓存交还缓存池
+    ThreadFileToDisk::Ins().m_preTriggerPing.RequestDrain();
+    WAIT_STATS waitStats;
+    gatherWait_.GetStats(waitStats);
+    LOG_PRINTF(4, "[kcDAQ::StopDASequence], wait %s, waits %llu polls/wait %.1f avg %.1f us, wake latency p50 %.1f p99 %.1f max %.1f us",
+        WaitStrategy::ModeName(gatherWait_.GetMode()), (unsigned long long)waitStats.uWaits, waitStats.dPollsPerWait,
+        waitStats.dAvgWaitUs, waitStats.dLatencyP50Us, waitStats.dLatencyP99Us, waitStats.dLatencyMaxUs);
+    //写完已采集的数据，关闭文件时写入索引尾并截断预分配的空间
+    ThreadFileToDisk::Ins().StopPing();
     sequenceRunning_ = false;
     return DEVICE_OK;
 }
@@ -1619,13 +1907,13 @@ int kcDAQ::SendDASequence()
 
 int kcDAQ::OnOffset(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
-    std::string propName = pProp->GetName();  // ȡص
+    std::string propName = pProp->GetName();  // 获取触发回调的属性名称
     if (eAct == MM::AfterSet)
     {
         double offset;
-        pProp->Get(offset); // лȡûõƫֵ
+        pProp->Get(offset); // 从属性中获取用户设置的新偏移值
 
-        int channelID = 0;  // ʼͨID
+        int channelID = 0;  // 初始化通道ID
         if (propName == "Channel1 offset")
         {
             channelID = 1;
@@ -1643,7 +1931,7 @@ int kcDAQ::OnOffset(MM::PropertyBase* pProp, MM::ActionType eAct)
             channelID = 4;
         }
 
-        if (channelID > 0) {  // channelIDǷЧ
+        if (channelID > 0) {  // 检查channelID是否有效
             int err = QT_BoardSetOffset(channelID, offset);
             if (err != DEVICE_OK)
                 return err;
@@ -1665,8 +1953,8 @@ int kcDAQ::OnFrameHeader(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
     if (eAct == MM::AfterSet)
     {
-        double fh;  // ڴ洢ȡֵ
-        pProp->Get(fh);  // ȷݲ
+        double fh;  // 用于存储获取到的属性值
+        pProp->Get(fh);  // 正确传递参数
         frameheader = static_cast<int>(fh);
         int err = QT_BoardSetFrameheader(frameheader);
         return err;
@@ -1677,8 +1965,8 @@ int kcDAQ::OnClockMode(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
     if (eAct == MM::AfterSet)
     {
-        double cm;  // ڴ洢ȡֵ
-        pProp->Get(cm);  // ȷݲ
+        double cm;  // 用于存储获取到的属性值
+        pProp->Get(cm);  // 正确传递参数
         clockmode = static_cast<int>(cm);
         int err = QT_BoardSetClockMode(clockmode);
         return err;
@@ -1689,10 +1977,10 @@ int kcDAQ::OnTriggerMode(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
     if (eAct == MM::AfterSet)
     {
-        double tm;  // ڴ洢ȡֵ
-        pProp->Get(tm);  // ȷݲ
+        double tm;  // 用于存储获取到的属性值
+        pProp->Get(tm);  // 正确传递参数
         triggermode = static_cast<int>(tm);
-        // readonly
+        // 设置readonly
         if (triggermode != 1)
         {
             SetPropertyReadOnly("Pulse Period", true);
@@ -1711,10 +1999,10 @@ int kcDAQ::OnTriggerMode(MM::PropertyBase* pProp, MM::ActionType eAct)
             SetPropertyReadOnly("Trigger Channel", true);
             SetPropertyReadOnly("Falling Codevalue", true);
         }
-        // ģʽ
+        // 调整触发模式
         if (triggermode == 0)
         {
-            int err = QT_BoardSoftTrigger(); //
+            int err = QT_BoardSoftTrigger(); //软件触发
         }
         else if (triggermode == 1)
         {
@@ -1763,7 +2051,7 @@ int kcDAQ::OnPulsePeriod(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
     if (eAct == MM::AfterSet)
     {
-        pProp->Get(pulseperiod);  // ȷݲ
+        pProp->Get(pulseperiod);  // 正确传递参数
     }
     return DEVICE_OK;
 }
@@ -1771,7 +2059,7 @@ int kcDAQ::OnPulseWidth(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
     if (eAct == MM::AfterSet)
     {
-        pProp->Get(pulsewidth);  // ȷݲ
+        pProp->Get(pulsewidth);  // 正确传递参数
     }
     return DEVICE_OK;
 }
@@ -1779,7 +2067,7 @@ int kcDAQ::OnArmHysteresis(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
     if (eAct == MM::AfterSet)
     {
-        pProp->Get(armhysteresis);  // ȷݲ
+        pProp->Get(armhysteresis);  // 正确传递参数
         QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x3C, armhysteresis);
         ChannelTriggerConfig();
     }
@@ -1789,7 +2077,7 @@ int kcDAQ::OnTriggerChannel(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
     if (eAct == MM::AfterSet)
     {
-        pProp->Get(triggerchannel);  // ȷݲ
+        pProp->Get(triggerchannel);  // 正确传递参数
         ChannelTriggerConfig();
     }
     return DEVICE_OK;
@@ -1798,7 +2086,7 @@ int kcDAQ::OnRasingCodevalue(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
     if (eAct == MM::AfterSet)
     {
-        pProp->Get(rasingcodevalue);  // ȷݲ
+        pProp->Get(rasingcodevalue);  // 正确传递参数
         ChannelTriggerConfig();
     }
     return DEVICE_OK;
@@ -1807,7 +2095,7 @@ int kcDAQ::OnFallingCodevalue(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
     if (eAct == MM::AfterSet)
     {
-        pProp->Get(fallingcodevalue);  // ȷݲ
+        pProp->Get(fallingcodevalue);  // 正确传递参数
         ChannelTriggerConfig();
     }
     return DEVICE_OK;
@@ -1816,7 +2104,7 @@ int kcDAQ::OnSegmentDuration(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
     if (eAct == MM::AfterSet)
     {
-        pProp->Get(segmentduration);  // ȷݲ
+        pProp->Get(segmentduration);  // 正确传递参数
         dataConfig();
     }
     return DEVICE_OK;
@@ -1825,14 +2113,434 @@ int kcDAQ::OnRepetitionFrequency(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
     if (eAct == MM::AfterSet)
     {
-        pProp->Get(repetitionfrequency);  // ȷݲ
+        pProp->Get(repetitionfrequency);  // 正确传递参数
         dataConfig();
     }
     return DEVICE_OK;
 }
+int kcDAQ::OnPoolBudget(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(poolbudget);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        //回放线程在使用缓存池，不能重建
+        if (replay_.IsRunning())
+        {
+            LogMessage("pool budget can not be changed during replay, stop the replay first");
+            return DEVICE_ERR;
+        }
+        pProp->Get(poolbudget);
+        //采集中修改时在下次StartDASequence生效
+        if (!sequenceRunning_)
+            ResizePool();
+    }
+    return DEVICE_OK;
+}
+int kcDAQ::OnBufferSeconds(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(bufferseconds);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        if (replay_.IsRunning())
+        {
+            LogMessage("buffer seconds can not be changed during replay, stop the replay first");
+            return DEVICE_ERR;
+        }
+        pProp->Get(bufferseconds);
+        if (!sequenceRunning_)
+            ResizePool();
+    }
+    return DEVICE_OK;
+}
+int kcDAQ::OnRawRing(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(rawringmb);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        long ringmb = 0;
+        pProp->Get(ringmb);
+        //写盘线程是数据环唯一的写者，采集或回放时不能重建
+        if (sequenceRunning_ || replay_.IsRunning())
+        {
+            LogMessage("raw ring can not be resized during acquisition or replay");
+            return DEVICE_ERR;
+        }
+        //回放结束后写盘线程可能还在运行
+        ThreadFileToDisk::Ins().StopPing();
+        if (!ThreadFileToDisk::Ins().initRawRing((uint64_t)ringmb * (1 MB), RingStore::FULL_OVERWRITE))
+        {
+            LogMessage("raw ring create failed");
+            return DEVICE_ERR;
+        }
+        rawringmb = ringmb;
+    }
+    return DEVICE_OK;
+}
+int kcDAQ::OnCompression(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    std::string propName = pProp->GetName();
+    BlockCompressor& compressor = ThreadFileToDisk::Ins().m_compressorPing;
+    if (eAct == MM::BeforeGet)
+    {
+        if (propName == "Compression")
+            pProp->Set(compress ? "On" : "Off");
+        else if (propName == "Compress Threads")
+            pProp->Set(compressthreads);
+        else if (propName == "Compress Ratio")
+            pProp->Set(compressor.GetRatio());
+        else if (propName == "Codec(MB/s)")
+            pProp->Set(compressor.GetCodecMBps());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        //压缩线程随写盘文件创建启动，采集或回放时不能改
+        if (sequenceRunning_ || replay_.IsRunning())
+        {
+            LogMessage("compression can not be changed during acquisition or replay");
+            return DEVICE_ERR;
+        }
 
+        if (propName == "Compression")
+        {
+            std::string value;
+            pProp->Get(value);
+            compress = (value == "On") ? 1 : 0;
+        }
+        else if (propName == "Compress Threads")
+            pProp->Get(compressthreads);
+        ThreadFileToDisk::Ins().set_compression(compress != 0, (int)compressthreads, (int)channelcount);
+    }
+    return DEVICE_OK;
+}
+int kcDAQ::OnReplayFile(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(replayfile.c_str());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        pProp->Get(replayfile);
+    }
+    return DEVICE_OK;
+}
+int kcDAQ::OnReplayRate(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(replayrate);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        pProp->Get(replayrate);
+    }
+    return DEVICE_OK;
+}
+int kcDAQ::OnReplay(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(!replay_.IsRunning() ? "Off" : (replay_.IsLoop() ? "Loop" : "On"));
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        std::string mode;
+        pProp->Get(mode);
+        if (mode == "Off")
+        {
+            //只停止回放启动的写盘线程：采集时写盘线程属于采集，回放已结束时已由OnReplayFinished停止
+            bool bRunning = replay_.IsRunning();
+            replay_.Stop();
+            if (bRunning)
+                ThreadFileToDisk::Ins().StopPing();
+            return DEVICE_OK;
+        }
+        //回放数据和采集数据共用缓存池和写盘线程，采集时不允许回放
+        if (sequenceRunning_)
+        {
+            LogMessage("replay can not be started during acquisition");
+            return DEVICE_ERR;
+        }
+        //上一次回放的文件先关闭，本次回放写入新文件；回放的块大小按录制时的单次中断数据量
+        replay_.Stop();
+        ThreadFileToDisk::Ins().StopPing();
+        if (!replay_.Open(replayfile, (uint32_t)data1.DMATotolbytes))
+            return DEVICE_ERR;
+        ThreadFileToDisk::Ins().StartPing();
+        replay_.SetFinishCallback(OnReplayFinished, this);
+        if (!replay_.Start(replayrate, mode == "Loop"))
+        {
+            ThreadFileToDisk::Ins().StopPing();
+            return DEVICE_ERR;
+        }
+    }
+    return DEVICE_OK;
+}
+
+void kcDAQ::OnReplayFinished(void* pContext)
+{
+    //回放线程已把所有块放入可用队列，写盘线程写完后关闭文件
+    ThreadFileToDisk::Ins().StopPing();
+}
+
+int kcDAQ::OnPipelineStats(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        PIPELINE_STATS stats;
+        ThreadFileToDisk::Ins().GetStatsPing(stats);
+
+        std::string propName = pProp->GetName();
+        if (propName == "Ingest(MB/s)")
+            pProp->Set(stats.dIngestMBps);
+        else if (propName == "Writer(MB/s)")
+            pProp->Set(stats.dWriterMBps);
+        else if (propName == "Pool Free")
+            pProp->Set((long)stats.iFree);
+        else if (propName == "Pool Available")
+            pProp->Set((long)stats.iAvail);
+        else if (propName == "Pool InUse HighWater")
+            pProp->Set((long)stats.iInUseHighWater);
+        else if (propName == "Pool Available HighWater")
+            pProp->Set((long)stats.iAvailHighWater);
+        else if (propName == "Pool Exhausted")
+            pProp->Set((long)stats.uPoolExhausted);
+        else if (propName == "Dropped Blocks")
+            pProp->Set((long)stats.uDropped);
+        else if (propName == "Ring Overwritten(MB)")
+            pProp->Set(stats.uRingOverwritten / (1024.0 * 1024.0));
+    }
+    return DEVICE_OK;
+}
+
+int kcDAQ::OnEventRecord(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    std::string propName = pProp->GetName();
+    PreTriggerGate& gate = ThreadFileToDisk::Ins().m_preTriggerPing;
+    if (eAct == MM::BeforeGet)
+    {
+        if (propName == "Event Record")
+            pProp->Set(eventrecord ? "On" : "Off");
+        else if (propName == "Pre Trigger Seconds")
+            pProp->Set(pretrigseconds);
+        else if (propName == "Post Trigger Seconds")
+            pProp->Set(posttrigseconds);
+        else if (propName == "Event Threshold Channel")
+            pProp->Set(eventchannel);
+        else if (propName == "Event Threshold Level")
+            pProp->Set(eventlevel);
+        else if (propName == "Software Trigger")
+            pProp->Set("Idle");
+        else if (propName == "Event Count")
+            pProp->Set((long)gate.GetEventCount());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        if (propName == "Software Trigger")
+        {
+            std::string value;
+            pProp->Get(value);
+            if (value == "Fire")
+                gate.Trigger(PreTriggerGate::SOURCE_SOFTWARE);
+            return DEVICE_OK;
+        }
+
+        //回放线程在使用缓存池和事件记录，不能重建
+        if (replay_.IsRunning())
+        {
+            LogMessage("event record settings can not be changed during replay, stop the replay first");
+            return DEVICE_ERR;
+        }
+
+        if (propName == "Event Record")
+        {
+            std::string value;
+            pProp->Get(value);
+            eventrecord = (value == "On") ? 1 : 0;
+        }
+        else if (propName == "Pre Trigger Seconds")
+            pProp->Get(pretrigseconds);
+        else if (propName == "Post Trigger Seconds")
+            pProp->Get(posttrigseconds);
+        else if (propName == "Event Threshold Channel")
+            pProp->Get(eventchannel);
+        else if (propName == "Event Threshold Level")
+            pProp->Get(eventlevel);
+
+        //采集中修改时在下次StartDASequence生效
+        if (!sequenceRunning_)
+        {
+            ResizePool();
+            ConfigureEventRecord();
+        }
+    }
+    return DEVICE_OK;
+}
+
+int kcDAQ::OnSplitFile(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::AfterSet)
+    {
+        std::string file;
+        pProp->Get(file);
+        if (file.empty())
+            return DEVICE_OK;
+
+        std::string prefix = file;
+        size_t dot = prefix.find_last_of('.');
+        if (dot != std::string::npos && prefix.find_first_of("\\/", dot) == std::string::npos)
+            prefix.erase(dot);
+        //一次读文件同时输出所有通道，替代逐通道调用QTXdmaDataSplitChannels
+        if (ChannelSplitter::Split(file, (int)channelcount, prefix) != 0)
+            return DEVICE_ERR;
+    }
+    return DEVICE_OK;
+}
+
+int kcDAQ::OnRegTrace(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    std::string name = pProp->GetName();
+    if (name == "Register Trace")
+    {
+        if (eAct == MM::BeforeGet)
+        {
+            pProp->Set(RegTrace::Ins().IsEnabled() ? "On" : "Off");
+        }
+        else if (eAct == MM::AfterSet)
+        {
+            std::string value;
+            pProp->Get(value);
+            RegTrace::Ins().Enable(value == "On");
+        }
+    }
+    else if (name == "Register Trace Dump" && eAct == MM::AfterSet)
+    {
+        std::string file;
+        pProp->Get(file);
+        if (file.empty())
+            return DEVICE_OK;
 
-// 
+        size_t dot = file.find_last_of('.');
+        bool text = dot != std::string::npos && file.substr(dot) == ".txt";
+        bool ok = text ? RegTrace::Ins().DumpText(file) : RegTrace::Ins().DumpBinary(file);
+        if (!ok)
+            return DEVICE_ERR;
+    }
+    return DEVICE_OK;
+}
+int kcDAQ::OnRegCache(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set(RegShadow::Ins().IsEnabled() ? "On" : "Off");
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        std::string value;
+        pProp->Get(value);
+        RegShadow::Ins().Enable(value == "On");
+    }
+    return DEVICE_OK;
+}
+int kcDAQ::OnWaitStrategy(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    std::string propName = pProp->GetName();
+    if (eAct == MM::BeforeGet)
+    {
+        WAIT_STATS stats;
+        gatherWait_.GetStats(stats);
+        if (propName == "Wait Strategy")
+            pProp->Set(WaitStrategy::ModeName(waitmode));
+        else if (propName == "Wait Spin Count")
+            pProp->Set(waitspincount);
+        else if (propName == "Wait Yield Count")
+            pProp->Set(waityieldcount);
+        else if (propName == "Wait Max Sleep(ms)")
+            pProp->Set(waitmaxsleep);
+        else if (propName == "Wake Latency p50(us)")
+            pProp->Set(stats.dLatencyP50Us);
+        else if (propName == "Wake Latency p99(us)")
+            pProp->Set(stats.dLatencyP99Us);
+        else if (propName == "Wake Latency Max(us)")
+            pProp->Set(stats.dLatencyMaxUs);
+        else if (propName == "Polls Per Wait")
+            pProp->Set(stats.dPollsPerWait);
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        //采集中修改不影响正在等待的线程，下次StartDASequence生效
+        if (propName == "Wait Strategy")
+        {
+            std::string value;
+            pProp->Get(value);
+            waitmode = WaitStrategy::ParseMode(value.c_str());
+        }
+        else if (propName == "Wait Spin Count")
+            pProp->Get(waitspincount);
+        else if (propName == "Wait Yield Count")
+            pProp->Get(waityieldcount);
+        else if (propName == "Wait Max Sleep(ms)")
+            pProp->Get(waitmaxsleep);
+    }
+    return DEVICE_OK;
+}
+int kcDAQ::OnStageTrace(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    std::string name = pProp->GetName();
+    if (name == "Stage Trace")
+    {
+        if (eAct == MM::BeforeGet)
+        {
+            pProp->Set(StageTrace::IsEnabled() ? "On" : "Off");
+        }
+        else if (eAct == MM::AfterSet)
+        {
+            std::string value;
+            pProp->Get(value);
+            bool enable = value == "On";
+            //重新打开时丢弃上一次的事件
+            if (enable && !StageTrace::IsEnabled())
+                StageTrace::Clear();
+            StageTrace::Enable(enable);
+        }
+    }
+    else if (name == "Stage Trace Export" && eAct == MM::AfterSet)
+    {
+        std::string file;
+        pProp->Get(file);
+        if (file.empty())
+            return DEVICE_OK;
+        if (!StageTrace::ExportJson(file))
+            return DEVICE_ERR;
+    }
+    return DEVICE_OK;
+}
+int kcDAQ::OnLogLevel(MM::PropertyBase* pProp, MM::ActionType eAct)
+{
+    if (eAct == MM::BeforeGet)
+    {
+        pProp->Set((long)pLog->GetLogLevel());
+    }
+    else if (eAct == MM::AfterSet)
+    {
+        long level;
+        pProp->Get(level);
+        pLog->TraceLevel(level);
+        pLogReg->TraceLevel(level);
+    }
+    return DEVICE_OK;
+}
+
+// 其他函数
 int kcDAQ::ChannelTriggerConfig()
 {
     int err = QT_BoardChannelTrigger(triggermode, triggercount, triggerchannel, rasingcodevalue, fallingcodevalue);
@@ -1841,7 +2549,7 @@ int kcDAQ::ChannelTriggerConfig()
 int kcDAQ::dataConfig()
 {
     once_trig_bytes = segmentduration * smaplerate * channelcount * 2;
-    //жϵδֽǷ64ֽڵı
+    //判断单次触发的字节数是否满足64字节的倍数
     if (once_trig_bytes % 512 == 0)
     {
         once_trig_bytes = once_trig_bytes;
@@ -1852,13 +2560,13 @@ int kcDAQ::dataConfig()
     }
     if (once_trig_bytes > 4294967232)
     {
-        printf("δDDRССʱ߽ʹƵʣ\n");
+        printf("单次触发数据量超过DDR大小！请减小触发段时长或者降低触发频率！\n");
         return DEVICE_ERR;
     }
-    //ͨδʱ󴥷Ƶʵֵ
+    //通过单次触发段时长计算的最大触发频率的理论值
     double TriggerFrequency = (1 / segmentduration) * 1000000;
     uint64_t GB = 4000000000;
-    //ٶȲ4GB/S㴦Ƽ󴥷Ƶ
+    //依据流盘速度不大于4GB/S计算处推荐的最大触发频率
     if (triggermode != 0 && triggermode != 1)
     {
         if (triggermode == 6 || triggermode == 7)
@@ -1869,7 +2577,7 @@ int kcDAQ::dataConfig()
         {
             TriggerFrequency = GB / once_trig_bytes;
         }
-        printf("󴥷Ƶ(λ:Hz): %f\n", TriggerFrequency);
+        printf("最大触发频率(单位:Hz): %f\n", TriggerFrequency);
     }
     double triggerduration = 0;
     if (triggermode == 1)
@@ -1887,13 +2595,13 @@ int kcDAQ::dataConfig()
         }
         if (dataspeed > 4000)
         {
-            printf("ٶȴ4GB/S齵ʹʱߴڣ\n");
+            printf("流盘速度大于4GB/S！建议降低触发段时长或者提高触发周期！\n");
             return 0;
         }
 
         triggerduration = (1 / repetitionfrequency) * 1000;
     }
-    printf("ʱ(λ:ms): %lf\n", triggerduration);
+    printf("触发时长(单位:ms): %lf\n", triggerduration);
     if (triggerduration > single_interruption_duration)
     {
         data1.DMATotolbytes = once_trig_bytes;
@@ -1903,7 +2611,7 @@ int kcDAQ::dataConfig()
         double x = single_interruption_duration / triggerduration;
         if (x - int(x) > .5)x += 1;
         int xx = x;
-        printf("֡ͷ = %d\n", xx);
+        printf("帧头个数 = %d\n", xx);
         data1.DMATotolbytes = once_trig_bytes * xx;
     }
 
@@ -1918,45 +2626,141 @@ int kcDAQ::dataConfig()
 
     if (data1.DMATotolbytes > 4294967232)
     {
-        printf("жDDRССʱ߽ʹƵʣ\n");
+        printf("单次中断数据量超过DDR大小！请减小触发段时长或者降低触发频率！\n");
         return 0;
     }
 
-    printf("ж(λ:ֽ): %lld\n", data1.DMATotolbytes);
+    printf("单次中断数据量(单位:字节): %lld\n", data1.DMATotolbytes);
     data1.allbytes = data1.DMATotolbytes;
+    //按触发周期估算数据率，用于缓存池规划
+    datarate = triggerduration > 0 ? once_trig_bytes * 1000.0 / triggerduration : 0;
+    if (triggermode == 6 || triggermode == 7)
+    {
+        datarate = datarate * 2;
+    }
+}
+std::string kcDAQ::BuildConfigSnapshot()
+{
+    char buf[2048] = { 0 };
+    snprintf(buf, sizeof(buf),
+        "triggermode=%d\n"
+        "triggercount=%f\n"
+        "triggerchannel=%f\n"
+        "rasingcodevalue=%f\n"
+        "fallingcodevalue=%f\n"
+        "armhysteresis=%f\n"
+        "pulseperiod=%f\n"
+        "pulsewidth=%f\n"
+        "segmentduration=%f\n"
+        "samplerate=%f\n"
+        "channelcount=%f\n"
+        "repetitionfrequency=%f\n"
+        "pretriglength=%f\n"
+        "frameheader=%d\n"
+        "clockmode=%d\n"
+        "offset1=%f\n"
+        "offset2=%f\n"
+        "offset3=%f\n"
+        "offset4=%f\n"
+        "once_trig_bytes=%llu\n"
+        "dma_total_bytes=%llu\n",
+        triggermode, triggercount, triggerchannel, rasingcodevalue, fallingcodevalue, armhysteresis,
+        pulseperiod, pulsewidth, segmentduration, smaplerate, channelcount, repetitionfrequency,
+        pretriglength, frameheader, clockmode, offset1, offset2, offset3, offset4,
+        (unsigned long long)once_trig_bytes, (unsigned long long)data1.DMATotolbytes);
+    return buf;
+}
+
+void kcDAQ::PlanPool(int& iBlockSize, int& iBlockCount)
+{
+    //块大小取单次中断数据量，按单次读取长度对齐，保证中断线程按once_readbytes读满一块时不越界
+    const int iReadMB = (int)(once_readbytes / (1 MB));
+    iBlockSize = 80;
+    if (data1.DMATotolbytes > 0)
+    {
+        uint64_t uInterruptMB = (data1.DMATotolbytes + (1 MB) - 1) / (1 MB);
+        iBlockSize = (int)((uInterruptMB + iReadMB - 1) / iReadMB * iReadMB);
+        iBlockSize = std::max(iReadMB, std::min(iBlockSize, 256));
+    }
+
+    //块数还受可用缓存环的槽数限制，小块大预算时按环的容量截断
+    int iMaxCount = std::max(1, (int)(poolbudget / iBlockSize));
+    if (iMaxCount > ThreadFileToDisk::MAX_POOL_BLOCKS)
+    {
+        LogMessage("pool budget exceeds the avail ring capacity, pool clamped to the ring");
+        iMaxCount = ThreadFileToDisk::MAX_POOL_BLOCKS;
+    }
+    if (datarate <= 0)
+    {
+        //采集参数未设置时用满预算
+        iBlockCount = iMaxCount;
+        return;
+    }
+
+    //至少容纳ping/pong两次中断，其余按数据率缓冲bufferseconds秒
+    uint64_t uBlockBytes = (uint64_t)iBlockSize * (1 MB);
+    int iPerInterrupt = (int)((data1.DMATotolbytes + uBlockBytes - 1) / uBlockBytes);
+    //事件触发记录时预触发数据也留在缓存池中
+    double dSeconds = bufferseconds + (eventrecord ? pretrigseconds : 0);
+    double dNeed = datarate * dSeconds / uBlockBytes;
+    iBlockCount = std::max(2 * iPerInterrupt, (int)(dNeed + 0.999));
+    if (iBlockCount > iMaxCount)
+    {
+        LogMessage("pool budget is smaller than the buffering target, pool clamped to budget");
+        iBlockCount = iMaxCount;
+    }
 }
-int kcDAQ::initializeTheadtoDisk()
+
+int kcDAQ::ResizePool()
 {
-    //гʼ
-    //гʼ
-    int fifo_size = 16;
+    int iBlockSize = 0, iBlockCount = 0;
+    PlanPool(iBlockSize, iBlockCount);
+    if (!ThreadFileToDisk::Ins().ResizePool(iBlockSize, iBlockCount))
+    {
+        LogMessage("buffer pool resize failed, keep current pool");
+        return DEVICE_ERR;
+    }
+    return DEVICE_OK;
+}
 
-    char filepath[128] = { "D:\program\Micro-Manager-2.0\data" };
+int kcDAQ::ConfigureEventRecord()
+{
+    uint64_t uPreBytes = (uint64_t)(datarate * pretrigseconds);
+    uint64_t uPostBytes = (uint64_t)(datarate * posttrigseconds);
+    if (eventrecord && datarate <= 0)
+        LogMessage("event record enabled before the trigger parameters are set, only the event buffer is recorded");
 
-    ThreadFileToDisk::Ins().m_vectorBuffer.resize(10240);
+    //预触发最多占缓存池的3/4，其余留给中断线程和写盘周转
+    int iMaxHeld = std::max(1, ThreadFileToDisk::Ins().GetPoolBlockCount() * 3 / 4);
+    PreTriggerGate& gate = ThreadFileToDisk::Ins().m_preTriggerPing;
+    gate.SetThreshold(eventchannel > 0, (int)eventchannel - 1, (int)channelcount, (int16_t)eventlevel);
+    gate.Configure(eventrecord != 0, uPreBytes, uPostBytes, iMaxHeld);
+    return DEVICE_OK;
+}
 
-    //ʼ8Gpingڴ
-    for (int i = 0; i < 10240; i++)
-    {
-        ThreadFileToDisk::Ins().m_vectorBuffer[i] = new databuffer();
+int kcDAQ::initializeTheadtoDisk()
+{
+    //队列初始化操作
+    char filepath[128] = { "D:\\program\\Micro-Manager-2.0\\data" };
 
-        ThreadFileToDisk::Ins().m_vectorBuffer[i]->m_bufferAddr = NULL;
-        ThreadFileToDisk::Ins().m_vectorBuffer[i]->m_bAvailable = false;
-        ThreadFileToDisk::Ins().m_vectorBuffer[i]->m_bAllocateMem = false;
-        ThreadFileToDisk::Ins().m_vectorBuffer[i]->m_iBufferIndex = i;
-        ThreadFileToDisk::Ins().m_vectorBuffer[i]->m_iBufferSize = 0;
-    }
+    ThreadFileToDisk::Ins().set_poolMemory(true, -1);	//缓存池用大页，绑定到采集卡所在的NUMA节点
+    //缓存池按内存预算分配，采集参数确定后在StartDASequence中重新规划
+    ResizePool();
 
-    //1ɼ 2д 3д
+    //1触发采集 2单次写盘 3连续写盘
     int iGatherDataType = 3;
     ThreadFileToDisk::Ins().set_toDiskType(iGatherDataType);
 
-    int iToFileType = 2;		//дļǵļ   2óɵļģʽ
-    ThreadFileToDisk::Ins().initDataFileBufferPing(80, 200, fifo_size);	//ʼbuffer飬ĳ58M
-    ThreadFileToDisk::Ins().set_filePath_Ping(filepath);				//ļ·
+    int iToFileType = 2;		//区分写多个文件还是单个文件   2是设置成单个文件的模式
+    ThreadFileToDisk::Ins().set_filePath_Ping(filepath);				//设置文件路径
     ThreadFileToDisk::Ins().set_fileBlockType(iToFileType);
     ThreadFileToDisk::Ins().filecount = 10;
-    ThreadFileToDisk::Ins().StartPing();
+    ThreadFileToDisk::Ins().set_diskWriter(true, 8, (uint64_t)16 * 1024 * 1024 * 1024);	//8个未完成写请求，预分配16G
+    ThreadFileToDisk::Ins().set_writerPool(4);	//多文件模式下4个写盘线程
+    ThreadFileToDisk::Ins().set_segmentPolicy((uint64_t)4 * 1024 * 1024 * 1024, 0);	//每4G轮换一个文件
+    ThreadFileToDisk::Ins().set_compression(compress != 0, (int)compressthreads, (int)channelcount);	//写盘前压缩，由Compression属性打开
+    //原始数据环默认不创建，需要在线读取时通过Raw Ring(MB)属性打开
+    //写盘线程随每次采集启动和停止，停止时写完剩余数据并关闭文件
     return DEVICE_OK;
 }
 
@@ -1965,7 +2769,7 @@ void* kcDAQ::PollIntr(void* lParam)
     ThreadParams* params = static_cast<ThreadParams*>(lParam);
     kcDAQ* instance = params->instance;
 
-    pthread_detach(pthread_self());
+    StageTrace::SetThreadName("PollIntr");
     int intr_cnt = 1;
     int intr_ping = 0;
     int intr_pong = 0;
@@ -1976,19 +2780,25 @@ void* kcDAQ::PollIntr(void* lParam)
 
     while (true)
     {
-        QT_BoardInterruptGatherType();
+        {
+            STAGE_TRACE_SCOPE("InterruptWait", intr_cnt);
+            //停止采集时等待被取消，线程退出
+            if (QT_BoardInterruptGatherType(&instance->gatherWait_) != 0)
+                break;
+        }
 
         finish = clock();
         time1 = (double)(finish - start) / CLOCKS_PER_SEC;
-        printf("intr time is %f\n", time1);
+        LOG_PRINTF(5, "[kcDAQ::PollIntr], intr time is %f", time1);
         start = finish;
 
-        // ʹûʵķ
+        // 使用互斥锁保护对实例变量的访问
         pthread_mutex_lock(&instance->mutex_);
 
         if (intr_cnt % 2 == 0)
         {
             int iBufferIndex = -1;
+            int iStallSpins = 0;    //缓存池耗尽后空转的次数，只在耗尽和恢复时各记一次日志
             int64_t remain_size = instance->data1.DMATotolbytes;
             uint64_t offsetaddr_pong = 0x100000000;
 
@@ -1999,18 +2809,27 @@ void* kcDAQ::PollIntr(void* lParam)
 
                 ThreadFileToDisk::Ins().CheckFreeBuffer(iBufferIndex);
 
-                if (iBufferIndex == -1)		//жbufferǷ
+                if (iBufferIndex == -1)		//判断buffer是否可用
                 {
-                    printf("buffer is null! %d\n", ThreadFileToDisk::Ins().GetFreeSizePing());
-                    LogMessage("pong buffer is null!");
+                    //停止采集时不再等待空闲缓存
+                    if (instance->gatherWait_.IsCancelled())
+                        break;
+                    if (iStallSpins++ == 0)
+                        LOG_PRINTF(2, "[kcDAQ::PollIntr], pong buffer pool exhausted, free %d", ThreadFileToDisk::Ins().GetFreeSizePing());
                     continue;
                 }
+                if (iStallSpins > 0)
+                {
+                    LOG_PRINTF(4, "[kcDAQ::PollIntr], pong buffer available after %d spins", iStallSpins);
+                    iStallSpins = 0;
+                }
 
                 ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_iBufferSize = 0;
 
                 int iLoopCount = 0;
                 int iWriteBytes = 0;
 
+                StageTraceScope dmaRead("DmaRead", iBufferIndex);
                 do
                 {
                     if (remain_size >= once_readbytes)
@@ -2043,6 +2862,11 @@ void* kcDAQ::PollIntr(void* lParam)
                     }
 
                 } while (iWriteBytes < ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_iTotalSize);
+                dmaRead.End();
+
+                //数据就绪，交给写盘线程；写盘完成后由消费者归还到空闲链表
+                ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_bAvailable.store(true, std::memory_order_release);
+                ThreadFileToDisk::Ins().PushAvailToListPing(iBufferIndex);
 #endif
                 //sem_post(&c2h_pong);
                 intr_pong++;
@@ -2052,6 +2876,7 @@ void* kcDAQ::PollIntr(void* lParam)
         else
         {
             int iBufferIndex = -1;
+            int iStallSpins = 0;    //缓存池耗尽后空转的次数，只在耗尽和恢复时各记一次日志
             int64_t remain_size = instance->data1.DMATotolbytes;
             uint64_t offsetaddr_ping = 0x0;
 
@@ -2062,17 +2887,26 @@ void* kcDAQ::PollIntr(void* lParam)
                 //ThreadFileToDisk::Ins().PopFreeFromListPing(iBufferIndex);
                 ThreadFileToDisk::Ins().CheckFreeBuffer(iBufferIndex);
 
-                if (iBufferIndex == -1)		//жbufferǷ
+                if (iBufferIndex == -1)		//判断buffer是否可用
                 {
-                    printf("buffer is null %d!\n", ThreadFileToDisk::Ins().GetFreeSizePing());
+                    if (instance->gatherWait_.IsCancelled())
+                        break;
+                    if (iStallSpins++ == 0)
+                        LOG_PRINTF(2, "[kcDAQ::PollIntr], ping buffer pool exhausted, free %d", ThreadFileToDisk::Ins().GetFreeSizePing());
                     continue;
                 }
+                if (iStallSpins > 0)
+                {
+                    LOG_PRINTF(4, "[kcDAQ::PollIntr], ping buffer available after %d spins", iStallSpins);
+                    iStallSpins = 0;
+                }
 
                 ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_iBufferSize = 0;
 #endif
                 int iLoopCount = 0;
                 int iWriteBytes = 0;
 
+                StageTraceScope dmaRead("DmaRead", iBufferIndex);
                 do
                 {
                     if (remain_size >= once_readbytes)
@@ -2103,13 +2937,15 @@ void* kcDAQ::PollIntr(void* lParam)
                     }
                     iLoopCount++;
                 } while (iWriteBytes < ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_iTotalSize);
-                // ݶȡʹ
+                dmaRead.End();
+                // 数据读取和处理
                 if (ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_iBufferSize % sizeof(int16_t) == 0) {
                     size_t numElements = ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_iBufferSize / sizeof(int16_t);
                     if (numElements % 4 != 0) {
                         std::cerr << "Number of elements is not a multiple of 4." << std::endl;
                     }
                     else {
+                        STAGE_TRACE_SCOPE("Deinterleave", iBufferIndex);
                         size_t numSamples = numElements / 4;
                         std::vector<std::vector<int16_t>> channels(4);
 
@@ -2124,6 +2960,11 @@ void* kcDAQ::PollIntr(void* lParam)
 
                     }
                 }
+#ifdef WRITEFILE
+                //数据就绪，交给写盘线程；写盘完成后由消费者归还到空闲链表
+                ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_bAvailable.store(true, std::memory_order_release);
+                ThreadFileToDisk::Ins().PushAvailToListPing(iBufferIndex);
+#endif
                 //sem_post(&c2h_ping);
                 intr_ping++;
                 //printf("ping is %d free list size %d\n", intr_ping, ThreadFileToDisk::Ins().GetFreeSizePing());
@@ -2134,10 +2975,20 @@ void* kcDAQ::PollIntr(void* lParam)
     }
 
 
-EXIT:
-    pthread_exit(NULL);
+    //直接返回，由PollIntrEntry释放参数
     return 0;
 }
+
+void kcDAQ::StopPollIntr()
+{
+    if (!pollThreadRunning_)
+        return;
+
+    gatherWait_.Cancel();
+    pthread_join(pollThread_, NULL);
+    pollThreadRunning_ = false;
+}
+
 void* kcDAQ::datacollect(void* lParam)
 {
     pthread_detach(pthread_self());
@@ -2147,7 +2998,7 @@ void* kcDAQ::datacollect(void* lParam)
 
     while (1)
     {
-        //pingݰ
+        //ping数据搬移
         {
             sem_wait(&c2h_ping);
             int iBufferIndex = -1;
@@ -2190,7 +3041,7 @@ void* kcDAQ::datacollect(void* lParam)
                     }
                     iLoopCount++;
                 } while (iWriteBytes < ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_iTotalSize);
-                // ݶȡʹ
+                // 数据读取和处理
                 if (ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_iBufferSize % sizeof(int16_t) == 0) {
                     size_t numElements = ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_iBufferSize / sizeof(int16_t);
                     if (numElements % 4 != 0) {
@@ -2214,7 +3065,7 @@ void* kcDAQ::datacollect(void* lParam)
 //
 //#ifdef WRITEFILE
 //
-//                //ִдļĲ
+//                //执行写文件的操作
 //                ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_bAvailable = true;
 //
 //                ThreadFileToDisk::Ins().PushAvailToListPing(iBufferIndex);
@@ -2224,10 +3075,11 @@ void* kcDAQ::datacollect(void* lParam)
         }
         ping_getdata++;
 
-        //pongݰƿʼ
+        //pong数据搬移开始
         {
             sem_wait(&c2h_pong);
             int iBufferIndex = -1;
+            int iStallSpins = 0;    //缓存池耗尽后空转的次数，只在耗尽和恢复时各记一次日志
             int64_t remain_size = data1.DMATotolbytes;
             uint64_t offsetaddr_pong = 0x100000000;
 
@@ -2238,12 +3090,17 @@ void* kcDAQ::datacollect(void* lParam)
 
                 ThreadFileToDisk::Ins().CheckFreeBuffer(iBufferIndex);
 
-                if (iBufferIndex == -1)		//жbufferǷ
+                if (iBufferIndex == -1)		//判断buffer是否可用
                 {
-                    printf("buffer is null! %d\n", ThreadFileToDisk::Ins().GetFreeSizePing());
-                    LogMessage("pong buffer is null!");
+                    if (iStallSpins++ == 0)
+                        LOG_PRINTF(2, "[kcDAQ::datacollect], pong buffer pool exhausted, free %d", ThreadFileToDisk::Ins().GetFreeSizePing());
                     continue;
                 }
+                if (iStallSpins > 0)
+                {
+                    LOG_PRINTF(4, "[kcDAQ::datacollect], pong buffer available after %d spins", iStallSpins);
+                    iStallSpins = 0;
+                }
 
                 ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_iBufferSize = 0;
 
@@ -2285,7 +3142,7 @@ void* kcDAQ::datacollect(void* lParam)
 #endif
 
 #ifdef WRITEFILE
-                //ִдļĲ
+                //执行写文件的操作
                 ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_bAvailable = true;
 
                 ThreadFileToDisk::Ins().PushAvailToListPing(iBufferIndex);
@@ -2293,7 +3150,7 @@ void* kcDAQ::datacollect(void* lParam)
             }
         }
         pong_getdata++;
-        printf("ping_getdata=%d  pong_getdata=%d\n", ping_getdata, pong_getdata);
+        LOG_PRINTF(5, "[kcDAQ::datacollect], ping_getdata=%d  pong_getdata=%d", ping_getdata, pong_getdata);
     }
     puts("thread exit while!");
 EXIT:
@@ -2311,15 +3168,14 @@ void printfLog(int nLevel, const char* fmt, ...)
     if (nLevel == 0)
         return;
 
-    if (pLog == NULL)
+    //级别未通过时不格式化
+    if (pLog == NULL || !pLog->Passed(nLevel))
         return;
 
-    char buf[1024];
     va_list list;
     va_start(list, fmt);
-    vsprintf(buf, fmt, list);
+    pLog->TraceV(nLevel, fmt, list);
     va_end(list);
-    pLog->Trace(nLevel, buf);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////
@@ -2423,16 +3279,16 @@ std::string optotune::sendStart()
     PurgeComPort(port.c_str());
     if (result == DEVICE_OK) {
         if (answer == "OK") {
-            // յ"ready"Ϣ
+            // 处理接收到的"ready"信息
             std::cout << "Device is ready." << std::endl;
         }
         else {
-            // յϢ"ready"
+            // 接收到的信息不是"ready"
             std::cout << "Received unexpected response: " << answer << std::endl;
         }
     }
     else {
-        // 
+        // 错误处理
         std::cerr << "Failed to receive answer: " << result << std::endl;
     }
 
@@ -2525,10 +3381,10 @@ int TPMCamera::Shutdown()
     return DEVICE_OK;
 }
 
-// عͣ
+// 控制曝光的启停
 int TPMCamera::SnapImage()
 {
-    // ѹ  
+    // 换算电压 或者 
     return DEVICE_OK;
 }
 
@@ -2542,7 +3398,7 @@ int TPMCamera::
 
 int TPM::Initialize()
 {
-    // AOSequenceĲ
+    // 输出AOSequence的测试属性
     initialized_ = true;
     CPropertyAction* pAct = new CPropertyAction(this, &TPM::OnTriggerAOSequence);
     CreateProperty("TriggerAOSequence", "Off", MM::String, false, pAct);
@@ -2559,14 +3415,14 @@ int TPM::Initialize()
     CreateProperty("PortName", "Dev1/ao0", MM::String, false, pAct);
     AddAllowedValue("PortName", "Dev1/ao0");
     AddAllowedValue("PortName", "Dev1/ao1");
-    AddAllowedValue("PortName", "Dev1/ao2");  // ʵʶ˿ڽ
+    AddAllowedValue("PortName", "Dev1/ao2");  // 根据实际端口进行添加
 
     // DO port
     pAct = new CPropertyAction(this, &TPM::OnDOPortName);
     CreateProperty("DOPortName", "Dev1/port0/line0", MM::String, false, pAct);
     AddAllowedValue("DOPortName", "Dev1/port0/line0");
     AddAllowedValue("DOPortName", "Dev1/port0/line1");
-    AddAllowedValue("DOPortName", "Dev1/port0/line2");  // ʵʶ˿ڽ
+    AddAllowedValue("DOPortName", "Dev1/port0/line2");  // 根据实际端口进行添加
 
     // resonant / galvo
     pAct = new CPropertyAction(this, &TPM::OnScanMode);
@@ -2583,7 +3439,7 @@ int TPM::Initialize()
     CreateProperty("StartAcquision", "Off", MM::String, false, pAct);
     AddAllowedValue("StartAcquision", "Off");
     AddAllowedValue("StartAcquision", "On");
-    // ... ʼ ...
+    // ... 其它初始化代码 ...
 
     return DEVICE_OK;
 }
@@ -2619,7 +3475,7 @@ NIDAQHub* TPM::GetNIDAQHubSafe() {
     NIDAQHub* hub = static_cast<NIDAQHub*>(GetDevice(g_DeviceNameNIDAQHub));
     if (!hub) {
         std::cerr << "Error: NIDAQHub not found or not properly initialized." << std::endl;
-        return nullptr; // ʽ
+        return nullptr; // 或处理错误的其他方式
     }
     return hub;
 }
@@ -2628,7 +3484,7 @@ kcDAQ* TPM::GetkcDAQSafe() {
     kcDAQ* daq = static_cast<kcDAQ*>(GetDevice(g_DeviceNameDAQ));
     if (!daq) {
         std::cerr << "Error: NIDAQHub not found or not properly initialized." << std::endl;
-        return nullptr; // ʽ
+        return nullptr; // 或处理错误的其他方式
     }
     return daq;
 }
@@ -2638,14 +3494,14 @@ int TPM::OnPortName(MM::PropertyBase* pProp, MM::ActionType eAct)
     if (eAct == MM::BeforeGet)
     {
         std::string portName;
-        GetPortName(portName);  // ȡǰõĶ˿
+        GetPortName(portName);  // 获取当前设置的端口名
         pProp->Set(portName.c_str());
     }
     else if (eAct == MM::AfterSet)
     {
         std::string portName;
         pProp->Get(portName);
-        SetPortName(portName);  // õĶ˿
+        SetPortName(portName);  // 保存新设置的端口名
     }
     return DEVICE_OK;
 }
@@ -2654,20 +3510,20 @@ int TPM::OnTriggerAOSequence(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
     if (eAct == MM::BeforeGet)
     {
-        // ṩһЩ״̬Ϣ
+        // 可以提供一些状态信息
     }
     else if (eAct == MM::AfterSet)
     {
         std::string value;
-        pProp->Get(value); // ȡǰԵֵ
+        pProp->Get(value); // 获取当前属性的值
 
         if (value == "On")
         {
-            return TriggerAOSequence(); // "On"ִTriggerAOSequence
+            return TriggerAOSequence(); // 如果是"On"，则执行TriggerAOSequence
         }
         else if (value == "Off")
         {
-            return StopAOSequence(); // "Off"ִStopAOSequenceϣĺ
+            return StopAOSequence(); // 如果是"Off"，则执行StopAOSequence或其他你希望的函数
         }
     }
     return DEVICE_OK;
@@ -2677,20 +3533,20 @@ int TPM::OnTriggerDOSequence(MM::PropertyBase* pProp, MM::ActionType eAct)
 {
     if (eAct == MM::BeforeGet)
     {
-        // ṩһЩ״̬Ϣ
+        // 可以提供一些状态信息
     }
     else if (eAct == MM::AfterSet)
     {
         std::string value;
-        pProp->Get(value); // ȡǰԵֵ
+        pProp->Get(value); // 获取当前属性的值
 
         if (value == "On")
         {
-            return TriggerDOSequence(); // "On"ִTriggerAOSequence
+            return TriggerDOSequence(); // 如果是"On"，则执行TriggerAOSequence
         }
         else if (value == "Off")
         {
-            return StopDOSequence(); // "Off"ִStopAOSequenceϣĺ
+            return StopDOSequence(); // 如果是"Off"，则执行StopAOSequence或其他你希望的函数
         }
     }
     return DEVICE_OK;
@@ -2698,7 +3554,7 @@ int TPM::OnTriggerDOSequence(MM::PropertyBase* pProp, MM::ActionType eAct)
 
 int TPM::TriggerAOSequence() {
     std::string portName;
-    GetPortName(portName);  // ȡǰõĶ˿
+    GetPortName(portName);  // 获取当前设置的端口名
     NIDAQHub* nidaqHub = GetNIDAQHubSafe();
     if (nidaqHub) {
         std::vector<double> sequence = { -1.0, -0.96, -0.92, -0.88, -0.84, -0.8, -0.76, -0.72, -0.68, -0.64, -0.6, -0.56, -0.52, -0.48, -0.44, -0.4,
@@ -2709,7 +3565,7 @@ int TPM::TriggerAOSequence() {
     -0.44, -0.48, -0.52, -0.56, -0.6, -0.64, -0.68, -0.72, -0.76, -0.8, -0.84, -0.88, -0.92, -0.96 };
         int result = nidaqHub->StartAOSequenceForPort(portName, sequence);
         if (result != DEVICE_OK) {
-            // 
+            // 处理错误
             std::cerr << "Error starting AO sequence on port " << portName << std::endl;
             return result;
         };
@@ -2719,7 +3575,7 @@ int TPM::TriggerAOSequence() {
 
 int TPM::StopAOSequence() {
     std::string portName;
-    GetPortName(portName);  // ȡǰõĶ˿
+    GetPortName(portName);  // 获取当前设置的端口名
     NIDAQHub* nidaqHub = GetNIDAQHubSafe();
     if (nidaqHub) {
         int result = nidaqHub->StopAOSequenceForPort(portName);
@@ -2737,14 +3593,14 @@ int TPM::OnDOPortName(MM::PropertyBase* pProp, MM::ActionType eAct)
     if (eAct == MM::BeforeGet)
     {
         std::string portName;
-        GetDOPortName(portName);  // ȡǰõĶ˿
+        GetDOPortName(portName);  // 获取当前设置的端口名
         pProp->Set(portName.c_str());
     }
     else if (eAct == MM::AfterSet)
     {
         std::string portName;
         pProp->Get(portName);
-        SetDOPortName(portName);  // õĶ˿
+        SetDOPortName(portName);  // 保存新设置的端口名
     }
     return DEVICE_OK;
 }
@@ -2778,13 +3634,13 @@ int TPM::OnDAQAcquisition(MM::PropertyBase* pProp, MM::ActionType eAct)
 
 int TPM::TriggerDOSequence() {
     std::string portName;
-    GetDOPortName(portName);  // ȡǰõĶ˿
+    GetDOPortName(portName);  // 获取当前设置的端口名
     NIDAQHub* nidaqHub = GetNIDAQHubSafe();
     if (nidaqHub) {
         int result = nidaqHub->StartDOBlankingAndOrSequenceWithoutTrigger(portName, true, false,
             1, false, 512 * 512);
         if (result != DEVICE_OK) {
-            // 
+            // 处理错误
             std::cerr << "Error starting AO sequence on port " << portName << std::endl;
             return result;
         };
@@ -2794,7 +3650,7 @@ int TPM::TriggerDOSequence() {
 
 int TPM::StopDOSequence() {
     std::string portName;
-    GetDOPortName(portName);  // ȡǰõĶ˿
+    GetDOPortName(portName);  // 获取当前设置的端口名
     NIDAQHub* nidaqHub = GetNIDAQHubSafe();
     if (nidaqHub) {
         int result = nidaqHub->StopDOBlankingAndSequence(32);
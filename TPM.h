@@ -28,6 +28,9 @@
 #include "pthread.h"
 #include "semaphore.h"
 #include "ThreadFileToDisk.h"
+#include "ReplaySource.h"
+#include "ChannelSplitter.h"
+#include "RegTrace.h"
 #include "TraceLog.h"
 #include "databuffer.h"
 #include "Mutex.h"
@@ -74,6 +77,7 @@ extern const int ERR_VOLTAGE_OUT_OF_RANGE;
 extern const int ERR_NONUNIFORM_CHANNEL_VOLTAGE_RANGES;
 extern const int ERR_VOLTAGE_RANGE_EXCEEDS_DEVICE_LIMITS;
 extern const int ERR_UNKNOWN_PINS_PER_PORT;
+extern const int ERR_CHANGE_DETECTION_IN_USE;
 
 
 
@@ -155,6 +159,8 @@ public:
 	int StopDOBlankingAndSequence();
 	int AddDOPortToSequencing(const std::string& port, const std::vector<Tuint> sequence);
 	void RemoveDOPortFromSequencing(const std::string& port);
+	// The DI task uses the device's change detection while blanking/sequencing runs
+	bool IsChangeDetectionRunning() const { return diTask_ != 0; }
 
 private:
 
@@ -222,6 +228,14 @@ public:
 	int StopTask(TaskHandle& task);
 
 private:
+	//事件触发记录的外部输入：DI线上升沿通知写盘线程
+	int StartEventInputTask();
+	static int32 CVICALLBACK OnEventInputEdge(TaskHandle taskHandle, int32 signalID, void* callbackData);
+	static int32 CVICALLBACK OnEventInputDone(TaskHandle taskHandle, int32 status, void* callbackData);
+	//换向检测每个设备只有一个，DO消隐/序列和事件输入不能同时使用
+	bool IsDOChangeDetectionRunning() const;
+	int ReportChangeDetectionConflict(const std::string& user);
+
 	int AddAOPortToSequencing(const std::string& port, const std::vector<double> sequence);
 	void RemoveAOPortFromSequencing(const std::string& port);
 
@@ -244,6 +258,7 @@ private:
 	int OnSequencingEnabled(MM::PropertyBase* pProp, MM::ActionType eAct);
 	int OnTriggerInputPort(MM::PropertyBase* pProp, MM::ActionType eAct);
 	int OnSampleRate(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnEventInput(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 
 	bool initialized_;
@@ -255,6 +270,7 @@ private:
 	std::string niTriggerPort_;
 	std::string niChangeDetection_;
 	std::string niSampleClock_;
+	std::string niEventInput_;	// DI line used as event trigger, "None" when unused
 
 	double minVolts_; // Min possible for device
 	double maxVolts_; // Max possible for device
@@ -262,6 +278,7 @@ private:
 
 	TaskHandle aoTask_;
 	TaskHandle doTask_;
+	TaskHandle eventTask_;
 
 	NIDAQDOHub<uInt8>* doHub8_;
 	NIDAQDOHub<uInt16>* doHub16_;
@@ -477,15 +494,39 @@ private:
 	double smaplerate;
 	double channelcount;
 	double repetitionfrequency;
+	double datarate;		//按触发参数估算的数据率(字节/秒)
+	double poolbudget;		//缓存池内存预算(MB)
+	double bufferseconds;	//缓存池按数据率可缓冲的秒数
+	long rawringmb;			//原始数据环容量(MB)，0为不创建
+	int compress;			//写盘前无损压缩，压缩后的文件需按容器索引解压读取
+	long compressthreads;	//压缩线程数
+
+	int eventrecord;		//事件触发记录：只在事件前后的窗口内写盘
+	double pretrigseconds;	//事件前保留的秒数
+	double posttrigseconds;	//事件后继续记录的秒数
+	long eventchannel;		//阈值触发通道(1~4)，0为不用阈值触发
+	long eventlevel;		//阈值触发的码值
+
+	ReplaySource replay_;		//离线回放，不需要采集卡
+	std::string replayfile;
+	double replayrate;		//回放数据率(MB/s)，0为全速
+
+	WaitStrategy gatherWait_;	//中断等待线程查询未就绪时的等待策略
+	long waitmode;			//WaitStrategy::Mode，下次开始采集时生效
+	long waitspincount;		//自适应模式的自旋次数
+	long waityieldcount;	//自适应模式的让出次数
+	long waitmaxsleep;		//休眠退避上限(ms)
+	pthread_t pollThread_;	//中断等待线程，停止采集时取消等待并等它退出
+	bool pollThreadRunning_;
 
 	std::vector<double> unsentSequence_;
 	std::vector<double> sentSequence_;
 
-	sem_t c2h_ping;		//pingź
-	sem_t c2h_pong;		//pongź
+	sem_t c2h_ping;		//ping信号量
+	sem_t c2h_pong;		//pong信号量
 	long once_readbytes = 8 MB;
 
-	// ̲߳
+	// 新增互斥锁和线程参数
 	pthread_mutex_t mutex_;
 	struct ThreadParams {
 		kcDAQ* instance;
@@ -506,15 +547,31 @@ private:
 	int OnFallingCodevalue(MM::PropertyBase* pProp, MM::ActionType eAct);
 	int OnSegmentDuration(MM::PropertyBase* pProp, MM::ActionType eAct);
 	int OnRepetitionFrequency(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnPoolBudget(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnBufferSeconds(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnRawRing(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnCompression(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnReplayFile(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnReplayRate(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnReplay(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnPipelineStats(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnEventRecord(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnSplitFile(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnRegTrace(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnRegCache(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnStageTrace(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnLogLevel(MM::PropertyBase* pProp, MM::ActionType eAct);
+	int OnWaitStrategy(MM::PropertyBase* pProp, MM::ActionType eAct);
 
 	//int initializeBoard();
 	int ChannelTriggerConfig();
 	int dataConfig();
+	std::string BuildConfigSnapshot();//当前采集配置，每行 key=value
 	static void* PollIntrEntry(void* arg) {
 		kcDAQ::ThreadParams* params = static_cast<kcDAQ::ThreadParams*>(arg);
 		kcDAQ* self = params->instance;
 		self->PollIntr(params);
-		delete params;  // ȷʹͷ
+		delete params;  // 确保参数在使用完后释放
 		return nullptr;
 	}
 	static void* DatacollectEntry(void* arg) {
@@ -523,8 +580,17 @@ private:
 		return nullptr;
 	}
 	void* PollIntr(void* lParam);
+	//非循环回放结束时在回放线程中调用，写完并关闭回放写出的文件
+	static void OnReplayFinished(void* pContext);
+	//取消中断等待并等待线程退出，之后不再有缓存交给写盘线程，可以重设等待策略
+	void StopPollIntr();
 	void* datacollect(void* lParam);
 	int initializeTheadtoDisk();
+	//按内存预算和采集参数计算缓存池的块大小(MB)和块数，并在两次采集之间重建缓存池
+	void PlanPool(int& iBlockSize, int& iBlockCount);
+	int ResizePool();
+	//按采集数据率把事件前后的秒数换算成字节数，设置到写盘线程的事件触发记录
+	int ConfigureEventRecord();
 	void printfLog(int nLevel, const char* fmt, ...);
 private:
 
@@ -799,9 +865,9 @@ public:
 
 	int OnDAQAcquisition(MM::PropertyBase* pProp, MM::ActionType eAct);
 private:
-	std::string portName_;  // ڴ洢˿
-	std::string DOportName_;  // ڴ洢˿
-	std::string ScanMode;  // ڴ洢˿
+	std::string portName_;  // 用于存储端口名
+	std::string DOportName_;  // 用于存储端口名
+	std::string ScanMode;  // 用于存储端口名
 	double Frequency;
 
 	int TriggerAOSequence();
@@ -0,0 +1,458 @@
+﻿#include "HandoffBench.h"
+#include "free_index_list.h"
+#include "lock_free_queue.h"
+#include "spsc_index_ring.h"
+#include "Mutex.h"
+
+#include <windows.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <algorithm>
+#include <stdio.h>
+
+extern void printfLog(int nLevel, const char * fmt, ...);
+
+namespace {
+
+typedef std::chrono::steady_clock BenchClock;
+
+//启动iThreadCount个线程同时执行fn(线程号)，返回总耗时(纳秒)
+template<typename Fn>
+double RunThreads(int iThreadCount, Fn fn)
+{
+	std::atomic<bool> bGo(false);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < iThreadCount; t++)
+	{
+		threads.emplace_back([&, t]() {
+			while (!bGo.load(std::memory_order_acquire))
+				std::this_thread::yield();
+			fn(t);
+		});
+	}
+
+	BenchClock::time_point start = BenchClock::now();
+	bGo.store(true, std::memory_order_release);
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+	return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(BenchClock::now() - start).count();
+}
+
+//原CheckFreeBuffer的做法：从头扫描第一个空闲标志
+double BenchLinearScan(int iPoolSize, int iOccupied, int iThreadCount, int iIterations, uint64_t& uMiss)
+{
+	std::unique_ptr<std::atomic<bool>[]> busy(new std::atomic<bool>[iPoolSize]);
+	for (int i = 0; i < iPoolSize; i++)
+		busy[i].store(i < iOccupied, std::memory_order_relaxed);
+
+	std::atomic<uint64_t> miss(0);
+	double ns = RunThreads(iThreadCount, [&](int) {
+		uint64_t uLocalMiss = 0;
+		for (int n = 0; n < iIterations; n++)
+		{
+			int iIndex = -1;
+			for (int i = 0; i < iPoolSize; i++)
+			{
+				bool bExpected = false;
+				if (!busy[i].load(std::memory_order_relaxed) &&
+					busy[i].compare_exchange_strong(bExpected, true, std::memory_order_acquire))
+				{
+					iIndex = i;
+					break;
+				}
+			}
+			if (iIndex == -1)
+			{
+				uLocalMiss++;
+				continue;
+			}
+			busy[iIndex].store(false, std::memory_order_release);
+		}
+		miss.fetch_add(uLocalMiss);
+	});
+	uMiss = miss.load();
+	return ns;
+}
+
+double BenchFreeList(int iPoolSize, int iOccupied, int iThreadCount, int iIterations, uint64_t& uMiss)
+{
+	FreeIndexList freeList;
+	freeList.reset(iPoolSize);
+	for (int i = iPoolSize - 1; i >= iOccupied; i--)
+		freeList.push(i);
+
+	double ns = RunThreads(iThreadCount, [&](int) {
+		for (int n = 0; n < iIterations; n++)
+		{
+			int iIndex = -1;
+			if (!freeList.pop(iIndex))
+				continue;
+			freeList.push(iIndex);
+		}
+	});
+	uMiss = freeList.exhaustedCount();
+	return ns;
+}
+
+
+//各交接结构统一为 Push/Pop，队列满或空时返回false
+//原ThreadFileToDisk的Pong空闲/可用链表：deque加递归互斥体，按容量限制模拟索引总数有限
+class DequeMutexAdapter
+{
+public:
+	DequeMutexAdapter(int iCapacity) : m_iCapacity(iCapacity) {}
+	bool Push(int iIndex)
+	{
+		m_mutex.Lock();
+		bool bOk = (int)m_list.size() < m_iCapacity;
+		if (bOk)
+			m_list.push_back(iIndex);
+		m_mutex.Unlock();
+		return bOk;
+	}
+	bool Pop(int& iIndex)
+	{
+		m_mutex.Lock();
+		bool bOk = !m_list.empty();
+		if (bOk)
+		{
+			iIndex = m_list.front();
+			m_list.pop_front();
+		}
+		m_mutex.Unlock();
+		return bOk;
+	}
+private:
+	std::deque<int> m_list;
+	mt::Mutex m_mutex;
+	int m_iCapacity;
+};
+
+class LockFreeQueueAdapter
+{
+public:
+	LockFreeQueueAdapter(int iCapacity) : m_queue(iCapacity) {}
+	bool Push(int iIndex) { return m_queue.enqueue(iIndex); }
+	bool Pop(int& iIndex) { return m_queue.dequeue(iIndex); }
+private:
+	LockFreeQueue<int> m_queue;
+};
+
+//FreeIndexList是后进先出的栈，索引必须小于容量，交接的是槽号而不是序号
+class FreeIndexListAdapter
+{
+public:
+	FreeIndexListAdapter(int iCapacity) { m_list.reset(iCapacity); }
+	bool Push(int iIndex) { return m_list.push(iIndex); }
+	bool Pop(int& iIndex) { return m_list.pop(iIndex); }
+private:
+	FreeIndexList m_list;
+};
+
+class SpscRingAdapter
+{
+public:
+	SpscRingAdapter(int iCapacity) : m_ring(iCapacity) {}
+	bool Push(int iIndex) { return m_ring.push(iIndex); }
+	bool Pop(int& iIndex) { return m_ring.pop(iIndex); }
+private:
+	SpscIndexRing m_ring;
+};
+
+struct QueueBenchResult
+{
+	double dOpsPerSec;
+	double dP50Ns;
+	double dP99Ns;
+	double dP999Ns;
+	double dMaxNs;
+};
+
+void PinToCore(int iCore)
+{
+	int iCores = (int)std::thread::hardware_concurrency();
+	if (iCores <= 0)
+		return;
+	iCore %= std::min(iCores, (int)(sizeof(DWORD_PTR) * 8));
+	SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << iCore);
+}
+
+double Percentile(std::vector<int64_t>& samples, double dFraction)
+{
+	if (samples.empty())
+		return 0;
+	size_t uPos = std::min(samples.size() - 1, (size_t)(dFraction * samples.size()));
+	std::nth_element(samples.begin(), samples.begin() + uPos, samples.end());
+	return (double)samples[uPos];
+}
+
+//生产者在入队前记下每个序号的时间，消费者出队后计算延迟；槽位时间戳随交接的索引传递
+template<typename Queue>
+QueueBenchResult BenchHandoff(int iCapacity, int iProducers, int iConsumers, int iItemsPerProducer, bool bPinCores, bool bSlotIndex)
+{
+	Queue queue(iCapacity);
+	int64_t iTotal = (int64_t)iProducers * iItemsPerProducer;
+
+	std::unique_ptr<std::atomic<int64_t>[]> stamps(new std::atomic<int64_t>[bSlotIndex ? iCapacity : iTotal]);
+	std::atomic<int64_t> consumed(0);
+	std::vector<std::vector<int64_t>> latencies(iConsumers);
+	for (int c = 0; c < iConsumers; c++)
+		latencies[c].reserve((size_t)(iTotal / iConsumers + 1));
+
+	//以槽号交接时(FreeIndexList)，消费者把用完的槽号交还给它的生产者，
+	//每对消费者/生产者一个单生产者单消费者环，归还路径不引入额外争用
+	std::vector<std::unique_ptr<SpscRingAdapter>> slotReturn;
+	if (bSlotIndex)
+	{
+		for (int i = 0; i < iConsumers * iProducers; i++)
+			slotReturn.push_back(std::unique_ptr<SpscRingAdapter>(new SpscRingAdapter(iCapacity)));
+		for (int i = 0; i < iCapacity; i++)
+			slotReturn[i % iProducers]->Push(i);
+	}
+
+	double ns = RunThreads(iProducers + iConsumers, [&](int t) {
+		if (bPinCores)
+			PinToCore(t);
+
+		if (t < iProducers)
+		{
+			for (int n = 0; n < iItemsPerProducer; n++)
+			{
+				int iIndex = t * iItemsPerProducer + n;
+				for (int c = 0; bSlotIndex && !slotReturn[c * iProducers + t]->Pop(iIndex); c = (c + 1) % iConsumers)
+				{
+					if (c == iConsumers - 1)
+						std::this_thread::yield();
+				}
+				stamps[iIndex].store(BenchClock::now().time_since_epoch().count(), std::memory_order_relaxed);
+				while (!queue.Push(iIndex))
+					std::this_thread::yield();
+			}
+			return;
+		}
+
+		std::vector<int64_t>& lat = latencies[t - iProducers];
+		while (consumed.load(std::memory_order_relaxed) < iTotal)
+		{
+			int iIndex = -1;
+			if (!queue.Pop(iIndex))
+			{
+				std::this_thread::yield();
+				continue;
+			}
+			int64_t iNow = BenchClock::now().time_since_epoch().count();
+			lat.push_back(iNow - stamps[iIndex].load(std::memory_order_relaxed));
+			consumed.fetch_add(1, std::memory_order_relaxed);
+			if (bSlotIndex)
+				slotReturn[(t - iProducers) * iProducers + iIndex % iProducers]->Push(iIndex);
+		}
+	});
+
+	std::vector<int64_t> all;
+	all.reserve((size_t)iTotal);
+	for (int c = 0; c < iConsumers; c++)
+		all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+
+	//时钟单位换算为纳秒
+	double dTickNs = 1e9 * BenchClock::period::num / BenchClock::period::den;
+	QueueBenchResult result;
+	result.dOpsPerSec = ns > 0 ? iTotal * 1e9 / ns : 0;
+	result.dP50Ns = Percentile(all, 0.50) * dTickNs;
+	result.dP99Ns = Percentile(all, 0.99) * dTickNs;
+	result.dP999Ns = Percentile(all, 0.999) * dTickNs;
+	result.dMaxNs = all.empty() ? 0 : *std::max_element(all.begin(), all.end()) * dTickNs;
+	return result;
+}
+
+void ReportHandoff(const char* szName, int iProducers, int iConsumers, const QueueBenchResult& r)
+{
+	printf("%-14s %3d %3d %12.0f %10.0f %10.0f %10.0f %12.0f\n", szName, iProducers, iConsumers,
+		r.dOpsPerSec, r.dP50Ns, r.dP99Ns, r.dP999Ns, r.dMaxNs);
+	printfLog(4, "[HandoffBench::RunQueueBench], %s %dP/%dC %.0f ops/s latency p50 %.0f p99 %.0f p99.9 %.0f max %.0f ns",
+		szName, iProducers, iConsumers, r.dOpsPerSec, r.dP50Ns, r.dP99Ns, r.dP999Ns, r.dMaxNs);
+}
+}
+
+void HandoffBench::RunFreeListBench(int iThreadCount, int iIterations)
+{
+	static const int s_poolSizes[] = { 200, 1024, 4096, 10240 };
+	static const int s_occupancyPercent[] = { 0, 50, 90 };
+
+	if (iThreadCount < 1)
+		iThreadCount = 1;
+
+	printfLog(4, "[HandoffBench::RunFreeListBench], threads %d iterations %d", iThreadCount, iIterations);
+	printf("%8s %6s %16s %16s %10s %10s\n", "pool", "occ%", "scan ns/op", "freelist ns/op", "scan miss", "list miss");
+
+	for (size_t p = 0; p < sizeof(s_poolSizes) / sizeof(s_poolSizes[0]); p++)
+	{
+		for (size_t o = 0; o < sizeof(s_occupancyPercent) / sizeof(s_occupancyPercent[0]); o++)
+		{
+			int iPoolSize = s_poolSizes[p];
+			int iOccupied = iPoolSize * s_occupancyPercent[o] / 100;
+			double dOps = (double)iThreadCount * iIterations;
+
+			uint64_t uScanMiss = 0, uListMiss = 0;
+			double dScanNs = BenchLinearScan(iPoolSize, iOccupied, iThreadCount, iIterations, uScanMiss) / dOps;
+			double dListNs = BenchFreeList(iPoolSize, iOccupied, iThreadCount, iIterations, uListMiss) / dOps;
+
+			printf("%8d %6d %16.1f %16.1f %10llu %10llu\n", iPoolSize, s_occupancyPercent[o],
+				dScanNs, dListNs, (unsigned long long)uScanMiss, (unsigned long long)uListMiss);
+			printfLog(4, "[HandoffBench::RunFreeListBench], pool %d occupied %d%% scan %.1f ns/op freelist %.1f ns/op miss %llu/%llu",
+				iPoolSize, s_occupancyPercent[o], dScanNs, dListNs, (unsigned long long)uScanMiss, (unsigned long long)uListMiss);
+		}
+	}
+}
+
+void HandoffBench::RunQueueBench(int iMaxProducers, int iMaxConsumers, int iItemsPerProducer, int iCapacity, bool bPinCores)
+{
+	if (iMaxProducers < 1)
+		iMaxProducers = 1;
+	if (iMaxConsumers < 1)
+		iMaxConsumers = 1;
+	if (iCapacity < 2)
+		iCapacity = 2;
+
+	printfLog(4, "[HandoffBench::RunQueueBench], producers 1..%d consumers 1..%d items %d capacity %d pin %d",
+		iMaxProducers, iMaxConsumers, iItemsPerProducer, iCapacity, (int)bPinCores);
+	printf("%-14s %3s %3s %12s %10s %10s %10s %12s\n", "queue", "P", "C", "ops/s", "p50 ns", "p99 ns", "p99.9 ns", "max ns");
+
+	for (int p = 1; p <= iMaxProducers; p++)
+	{
+		for (int c = 1; c <= iMaxConsumers; c++)
+		{
+			ReportHandoff("deque+Mutex", p, c, BenchHandoff<DequeMutexAdapter>(iCapacity, p, c, iItemsPerProducer, bPinCores, false));
+			ReportHandoff("LockFreeQueue", p, c, BenchHandoff<LockFreeQueueAdapter>(iCapacity, p, c, iItemsPerProducer, bPinCores, false));
+			ReportHandoff("FreeIndexList", p, c, BenchHandoff<FreeIndexListAdapter>(iCapacity, p, c, iItemsPerProducer, bPinCores, true));
+			if (p == 1 && c == 1)
+				ReportHandoff("SpscIndexRing", p, c, BenchHandoff<SpscRingAdapter>(iCapacity, p, c, iItemsPerProducer, bPinCores, false));
+		}
+	}
+}
+
+bool HandoffBench::RunQueueStress(int iProducers, int iConsumers, int iItemsPerProducer, int iCapacity)
+{
+	static const int BULK = 16;
+
+	if (iProducers < 1)
+		iProducers = 1;
+	if (iConsumers < 1)
+		iConsumers = 1;
+	if (iItemsPerProducer < 1)
+		iItemsPerProducer = 1;
+	if (iCapacity < 2)
+		iCapacity = 2;
+
+	LockFreeQueue<int> queue(iCapacity);
+	int64_t iTotal = (int64_t)iProducers * iItemsPerProducer;
+	std::unique_ptr<std::atomic<uint8_t>[]> seen(new std::atomic<uint8_t>[(size_t)iTotal]);
+	for (int64_t i = 0; i < iTotal; i++)
+		seen[i].store(0, std::memory_order_relaxed);
+
+	std::atomic<int64_t> consumed(0);
+	std::atomic<int> producersDone(0);
+	std::atomic<uint64_t> outOfRange(0);
+	std::atomic<uint64_t> outOfOrder(0);
+
+	double ns = RunThreads(iProducers + iConsumers, [&](int t) {
+		int values[BULK];
+		if (t < iProducers)
+		{
+			//偶数号生产者单个入队，奇数号批量入队，队列满时让出
+			int iBase = t * iItemsPerProducer;
+			int n = 0;
+			while (n < iItemsPerProducer)
+			{
+				size_t uDone = 0;
+				if (t % 2 == 0)
+				{
+					uDone = queue.enqueue(iBase + n) ? 1 : 0;
+				}
+				else
+				{
+					int iCount = std::min(BULK, iItemsPerProducer - n);
+					for (int i = 0; i < iCount; i++)
+						values[i] = iBase + n + i;
+					uDone = queue.enqueue_bulk(values, iCount);
+				}
+				n += (int)uDone;
+				if (uDone == 0)
+					std::this_thread::yield();
+			}
+			producersDone.fetch_add(1, std::memory_order_release);
+			return;
+		}
+
+		//每个消费者记下各生产者最后收到的元素，出队位置单调递增，同一生产者的元素应按入队顺序到达
+		int c = t - iProducers;
+		std::vector<int> last(iProducers, -1);
+		uint64_t uLocalRange = 0, uLocalOrder = 0;
+		BenchClock::time_point idleSince = BenchClock::now();
+		for (int iRound = 0; consumed.load(std::memory_order_relaxed) < iTotal; iRound++)
+		{
+			size_t uGot = 0;
+			int iMode = (c + iRound) % 3;
+			if (iMode == 0)
+				uGot = queue.dequeue(values[0]) ? 1 : 0;
+			else if (iMode == 1)
+				uGot = queue.dequeue_bulk(values, BULK);
+			else
+				uGot = queue.wait_dequeue(values[0], 1) ? 1 : 0;
+
+			if (uGot == 0)
+			{
+				//生产者都已结束后队列为空，或1秒内取不出数据(槽位卡住)，剩下的元素按丢失计
+				if (producersDone.load(std::memory_order_acquire) == iProducers
+					&& (queue.size_approx() == 0 || BenchClock::now() - idleSince > std::chrono::seconds(1)))
+					break;
+				if (iMode != 2)
+					std::this_thread::yield();
+				continue;
+			}
+			idleSince = BenchClock::now();
+
+			for (size_t i = 0; i < uGot; i++)
+			{
+				int iItem = values[i];
+				if (iItem < 0 || iItem >= iTotal)
+				{
+					uLocalRange++;
+					continue;
+				}
+				seen[iItem].fetch_add(1, std::memory_order_relaxed);
+				int p = iItem / iItemsPerProducer;
+				if (iItem <= last[p])
+					uLocalOrder++;
+				last[p] = iItem;
+			}
+			consumed.fetch_add((int64_t)uGot, std::memory_order_relaxed);
+		}
+		outOfRange.fetch_add(uLocalRange);
+		outOfOrder.fetch_add(uLocalOrder);
+	});
+
+	uint64_t uLost = 0, uDuplicated = 0;
+	for (int64_t i = 0; i < iTotal; i++)
+	{
+		uint8_t uCount = seen[i].load(std::memory_order_relaxed);
+		if (uCount == 0)
+			uLost++;
+		else if (uCount > 1)
+			uDuplicated += uCount - 1;
+	}
+
+	bool bPass = uLost == 0 && uDuplicated == 0 && outOfRange.load() == 0 && outOfOrder.load() == 0 && queue.size_approx() == 0;
+	printf("LockFreeQueue stress %dP/%dC capacity %d items %lld: %s, lost %llu duplicated %llu out of range %llu out of order %llu, %.0f ops/s\n",
+		iProducers, iConsumers, (int)queue.capacity(), (long long)iTotal, bPass ? "PASS" : "FAIL",
+		(unsigned long long)uLost, (unsigned long long)uDuplicated, (unsigned long long)outOfRange.load(),
+		(unsigned long long)outOfOrder.load(), ns > 0 ? iTotal * 1e9 / ns : 0);
+	printfLog(bPass ? 4 : 2, "[HandoffBench::RunQueueStress], %dP/%dC capacity %d items %lld %s, lost %llu duplicated %llu out of range %llu out of order %llu",
+		iProducers, iConsumers, (int)queue.capacity(), (long long)iTotal, bPass ? "pass" : "FAIL",
+		(unsigned long long)uLost, (unsigned long long)uDuplicated, (unsigned long long)outOfRange.load(),
+		(unsigned long long)outOfOrder.load());
+	return bPass;
+}
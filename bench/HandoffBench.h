@@ -0,0 +1,30 @@
+﻿#pragma once
+
+#include <stdint.h>
+
+//缓存交接数据结构的性能基准，由独立的控制台程序HandoffBench.exe运行，结果打印到控制台
+class HandoffBench
+{
+public:
+	//函数功能: 空闲缓存获取基准，对比线性扫描m_bAvailable与FreeIndexList
+	//函数参数：iThreadCount：并发取还线程数  iIterations：每线程取还次数
+	//          池大小依次为 200(默认块数) 1024 4096 10240(initializeTheadtoDisk预留的槽数)，
+	//          并在空载、半满、90%占用三种占用率下各测一次
+	static void RunFreeListBench(int iThreadCount = 2, int iIterations = 200000);
+
+	//函数功能: 缓存索引交接基准，对比 deque+mt::Mutex(原空闲/可用链表)、LockFreeQueue、FreeIndexList、SpscIndexRing
+	//函数参数：iMaxProducers/iMaxConsumers：生产者和消费者线程数各自从1递增到该值，SpscIndexRing只测1对1
+	//          iItemsPerProducer：每个生产者交接的索引数  iCapacity：容量，对应缓存池块数
+	//          bPinCores：生产者和消费者依次绑定到不同的逻辑核心
+	//          输出每秒交接次数，以及从入队到出队的延迟分位数(p50/p99/p99.9/max)；
+	//          生产者全速入队，延迟包含排队时间，队列满时约为 容量/吞吐量，可减小iCapacity观察交接本身的开销
+	static void RunQueueBench(int iMaxProducers = 4, int iMaxConsumers = 4, int iItemsPerProducer = 1000000,
+		int iCapacity = 1024, bool bPinCores = true);
+
+	//函数功能: LockFreeQueue多线程压力测试，生产者交替单个/批量入队，消费者轮流单个/批量/阻塞出队
+	//函数参数：iProducers/iConsumers：线程数  iItemsPerProducer：每个生产者入队的元素数
+	//          iCapacity：队列容量，取小值使环频繁回绕、队列经常满和空
+	//函数返回: 每个元素恰好出队一次、没有越界值、同一生产者的元素在每个消费者处保持入队顺序时返回true；
+	//          丢失、重复、越界和乱序的个数写入日志
+	static bool RunQueueStress(int iProducers = 4, int iConsumers = 4, int iItemsPerProducer = 1000000, int iCapacity = 64);
+};
@@ -0,0 +1,60 @@
+﻿#include "HandoffBench.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+//基准在独立进程中运行，不与设备适配器的采集线程争用核心
+//printfLog只输出错误(级别<=2)到stderr，表格由基准自己打印到stdout；-v时输出全部日志
+static int s_iLogLevel = 2;
+
+void printfLog(int nLevel, const char* fmt, ...)
+{
+	if (nLevel > s_iLogLevel)
+		return;
+	va_list args;
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	fputc('\n', stderr);
+}
+
+static void Usage()
+{
+	printf("usage: HandoffBench [-v] [freelist|queue|stress|all]\n");
+}
+
+//返回值：压力测试失败时返回1，参数错误返回2
+int main(int argc, char* argv[])
+{
+	const char* pWhich = "all";
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-v") == 0)
+			s_iLogLevel = 5;
+		else if (argv[i][0] == '-')
+		{
+			Usage();
+			return 2;
+		}
+		else
+			pWhich = argv[i];
+	}
+
+	bool bAll = strcmp(pWhich, "all") == 0;
+	if (!bAll && strcmp(pWhich, "freelist") != 0 && strcmp(pWhich, "queue") != 0 && strcmp(pWhich, "stress") != 0)
+	{
+		Usage();
+		return 2;
+	}
+
+	int iRet = 0;
+	if (bAll || strcmp(pWhich, "freelist") == 0)
+		HandoffBench::RunFreeListBench();
+	if (bAll || strcmp(pWhich, "queue") == 0)
+		HandoffBench::RunQueueBench();
+	//LockFreeQueue丢失、重复或乱序时以非零退出码结束，便于脚本判断
+	if ((bAll || strcmp(pWhich, "stress") == 0) && !HandoffBench::RunQueueStress())
+		iRet = 1;
+	return iRet;
+}
@@ -0,0 +1,125 @@
+﻿#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#pragma pack(push, 1)
+//压缩块头，块总长按4096对齐，可直接无缓冲写盘
+typedef struct
+{
+	uint32_t uMagic;			//BLOCK_MAGIC
+	uint16_t uVersion;
+	uint16_t uChannels;			//交织通道数
+	uint64_t uSequence;			//块序号
+	uint32_t uRawBytes;			//原始数据字节数
+	uint32_t uPayloadBytes;		//压缩数据字节数(不含块头和补齐)
+	uint32_t uFrameBytes;		//块总字节数(含块头和补齐)
+	uint16_t uGroupSamples;		//每组样点数
+	uint16_t uCodec;			//CODEC_xxx
+	uint8_t reserved[32];
+}COMPRESSED_BLOCK_HEADER;
+#pragma pack(pop)
+
+//原始ADC块的并行无损压缩：每通道做差分+zigzag，再按组(128样点)位压缩
+//每块独立压缩，可独立解压；工作线程完成后按提交顺序输出
+//Submit/PopCompleted只允许一个线程调用
+class BlockCompressor
+{
+public:
+	enum
+	{
+		BLOCK_MAGIC = 0x4342434B,	//"KCBC"
+		BLOCK_ALIGN = 4096,
+		GROUP_SAMPLES = 128,
+		CODEC_DELTA_BITPACK = 1,
+		OUTPUT_INDEX_BASE = 0x40000000	//输出缓存编号的基数，用于和缓存池索引区分
+	};
+
+	//输入缓存用完的回调(可以归还到缓存池)，在工作线程中执行
+	typedef void (*InputDoneCallback)(void* pContext, int iBufferIndex);
+
+	BlockCompressor();
+	virtual ~BlockCompressor();
+
+	//函数功能: 启动工作线程
+	//函数参数：iThreadCount：线程数  iChannels：交织通道数  iOutputCount：输出缓存数，限制已压缩未写盘的块数
+	bool Start(int iThreadCount, int iChannels, int iOutputCount);
+	//停止线程，调用前应先用PopCompleted取完所有已提交的块
+	void Stop();
+	bool IsRunning() const { return !m_threads.empty(); }
+
+	void SetInputDoneCallback(InputDoneCallback pfnCallback, void* pContext);
+
+	//提交一块原始数据，压缩完成前pData必须保持有效
+	void Submit(int iBufferIndex, const void* pData, uint32_t uBytes);
+
+	//函数功能: 按提交顺序取出下一块压缩结果
+	//函数参数：iOutputIndex：输出缓存编号(已加OUTPUT_INDEX_BASE)，写盘后调用ReleaseOutput归还
+	//函数返回: 下一块尚未完成时返回false
+	bool PopCompleted(int& iOutputIndex, const void*& pFrame, uint32_t& uFrameBytes);
+	void ReleaseOutput(int iOutputIndex);
+
+	//已提交但未取出的块数
+	int GetPendingCount() const { return (int)(m_uSubmitSeq - m_uPopSeq); }
+
+	//统计
+	double GetRatio() const;				//原始字节/压缩后字节
+	double GetCodecMBps() const;			//单线程压缩速度
+	uint64_t GetRawBytes() const { return m_uRawBytes.load(std::memory_order_relaxed); }
+	uint64_t GetCompressedBytes() const { return m_uCompressedBytes.load(std::memory_order_relaxed); }
+
+	//函数功能: 压缩/解压一块，与线程无关
+	//函数返回: 压缩返回块总字节数；解压返回原始字节数，格式错误或空间不足返回0
+	static uint32_t CompressBound(uint32_t uRawBytes, int iChannels);
+	static uint32_t Compress(const void* pSrc, uint32_t uRawBytes, int iChannels, uint64_t uSequence, void* pDst, uint32_t uDstBytes);
+	static uint32_t Decompress(const void* pFrame, uint32_t uFrameBytes, void* pDst, uint32_t uDstBytes);
+
+private:
+	struct Job
+	{
+		int iBufferIndex;
+		const void* pData;
+		uint32_t uBytes;
+		uint64_t uSequence;
+	};
+
+	struct Output
+	{
+		uint8_t* pBuffer;
+		uint32_t uCapacity;
+		uint32_t uFrameBytes;
+	};
+
+	void WorkerThread();
+
+	BlockCompressor(const BlockCompressor&);
+	void operator = (const BlockCompressor&);
+
+private:
+	int m_iChannels;
+	InputDoneCallback m_pfnCallback;
+	void* m_pContext;
+
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_cvJob;		//工作线程等待任务和空闲输出缓存
+	std::deque<Job> m_jobs;
+	std::vector<Output> m_outputs;
+	std::vector<int> m_freeOutputs;
+	std::map<uint64_t, int> m_completed;	//序号 -> 输出缓存
+	bool m_bStop;
+
+	uint64_t m_uSubmitSeq;					//只在提交线程中访问
+	uint64_t m_uPopSeq;
+
+	std::atomic<uint64_t> m_uRawBytes;
+	std::atomic<uint64_t> m_uCompressedBytes;
+	std::atomic<uint64_t> m_uBusyNs;
+};
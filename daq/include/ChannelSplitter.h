@@ -0,0 +1,49 @@
+﻿#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//按通道拆分采集文件，替代逐通道调用QTXdmaDataSplitChannels(拆N个通道要读N遍文件)
+//输入文件只映射并读一遍，按块分给多个线程；每个线程把一块解交织到各通道的对齐缓存，
+//再用无缓冲句柄按预先算好的偏移写入各通道文件，所有通道同时输出
+//数据为16位采样、按通道交织，文件末尾不足一帧的部分忽略
+//RawContainer文件按块索引取数据块(跳过文件头、索引区和索引尾)，压缩块先解压再解交织
+class ChannelSplitter
+{
+public:
+	enum
+	{
+		CHUNK_FRAMES = 2 * 1024 * 1024	//每块帧数，每通道每块4MB
+	};
+
+	//函数功能: 拆分多通道文件
+	//函数参数：strInput：多通道原始数据文件  iChannels：通道数
+	//          strOutputPrefix：输出前缀，第c个通道(从0开始)写到 <前缀>_ch<c>.bin
+	//          iThreadCount：线程数，0为按CPU核数
+	//函数返回: 成功返回0，失败返回-1，与QTXdmaDataSplitChannels一致
+	static int Split(const std::string& strInput, int iChannels, const std::string& strOutputPrefix, int iThreadCount = 0);
+
+	//函数功能: 解交织uFrames帧，2/4通道用SSE2，其余逐个采样
+	//函数参数：ppDst：各通道的输出地址，每个至少uFrames个采样
+	static void Deinterleave(const int16_t* pSrc, size_t uFrames, int iChannels, int16_t** ppDst);
+
+private:
+	//输入文件中的一段交织数据，输出从第uFirstFrame帧开始
+	struct Piece
+	{
+		uint64_t uOffset;
+		uint32_t uStoredBytes;
+		uint64_t uFrames;
+		uint64_t uFirstFrame;
+		bool bCompressed;
+	};
+
+	//函数功能: 生成要拆分的数据段，容器文件按块索引，普通文件按CHUNK_FRAMES分段
+	//函数返回: 总帧数，失败返回0
+	static uint64_t BuildPieces(const std::string& strInput, const uint8_t* pView, uint64_t uFileSize, int iChannels,
+		std::vector<Piece>& pieces);
+	static void Deinterleave2(const int16_t* pSrc, size_t uFrames, int16_t* pDst0, int16_t* pDst1);
+	static void Deinterleave4(const int16_t* pSrc, size_t uFrames, int16_t** ppDst);
+};
@@ -0,0 +1,109 @@
+﻿#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "ZlibEncoder.h"
+
+//按(t, c, z, y, x)分块的五维数组目录存储，格式与Zarr v2一致(16位无符号，C顺序，块文件名 t.c.z.y.x)
+//块形状为 1 x 1 x iChunkZ x iChunkY x iChunkX，凑齐iChunkZ层的一段后拆成块，由线程池并行写出
+//每个块先写临时文件再改名，.zarray中的时间维只包含所有块都已写完的时间点，采集过程中可以直接打开读取
+//有块写失败的时间点及其后的时间点不再对外可见
+//WritePlane/Close只允许一个线程调用
+class ChunkedArrayStore
+{
+public:
+	ChunkedArrayStore();
+	virtual ~ChunkedArrayStore();
+
+	//函数功能: 创建目录和.zarray，启动写线程
+	//函数参数：strDir：数组目录  iSizeC/iSizeZ/iHeight/iWidth：除时间外的各维大小
+	//          iChunkZ/iChunkY/iChunkX：块大小  iThreadCount：写线程数
+	//          bCompress：用ZlibEncoder压缩每个块，.zarray中compressor为{"id": "zlib", "level": 1}，标准Zarr读取端可直接解码
+	bool Open(const std::string& strDir, int iSizeC, int iSizeZ, int iHeight, int iWidth,
+		int iChunkZ, int iChunkY, int iChunkX, int iThreadCount, bool bCompress);
+	//写出未凑齐的段(缺少的层补0)，等待所有块写完后更新.zarray
+	void Close();
+	bool IsOpen() const { return !m_threads.empty(); }
+
+	//函数功能: 写入一个平面，同一段内的层可以乱序；排队的块过多时等待
+	//函数参数：pPlane：iHeight*iWidth个16位像素，返回后即可复用
+	bool WritePlane(int iT, int iC, int iZ, const uint16_t* pPlane);
+
+	int GetCompletedT() const { return m_iCompleteT.load(std::memory_order_relaxed); }
+	uint64_t GetChunksWritten() const { return m_uChunksWritten.load(std::memory_order_relaxed); }
+	uint64_t GetBytesWritten() const { return m_uBytesWritten.load(std::memory_order_relaxed); }
+	int GetPendingChunks();
+
+private:
+	//iChunkZ层组成的一段，拆成的所有块写完后释放
+	struct Slab
+	{
+		int iT;
+		int iC;
+		int iZChunk;
+		int iPlanes;					//已写入的层数
+		std::vector<uint16_t> data;		//iChunkZ * iHeight * iWidth
+	};
+
+	struct Job
+	{
+		std::shared_ptr<Slab> pSlab;
+		int iYChunk;
+		int iXChunk;
+	};
+
+	void SubmitSlab(const std::shared_ptr<Slab>& pSlab);
+	void WorkerThread();
+	bool WriteChunk(const Job& job, std::vector<uint16_t>& tile, std::vector<uint8_t>& packed, ZlibEncoder& encoder);
+	void OnChunkDone(int iT, bool bOk);
+	bool WriteMetadata(int iSizeT);
+	bool WriteFileAtomic(const std::string& strFileName, const void* pData, uint32_t uBytes);
+
+	ChunkedArrayStore(const ChunkedArrayStore&);
+	void operator = (const ChunkedArrayStore&);
+
+private:
+	std::string m_strDir;
+	int m_iSizeC;
+	int m_iSizeZ;
+	int m_iHeight;
+	int m_iWidth;
+	int m_iChunkZ;
+	int m_iChunkY;
+	int m_iChunkX;
+	int m_iChunksZ;						//各维块数
+	int m_iChunksY;
+	int m_iChunksX;
+	bool m_bCompress;
+	int m_iMaxJobs;						//排队块数上限
+
+	//以下只在调用线程中访问
+	std::map<uint64_t, std::shared_ptr<Slab> > m_slabs;	//未凑齐的段，键由(t, c, z块)组成
+	int m_iMaxT;
+
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_cvJob;	//写线程等待任务
+	std::condition_variable m_cvSpace;	//调用线程等待队列空位
+	std::deque<Job> m_jobs;
+	std::map<int, int> m_doneChunks;	//时间点 -> 已写完的块数
+	int m_iFailedT;						//第一个有块写失败的时间点，-1为没有
+	bool m_bStop;
+
+	std::mutex m_metaMutex;				//串行化.zarray的更新
+	int m_iMetaT;						//.zarray中当前的时间维大小
+
+	std::atomic<int> m_iCompleteT;		//从0开始连续写完的时间点数
+	std::atomic<uint64_t> m_uChunksWritten;
+	std::atomic<uint64_t> m_uBytesWritten;
+};
@@ -0,0 +1,112 @@
+﻿#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <atomic>
+
+//无缓冲直写磁盘(FILE_FLAG_NO_BUFFERING + 重叠I/O)，同时保持多个未完成的写请求
+//只允许一个线程调用Submit/Poll/Flush/Close，完成回调也在该线程中按提交顺序执行
+//默认文件内容与提交的数据首尾相接：不足一个扇区的尾部暂存，与下一次提交的数据拼接后写入，Close时补齐写入再截断
+//缓存地址按扇区对齐(VirtualAlloc分配即可)且前面没有暂存尾部时直接写，否则分成不超过BOUNCE_BYTES的片段，
+//经每个请求槽固定的中转缓存写出；补齐模式下每次提交从扇区边界开始，只有最后不足一个扇区的部分经中转缓存
+class DirectDiskWriter
+{
+public:
+	//写完成回调，dwError为0表示成功
+	typedef void (*CompleteCallback)(void* pContext, int iBufferIndex, DWORD dwError);
+
+	enum
+	{
+		BOUNCE_BYTES = 4 * 1024 * 1024		//中转缓存大小，需要拼接或对齐的数据按此分片写出
+	};
+
+	DirectDiskWriter();
+	virtual ~DirectDiskWriter();
+
+	//函数功能: 创建文件并预分配空间
+	//函数参数：strFileName：文件名  iQueueDepth：未完成写请求的最大数量
+	//          uPreallocBytes：预分配字节数，0为不预分配
+	//函数返回: 成功返回true
+	bool Open(const std::string& strFileName, int iQueueDepth, uint64_t uPreallocBytes);
+
+	//等待所有写请求完成，把文件截断到实际写入长度后关闭
+	void Close();
+	bool IsOpen() const { return m_hFile != INVALID_HANDLE_VALUE; }
+
+	void SetCompleteCallback(CompleteCallback pfnCallback, void* pContext);
+	//函数功能: 补齐模式，每次提交的数据从扇区边界开始并补零到整扇区，块之间留有空隙；
+	//          调用者按Submit返回的偏移和自己的长度定位数据(容器格式的块索引)，Close时截断到最后一块数据的结尾
+	void SetPadToSector(bool bPad) { m_bPadToSector = bPad; }
+
+	//函数功能: 提交一次异步写，队列满时等待最早的请求完成
+	//函数参数：iBufferIndex：回调时原样返回  pOffset：返回该数据在文件中的偏移
+	//函数返回: 提交失败返回false，此时不会触发回调，已发出的部分也已完成；成功后缓存可在回调中归还(暂存的尾部已拷贝)
+	bool Submit(int iBufferIndex, const void* pData, uint32_t uBytes, uint64_t* pOffset = NULL);
+
+	//回收已完成的请求(不等待)，返回回收数量
+	int Poll();
+	//等待所有请求完成
+	void Flush();
+
+	uint32_t GetSectorSize() const { return m_uSectorSize; }
+	int GetOutstanding() const { return m_iCount; }
+	//下一次提交的数据在文件中的偏移(补齐模式下含块之间的补齐)
+	uint64_t GetFileOffset() const { return m_uFileOffset; }
+
+	//吞吐量统计
+	uint64_t GetBytesWritten() const { return m_uBytesWritten.load(std::memory_order_relaxed); }
+	double GetThroughputMBps() const { return m_dThroughputMBps.load(std::memory_order_relaxed); }
+	uint64_t GetErrorCount() const { return m_uErrorCount.load(std::memory_order_relaxed); }
+
+	//取文件所在卷的物理扇区大小，取不到时用逻辑扇区大小
+	static uint32_t QuerySectorSize(const std::string& strFileName);
+	//函数功能: 从 暂存尾部+数据+补零 组成的字节流中取[uPos, uPos+uBytes)拷贝到pDst
+	static void CopyStream(uint8_t* pDst, uint64_t uPos, uint32_t uBytes, const uint8_t* pTail, uint32_t uTailBytes,
+		const uint8_t* pData, uint32_t uDataBytes);
+
+private:
+	struct WriteSlot
+	{
+		OVERLAPPED ov;
+		int iBufferIndex;
+		bool bNotify;				//一次提交分成多个请求时只有最后一个回调
+		uint32_t uBytes;			//实际发出的写长度，0表示数据全部暂存，没有发出写请求
+		uint8_t* pBounce;			//BOUNCE_BYTES的对齐中转缓存，第一次使用时分配，Close时释放
+	};
+
+	//取下一个空闲请求槽，队列满时等待最早的请求完成
+	WriteSlot& AcquireSlot();
+	bool IssueSlot(WriteSlot& slot, const void* pWrite, uint32_t uBytes, uint64_t uWritePos, int iBufferIndex, bool bNotify);
+	bool ReapOldest(bool bWait);
+	bool WriteTail();
+	void UpdateThroughput(uint64_t uBytes);
+
+	DirectDiskWriter(const DirectDiskWriter&);
+	void operator = (const DirectDiskWriter&);
+
+private:
+	HANDLE m_hFile;
+	std::string m_strFileName;
+	uint32_t m_uSectorSize;
+	uint64_t m_uFileOffset;		//下一次提交的数据的偏移
+	uint64_t m_uDataEnd;		//最后一块数据的结尾，Close时截断到这里
+	uint8_t* m_pTail;			//不足一个扇区的尾部，写在 m_uFileOffset - m_uTailBytes 处
+	uint32_t m_uTailBytes;
+	bool m_bPadToSector;
+	DWORD m_dwChainError;		//同一次提交中前面请求的错误，由最后一个请求的回调报告
+
+	std::vector<WriteSlot> m_slots;
+	int m_iHead;				//最早提交的请求
+	int m_iCount;				//未完成请求数
+
+	CompleteCallback m_pfnCallback;
+	void* m_pContext;
+
+	std::atomic<uint64_t> m_uBytesWritten;
+	std::atomic<double> m_dThroughputMBps;
+	std::atomic<uint64_t> m_uErrorCount;
+	ULONGLONG m_uWindowStartMs;
+	uint64_t m_uWindowBytes;
+};
@@ -0,0 +1,25 @@
+﻿#pragma once
+
+#include "TraceLog.h"
+
+//按级别过滤的日志宏，级别与Log_TraceLog一致：1严重错误 2失败 3警告 4一般信息 5调试
+//LOG_COMPILE_LEVEL：编译期阈值，级别大于它的LOG_PRINTF整条编译掉，参数不会出现在代码中；
+//发布版可在工程预处理器定义中设为4，去掉所有调试日志
+//未被编译掉时先比较运行期级别，未通过则不求值参数、不调用printfLog，热路径上关闭的日志只剩一次比较
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 5
+#endif
+
+extern Log_TraceLog* pLog;
+extern Log_TraceLog* pLogReg;
+extern void printfLog(int nLevel, const char * fmt, ...);
+extern void printfLogReg(int nLevel, const char * fmt, ...);
+
+#define LOG_LEVEL_ENABLED(log, level) \
+	((level) <= LOG_COMPILE_LEVEL && (level) != 0 && (log) != NULL && (log)->Passed(level))
+
+#define LOG_PRINTF(level, ...) \
+	do { if (LOG_LEVEL_ENABLED(pLog, level)) printfLog(level, __VA_ARGS__); } while (0)
+
+#define LOG_PRINTF_REG(level, ...) \
+	do { if (LOG_LEVEL_ENABLED(pLogReg, level)) printfLogReg(level, __VA_ARGS__); } while (0)
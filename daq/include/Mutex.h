@@ -5,10 +5,10 @@
 namespace mt {
 
 	/**
-	 * 
+	 * 互斥体
 	 *
-	 * Եݹ鷽ʽΣҲ˵ͬһ߳пԵLockжμ
-	 * 
+	 * 以递归方式锁定代码段，也就是说在同一个线程中可以调用Lock进行多次加锁，
+	 * 而不会引起死锁。
 	 */
 	class Mutex  
 	{
@@ -0,0 +1,27 @@
+﻿#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+
+//缓存池内存分配：优先用大页，并绑定到采集卡所在的NUMA节点
+//大页分配时即已锁定在物理内存中；普通页分配后逐页写一次，避免DMA拷贝时才触发缺页
+class NumaAllocator
+{
+public:
+	//函数功能: 查询XDMA采集卡所在的NUMA节点
+	//函数返回: 节点号；单节点系统返回0，查询失败返回-1
+	static int QueryDeviceNumaNode();
+
+	//函数功能: 启用SeLockMemoryPrivilege，只在第一次调用时执行
+	//函数返回: 可以分配大页时返回true
+	static bool EnableLargePages();
+
+	//函数功能: 分配一块池内存
+	//函数参数：iNode：NUMA节点，-1为不指定  bLargePages：尝试大页  pbLargePages：返回是否分配到大页
+	//函数返回: 失败返回NULL，用Free释放
+	static uint8_t* Allocate(size_t uBytes, int iNode, bool bLargePages, bool* pbLargePages = NULL);
+	static void Free(void* p);
+
+private:
+	static void Prefault(uint8_t* p, size_t uBytes);
+};
@@ -0,0 +1,81 @@
+﻿#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//重建后的TPMCamera图像流式写入BigTIFF(OME-TIFF)，16位灰度，每帧一个条带
+//文件布局固定：文件头 + OME-XML预留区 + 若干帧块，每个帧块 = IFD区(IFDS_PER_BLOCK个定长IFD) + IFDS_PER_BLOCK帧图像
+//IFD内容和帧偏移都可以预先算出，写入过程完全顺序，关闭时只回写OME-XML和最后一个IFD的链接
+//帧顺序为XYCZT：通道最快，其次z，最后t
+//只允许一个线程调用
+class OmeTiffWriter
+{
+public:
+	enum
+	{
+		XML_RESERVE = 65536,		//文件头+OME-XML预留区，帧块从这里开始
+		IFDS_PER_BLOCK = 64,
+		IFD_BYTES = 256,			//定长IFD，最多12项
+		STAGING_BYTES = 16 * 1024 * 1024
+	};
+
+	OmeTiffWriter();
+	virtual ~OmeTiffWriter();
+
+	//函数功能: 创建文件，写入前设置尺寸
+	//函数参数：iWidth/iHeight：图像尺寸  iSizeC：通道数  iSizeZ：z层数
+	//          iSizeT：时间点数，0为未知(关闭时按实际帧数回写)  uPreallocFrames：预分配帧数，0为不预分配
+	bool Open(const std::string& strFileName, int iWidth, int iHeight, int iSizeC, int iSizeZ, int iSizeT, uint64_t uPreallocFrames);
+	//写入剩余数据，回写OME-XML后关闭；没有写入帧时删除文件
+	bool Close();
+	bool IsOpen() const { return m_hFile != INVALID_HANDLE_VALUE; }
+
+	//Open前调用，写入OME-XML
+	void SetChannelNames(const std::vector<std::string>& names) { m_channelNames = names; }
+	void SetPhysicalSize(double dPixelUm, double dZStepUm) { m_dPixelUm = dPixelUm; m_dZStepUm = dZStepUm; }
+
+	//函数功能: 写入一帧，pFrame为iWidth*iHeight个16位像素
+	//函数返回: 写盘失败返回false
+	bool WriteFrame(const uint16_t* pFrame);
+
+	uint64_t GetFrameCount() const { return m_uFrames; }
+	double GetThroughputMBps() const { return m_dThroughputMBps; }
+
+private:
+	uint64_t BlockOffset(uint64_t uBlock) const;
+	uint64_t FrameOffset(uint64_t uFrame) const;
+	uint64_t IfdOffset(uint64_t uFrame) const;
+	std::string BuildXml(uint64_t uFrames) const;
+	void BuildIfd(uint64_t uFrame, bool bLast, uint8_t* pDst) const;
+	bool Append(const void* pData, uint32_t uBytes);
+	bool FlushStaging();
+	bool WriteAt(uint64_t uOffset, const void* pData, uint32_t uBytes);
+
+	OmeTiffWriter(const OmeTiffWriter&);
+	void operator = (const OmeTiffWriter&);
+
+private:
+	HANDLE m_hFile;
+	std::string m_strFileName;
+	int m_iWidth;
+	int m_iHeight;
+	int m_iSizeC;
+	int m_iSizeZ;
+	int m_iSizeT;
+	uint32_t m_uFrameBytes;
+	std::vector<std::string> m_channelNames;
+	double m_dPixelUm;
+	double m_dZStepUm;
+
+	uint8_t* m_pStaging;			//合并成大块顺序写
+	uint32_t m_uStagingUsed;
+	uint64_t m_uFileOffset;			//已写入文件的长度(不含暂存区)
+	uint64_t m_uFrames;
+	uint32_t m_uXmlBytes;			//OME-XML长度(含结尾0)
+
+	ULONGLONG m_uWindowStartMs;
+	uint64_t m_uWindowBytes;
+	double m_dThroughputMBps;
+};
@@ -0,0 +1,89 @@
+﻿#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include <atomic>
+
+//事件触发记录：没有事件时只在缓存池中保留最近一段数据(预触发)，更早的缓存直接归还、不写盘；
+//发生事件时把保留的预触发数据连同之后一段(后触发)数据交给写盘，记录期间的新事件延长后触发窗口
+//事件来源：软件触发、某通道越过阈值(在写盘线程中扫描数据)、外部DI边沿(NIDAQHub变化检测回调)
+//Trigger可在任意线程调用；Configure/SetThreshold在没有数据流动时调用；Offer/Drain只允许写盘线程调用
+class PreTriggerGate
+{
+public:
+	enum TriggerSource
+	{
+		SOURCE_SOFTWARE = 0,
+		SOURCE_THRESHOLD = 1,
+		SOURCE_EXTERNAL = 2
+	};
+
+	PreTriggerGate();
+	virtual ~PreTriggerGate();
+
+	//函数功能: 设置预触发和后触发长度
+	//函数参数：uPreBytes：事件前保留的字节数  uPostBytes：事件后继续记录的字节数
+	//          iMaxHeld：最多保留的缓存数，0为不限；防止预触发占满缓存池使采集线程取不到空闲缓存
+	void Configure(bool bEnable, uint64_t uPreBytes, uint64_t uPostBytes, int iMaxHeld);
+	//函数功能: 设置阈值触发，数据为iChannels通道交织的16位采样
+	//函数参数：iChannel：从0开始的通道号  sLevel：该通道由低于sLevel变为不低于sLevel时触发
+	void SetThreshold(bool bEnable, int iChannel, int iChannels, int16_t sLevel);
+	bool IsEnabled() const { return m_bEnable.load(std::memory_order_acquire); }
+
+	//函数功能: 发出一次事件，在写盘线程处理下一个缓存时生效
+	void Trigger(int iSource);
+
+	//函数功能: 处理一个新到的缓存
+	//函数参数：commit：返回应写盘的缓存，按到达顺序  release：返回应直接归还的缓存
+	//函数返回: 本次开始一段新的记录时返回true
+	bool Offer(int iBufferIndex, const void* pData, uint32_t uBytes, std::vector<int>& commit, std::vector<int>& release);
+	//函数功能: 停止时取出所有保留的缓存，结束当前记录
+	void Drain(std::vector<int>& release);
+	//请求写盘线程在空闲时执行Drain，采集停止后调用，使缓存池能够重建、上次的预触发数据不会混入下次记录
+	void RequestDrain() { m_bDrainRequested.store(true, std::memory_order_release); }
+	bool IsDrainRequested() const { return m_bDrainRequested.load(std::memory_order_acquire); }
+
+	bool IsRecording() const { return m_bRecording.load(std::memory_order_relaxed); }
+	uint64_t GetEventCount() const { return m_uEvents.load(std::memory_order_relaxed); }
+	uint64_t GetCommittedBytes() const { return m_uCommitted.load(std::memory_order_relaxed); }
+	uint64_t GetDiscardedBytes() const { return m_uDiscarded.load(std::memory_order_relaxed); }
+
+private:
+	struct Held
+	{
+		int iBufferIndex;
+		uint32_t uBytes;
+	};
+
+	bool ScanThreshold(const void* pData, uint32_t uBytes);
+
+	PreTriggerGate(const PreTriggerGate&);
+	void operator = (const PreTriggerGate&);
+
+private:
+	std::atomic<bool> m_bEnable;
+	uint64_t m_uPreBytes;
+	uint64_t m_uPostBytes;
+	int m_iMaxHeld;
+
+	bool m_bThreshold;
+	int m_iThresholdChannel;
+	int m_iThresholdChannels;
+	int16_t m_sLevel;
+	bool m_bBelow;					//阈值通道上一个采样低于阈值
+
+	std::atomic<int> m_iPending;	//待处理事件的来源，-1为无
+	std::atomic<bool> m_bDrainRequested;
+
+	//以下只在写盘线程中访问
+	std::deque<Held> m_held;
+	uint64_t m_uHeldBytes;
+	uint64_t m_uPostRemain;
+
+	std::atomic<bool> m_bRecording;
+	std::atomic<uint64_t> m_uEvents;
+	std::atomic<uint64_t> m_uCommitted;
+	std::atomic<uint64_t> m_uDiscarded;
+};
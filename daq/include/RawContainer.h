@@ -0,0 +1,105 @@
+﻿#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#pragma pack(push, 1)
+//文件头，占文件开头4096字节
+typedef struct
+{
+	uint32_t uMagic;				//RawContainer::HEADER_MAGIC
+	uint16_t uVersion;
+	uint16_t uHeaderBytes;			//文件头字节数，数据块从这里开始
+	uint32_t uFileIndex;			//分段文件序号
+	uint32_t uSegmentBytes;			//单次触发段字节数(once_trig_bytes)
+	uint32_t uSegmentsPerBlock;		//每块包含的触发段数
+	uint32_t uConfigBytes;			//szConfig有效长度
+	uint64_t uCreateTime;			//创建时间(FILETIME)
+	uint8_t reserved[32];
+	char szConfig[4096 - 64];		//采集配置快照，每行 key=value
+}RAW_CONTAINER_HEADER;
+
+//块索引记录，定长，第i块的记录位于索引区 i*sizeof(RAW_INDEX_RECORD)
+typedef struct
+{
+	uint64_t uSequence;				//块序号(整个采集过程连续)
+	uint64_t uFileOffset;			//块在文件中的偏移，按扇区对齐，与前一块之间补零
+	uint32_t uStoredBytes;			//块在文件中的字节数
+	uint32_t uRawBytes;				//原始数据字节数
+	uint64_t uTimestamp;			//写入时间(FILETIME)
+	uint64_t uFirstSegment;			//块中第一个触发段的序号(整个采集过程连续)
+	uint32_t uFlags;				//INDEX_FLAG_xxx
+	uint8_t reserved[20];
+}RAW_INDEX_RECORD;
+
+//索引尾，位于文件最后64字节
+typedef struct
+{
+	uint32_t uMagic;				//RawContainer::FOOTER_MAGIC
+	uint32_t uVersion;
+	uint64_t uRecordCount;
+	uint64_t uIndexOffset;			//索引区在文件中的偏移
+	uint8_t reserved[40];
+}RAW_INDEX_FOOTER;
+#pragma pack(pop)
+
+//自描述的原始数据容器：文件头(配置快照) + 数据块 + 索引区 + 索引尾
+//采集过程中索引同时追加到旁路文件 <数据文件>.idx，异常退出时仍可按块定位
+//按触发段序号定位块为O(1)：块号 = (段号 - 首块段号) / 每块段数
+class RawContainer
+{
+public:
+	enum
+	{
+		HEADER_MAGIC = 0x4352434B,	//"KCRC"
+		FOOTER_MAGIC = 0x4952434B,	//"KCRI"
+		HEADER_BYTES = 4096,
+		INDEX_FLAG_COMPRESSED = 1
+	};
+
+	RawContainer();
+	virtual ~RawContainer();
+
+	//函数功能: 生成文件头并打开旁路索引文件
+	//函数参数：strDataFile：数据文件名  iFileIndex：分段文件序号  strConfig：配置快照
+	//          uSegmentBytes：单次触发段字节数  uSegmentsPerBlock：每块触发段数
+	bool Create(const std::string& strDataFile, int iFileIndex, const std::string& strConfig, uint32_t uSegmentBytes, uint32_t uSegmentsPerBlock);
+	void Close();
+
+	//文件头缓存(扇区对齐)，须作为文件的第一次写入
+	const void* GetHeader() const { return m_pHeader; }
+
+	//函数功能: 登记一个已写盘的块
+	//函数参数：pData：块数据，压缩块从块头取原始长度  uFirstSegment：块中第一个触发段的序号
+	//函数返回: 块中的触发段数
+	uint64_t AddBlock(uint64_t uSequence, uint64_t uFileOffset, const void* pData, uint32_t uStoredBytes, uint64_t uFirstSegment);
+	//块中的触发段数，与AddBlock的返回值相同，用于提交时先分配触发段序号
+	uint64_t GetSegmentCount(const void* pData, uint32_t uStoredBytes) const;
+
+	//函数功能: 生成索引区和索引尾(扇区对齐)，写在最后一个数据块之后
+	//函数参数：uIndexOffset：索引区在文件中的偏移  uBytes：返回缓存字节数
+	const void* BuildFooter(uint64_t uIndexOffset, uint32_t& uBytes);
+
+	int GetBlockCount() const { return (int)m_records.size(); }
+
+	//函数功能: 读取文件头和块索引，优先用索引尾，没有时读旁路索引文件
+	static bool ReadIndex(const std::string& strDataFile, RAW_CONTAINER_HEADER& header, std::vector<RAW_INDEX_RECORD>& records);
+	//函数功能: 按触发段序号查找块
+	//函数返回: 块在records中的下标，不在本文件中返回-1
+	static int FindBlock(const RAW_CONTAINER_HEADER& header, const std::vector<RAW_INDEX_RECORD>& records, uint64_t uSegment);
+
+private:
+	RawContainer(const RawContainer&);
+	void operator = (const RawContainer&);
+
+private:
+	uint8_t* m_pHeader;
+	uint8_t* m_pFooter;
+	uint32_t m_uFooterCapacity;
+	uint32_t m_uSegmentBytes;
+	FILE* m_fpIndex;
+	std::vector<RAW_INDEX_RECORD> m_records;
+};
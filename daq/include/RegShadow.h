@@ -0,0 +1,81 @@
+﻿#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+//寄存器影子缓存：记录最近一次写入/读出的配置寄存器值，值未变化的写和重复的读不再访问PCIe
+//每个寄存器有一种策略：
+//  POLICY_CACHEABLE  配置寄存器和只读的板卡信息，读命中时直接返回缓存值，写入值与缓存相同时跳过
+//  POLICY_VOLATILE   状态寄存器，硬件会自行改变，每次都访问板卡(未登记的寄存器都按此处理)
+//  POLICY_PULSE      上升沿有效的触发/清除寄存器，每次写都访问板卡；只记录最后写入的值，供IsPulseLow判断前导0能否省略
+//软复位、打开/关闭板卡后调用InvalidateAll，之后第一次访问重新从板卡取值
+class RegShadow
+{
+public:
+	enum Policy
+	{
+		POLICY_VOLATILE = 0,
+		POLICY_CACHEABLE = 1,
+		POLICY_PULSE = 2
+	};
+
+	static RegShadow& Ins();
+
+	void Enable(bool bEnable);
+	bool IsEnabled() const { return m_bEnable.load(std::memory_order_relaxed); }
+
+	//函数功能: 设置寄存器的缓存策略，基地址或偏移超出缓存范围时按POLICY_VOLATILE处理
+	void SetPolicy(uint64_t uBase, uint32_t uOffset, int iPolicy);
+	int GetPolicy(uint64_t uBase, uint32_t uOffset) const;
+
+	//函数功能: 读缓存
+	//函数返回: 可缓存且已有有效值时返回true并给出uValue，否则需要访问板卡
+	bool Lookup(uint64_t uBase, uint32_t uOffset, uint64_t& uValue);
+	//函数功能: 判断写入是否可以跳过(可缓存且缓存值与uValue相同)
+	bool IsRedundantWrite(uint64_t uBase, uint32_t uOffset, uint64_t uValue);
+	//函数功能: 判断脉冲寄存器当前是否已为0(上一次脉冲以0结束)，是则0-1-0序列的第一次写可以省略
+	bool IsPulseLow(uint64_t uBase, uint32_t uOffset);
+	//函数功能: 访问板卡成功后更新缓存，易变寄存器忽略
+	void Store(uint64_t uBase, uint32_t uOffset, uint64_t uValue);
+	//函数功能: 作废一个寄存器的缓存(访问失败时调用，板卡上的值未知)
+	void Invalidate(uint64_t uBase, uint32_t uOffset);
+	//函数功能: 作废一个基地址下全部寄存器的缓存(硬件会改写整组寄存器时调用，例如停止采集后的DMA参数块)
+	void InvalidateBase(uint64_t uBase);
+	//函数功能: 作废全部缓存
+	void InvalidateAll();
+
+	uint64_t GetReadHits() const { return m_uReadHits.load(std::memory_order_relaxed); }
+	uint64_t GetWriteSkips() const { return m_uWriteSkips.load(std::memory_order_relaxed); }
+
+private:
+	enum
+	{
+		BASE_BLOCKS = 16,			//基地址0x0000~0xF000，每块0x1000
+		REGS_PER_BLOCK = 64			//偏移0x00~0xFC，4字节对齐
+	};
+
+	struct Entry
+	{
+		std::atomic<uint8_t> uPolicy;	//策略不加锁读取，访问脉冲/状态寄存器时不进入锁
+		bool bValid;
+		uint64_t uValue;
+	};
+
+	RegShadow();
+	virtual ~RegShadow();
+
+	//函数返回: 寄存器在缓存中的下标，不在缓存范围内返回-1
+	static int IndexOf(uint64_t uBase, uint32_t uOffset);
+	void SetDefaultPolicies();
+
+	RegShadow(const RegShadow&);
+	void operator = (const RegShadow&);
+
+private:
+	Entry m_entries[BASE_BLOCKS * REGS_PER_BLOCK];
+	mutable std::mutex m_mutex;
+	std::atomic<bool> m_bEnable;
+	std::atomic<uint64_t> m_uReadHits;
+	std::atomic<uint64_t> m_uWriteSkips;
+};
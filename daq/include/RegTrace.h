@@ -0,0 +1,119 @@
+﻿#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+
+//寄存器访问的二进制跟踪：每次读写只把时间戳、基地址、偏移、值和方向写入定长环，不做格式化和文件操作，
+//环满后覆盖最早的记录(保留最近的访问)；需要时导出为二进制文件离线解码，或直接解码为文本
+//Record可在任意线程并发调用；每条记录带序号，读取时跳过正在被覆盖的记录
+class RegTrace
+{
+public:
+	enum Direction
+	{
+		DIR_READ = 0,
+		DIR_WRITE = 1
+	};
+
+	enum
+	{
+		DEFAULT_RECORDS = 65536,	//每条32字节，共2MB
+		FILE_MAGIC = 0x52545251,	//"QRTR"
+		FILE_VERSION = 1
+	};
+
+#pragma pack(push, 1)
+	//导出文件的记录格式，与环中的记录相同
+	struct REG_TRACE_RECORD
+	{
+		uint64_t uTick;				//QueryPerformanceCounter
+		uint64_t uValue;
+		uint32_t uBase;				//板卡基地址都在32位以内，只保留低32位
+		uint32_t uOffset;
+		uint16_t usDirection;
+		int16_t sResult;			//驱动接口的返回值
+		uint32_t uThreadId;
+	};
+
+	//导出文件头，之后紧跟uCount条记录(从旧到新)
+	struct REG_TRACE_FILE_HEADER
+	{
+		uint32_t uMagic;
+		uint32_t uVersion;
+		uint64_t uTickFrequency;
+		uint64_t uBaseTick;			//与uBaseFileTime同一时刻的计数值，用于把计数换算为时间
+		uint64_t uBaseFileTime;		//UTC FILETIME
+		uint64_t uCount;
+	};
+#pragma pack(pop)
+
+	static RegTrace& Ins();
+
+	void Enable(bool bEnable) { m_bEnable.store(bEnable, std::memory_order_relaxed); }
+	bool IsEnabled() const { return m_bEnable.load(std::memory_order_relaxed); }
+
+	//函数功能: 记录一次寄存器访问，关闭时直接返回
+	void Record(int iDirection, uint64_t uBase, uint32_t uOffset, uint64_t uValue, int iResult)
+	{
+		if (!m_bEnable.load(std::memory_order_relaxed))
+			return;
+
+		LARGE_INTEGER tick;
+		QueryPerformanceCounter(&tick);
+
+		uint64_t pos = m_uWritePos.fetch_add(1, std::memory_order_relaxed);
+		Slot& slot = m_slots[pos & m_uMask];
+		//先作废序号再写内容，读者据此跳过写到一半的记录
+		slot.uSeq.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.record.uTick = (uint64_t)tick.QuadPart;
+		slot.record.uValue = uValue;
+		slot.record.uBase = (uint32_t)uBase;
+		slot.record.uOffset = uOffset;
+		slot.record.usDirection = (uint16_t)iDirection;
+		slot.record.sResult = (int16_t)iResult;
+		slot.record.uThreadId = GetCurrentThreadId();
+		slot.uSeq.store(pos + 1, std::memory_order_release);
+	}
+
+	//函数功能: 取出环中现有的记录，从旧到新
+	void Snapshot(std::vector<REG_TRACE_RECORD>& records) const;
+	//函数功能: 导出二进制跟踪文件，供DecodeFile离线解码
+	bool DumpBinary(const std::string& strFile) const;
+	//函数功能: 把环中的记录解码为文本
+	bool DumpText(const std::string& strFile) const;
+	//函数功能: 把DumpBinary导出的文件解码为文本，每行 时间 线程 方向 基地址 偏移 值 返回值
+	static bool DecodeFile(const std::string& strBinaryFile, const std::string& strTextFile);
+
+	uint64_t GetRecordCount() const { return m_uWritePos.load(std::memory_order_relaxed); }
+
+private:
+	struct Slot
+	{
+		std::atomic<uint64_t> uSeq;		//0为无效，否则为写入位置+1
+		REG_TRACE_RECORD record;
+	};
+
+	RegTrace();
+	virtual ~RegTrace();
+
+	void FillHeader(REG_TRACE_FILE_HEADER& header, uint64_t uCount) const;
+	static bool WriteText(const REG_TRACE_FILE_HEADER& header, const REG_TRACE_RECORD* pRecords, const std::string& strFile);
+
+	RegTrace(const RegTrace&);
+	void operator = (const RegTrace&);
+
+private:
+	std::unique_ptr<Slot[]> m_slots;
+	uint64_t m_uMask;
+	std::atomic<bool> m_bEnable;
+	alignas(64) std::atomic<uint64_t> m_uWritePos;
+
+	uint64_t m_uTickFrequency;
+	uint64_t m_uBaseTick;
+	uint64_t m_uBaseFileTime;
+};
@@ -0,0 +1,68 @@
+﻿#pragma once
+
+#include "QTXdmaApi.h"
+#include <windows.h>
+#include <stdint.h>
+#include <mutex>
+
+//寄存器事务：先收集一组寄存器操作，Flush时按加入顺序一次执行，整组只写一条寄存器日志
+//不同事务之间互斥，一组配置(例如DMA参数块+启动脉冲)不会与其他线程的事务交错
+//任一操作失败时后面的操作不再执行，避免在参数没写进去的情况下产生启动/更新脉冲
+//值未变化的配置寄存器写入和已为0的脉冲前导写入由RegShadow跳过，减少驱动调用次数
+//操作保存在对象内的定长数组中，不分配内存，可在采集线程中使用
+class RegTransaction
+{
+public:
+	enum
+	{
+		MAX_OPS = 32
+	};
+
+	RegTransaction(const char* szName);
+
+	//函数功能: 写寄存器
+	RegTransaction& Write(uint64_t uBase, uint32_t uOffset, uint64_t uValue);
+	//函数功能: 产生上升沿脉冲，依次写0、1、0
+	RegTransaction& Pulse(uint64_t uBase, uint32_t uOffset);
+	//函数功能: 读寄存器，Flush后pValue中为读出的值
+	RegTransaction& Read(uint64_t uBase, uint32_t uOffset, uint64_t* pValue);
+	//函数功能: 回读校验，不经过影子缓存，总是读板卡上的值
+	RegTransaction& ReadBack(uint64_t uBase, uint32_t uOffset, uint64_t* pValue);
+
+	//函数功能: 按顺序执行所有操作，执行后事务清空可重新使用
+	//函数返回: 成功返回0，否则返回第一个失败操作的返回值；操作数超过MAX_OPS时返回-1且不执行
+	int Flush(STXDMA_CARDINFO* pCardInfo);
+
+	int GetOpCount() const { return m_iOpCount; }
+
+private:
+	enum OpType
+	{
+		OP_WRITE = 0,
+		OP_PULSE,
+		OP_READ,
+		OP_READ_BACK
+	};
+
+	struct Op
+	{
+		int iType;
+		uint64_t uBase;
+		uint32_t uOffset;
+		uint64_t uValue;
+		uint64_t* pValue;
+	};
+
+	RegTransaction& Add(int iType, uint64_t uBase, uint32_t uOffset, uint64_t uValue, uint64_t* pValue);
+
+	RegTransaction(const RegTransaction&);
+	void operator = (const RegTransaction&);
+
+private:
+	const char* m_szName;
+	Op m_ops[MAX_OPS];
+	int m_iOpCount;
+	bool m_bOverflow;
+
+	static std::mutex s_mutex;
+};
@@ -0,0 +1,86 @@
+﻿#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+//离线回放：把录制的原始文件映射到内存，按块填入ping缓存池并放入可用队列，
+//和中断线程走同一条路径，之后的写盘/压缩/容器等环节不需要区分数据来源
+//支持普通原始文件和RawContainer分段文件(按索引取块，压缩块先解压)
+//可以全速回放(测试流水线吞吐)或按指定数据率回放(模拟实时采集)
+class ReplaySource
+{
+public:
+	enum
+	{
+		READ_AHEAD_BYTES = 256 * 1024 * 1024	//预读窗口
+	};
+
+	//非循环回放到文件末尾正常结束时在回放线程中调用，Stop中止时不调用；回调返回后IsRunning才变为false
+	typedef void (*FinishCallback)(void* pContext);
+
+	ReplaySource();
+	virtual ~ReplaySource();
+
+	//函数功能: 映射文件并生成块列表
+	//函数参数：uChunkBytes：普通原始文件的分块大小，0或超过缓存池块大小时取缓存池块大小；容器文件按索引分块
+	bool Open(const std::string& strFileName, uint32_t uChunkBytes);
+	void Close();
+	bool IsOpen() const { return m_pView != NULL; }
+	bool IsContainer() const { return m_bContainer; }
+	int GetBlockCount() const { return (int)m_blocks.size(); }
+
+	//函数功能: 启动回放线程
+	//函数参数：dRateMBps：回放数据率，0为全速  bLoop：到文件末尾后从头开始
+	bool Start(double dRateMBps, bool bLoop);
+	void Stop();
+	bool IsRunning() const { return m_bRunning.load(std::memory_order_relaxed); }
+	bool IsLoop() const { return m_bLoop; }
+	void SetFinishCallback(FinishCallback pfnCallback, void* pContext);
+
+	uint64_t GetBytesReplayed() const { return m_uBytes.load(std::memory_order_relaxed); }
+	uint64_t GetBlocksReplayed() const { return m_uBlocks.load(std::memory_order_relaxed); }
+	uint64_t GetStallCount() const { return m_uStalls.load(std::memory_order_relaxed); }	//缓存池耗尽等待次数
+	double GetThroughputMBps() const;
+
+private:
+	struct Block
+	{
+		uint64_t uOffset;
+		uint32_t uStoredBytes;
+		uint32_t uRawBytes;
+		bool bCompressed;
+	};
+
+	void ReplayThread();
+	bool FeedBlock(const Block& block);
+	void ReadAhead(uint64_t uOffset);
+
+	ReplaySource(const ReplaySource&);
+	void operator = (const ReplaySource&);
+
+private:
+	HANDLE m_hFile;
+	HANDLE m_hMapping;
+	const uint8_t* m_pView;
+	uint64_t m_uFileSize;
+	bool m_bContainer;
+	std::vector<Block> m_blocks;
+	uint64_t m_uPrefetched;			//已发起预读的位置，只在回放线程中访问
+
+	double m_dRateMBps;
+	bool m_bLoop;
+	FinishCallback m_pfnFinish;
+	void* m_pFinishContext;
+	std::thread m_thread;
+	std::atomic<bool> m_bStop;
+	std::atomic<bool> m_bRunning;
+
+	std::atomic<uint64_t> m_uBytes;
+	std::atomic<uint64_t> m_uBlocks;
+	std::atomic<uint64_t> m_uStalls;
+	std::atomic<uint64_t> m_uElapsedMs;
+};
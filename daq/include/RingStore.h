@@ -0,0 +1,89 @@
+﻿#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+//定容环形数据存储，单写者、多读者
+//每个读者通过独立游标读取；写满后按策略覆盖最旧数据或阻塞写者等待最慢的读者
+//可选以文件映射作为后备存储
+class RingStore
+{
+public:
+	enum FullPolicy
+	{
+		FULL_OVERWRITE = 0,	//覆盖最旧数据，落后的读者会丢数据
+		FULL_BLOCK = 1		//阻塞写者直到所有读者腾出空间
+	};
+
+	static const int MAX_CURSOR = 8;
+
+	RingStore();
+	virtual ~RingStore();
+
+	//函数功能: 创建存储区
+	//函数参数：uCapacity：容量(字节)  iPolicy：写满策略  strFilePath：为空时使用内存，否则映射到该文件
+	//函数返回: 成功返回true
+	bool Create(uint64_t uCapacity, int iPolicy, const std::string& strFilePath = "");
+	void Destroy();
+	bool IsCreated() const { return m_pBase != NULL; }
+
+	//函数功能: 写入数据(只允许一个写线程)，没有打开的游标时只推进写位置、不拷贝数据
+	//函数返回: FULL_BLOCK策略下被Interrupt唤醒时返回false
+	bool Write(const void* pData, uint64_t uBytes);
+
+	//函数功能: 打开一个读游标，从当前写位置开始读
+	//函数返回: 游标号，游标用完返回-1
+	int OpenCursor();
+	void CloseCursor(int iCursor);
+
+	//函数功能: 从游标读取数据
+	//函数参数：uBytes：最多读取字节数  uTimeoutMs：无数据时的等待时间，0为不等待
+	//          pLost：返回读取前被覆盖而丢失的字节数
+	//函数返回: 实际读取的字节数
+	uint64_t Read(int iCursor, void* pDst, uint64_t uBytes, DWORD uTimeoutMs = 0, uint64_t* pLost = NULL);
+
+	//游标可读字节数
+	uint64_t Available(int iCursor) const;
+
+	//唤醒阻塞的写者和读者(停止采集时调用)
+	void Interrupt();
+	//清除Interrupt标志，重新开始采集前调用
+	void ResetInterrupt();
+
+	uint64_t GetCapacity() const { return m_uCapacity; }
+	uint64_t GetWritePos() const { return m_uWritePos.load(std::memory_order_acquire); }
+	uint64_t GetOverwrittenBytes() const { return m_uOverwritten.load(std::memory_order_relaxed); }
+
+private:
+	void CopyIn(uint64_t uPos, const uint8_t* pSrc, uint64_t uBytes);
+	void CopyOut(uint64_t uPos, uint8_t* pDst, uint64_t uBytes) const;
+	uint64_t MinCursorPos() const;
+	bool HasCursor() const;
+
+	RingStore(const RingStore&);
+	void operator = (const RingStore&);
+
+private:
+	uint8_t* m_pBase;
+	uint64_t m_uCapacity;
+	int m_iPolicy;
+
+	HANDLE m_hFile;
+	HANDLE m_hMapping;
+
+	std::atomic<uint64_t> m_uWritePos;		//已写完的位置(单调递增)
+	std::atomic<uint64_t> m_uReservePos;	//正在写入区域的末尾，读者据此判断数据是否被覆盖
+	std::atomic<uint64_t> m_uOverwritten;	//读者丢失的字节数累计
+
+	std::atomic<uint64_t> m_uCursorPos[MAX_CURSOR];
+	std::atomic<bool> m_bCursorUsed[MAX_CURSOR];
+
+	std::atomic<bool> m_bInterrupt;
+	std::mutex m_mutex;
+	std::condition_variable m_cvSpace;	//阻塞策略下写者等待空间
+	std::condition_variable m_cvData;	//读者等待数据
+};
@@ -0,0 +1,138 @@
+﻿#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "DirectDiskWriter.h"
+#include "RawContainer.h"
+
+//分段文件存储：按大小或时间轮换文件，当前分段接近轮换条件时由后台线程提前创建并预分配下一个分段，
+//旧分段也由后台线程关闭，写线程只需切换句柄；每个分段关闭后追加到清单文件
+//Submit/Poll/Close只允许一个线程调用；完成回调可能在写线程或后台线程中执行
+//启用容器格式时每个分段为一个RawContainer文件，文件头和索引尾以META_BUFFER_INDEX提交，回调中应忽略；
+//数据块在写完成回调中登记到索引，写失败的块不进索引
+class SegmentFileStore
+{
+public:
+	enum { META_BUFFER_INDEX = -1 };
+	enum { PRECREATE_LEAD_MS = 5000 };	//按时间轮换时提前创建下一个分段的时间
+
+	SegmentFileStore();
+	virtual ~SegmentFileStore();
+
+	//函数功能: 设置轮换策略，Open前调用
+	//函数参数：uMaxBytes：单个分段最大字节数，0为不限  uMaxSeconds：单个分段最长时间，0为不限
+	void SetPolicy(uint64_t uMaxBytes, DWORD uMaxSeconds);
+	void SetCompleteCallback(DirectDiskWriter::CompleteCallback pfnCallback, void* pContext);
+	//函数功能: 设置容器格式，Open前调用
+	//函数参数：strConfig：写入文件头的配置快照  uSegmentBytes：单次触发段字节数  uSegmentsPerBlock：每块触发段数
+	void SetContainer(bool bEnable, const std::string& strConfig, uint32_t uSegmentBytes, uint32_t uSegmentsPerBlock);
+
+	//函数功能: 创建第一个分段并启动后台线程
+	//函数参数：strDir：目录  strPrefix：文件名前缀，分段名为 prefix_00000.bin，清单为 prefix_manifest.csv
+	//          iQueueDepth：每个分段的未完成写请求数  uPreallocBytes：不按大小轮换时每个分段的预分配大小
+	bool Open(const std::string& strDir, const std::string& strPrefix, int iQueueDepth, uint64_t uPreallocBytes);
+	void Close();
+	bool IsOpen() const { return m_pCurrent != NULL; }
+
+	//函数功能: 写入一个缓存，达到轮换条件时先切换到下一个分段
+	//函数返回: 提交失败返回false，此时不会触发回调
+	bool Submit(int iBufferIndex, const void* pData, uint32_t uBytes);
+	int Poll();
+	//下一次Submit时切换到新分段(当前分段为空时忽略)，用于让每段连续记录单独成文件
+	void RequestRotate() { m_bRotateRequested = true; }
+
+	int GetSegmentIndex() const { return m_iSegment; }
+	uint64_t GetBytesWritten() const;
+	double GetThroughputMBps() const;
+
+private:
+	//已提交、等待写完成后登记的块
+	struct PendingBlock
+	{
+		uint64_t uSequence;
+		uint64_t uOffset;
+		const void* pData;
+		uint32_t uBytes;
+		uint64_t uFirstSegment;
+	};
+
+	//分段的容器和待登记的块，作为该分段写完成回调的上下文；分段在线程间移动时地址不变
+	//只由当前持有该分段的线程(写线程或后台线程)访问
+	struct SegmentIndex
+	{
+		SegmentFileStore* pStore;
+		std::unique_ptr<RawContainer> pContainer;
+		std::deque<PendingBlock> pending;	//按提交顺序，与完成回调的顺序一致
+	};
+
+	struct Segment
+	{
+		std::unique_ptr<DirectDiskWriter> pWriter;
+		std::unique_ptr<SegmentIndex> pIndex;
+		int iIndex;
+		std::string strFileName;
+		SYSTEMTIME tmStart;
+	};
+
+	std::string SegmentFileName(int iIndex) const;
+	bool OpenSegment(Segment& seg, int iIndex);
+	bool NeedRotate(uint32_t uBytes) const;
+	bool NearRotate(uint32_t uBytes) const;
+	void RequestNext();
+	bool Rotate();
+	void RetireSegment(Segment& seg);
+	void AppendManifest(const Segment& seg);
+	void BackgroundThread();
+	static void OnSegmentWriteComplete(void* pContext, int iBufferIndex, DWORD dwError);
+
+	SegmentFileStore(const SegmentFileStore&);
+	void operator = (const SegmentFileStore&);
+
+private:
+	std::string m_strDir;
+	std::string m_strPrefix;
+	std::string m_strManifest;
+	int m_iQueueDepth;
+	uint64_t m_uPreallocBytes;
+	uint64_t m_uMaxBytes;
+	DWORD m_uMaxSeconds;
+
+	bool m_bContainer;
+	std::string m_strConfig;
+	uint32_t m_uSegmentBytes;
+	uint32_t m_uSegmentsPerBlock;
+
+	DirectDiskWriter::CompleteCallback m_pfnCallback;
+	void* m_pContext;
+
+	//以下只在写线程中访问
+	DirectDiskWriter* m_pCurrent;
+	Segment m_current;
+	ULONGLONG m_uSegmentStartMs;
+	int m_iSegment;
+	int m_iSegmentBlocks;			//当前分段已写入的块数
+	bool m_bRotateRequested;
+	bool m_bNextRequested;			//已请求后台线程创建下一个分段
+	uint64_t m_uBlockSeq;			//块序号
+	uint64_t m_uTrigSegment;		//下一块第一个触发段的序号
+
+	//以下由m_mutex保护
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	Segment m_next;					//后台线程提前创建的下一个分段
+	bool m_bNextWanted;				//需要创建下一个分段
+	bool m_bNextFailed;
+	std::deque<Segment> m_retired;	//等待后台线程关闭的分段
+	bool m_bStop;
+	std::thread m_thread;
+
+	std::atomic<uint64_t> m_uClosedBytes;	//已关闭分段的写入字节数
+};
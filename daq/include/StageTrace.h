@@ -0,0 +1,106 @@
+﻿#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <memory>
+
+//流水线阶段事件跟踪：各线程把阶段的起止时间记录到自己的缓存(只有本线程写，无锁)，
+//导出为Chrome trace / Perfetto可读的JSON，在时间线上查看中断等待、DMA读、解交织、交接、写盘等阶段的重叠和停顿
+//每线程缓存写满后覆盖最早的事件；关闭时STAGE_TRACE_SCOPE只做一次标志判断
+class StageTrace
+{
+public:
+	enum
+	{
+		EVENTS_PER_THREAD = 65536,	//每条32字节，每线程2MB，首次记录时分配
+		MAX_THREADS = 256			//超过后新线程的事件丢弃
+	};
+
+	static void Enable(bool bEnable) { s_bEnable.store(bEnable, std::memory_order_relaxed); }
+	static bool IsEnabled() { return s_bEnable.load(std::memory_order_relaxed); }
+	static uint64_t Now() { LARGE_INTEGER tick; QueryPerformanceCounter(&tick); return (uint64_t)tick.QuadPart; }
+
+	//函数功能: 设置当前线程在时间线上显示的名字，线程开始时调用；不分配缓存
+	static void SetThreadName(const char* szName);
+	//函数功能: 记录一个完整事件
+	//函数参数：szName：阶段名，必须是静态字符串  iArg：附加值(缓存号、字节数等)，导出到args
+	static void AddEvent(const char* szName, uint64_t uBeginTick, uint64_t uEndTick, int64_t iArg);
+
+	//函数功能: 导出所有线程的事件，用 chrome://tracing 或 ui.perfetto.dev 打开
+	static bool ExportJson(const std::string& strFile);
+	//函数功能: 清空已记录的事件，释放已退出线程的缓存
+	static void Clear();
+
+private:
+	struct Event
+	{
+		const char* szName;
+		uint64_t uBegin;
+		uint64_t uEnd;
+		int64_t iArg;
+	};
+
+	struct ThreadBuffer
+	{
+		DWORD dwThreadId;
+		char szName[32];
+		std::unique_ptr<Event[]> events;
+		std::atomic<uint64_t> uCount;	//累计写入数，只有所属线程增加
+		std::atomic<uint64_t> uCleared;	//Clear时的uCount，导出从这里开始
+		std::atomic<bool> bExited;
+	};
+
+	//线程退出时标记缓存，导出后可以释放
+	struct ThreadSlot
+	{
+		ThreadSlot() : pBuffer(NULL) { szName[0] = '\0'; }
+		~ThreadSlot();
+		ThreadBuffer* pBuffer;
+		char szName[32];
+	};
+
+	static ThreadSlot& CurrentSlot();
+	static ThreadBuffer* AcquireBuffer(ThreadSlot& slot);
+
+	static std::atomic<bool> s_bEnable;
+	static std::mutex s_mutex;
+	static std::vector<ThreadBuffer*> s_buffers;
+};
+
+//作用域事件：构造时记开始时间，析构或End时记录
+class StageTraceScope
+{
+public:
+	StageTraceScope(const char* szName, int64_t iArg = 0)
+	:m_szName(szName)
+	,m_iArg(iArg)
+	,m_uBegin(StageTrace::IsEnabled() ? StageTrace::Now() : 0)
+	{
+	}
+	~StageTraceScope() { End(); }
+
+	void SetArg(int64_t iArg) { m_iArg = iArg; }
+	//提前结束，之后析构不再记录
+	void End()
+	{
+		if (m_uBegin != 0)
+			StageTrace::AddEvent(m_szName, m_uBegin, StageTrace::Now(), m_iArg);
+		m_uBegin = 0;
+	}
+
+private:
+	StageTraceScope(const StageTraceScope&);
+	void operator = (const StageTraceScope&);
+
+	const char* m_szName;
+	int64_t m_iArg;
+	uint64_t m_uBegin;
+};
+
+#define STAGE_TRACE_CONCAT2(a, b) a##b
+#define STAGE_TRACE_CONCAT(a, b) STAGE_TRACE_CONCAT2(a, b)
+#define STAGE_TRACE_SCOPE(name, arg) StageTraceScope STAGE_TRACE_CONCAT(stageTrace_, __LINE__)(name, arg)
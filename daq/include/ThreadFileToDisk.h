@@ -20,7 +20,15 @@
 
 #include "databuffer.h"
 
-#include "lock_free_queue.h"
+#include "spsc_index_ring.h"
+#include "free_index_list.h"
+#include "RingStore.h"
+#include "SegmentFileStore.h"
+#include "BlockCompressor.h"
+#include "NumaAllocator.h"
+#include "WriterPool.h"
+#include "RawContainer.h"
+#include "PreTriggerGate.h"
 #include <iostream>
 #include <thread>
 #include <atomic>
@@ -32,6 +40,20 @@ typedef struct
 	unsigned char * m_memAddr;//缓存地址
 }HWCCCEVENT;
 
+//采集流水线统计
+typedef struct
+{
+	double dIngestMBps;				//进入缓存池的数据率
+	double dWriterMBps;				//写盘(或压缩)完成归还缓存的数据率
+	int iFree;						//空闲缓存数
+	int iAvail;						//等待写盘的缓存数
+	int iInUseHighWater;			//同时被占用的缓存数峰值
+	int iAvailHighWater;			//等待写盘队列深度峰值
+	uint64_t uPoolExhausted;		//取空闲缓存时缓存池为空的次数
+	uint64_t uDropped;				//可用队列满而丢弃的块数
+	uint64_t uRingOverwritten;		//原始数据环覆盖的字节数
+}PIPELINE_STATS;
+
 //typedef std::list <databuffer> CCCEventList;
 typedef std::deque <int> CCCEventList;
 
@@ -40,6 +62,9 @@ typedef std::vector<databuffer *> VECTOR_BUFFER;
 class ThreadFileToDisk
 {
 public:
+	//缓存池最多的块数，即可用缓存环的槽数；缓存池不超过该值，所有块同时待写时环也不会满
+	static const int MAX_POOL_BLOCKS = 10240;
+
     ThreadFileToDisk();
     virtual ~ThreadFileToDisk();
     static ThreadFileToDisk& Ins();
@@ -48,8 +73,22 @@ public:
 	void set_filePath_Pong(const std::string &filepath);
 	void set_fileBlockType(int iType);
     void set_toDiskType(int iType);
+	//设置写盘：iQueueDepth为同时未完成的写请求数，uPreallocBytes为文件预分配大小
+	void set_diskWriter(bool bEnable, int iQueueDepth, uint64_t uPreallocBytes);
+	//设置分段轮换：uMaxBytes单个文件最大字节数，uMaxSeconds单个文件最长时间，0为不限
+	void set_segmentPolicy(uint64_t uMaxBytes, DWORD uMaxSeconds);
+	//设置写盘前的无损压缩：iThreadCount压缩线程数，iChannels交织通道数；在StartPing前设置
+	void set_compression(bool bEnable, int iThreadCount, int iChannels);
+	//设置自描述容器格式：strConfig为写入文件头的配置快照，第一块数据到达前设置有效
+	void set_container(bool bEnable, const std::string& strConfig, uint32_t uSegmentBytes, uint32_t uSegmentsPerBlock);
+	//设置缓存池内存：bLargePages优先用大页，iNumaNode为-1时绑定到采集卡所在的NUMA节点；在initDataFileBuffer前设置
+	void set_poolMemory(bool bLargePages, int iNumaNode);
+	//设置多文件模式(FileBlockType不为2)的写盘线程数；在StartPing前设置
+	void set_writerPool(int iThreadCount);
 public:
+	//函数功能: 启动写盘线程，每次采集(或回放)开始时调用，文件在第一块数据到达时创建
 	bool StartPing();
+	//函数功能: 写完可用队列中的数据、关闭文件后结束写盘线程，采集(或回放)结束时调用
 	bool StopPing();
 
 	bool StartPong();
@@ -60,10 +99,18 @@ public:
 public:
 	void PushAvailToListPing(const int& iBufferIndex);
 	void PopAvailFromListPing(int& iBufferIndex);
+	//函数功能: 取一个可用缓存，没有时最多等待dwTimeoutMs毫秒，有新数据或停止时立即返回
+	void WaitAvailFromListPing(int& iBufferIndex, DWORD dwTimeoutMs);
 	void PushAvailToListPong(const int& iBufferIndex);
 	void PopAvailFromListPong(int& iBufferIndex);
 
 	void CheckFreeBuffer(int& iBufferIndex);
+	uint64_t GetFreeExhaustedCountPing();
+
+	//函数功能: 读取ping流水线统计，速率按与上次调用之间的计数差计算
+	void GetStatsPing(PIPELINE_STATS& stats);
+	//清零计数和峰值，StartPing时调用
+	void ResetStatsPing();
 
     int GetAvailSizePing();
     int GetFreeSizePing();
@@ -78,9 +125,34 @@ public:
 	static UINT EventReporter(LPVOID lParam);
 	static UINT SingleFilePing(LPVOID lParam);
 	static UINT SingleFilePong(LPVOID lParam);
+	static void OnDiskWriteCompletePing(void* pContext, int iBufferIndex, DWORD dwError);
+	static bool SubmitSegmentPing(int iBufferIndex, const void* pData, uint32_t uBytes);
+	static void OnSegmentWriteCompletePing(void* pContext, int iBufferIndex, DWORD dwError);
+	static void OnCompressInputDonePing(void* pContext, int iBufferIndex);
+	static void SubmitCompressedPing();
+	static void OpenDiskWriterPing();
+	//函数功能: 经事件触发记录筛选，commit返回本次应写盘的缓存
+	//函数返回: 开始一段新的记录时返回true
+	static bool GateBufferPing(int iBufferIndex, std::vector<int>& commit);
+	static void ReleaseGatedPing();
+	static void OpenWriterPoolPing();
+	static void CloseWriterPoolPing();
+	static void OnPoolWriteCompletePing(void* pContext, int iBufferIndex, uint64_t uSequence, uint64_t uOffset,
+		const void* pData, uint32_t uBytes, DWORD dwError);
 
     void initDataFileBufferPing(int iBlockSize, int iBlockCount, int iTotalSize);
+	//函数功能: 按新的块大小(MB)和块数重建ping缓存池，只在所有缓存都已归还(两次采集之间)时允许
+	//          块数超过MAX_POOL_BLOCKS时按MAX_POOL_BLOCKS分配
+	//函数返回: 有缓存仍在使用或分配失败时返回false
+	bool ResizePool(int iBlockSize, int iBlockCount);
+	int GetPoolBlockCount() const { return m_iBlockSize; }
+	int GetPoolBlockSize() const { return m_iPoolBlockSizeMB; }
 	void initDataFileBufferPong(int iBlockSize, int iTotalSize);
+
+	//函数功能: 创建ping定容原始数据环，供在线读取最新数据；默认不创建
+	//函数参数：uCapacity：容量(字节)，0为释放数据环  iPolicy：RingStore::FullPolicy
+	//          strFilePath：为空时使用内存，否则映射到文件
+	bool initRawRing(uint64_t uCapacity, int iPolicy, const std::string& strFilePath = "");
 public:
     //databuffer m_databufferPing[10240];
 	//databuffer m_databufferPong[10240];
@@ -89,9 +161,12 @@ public:
 
     int m_iDataSpeed;
 private:
+	static void UpdateHighWater(std::atomic<int>& iHighWater, int iValue);
+
     //CCCEventList m_availListPing;
 
-    CCCEventList m_freeListPing;
+    FreeIndexList m_freeListPing;//空闲缓存索引，O(1)取还
+	SpscIndexRing m_availListPing;//可用缓存索引，中断线程到写盘线程的单生产者单消费者交接
 
 	CCCEventList m_availListPong;
 	CCCEventList m_freeListPong;
@@ -99,10 +174,9 @@ private:
 	HANDLE m_hThread;
     ULONG m_ulThreadID;
 	
-    mt::Mutex m_MutexFreePing;
-    mt::Mutex m_MutexAvailPing;
 	mt::Mutex m_MutexFreePong;
 	mt::Mutex m_MutexAvailPong;
+	mt::Mutex m_MutexConfig;//容器配置在采集线程和写盘线程之间传递
     bool m_bIsRunPing;
     bool m_bIsRunPong;
 public:
@@ -116,8 +190,55 @@ public:
 
     static bool m_bInterrupt;
 
-	std::vector<int16_t> m_rawDataPing;
-	std::vector<int16_t> m_rawDataPong;
+	//原始数据环，消费者通过OpenCursor/Read独立读取
+	RingStore m_rawRingPing;
+	RingStore m_rawRingPong;
+
+	SegmentFileStore m_segmentStorePing;//只在SingleFilePing线程中使用
+	std::string m_strSessionPing;//本次采集的开始时间，加在文件名中，每次采集写入新文件
+	bool m_bWriteDisk;
+	int m_iWriteQueueDepth;
+	uint64_t m_uPreallocBytes;
+	uint64_t m_uSegmentMaxBytes;
+	DWORD m_uSegmentMaxSeconds;
+
+	BlockCompressor m_compressorPing;
+	bool m_bCompress;
+	int m_iCompressThreads;
+	int m_iCompressChannels;
+
+	bool m_bContainer;
+	std::string m_strContainerConfig;
+	uint32_t m_uContainerSegmentBytes;
+	uint32_t m_uContainerSegmentsPerBlock;
+
+	bool m_bPoolLargePages;
+	int m_iPoolNumaNode;
+	int m_iPoolBlockSizeMB;
+
+	//多文件模式：EventReporter单线程分发，写盘线程池按预分配的偏移并行写，完成按序登记索引
+	WriterPool m_writerPoolPing;
+	int m_iWriterThreads;
+	RawContainer* m_pPoolContainerPing;//只在按序完成回调和EventReporter线程中访问
+	uint64_t m_uPoolTrigSegment;
+
+	//事件触发记录，Offer/Drain在写盘线程(SingleFilePing或EventReporter)中调用
+	PreTriggerGate m_preTriggerPing;
+
+	//流水线计数，各自只由一个线程累加，用relaxed原子操作
+	std::atomic<uint64_t> m_uIngestBytesPing;//中断(或回放)线程
+	std::atomic<uint64_t> m_uRetiredBytesPing;//写盘完成回调
+	std::atomic<uint64_t> m_uDroppedPing;
+	std::atomic<int> m_iAvailHighWaterPing;
+	std::atomic<int> m_iInUseHighWaterPing;
+	std::atomic<int> m_iSegmentPendingPing;//已提交给分段写盘、尚未完成的写请求数，决定写盘线程的等待时间
+	//速率采样点，只在GetStatsPing中访问
+	mt::Mutex m_MutexStats;
+	uint64_t m_uStatsIngestBytes;
+	uint64_t m_uStatsRetiredBytes;
+	ULONGLONG m_uStatsTickMs;
+	double m_dIngestMBps;
+	double m_dWriterMBps;
 
 
 };
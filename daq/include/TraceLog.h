@@ -13,7 +13,9 @@ Include
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <io.h>
+#include <stdarg.h>
 #include <string>
+#include <atomic>
 
 #include "Log_Lock.h"
 
@@ -111,8 +113,9 @@ public:
 	Log_TraceLog(std::string fname,bool bAddDateInFileName);
 	virtual ~Log_TraceLog();
 
-	void TraceNoTime(long level, const char *format ,...);	//Чʱ
-	void Trace(long level, const char *format ,...);		//Чʱ
+	void TraceNoTime(long level, const char *format ,...);	//最高效：不带时间戳
+	void Trace(long level, const char *format ,...);		//高效：带时间戳
+	void TraceV(long level, const char *format, va_list args);
 	void TraceInfo(long level, const char *format ,...);
 	void LogTime(long level);
 	void TraceLevel(long level);
@@ -120,12 +123,52 @@ public:
 	std::string GetDateTimeString(long timestringtype = TIMESTRING_NORMAL);
 	static std::string GetDateString();
 	std::string GetTimeString();
-	std::string GetTraceLevelTypeString();						//ȡ־
+	std::string GetTraceLevelTypeString();						//获取日志级别名称
 	std::string GetLogName();
 	int		GetLogLevel();
 	unsigned long GetMaxSize();
 	bool	SetMaxSize(unsigned long nSize);
-	void Working();											//ѭɾʱļ	
+	void Working();											//循环，删除超时的文件	
+
+	//函数功能: 切换到异步写日志：调用线程只把格式化后的文本放入定长记录环(无锁、不做文件操作)，
+	//          后台线程加时间戳、批量写入并处理按日期和大小的切换；环满时丢弃并计数，不阻塞调用线程
+	//函数参数：iRecordCount：记录数，向上取整为2的幂，每条记录最多ASYNC_TEXT_BYTES-1个字符
+	//函数返回: 成功或已经是异步模式返回true
+	bool StartAsync(int iRecordCount = 4096);
+	//函数功能: 停止后台线程，写出剩余记录后回到同步模式；须在DLL卸载前调用(析构时在加载器锁内不能等待线程)
+	void StopAsync();
+	bool IsAsync() const { return m_bAsync.load(std::memory_order_acquire); }
+	unsigned long long GetAsyncDropped() const { return m_uAsyncDropped.load(std::memory_order_relaxed); }
+	void AsyncWorking();									//异步模式的写日志线程
+
+	enum
+	{
+		ASYNC_TEXT_BYTES = 1000,		//与printfLog原来的缓存长度相当
+		ASYNC_FLUSH_MS = 50,			//后台线程最长间隔
+		ASYNC_BATCH_BYTES = 64 * 1024	//每次fwrite的最大长度
+	};
+
+private:
+	//异步日志记录，按Vyukov环的方式用序号标记可写/可读
+	struct AsyncRecord
+	{
+		std::atomic<size_t> uSeq;
+		FILETIME ftTime;
+		long lLevel;
+		int iKind;
+		int iLength;
+		char szText[ASYNC_TEXT_BYTES];
+	};
+	enum { ASYNC_KIND_TIME = 0, ASYNC_KIND_NOTIME = 1, ASYNC_KIND_TIMEONLY = 2 };
+
+	//调用线程进入/离开异步写入；进入时计数，StopAsync等计数归零后才停后台线程，不会漏掉已取得记录的调用
+	bool AsyncEnter();
+	void AsyncLeave();
+	AsyncRecord* AsyncClaim(size_t& pos);
+	void AsyncPublish(AsyncRecord* rec, size_t pos, long level, int kind);
+	void AsyncPush(long level, int kind, const char *format, va_list args);
+	void AsyncDrain();
+	void RotateFile(int size);
 
 private:
 	long				m_Level;
@@ -136,10 +179,26 @@ private:
 	std::string			m_strCurDate;
 	std::string			m_strPrefix;
 private:
-	//Զ־ɾ߳̿
+	//自动日志删除的线程控制
 	HANDLE				m_Thread;
 	DWORD				m_ThreadID;
-	
+
+	//异步模式
+	std::atomic<bool>	m_bAsync;
+	std::atomic<bool>	m_bAsyncStop;
+	std::atomic<bool>	m_bAsyncDone;			//后台线程已写完退出
+	AsyncRecord*		m_pAsyncRing;
+	size_t				m_uAsyncMask;
+	std::atomic<size_t>	m_uAsyncWrite;
+	std::atomic<size_t>	m_uAsyncRead;
+	std::atomic<unsigned long long> m_uAsyncDropped;
+	std::atomic<int>	m_iAsyncInFlight;		//正在写入异步环的调用线程数
+	unsigned long long	m_uAsyncDroppedReported;
+	char*				m_pAsyncBatch;
+	unsigned long		m_uAsyncFileSize;		//当前文件长度，代替每行调用_filelength
+	HANDLE				m_hAsyncEvent;
+	HANDLE				m_hAsyncThread;
+
 };
 
 /***********************************************************
@@ -167,7 +226,7 @@ private:
 inline void Log_TraceLog::TraceLevel(long level)
 { 
 	m_Level = level; 
-	Trace(1,"LogLevel Change: %s.", GetTraceLevelTypeString() );
+	Trace(1,"LogLevel Change: %s.", GetTraceLevelTypeString().c_str() );
 }
 
 inline bool Log_TraceLog::Passed(long level)
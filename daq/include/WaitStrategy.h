@@ -0,0 +1,95 @@
+﻿#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <atomic>
+
+//等待统计
+typedef struct
+{
+	uint64_t uWaits;				//等待次数
+	double dPollsPerWait;			//平均每次等待的轮询次数
+	double dAvgWaitUs;				//平均每次等待的时长
+	double dLatencyP50Us;			//唤醒延迟中位数(直方图桶上界)
+	double dLatencyP99Us;			//唤醒延迟99分位(直方图桶上界)
+	double dLatencyMaxUs;			//唤醒延迟最大值
+}WAIT_STATS;
+
+//轮询等待策略：中断/轮询采集循环每次查询未就绪时调用Idle，按策略决定让出CPU的方式
+//  MODE_SPIN      只执行pause，延迟最低，占满一个核(原来的行为)
+//  MODE_YIELD     SwitchToThread让出时间片，没有其他可运行线程时仍接近空转
+//  MODE_SLEEP     Sleep，从1ms开始按倍数退避到上限，CPU占用最低，延迟为毫秒级
+//  MODE_ADAPTIVE  先自旋iSpinCount次，再让出iYieldCount次，之后按Sleep退避
+//唤醒延迟：就绪前最后一次Idle开始到发现就绪的时间，即因让出CPU而晚发现就绪的上界；第一次查询就就绪时为0
+//Begin/Idle/End只由等待线程调用；SetMode在采集线程启动前调用；GetStats和Cancel可在其他线程调用
+class WaitStrategy
+{
+public:
+	enum Mode
+	{
+		MODE_SPIN = 0,
+		MODE_YIELD = 1,
+		MODE_SLEEP = 2,
+		MODE_ADAPTIVE = 3
+	};
+
+	enum
+	{
+		DEFAULT_SPIN_COUNT = 4000,		//约几十微秒
+		DEFAULT_YIELD_COUNT = 100,
+		DEFAULT_MAX_SLEEP_MS = 8,
+		LATENCY_BUCKETS = 32			//第i个桶为[2^(i-1), 2^i)微秒，第0个桶为1微秒以内
+	};
+
+	WaitStrategy();
+
+	void SetMode(int iMode, int iSpinCount = DEFAULT_SPIN_COUNT, int iYieldCount = DEFAULT_YIELD_COUNT, DWORD dwMaxSleepMs = DEFAULT_MAX_SLEEP_MS);
+	int GetMode() const { return m_iMode; }
+
+	//函数功能: 开始一次等待
+	void Begin();
+	//函数功能: 本次查询未就绪，按策略自旋、让出或休眠
+	void Idle();
+	//函数功能: 已就绪，记录本次等待的轮询次数和唤醒延迟
+	void End();
+
+	//函数功能: 取消等待，等待循环在下一次查询前结束(停止采集时调用)；ResetCancel在启动等待线程前调用
+	void Cancel() { m_bCancel.store(true, std::memory_order_release); }
+	void ResetCancel() { m_bCancel.store(false, std::memory_order_relaxed); }
+	bool IsCancelled() const { return m_bCancel.load(std::memory_order_acquire); }
+
+	void GetStats(WAIT_STATS& stats) const;
+	void ResetStats();
+
+	static const char* ModeName(int iMode);
+	//函数返回: 名字无效时返回MODE_SPIN
+	static int ParseMode(const char* szName);
+
+private:
+	uint64_t Now() const { LARGE_INTEGER tick; QueryPerformanceCounter(&tick); return (uint64_t)tick.QuadPart; }
+	void SleepBackoff();
+	double PercentileUs(double dFraction, uint64_t uCount) const;
+
+	WaitStrategy(const WaitStrategy&);
+	void operator = (const WaitStrategy&);
+
+private:
+	int m_iMode;
+	int m_iSpinCount;
+	int m_iYieldCount;
+	DWORD m_dwMaxSleepMs;
+	double m_dUsPerTick;
+
+	//当前等待，只有等待线程访问
+	uint64_t m_uIdleCount;			//空等时间很长时int会溢出
+	DWORD m_dwSleepMs;
+	uint64_t m_uWaitBegin;
+	uint64_t m_uIdleBegin;
+	std::atomic<bool> m_bCancel;
+
+	std::atomic<uint64_t> m_uWaits;
+	std::atomic<uint64_t> m_uPolls;
+	std::atomic<uint64_t> m_uWaitTicks;
+	std::atomic<uint64_t> m_uMaxLatencyTicks;
+	std::atomic<uint64_t> m_histogram[LATENCY_BUCKETS];
+};
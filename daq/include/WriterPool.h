@@ -0,0 +1,117 @@
+﻿#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+//多线程写盘池：提交时按顺序分配序号和文件偏移，各工作线程用自己的无缓冲句柄并行写入预先分配的位置
+//写完成可能乱序，完成回调按序号顺序逐个执行(同一时刻只有一个线程在执行回调)，索引可以按顺序追加
+//Submit只允许一个线程调用；默认文件内容与提交的数据首尾相接，不足一个扇区的尾部暂存，与下一次提交的数据拼接后写入
+//缓存地址按扇区对齐且前面没有暂存尾部时直接写，否则分片拷贝到DirectDiskWriter::BOUNCE_BYTES的中转缓存中写，
+//中转缓存循环使用，数量受未完成请求数限制；Close时补齐写入尾部再截断
+//补齐模式与DirectDiskWriter::SetPadToSector相同，每次提交从扇区边界开始、补零到整扇区
+class WriterPool
+{
+public:
+	//写完成回调，按uSequence(提交序号)顺序执行，dwError为0表示成功
+	typedef void (*CompleteCallback)(void* pContext, int iBufferIndex, uint64_t uSequence, uint64_t uOffset,
+		const void* pData, uint32_t uBytes, DWORD dwError);
+
+	WriterPool();
+	virtual ~WriterPool();
+
+	//函数功能: 创建文件并启动工作线程
+	//函数参数：iThreadCount：写线程数  uPreallocBytes：预分配字节数，0为不预分配
+	bool Open(const std::string& strFileName, int iThreadCount, uint64_t uPreallocBytes);
+	//等待所有写请求完成，把文件截断到实际写入长度后关闭
+	void Close();
+	bool IsOpen() const { return m_hFile != INVALID_HANDLE_VALUE; }
+
+	void SetCompleteCallback(CompleteCallback pfnCallback, void* pContext);
+	void SetPadToSector(bool bPad) { m_bPadToSector = bPad; }
+
+	//函数功能: 提交一次写，未完成的请求达到上限时等待
+	//函数参数：iBufferIndex：回调时原样返回  pOffset：返回该数据在文件中的偏移
+	bool Submit(int iBufferIndex, const void* pData, uint32_t uBytes, uint64_t* pOffset = NULL);
+	//等待所有请求完成并执行完回调
+	void Flush();
+
+	int GetThreadCount() const { return (int)m_threads.size(); }
+	uint32_t GetSectorSize() const { return m_uSectorSize; }
+	//下一次提交的数据在文件中的偏移(补齐模式下含块之间的补齐)
+	uint64_t GetFileOffset() const { return m_uFileOffset; }
+
+	uint64_t GetBytesWritten() const { return m_uBytesWritten.load(std::memory_order_relaxed); }
+	uint64_t GetErrorCount() const { return m_uErrorCount.load(std::memory_order_relaxed); }
+	double GetThroughputMBps() const;
+
+private:
+	//一次提交分成一个或多个写请求，只有最后一个请求回调
+	struct Job
+	{
+		int iBufferIndex;
+		const void* pData;
+		uint32_t uBytes;
+		uint64_t uBlockSeq;			//提交序号，回调时给出
+		uint64_t uSequence;			//请求序号，按它的顺序回调
+		uint64_t uOffset;			//数据在文件中的偏移
+		DWORD dwError;
+		bool bNotify;
+		//实际发出的写：从uWriteOffset开始的整扇区，uWriteBytes为0时数据全部暂存在尾部
+		const void* pWrite;
+		uint32_t uWriteBytes;
+		uint64_t uWriteOffset;
+		uint8_t* pBounce;			//中转缓存，写完归还
+	};
+
+	void QueueJob(Job& job, const void* pWrite, uint32_t uWriteBytes, uint64_t uWriteOffset, bool bNotify);
+	void WorkerThread(HANDLE hFile);
+	void Complete(const Job& job);
+	uint8_t* TakeBounce();
+	void WriteTail();
+
+	WriterPool(const WriterPool&);
+	void operator = (const WriterPool&);
+
+private:
+	HANDLE m_hFile;
+	std::string m_strFileName;
+	uint32_t m_uSectorSize;
+	int m_iMaxPending;
+
+	CompleteCallback m_pfnCallback;
+	void* m_pContext;
+
+	//以下只在提交线程中访问
+	uint64_t m_uFileOffset;			//下一次提交的数据的偏移
+	uint64_t m_uDataEnd;			//最后一块数据的结尾，Close时截断到这里
+	uint64_t m_uSubmitSeq;
+	uint64_t m_uBlockSeq;
+	uint8_t* m_pTail;				//不足一个扇区的尾部，写在 m_uFileOffset - m_uTailBytes 处
+	uint32_t m_uTailBytes;
+	bool m_bPadToSector;
+
+	std::vector<std::thread> m_threads;
+	std::vector<HANDLE> m_workerFiles;
+	std::mutex m_mutex;
+	std::condition_variable m_cvJob;		//工作线程等待任务
+	std::condition_variable m_cvDone;		//提交线程等待空位或全部完成
+	std::deque<Job> m_jobs;
+	std::map<uint64_t, Job> m_done;			//已写完但前面还有未完成的请求
+	std::vector<uint8_t*> m_bounces;		//空闲的中转缓存
+	uint64_t m_uNextComplete;				//下一个要回调的序号
+	bool m_bDelivering;						//有线程正在执行回调
+	DWORD m_dwChainError;					//同一次提交中前面请求的错误，只由正在回调的线程访问
+	bool m_bStop;
+
+	std::atomic<uint64_t> m_uBytesWritten;
+	std::atomic<uint64_t> m_uErrorCount;
+	ULONGLONG m_uOpenMs;
+};
@@ -0,0 +1,32 @@
+﻿#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+//zlib格式(RFC 1950/1951)编码：LZ77 + 固定Huffman表，输出可由zlib/numcodecs的Zlib解码
+//不依赖第三方库，供需要标准格式的输出(如Zarr块)使用；压缩率低于zlib但编码快
+//一个对象同时只能由一个线程使用，哈希表在对象中复用
+class ZlibEncoder
+{
+public:
+	enum
+	{
+		WINDOW_BYTES = 32768,		//deflate的最大回溯距离
+		HASH_BITS = 15,
+		MAX_CHAIN = 16,				//每个位置最多比较的候选数
+		MIN_MATCH = 3,
+		MAX_MATCH = 258
+	};
+
+	ZlibEncoder();
+
+	//函数功能: 编码一块数据
+	//函数参数：pDst：输出缓存，不小于CompressBound(uBytes)
+	//函数返回: 输出字节数，空间不足返回0
+	uint32_t Compress(const void* pSrc, uint32_t uBytes, void* pDst, uint32_t uDstBytes);
+	static uint32_t CompressBound(uint32_t uBytes);
+
+private:
+	std::vector<int32_t> m_head;		//哈希 -> 最近一次出现的位置
+	std::vector<int32_t> m_prev;		//位置(模窗口) -> 同哈希的上一个位置
+};
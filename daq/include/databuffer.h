@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include <stdint.h>
+#include <atomic>
 
 class databuffer
 {
@@ -10,7 +11,7 @@ public:
 public:
     int m_iBufferID;//缓存ID
 	uint8_t * m_bufferAddr;//缓存地址
-	bool m_bAvailable;//缓存是否可用
+	std::atomic<bool> m_bAvailable;//缓存中是否有待处理数据(生产者release写入，消费者acquire读取)
 	bool m_bAllocateMem;//是否已分配空间
     int m_iBufferSize;//申请的空间大小
     int m_iBufferIndex;//缓存索引
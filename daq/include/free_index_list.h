@@ -0,0 +1,96 @@
+﻿#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+//无锁空闲索引链表(Treiber栈)，用于缓存池的O(1)取/还
+//m_head: 高32位为版本号(防止ABA)，低32位为栈顶索引
+//push使用release，pop使用acquire，保证归还前对缓存的写入对下一个取得者可见
+class FreeIndexList
+{
+public:
+	FreeIndexList() : m_head(MakeHead(0, NIL)), m_iCapacity(0), m_iCount(0), m_uExhausted(0) {}
+	~FreeIndexList() {}
+
+	//重置容量，清空链表(非线程安全，只能在采集停止时调用)
+	void reset(int iCapacity)
+	{
+		m_next.reset(iCapacity > 0 ? new std::atomic<uint32_t>[iCapacity] : nullptr);
+		for (int i = 0; i < iCapacity; i++)
+			m_next[i].store(NIL, std::memory_order_relaxed);
+		m_iCapacity = iCapacity;
+		m_iCount.store(0, std::memory_order_relaxed);
+		m_uExhausted.store(0, std::memory_order_relaxed);
+		m_head.store(MakeHead(0, NIL), std::memory_order_release);
+	}
+
+	//归还索引
+	bool push(int iIndex)
+	{
+		if (iIndex < 0 || iIndex >= m_iCapacity)
+			return false;
+
+		uint64_t head = m_head.load(std::memory_order_relaxed);
+		uint64_t newHead;
+		do {
+			m_next[iIndex].store(Index(head), std::memory_order_relaxed);
+			newHead = MakeHead(Tag(head) + 1, (uint32_t)iIndex);
+		} while (!m_head.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+
+		m_iCount.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	//取出索引，链表为空时返回false并累计耗尽次数
+	bool pop(int& iIndex)
+	{
+		uint64_t head = m_head.load(std::memory_order_acquire);
+		for (;;)
+		{
+			uint32_t top = Index(head);
+			if (top == NIL)
+			{
+				m_uExhausted.fetch_add(1, std::memory_order_relaxed);
+				iIndex = -1;
+				return false;
+			}
+
+			uint32_t next = m_next[top].load(std::memory_order_relaxed);
+			if (m_head.compare_exchange_weak(head, MakeHead(Tag(head) + 1, next), std::memory_order_acquire, std::memory_order_acquire))
+			{
+				m_iCount.fetch_sub(1, std::memory_order_relaxed);
+				iIndex = (int)top;
+				return true;
+			}
+		}
+	}
+
+	int size() const
+	{
+		int iCount = m_iCount.load(std::memory_order_relaxed);
+		return iCount > 0 ? iCount : 0;
+	}
+
+	int capacity() const { return m_iCapacity; }
+
+	//链表为空时pop的累计次数
+	uint64_t exhaustedCount() const { return m_uExhausted.load(std::memory_order_relaxed); }
+
+private:
+	static const uint32_t NIL = 0xFFFFFFFFu;
+
+	static uint64_t MakeHead(uint32_t tag, uint32_t index) { return ((uint64_t)tag << 32) | index; }
+	static uint32_t Tag(uint64_t head) { return (uint32_t)(head >> 32); }
+	static uint32_t Index(uint64_t head) { return (uint32_t)head; }
+
+	FreeIndexList(const FreeIndexList&);
+	void operator = (const FreeIndexList&);
+
+private:
+	std::atomic<uint64_t> m_head;
+	std::unique_ptr<std::atomic<uint32_t>[]> m_next;
+	int m_iCapacity;
+	std::atomic<int> m_iCount;
+	std::atomic<uint64_t> m_uExhausted;
+};
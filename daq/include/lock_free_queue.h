@@ -1,69 +1,209 @@
 #pragma once
 
 #include <atomic>
-#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
+#include <cstdint>
 
+//有界多生产者多消费者无锁队列(Vyukov环)
+//每个槽带序号：序号==位置 表示可写，序号==位置+1 表示可读，读走后置为 位置+容量 供下一圈写入
+//生产者/消费者各自只在一个位置索引上CAS，两个索引分别占一个缓存行，避免伪共享
+//容量向上取整为2的幂；可选的阻塞等待只在有等待者时才加锁通知，不影响无锁路径
 template<typename T, size_t N = 1024>
 class LockFreeQueue
 {
 public:
-	LockFreeQueue() {}
-	LockFreeQueue(size_t s) : data_(s) {
-		read_index_ = 0;
-		write_index_ = 0;
-	}
+	LockFreeQueue() { init(N); }
+	LockFreeQueue(size_t s) { init(s); }
 	~LockFreeQueue() {}
 
 public:
 
+	//入队，队列满时返回false
 	bool enqueue(T value) {
-		size_t write_index = 0;
-		Element* e = nullptr;
-		do {
-			write_index = write_index_.load(std::memory_order_relaxed);
-			if (write_index >= (read_index_.load(std::memory_order_relaxed) + data_.size())) { // ʱպ
-				return false;
+		size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		Cell* cell;
+		for (;;) {
+			cell = &buffer_[pos & mask_];
+			size_t seq = cell->sequence_.load(std::memory_order_acquire);
+			intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+			if (dif == 0) {
+				if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed, std::memory_order_relaxed))
+					break;
+			}
+			else if (dif < 0) {
+				return false;	// 这个槽上一圈的数据还没被取走，队列满
 			}
-			size_t index = write_index % N;
-			e = &data_[index];
-			if (e->full_.load(std::memory_order_relaxed)) {
-				return false;
+			else {
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
 			}
-		} while (!write_index_.compare_exchange_weak(write_index, write_index + 1), std::memory_order_release, std::memory_order_relaxed);
+		}
 
-		e->data_ = std::move(value);
-		e->full_.store(true, std::memory_order_release);
+		cell->data_ = std::move(value);
+		cell->sequence_.store(pos + 1, std::memory_order_release);
+		notify();
 		return true;
 	}
 
+	//出队，队列空时返回false
 	bool dequeue(T& value) {
-		size_t read_index = 0;
-		Element* e = nullptr;
-		do {
-			read_index = read_index_.load(std::memory_order_relaxed);
-			if (read_index >= write_index_.load(std::memory_order_relaxed)) {
-				return false;
+		size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+		Cell* cell;
+		for (;;) {
+			cell = &buffer_[pos & mask_];
+			size_t seq = cell->sequence_.load(std::memory_order_acquire);
+			intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+			if (dif == 0) {
+				if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed, std::memory_order_relaxed))
+					break;
 			}
-			size_t index = read_index % N;
-			e = &data_[index];
-			if (!e->full_.load(std::memory_order_relaxed)) {
-				return false;
+			else if (dif < 0) {
+				return false;	// 这个槽还没写入，队列空
 			}
-		} while (!read_index_.compare_exchange_weak(read_index, read_index + 1), std::memory_order_release, std::memory_order_relaxed);
+			else {
+				pos = dequeue_pos_.load(std::memory_order_relaxed);
+			}
+		}
 
-		value = std::move(e->data_);
-		e->full_.store(false, std::memory_order_release);
+		value = std::move(cell->data_);
+		cell->sequence_.store(pos + mask_ + 1, std::memory_order_release);
 		return true;
 	}
+
+	//批量入队：一次CAS占用连续的多个槽，返回实际入队个数(队列剩余空间不足时少于count)
+	size_t enqueue_bulk(const T* values, size_t count) {
+		size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		size_t n;
+		for (;;) {
+			n = 0;
+			while (n < count && n <= mask_) {
+				size_t seq = buffer_[(pos + n) & mask_].sequence_.load(std::memory_order_acquire);
+				if (seq != pos + n)
+					break;
+				n++;
+			}
+			if (n == 0) {
+				size_t seq = buffer_[pos & mask_].sequence_.load(std::memory_order_acquire);
+				if ((intptr_t)seq - (intptr_t)pos < 0)
+					return 0;
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+				continue;
+			}
+			if (enqueue_pos_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed, std::memory_order_relaxed))
+				break;
+		}
+
+		for (size_t i = 0; i < n; i++) {
+			Cell& cell = buffer_[(pos + i) & mask_];
+			cell.data_ = values[i];
+			cell.sequence_.store(pos + i + 1, std::memory_order_release);
+		}
+		notify();
+		return n;
+	}
+
+	//批量出队：一次CAS取走连续的多个槽，返回实际出队个数
+	size_t dequeue_bulk(T* values, size_t max_count) {
+		size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+		size_t n;
+		for (;;) {
+			n = 0;
+			while (n < max_count && n <= mask_) {
+				size_t seq = buffer_[(pos + n) & mask_].sequence_.load(std::memory_order_acquire);
+				if (seq != pos + n + 1)
+					break;
+				n++;
+			}
+			if (n == 0) {
+				size_t seq = buffer_[pos & mask_].sequence_.load(std::memory_order_acquire);
+				if ((intptr_t)seq - (intptr_t)(pos + 1) < 0)
+					return 0;
+				pos = dequeue_pos_.load(std::memory_order_relaxed);
+				continue;
+			}
+			if (dequeue_pos_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed, std::memory_order_relaxed))
+				break;
+		}
+
+		for (size_t i = 0; i < n; i++) {
+			Cell& cell = buffer_[(pos + i) & mask_];
+			values[i] = std::move(cell.data_);
+			cell.sequence_.store(pos + i + mask_ + 1, std::memory_order_release);
+		}
+		return n;
+	}
+
+	//出队，队列空时最多等待timeout_ms毫秒
+	bool wait_dequeue(T& value, unsigned int timeout_ms) {
+		if (dequeue(value))
+			return true;
+
+		std::unique_lock<std::mutex> lock(wait_mutex_);
+		waiters_.fetch_add(1, std::memory_order_seq_cst);
+		// 登记等待者之后再检查队列，与生产者"发布数据后检查等待者"配对，不会漏掉唤醒
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		bool ok = wait_cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&]() { return dequeue(value); });
+		waiters_.fetch_sub(1, std::memory_order_relaxed);
+		return ok;
+	}
+
+	//唤醒所有等待者(停止时调用)
+	void wake_all() {
+		std::lock_guard<std::mutex> lock(wait_mutex_);
+		wait_cv_.notify_all();
+	}
+
+	//近似元素个数，并发修改时只作参考
+	size_t size_approx() const {
+		size_t enq = enqueue_pos_.load(std::memory_order_relaxed);
+		size_t deq = dequeue_pos_.load(std::memory_order_relaxed);
+		return enq > deq ? enq - deq : 0;
+	}
+
+	size_t capacity() const { return mask_ + 1; }
+
+private:
+	void init(size_t s) {
+		size_t cap = 2;
+		while (cap < s)
+			cap <<= 1;
+		buffer_.reset(new Cell[cap]);
+		for (size_t i = 0; i < cap; i++)
+			buffer_[i].sequence_.store(i, std::memory_order_relaxed);
+		mask_ = cap - 1;
+		enqueue_pos_.store(0, std::memory_order_relaxed);
+		dequeue_pos_.store(0, std::memory_order_relaxed);
+		waiters_.store(0, std::memory_order_relaxed);
+	}
+
+	void notify() {
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiters_.load(std::memory_order_relaxed) > 0) {
+			std::lock_guard<std::mutex> lock(wait_mutex_);
+			wait_cv_.notify_one();
+		}
+	}
+
+	LockFreeQueue(const LockFreeQueue&);
+	void operator = (const LockFreeQueue&);
+
 public:
-	struct Element {
-		std::atomic<bool> full_;
+	struct Cell {
+		std::atomic<size_t> sequence_;
 		T data_;
 	};
 
 private:
-	std::vector<Element> data_;
-	std::atomic<size_t> read_index_;
-	std::atomic<size_t> write_index_;
+	static const size_t CACHE_LINE = 64;
+
+	std::unique_ptr<Cell[]> buffer_;
+	size_t mask_;
+	alignas(CACHE_LINE) std::atomic<size_t> enqueue_pos_;
+	alignas(CACHE_LINE) std::atomic<size_t> dequeue_pos_;
+	alignas(CACHE_LINE) std::atomic<int> waiters_;
+	std::mutex wait_mutex_;
+	std::condition_variable wait_cv_;
 };
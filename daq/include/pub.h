@@ -9,5 +9,8 @@ public:
 	static std::string dec2hex(int i, int width);
 	static string DecIntToHexStr(long long num);
 	static string DecStrToHexStr(string str);
+
+	//为当前进程启用特权(如SeManageVolumePrivilege、SeLockMemoryPrivilege)，账户未被授予时返回false
+	static bool EnablePrivilege(const char* szPrivilege);
 };
 
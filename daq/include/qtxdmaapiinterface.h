@@ -29,9 +29,18 @@ uint32_t base：定义要读取的基地址（无符号32位整型）
 uint32_t offset：定义要读取的偏移地址（无符号32位整型）
 uint32_t *value：
 bool bWrilteLog = true：
+bool *pbCached = NULL：非空时返回本次是否命中影子缓存(未访问板卡)
 */
-    static int Func_QTXdmaReadRegister(STXDMA_CARDINFO *g_stCardInfo, uint64_t base, uint32_t offset, uint64_t *value, bool bWrilteLog = true);
-    static int Func_QTXdmaWriteRegister(STXDMA_CARDINFO *g_stCardInfo, uint64_t base, uint32_t offset, uint64_t value);
+    static int Func_QTXdmaReadRegister(STXDMA_CARDINFO *g_stCardInfo, uint64_t base, uint32_t offset, uint64_t *value, bool bWrilteLog = true, bool *pbCached = NULL);
+/*
+函数名：Func_QTXdmaReadRegisterDirect()
+函数作用：不经过寄存器影子缓存，直接从板卡读寄存器，成功后用读出的值刷新缓存；
+          用于写入后的回读校验，以及须以板卡上实际值为准的判断
+参数说明：同Func_QTXdmaReadRegister
+*/
+    static int Func_QTXdmaReadRegisterDirect(STXDMA_CARDINFO *g_stCardInfo, uint64_t base, uint32_t offset, uint64_t *value, bool bWrilteLog = true);
+    //pbSkipped非空时返回本次写入是否因与影子缓存相同而跳过(未访问板卡)
+    static int Func_QTXdmaWriteRegister(STXDMA_CARDINFO *g_stCardInfo, uint64_t base, uint32_t offset, uint64_t value, bool *pbSkipped = NULL);
 };
 
 #endif // QTXDMAAPIINTERFACE_H
@@ -0,0 +1,127 @@
+﻿#pragma once
+
+#include <windows.h>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+//单生产者单消费者缓存索引环，用于采集线程到写盘线程的可用缓存交接
+//push/pop都是无等待的：生产者只写m_uTail，消费者只写m_uHead，各自缓存对方的位置，只有看起来满/空时才重新读取
+//消费者可在空时阻塞在事件上，生产者只在消费者登记等待时才SetEvent，替代Sleep(1)轮询
+//同一时刻只能有一个线程push(中断线程或回放线程)、一个线程pop(写盘线程)
+class SpscIndexRing
+{
+public:
+	SpscIndexRing(int iCapacity)
+	:m_uMask(0)
+	,m_uHead(0)
+	,m_uTailCache(0)
+	,m_uTail(0)
+	,m_uHeadCache(0)
+	,m_bWaiting(false)
+	{
+		uint32_t uCapacity = 2;
+		while (uCapacity < (uint32_t)iCapacity)
+			uCapacity <<= 1;
+		m_slots.reset(new int[uCapacity]);
+		m_uMask = uCapacity - 1;
+		m_hEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	}
+	~SpscIndexRing()
+	{
+		if (m_hEvent != NULL)
+			CloseHandle(m_hEvent);
+	}
+
+	//生产者调用，环满时返回false
+	bool push(int iIndex)
+	{
+		uint32_t uTail = m_uTail.load(std::memory_order_relaxed);
+		if (uTail - m_uHeadCache > m_uMask)
+		{
+			m_uHeadCache = m_uHead.load(std::memory_order_acquire);
+			if (uTail - m_uHeadCache > m_uMask)
+				return false;
+		}
+
+		m_slots[uTail & m_uMask] = iIndex;
+		m_uTail.store(uTail + 1, std::memory_order_release);
+
+		//与wait_pop中的登记配对：要么消费者看到新数据，要么这里看到等待标志
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_bWaiting.load(std::memory_order_relaxed) && m_bWaiting.exchange(false, std::memory_order_relaxed))
+			SetEvent(m_hEvent);
+		return true;
+	}
+
+	//消费者调用，环空时返回false
+	bool pop(int& iIndex)
+	{
+		uint32_t uHead = m_uHead.load(std::memory_order_relaxed);
+		if (uHead == m_uTailCache)
+		{
+			m_uTailCache = m_uTail.load(std::memory_order_acquire);
+			if (uHead == m_uTailCache)
+				return false;
+		}
+
+		iIndex = m_slots[uHead & m_uMask];
+		m_uHead.store(uHead + 1, std::memory_order_release);
+		return true;
+	}
+
+	//消费者调用，环空时最多等待dwTimeoutMs毫秒，有数据或被wake唤醒时立即返回
+	bool wait_pop(int& iIndex, DWORD dwTimeoutMs)
+	{
+		if (pop(iIndex))
+			return true;
+
+		m_bWaiting.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (pop(iIndex))
+		{
+			m_bWaiting.store(false, std::memory_order_relaxed);
+			return true;
+		}
+
+		WaitForSingleObject(m_hEvent, dwTimeoutMs);
+		m_bWaiting.store(false, std::memory_order_relaxed);
+		return pop(iIndex);
+	}
+
+	//唤醒阻塞在wait_pop中的消费者(停止时调用)
+	void wake()
+	{
+		SetEvent(m_hEvent);
+	}
+
+	int size() const
+	{
+		uint32_t uTail = m_uTail.load(std::memory_order_relaxed);
+		uint32_t uHead = m_uHead.load(std::memory_order_relaxed);
+		return (int)(uTail - uHead);
+	}
+
+	int capacity() const { return (int)(m_uMask + 1); }
+
+private:
+	SpscIndexRing(const SpscIndexRing&);
+	void operator = (const SpscIndexRing&);
+
+private:
+	static const size_t CACHE_LINE = 64;
+
+	std::unique_ptr<int[]> m_slots;
+	uint32_t m_uMask;
+	HANDLE m_hEvent;
+
+	//消费者独占的缓存行
+	alignas(CACHE_LINE) std::atomic<uint32_t> m_uHead;
+	uint32_t m_uTailCache;
+
+	//生产者独占的缓存行
+	alignas(CACHE_LINE) std::atomic<uint32_t> m_uTail;
+	uint32_t m_uHeadCache;
+
+	alignas(CACHE_LINE) std::atomic<bool> m_bWaiting;
+};
@@ -0,0 +1,360 @@
+﻿#include "BlockCompressor.h"
+#include "StageTrace.h"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+extern void printfLog(int nLevel, const char * fmt, ...);
+
+BlockCompressor::BlockCompressor()
+:m_iChannels(4)
+,m_pfnCallback(NULL)
+,m_pContext(NULL)
+,m_bStop(false)
+,m_uSubmitSeq(0)
+,m_uPopSeq(0)
+,m_uRawBytes(0)
+,m_uCompressedBytes(0)
+,m_uBusyNs(0)
+{
+}
+
+BlockCompressor::~BlockCompressor()
+{
+	Stop();
+}
+
+bool BlockCompressor::Start(int iThreadCount, int iChannels, int iOutputCount)
+{
+	Stop();
+
+	if (iThreadCount < 1)
+		iThreadCount = 1;
+	if (iChannels < 1)
+		iChannels = 1;
+	if (iOutputCount < iThreadCount)
+		iOutputCount = iThreadCount;
+
+	m_iChannels = iChannels;
+	m_bStop = false;
+	m_uSubmitSeq = 0;
+	m_uPopSeq = 0;
+	m_jobs.clear();
+	m_completed.clear();
+	m_uRawBytes.store(0, std::memory_order_relaxed);
+	m_uCompressedBytes.store(0, std::memory_order_relaxed);
+	m_uBusyNs.store(0, std::memory_order_relaxed);
+
+	//输出缓存在第一次使用时按块大小分配
+	Output output = { NULL, 0, 0 };
+	m_outputs.assign(iOutputCount, output);
+	m_freeOutputs.clear();
+	for (int i = iOutputCount - 1; i >= 0; i--)
+		m_freeOutputs.push_back(i);
+
+	for (int i = 0; i < iThreadCount; i++)
+		m_threads.push_back(std::thread(&BlockCompressor::WorkerThread, this));
+
+	printfLog(4, "[BlockCompressor::Start], threads %d channels %d outputs %d", iThreadCount, iChannels, iOutputCount);
+	return true;
+}
+
+void BlockCompressor::Stop()
+{
+	if (m_threads.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bStop = true;
+	}
+	m_cvJob.notify_all();
+
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_threads[i].join();
+	m_threads.clear();
+
+	for (size_t i = 0; i < m_outputs.size(); i++)
+	{
+		if (m_outputs[i].pBuffer)
+			VirtualFree(m_outputs[i].pBuffer, 0, MEM_RELEASE);
+	}
+	m_outputs.clear();
+	m_freeOutputs.clear();
+	m_completed.clear();
+
+	printfLog(4, "[BlockCompressor::Stop], raw %llu compressed %llu ratio %.2f codec %.1f MB/s",
+		GetRawBytes(), GetCompressedBytes(), GetRatio(), GetCodecMBps());
+}
+
+void BlockCompressor::SetInputDoneCallback(InputDoneCallback pfnCallback, void* pContext)
+{
+	m_pfnCallback = pfnCallback;
+	m_pContext = pContext;
+}
+
+void BlockCompressor::Submit(int iBufferIndex, const void* pData, uint32_t uBytes)
+{
+	Job job;
+	job.iBufferIndex = iBufferIndex;
+	job.pData = pData;
+	job.uBytes = uBytes;
+	job.uSequence = m_uSubmitSeq++;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(job);
+	}
+	m_cvJob.notify_one();
+}
+
+bool BlockCompressor::PopCompleted(int& iOutputIndex, const void*& pFrame, uint32_t& uFrameBytes)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::map<uint64_t, int>::iterator it = m_completed.find(m_uPopSeq);
+	if (it == m_completed.end())
+		return false;
+
+	int iSlot = it->second;
+	m_completed.erase(it);
+	m_uPopSeq++;
+
+	iOutputIndex = OUTPUT_INDEX_BASE + iSlot;
+	pFrame = m_outputs[iSlot].pBuffer;
+	uFrameBytes = m_outputs[iSlot].uFrameBytes;
+	return true;
+}
+
+void BlockCompressor::ReleaseOutput(int iOutputIndex)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_freeOutputs.push_back(iOutputIndex - OUTPUT_INDEX_BASE);
+	}
+	m_cvJob.notify_one();
+}
+
+double BlockCompressor::GetRatio() const
+{
+	uint64_t uCompressed = GetCompressedBytes();
+	return uCompressed ? (double)GetRawBytes() / uCompressed : 0;
+}
+
+double BlockCompressor::GetCodecMBps() const
+{
+	uint64_t uBusyNs = m_uBusyNs.load(std::memory_order_relaxed);
+	return uBusyNs ? (double)GetRawBytes() / (1024.0 * 1024.0) / (uBusyNs / 1e9) : 0;
+}
+
+void BlockCompressor::WorkerThread()
+{
+	StageTrace::SetThreadName("BlockCompressor");
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		//任务和输出缓存同时取，保证输出缓存按序号分配，最早的块不会因缓存被后面的块占满而饿死
+		m_cvJob.wait(lock, [&]() { return (m_bStop && m_jobs.empty()) || (!m_jobs.empty() && !m_freeOutputs.empty()); });
+		if (m_jobs.empty())
+			break;
+
+		Job job = m_jobs.front();
+		m_jobs.pop_front();
+		int iSlot = m_freeOutputs.back();
+		m_freeOutputs.pop_back();
+		Output& output = m_outputs[iSlot];
+		lock.unlock();
+
+		uint32_t uBound = CompressBound(job.uBytes, m_iChannels);
+		if (output.uCapacity < uBound)
+		{
+			if (output.pBuffer)
+				VirtualFree(output.pBuffer, 0, MEM_RELEASE);
+			output.pBuffer = (uint8_t *)VirtualAlloc(NULL, uBound, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+			output.uCapacity = output.pBuffer ? uBound : 0;
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		uint32_t uFrameBytes = 0;
+		if (output.pBuffer)
+		{
+			STAGE_TRACE_SCOPE("Compress", job.uBytes);
+			uFrameBytes = Compress(job.pData, job.uBytes, m_iChannels, job.uSequence, output.pBuffer, output.uCapacity);
+		}
+		uint64_t uNs = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+		if (uFrameBytes == 0)
+			printfLog(2, "[BlockCompressor::WorkerThread], compress block %llu buffer %d failed", job.uSequence, job.iBufferIndex);
+
+		if (m_pfnCallback)
+			m_pfnCallback(m_pContext, job.iBufferIndex);
+
+		m_uRawBytes.fetch_add(job.uBytes, std::memory_order_relaxed);
+		m_uCompressedBytes.fetch_add(uFrameBytes, std::memory_order_relaxed);
+		m_uBusyNs.fetch_add(uNs, std::memory_order_relaxed);
+
+		lock.lock();
+		output.uFrameBytes = uFrameBytes;
+		m_completed[job.uSequence] = iSlot;
+	}
+}
+
+uint32_t BlockCompressor::CompressBound(uint32_t uRawBytes, int iChannels)
+{
+	if (iChannels < 1)
+		iChannels = 1;
+
+	uint32_t uSamples = uRawBytes / (sizeof(int16_t) * iChannels);
+	uint32_t uGroups = (uSamples + GROUP_SAMPLES - 1) / GROUP_SAMPLES;
+	uint32_t uTail = uRawBytes - uSamples * sizeof(int16_t) * iChannels;
+
+	//每组1字节位宽 + 最多16位/样点
+	uint32_t uPayload = iChannels * uGroups * (1 + GROUP_SAMPLES * sizeof(int16_t)) + uTail;
+	uint32_t uFrame = sizeof(COMPRESSED_BLOCK_HEADER) + uPayload;
+	return (uFrame + BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN;
+}
+
+uint32_t BlockCompressor::Compress(const void* pSrc, uint32_t uRawBytes, int iChannels, uint64_t uSequence, void* pDst, uint32_t uDstBytes)
+{
+	if (iChannels < 1 || uDstBytes < CompressBound(uRawBytes, iChannels))
+		return 0;
+
+	const int16_t* pSample = (const int16_t *)pSrc;
+	uint32_t uSamples = uRawBytes / (sizeof(int16_t) * iChannels);
+	uint32_t uTail = uRawBytes - uSamples * sizeof(int16_t) * iChannels;
+
+	uint8_t* pOut = (uint8_t *)pDst + sizeof(COMPRESSED_BLOCK_HEADER);
+	uint16_t zz[GROUP_SAMPLES];
+
+	for (int c = 0; c < iChannels; c++)
+	{
+		int16_t prev = 0;
+		for (uint32_t uStart = 0; uStart < uSamples; uStart += GROUP_SAMPLES)
+		{
+			uint32_t uCount = std::min((uint32_t)GROUP_SAMPLES, uSamples - uStart);
+
+			//差分后zigzag，使零附近的正负小值都映射为小的无符号数
+			uint16_t uOr = 0;
+			const int16_t* p = pSample + (size_t)uStart * iChannels + c;
+			for (uint32_t k = 0; k < uCount; k++)
+			{
+				int16_t v = p[(size_t)k * iChannels];
+				int16_t d = (int16_t)(v - prev);
+				prev = v;
+				zz[k] = (uint16_t)((d << 1) ^ (d >> 15));
+				uOr |= zz[k];
+			}
+
+			int iBits = 0;
+			while (iBits < 16 && (uOr >> iBits) != 0)
+				iBits++;
+			*pOut++ = (uint8_t)iBits;
+
+			uint64_t acc = 0;
+			int iAccBits = 0;
+			for (uint32_t k = 0; k < uCount && iBits != 0; k++)
+			{
+				acc |= (uint64_t)zz[k] << iAccBits;
+				iAccBits += iBits;
+				if (iAccBits >= 32)
+				{
+					uint32_t uWord = (uint32_t)acc;
+					memcpy(pOut, &uWord, sizeof(uWord));
+					pOut += sizeof(uWord);
+					acc >>= 32;
+					iAccBits -= 32;
+				}
+			}
+			while (iAccBits > 0)
+			{
+				*pOut++ = (uint8_t)acc;
+				acc >>= 8;
+				iAccBits -= 8;
+			}
+		}
+	}
+
+	//不足一个交织样点的尾部原样保存
+	memcpy(pOut, (const uint8_t *)pSrc + (uRawBytes - uTail), uTail);
+	pOut += uTail;
+
+	uint32_t uPayload = (uint32_t)(pOut - (uint8_t *)pDst) - sizeof(COMPRESSED_BLOCK_HEADER);
+	uint32_t uFrame = sizeof(COMPRESSED_BLOCK_HEADER) + uPayload;
+	uFrame = (uFrame + BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN;
+	memset(pOut, 0, uFrame - sizeof(COMPRESSED_BLOCK_HEADER) - uPayload);
+
+	COMPRESSED_BLOCK_HEADER* pHeader = (COMPRESSED_BLOCK_HEADER *)pDst;
+	memset(pHeader, 0, sizeof(COMPRESSED_BLOCK_HEADER));
+	pHeader->uMagic = BLOCK_MAGIC;
+	pHeader->uVersion = 1;
+	pHeader->uChannels = (uint16_t)iChannels;
+	pHeader->uSequence = uSequence;
+	pHeader->uRawBytes = uRawBytes;
+	pHeader->uPayloadBytes = uPayload;
+	pHeader->uFrameBytes = uFrame;
+	pHeader->uGroupSamples = GROUP_SAMPLES;
+	pHeader->uCodec = CODEC_DELTA_BITPACK;
+	return uFrame;
+}
+
+uint32_t BlockCompressor::Decompress(const void* pFrame, uint32_t uFrameBytes, void* pDst, uint32_t uDstBytes)
+{
+	if (uFrameBytes < sizeof(COMPRESSED_BLOCK_HEADER))
+		return 0;
+
+	const COMPRESSED_BLOCK_HEADER* pHeader = (const COMPRESSED_BLOCK_HEADER *)pFrame;
+	if (pHeader->uMagic != BLOCK_MAGIC || pHeader->uCodec != CODEC_DELTA_BITPACK || pHeader->uChannels == 0
+		|| pHeader->uGroupSamples != GROUP_SAMPLES || pHeader->uFrameBytes > uFrameBytes
+		|| sizeof(COMPRESSED_BLOCK_HEADER) + pHeader->uPayloadBytes > pHeader->uFrameBytes
+		|| pHeader->uRawBytes > uDstBytes)
+		return 0;
+
+	int iChannels = pHeader->uChannels;
+	uint32_t uRawBytes = pHeader->uRawBytes;
+	uint32_t uSamples = uRawBytes / (sizeof(int16_t) * iChannels);
+	uint32_t uTail = uRawBytes - uSamples * sizeof(int16_t) * iChannels;
+
+	const uint8_t* pIn = (const uint8_t *)pFrame + sizeof(COMPRESSED_BLOCK_HEADER);
+	const uint8_t* pEnd = pIn + pHeader->uPayloadBytes;
+	int16_t* pSample = (int16_t *)pDst;
+
+	for (int c = 0; c < iChannels; c++)
+	{
+		int16_t prev = 0;
+		for (uint32_t uStart = 0; uStart < uSamples; uStart += GROUP_SAMPLES)
+		{
+			uint32_t uCount = std::min((uint32_t)GROUP_SAMPLES, uSamples - uStart);
+			if (pIn >= pEnd)
+				return 0;
+
+			int iBits = *pIn++;
+			if (iBits > 16 || pIn + (uCount * iBits + 7) / 8 > pEnd)
+				return 0;
+
+			uint64_t acc = 0;
+			int iAccBits = 0;
+			uint32_t uMask = (1u << iBits) - 1;
+			int16_t* p = pSample + (size_t)uStart * iChannels + c;
+			for (uint32_t k = 0; k < uCount; k++)
+			{
+				while (iAccBits < iBits)
+				{
+					acc |= (uint64_t)*pIn++ << iAccBits;
+					iAccBits += 8;
+				}
+				uint16_t z = (uint16_t)(acc & uMask);
+				acc >>= iBits;
+				iAccBits -= iBits;
+
+				int16_t d = (int16_t)((z >> 1) ^ (uint16_t)-(int16_t)(z & 1));
+				prev = (int16_t)(prev + d);
+				p[(size_t)k * iChannels] = prev;
+			}
+		}
+	}
+
+	if (pIn + uTail != pEnd)
+		return 0;
+	memcpy((uint8_t *)pDst + (uRawBytes - uTail), pIn, uTail);
+	return uRawBytes;
+}
@@ -0,0 +1,354 @@
+﻿#include "ChannelSplitter.h"
+#include "DirectDiskWriter.h"
+#include "RawContainer.h"
+#include "BlockCompressor.h"
+#include "pub.h"
+
+#include <emmintrin.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+extern void printfLog(int nLevel, const char * fmt, ...);
+
+uint64_t ChannelSplitter::BuildPieces(const std::string& strInput, const uint8_t* pView, uint64_t uFileSize, int iChannels,
+	std::vector<Piece>& pieces)
+{
+	const uint64_t uFrameBytes = (uint64_t)iChannels * sizeof(int16_t);
+	uint64_t uFrames = 0;
+	pieces.clear();
+
+	if (uFileSize >= RawContainer::HEADER_BYTES && *(const uint32_t *)pView == RawContainer::HEADER_MAGIC)
+	{
+		RAW_CONTAINER_HEADER header;
+		std::vector<RAW_INDEX_RECORD> records;
+		if (!RawContainer::ReadIndex(strInput, header, records))
+		{
+			printfLog(2, "[ChannelSplitter::BuildPieces], %s has no block index", strInput.c_str());
+			return 0;
+		}
+
+		//与ReplaySource相同：异常结束的文件，旁路索引可能记录了未写完的块
+		for (size_t i = 0; i < records.size(); i++)
+		{
+			if (records[i].uFileOffset + records[i].uStoredBytes > uFileSize)
+				break;
+			if (records[i].uRawBytes % uFrameBytes != 0)
+				printfLog(2, "[ChannelSplitter::BuildPieces], block %llu has %u bytes, not a multiple of %d channels",
+					records[i].uSequence, records[i].uRawBytes, iChannels);
+
+			Piece piece;
+			piece.uOffset = records[i].uFileOffset;
+			piece.uStoredBytes = records[i].uStoredBytes;
+			piece.uFrames = records[i].uRawBytes / uFrameBytes;
+			piece.uFirstFrame = uFrames;
+			piece.bCompressed = (records[i].uFlags & RawContainer::INDEX_FLAG_COMPRESSED) != 0;
+			pieces.push_back(piece);
+			uFrames += piece.uFrames;
+		}
+		return uFrames;
+	}
+
+	uFrames = uFileSize / uFrameBytes;
+	for (uint64_t uFirst = 0; uFirst < uFrames; uFirst += CHUNK_FRAMES)
+	{
+		Piece piece;
+		piece.uOffset = uFirst * uFrameBytes;
+		piece.uFrames = std::min((uint64_t)CHUNK_FRAMES, uFrames - uFirst);
+		piece.uStoredBytes = (uint32_t)(piece.uFrames * uFrameBytes);
+		piece.uFirstFrame = uFirst;
+		piece.bCompressed = false;
+		pieces.push_back(piece);
+	}
+	return uFrames;
+}
+
+int ChannelSplitter::Split(const std::string& strInput, int iChannels, const std::string& strOutputPrefix, int iThreadCount)
+{
+	if (iChannels < 1)
+		return -1;
+
+	HANDLE hInput = CreateFileA(strInput.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hInput == INVALID_HANDLE_VALUE)
+	{
+		printfLog(2, "[ChannelSplitter::Split], open %s error(%d)", strInput.c_str(), GetLastError());
+		return -1;
+	}
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(hInput, &fileSize);
+	HANDLE hMapping = fileSize.QuadPart > 0 ? CreateFileMappingA(hInput, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	const uint8_t* pView = hMapping ? (const uint8_t *)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (pView == NULL)
+	{
+		printfLog(2, "[ChannelSplitter::Split], map %s error(%d)", strInput.c_str(), GetLastError());
+		if (hMapping)
+			CloseHandle(hMapping);
+		CloseHandle(hInput);
+		return -1;
+	}
+
+	const uint64_t uFrameBytes = (uint64_t)iChannels * sizeof(int16_t);
+	std::vector<Piece> pieces;
+	const uint64_t uFrames = BuildPieces(strInput, pView, (uint64_t)fileSize.QuadPart, iChannels, pieces);
+	if (uFrames == 0)
+	{
+		printfLog(2, "[ChannelSplitter::Split], %s holds no complete frame", strInput.c_str());
+		UnmapViewOfFile(pView);
+		CloseHandle(hMapping);
+		CloseHandle(hInput);
+		return -1;
+	}
+
+	if (iThreadCount <= 0)
+		iThreadCount = (int)std::max(1u, std::thread::hardware_concurrency());
+	iThreadCount = (int)std::min((uint64_t)iThreadCount, (uint64_t)pieces.size());
+
+	//各通道文件先按最终长度(扇区对齐)分配，并行写不同偏移时不会因扩展文件而串行化
+	std::vector<std::string> names(iChannels);
+	const uint64_t uChannelBytes = uFrames * sizeof(int16_t);
+	uint32_t uSector = DirectDiskWriter::QuerySectorSize(strOutputPrefix);
+	uint64_t uAllocBytes = (uChannelBytes + uSector - 1) / uSector * uSector;
+	bool bValidData = pub::EnablePrivilege(SE_MANAGE_VOLUME_NAME);
+	bool bOk = true;
+
+	//容器块的帧数不一定使输出偏移按扇区对齐，此时输出改用缓冲写
+	bool bDirect = true;
+	for (size_t i = 0; i < pieces.size() && bDirect; i++)
+		bDirect = (pieces[i].uFirstFrame * sizeof(int16_t)) % uSector == 0;
+
+	for (int c = 0; c < iChannels && bOk; c++)
+	{
+		char szName[512];
+		snprintf(szName, sizeof(szName), "%s_ch%d.bin", strOutputPrefix.c_str(), c);
+		names[c] = szName;
+
+		HANDLE hFile = CreateFileA(szName, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (hFile == INVALID_HANDLE_VALUE)
+		{
+			printfLog(2, "[ChannelSplitter::Split], create %s error(%d)", szName, GetLastError());
+			bOk = false;
+			break;
+		}
+		FILE_END_OF_FILE_INFO eofInfo;
+		eofInfo.EndOfFile.QuadPart = (LONGLONG)uAllocBytes;
+		SetFileInformationByHandle(hFile, FileEndOfFileInfo, &eofInfo, sizeof(eofInfo));
+		if (bValidData)
+			SetFileValidData(hFile, (LONGLONG)uAllocBytes);
+		CloseHandle(hFile);
+	}
+
+	std::atomic<size_t> uNextPiece(0);
+	std::atomic<int> iErrors(0);
+	std::vector<std::thread> threads;
+	ULONGLONG uStartMs = GetTickCount64();
+
+	for (int t = 0; t < iThreadCount && bOk; t++)
+	{
+		threads.push_back(std::thread([&]()
+		{
+			//同步句柄上的I/O按文件对象串行执行，每个线程每个通道单独一个句柄
+			std::vector<HANDLE> files(iChannels, INVALID_HANDLE_VALUE);
+			std::vector<int16_t*> buffers(iChannels, (int16_t*)NULL);
+			const size_t uBufferBytes = (size_t)CHUNK_FRAMES * sizeof(int16_t);
+			for (int c = 0; c < iChannels; c++)
+			{
+				files[c] = CreateFileA(names[c].c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+					bDirect ? FILE_FLAG_NO_BUFFERING : FILE_ATTRIBUTE_NORMAL, NULL);
+				buffers[c] = (int16_t *)VirtualAlloc(NULL, uBufferBytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+				if (files[c] == INVALID_HANDLE_VALUE || buffers[c] == NULL)
+				{
+					printfLog(2, "[ChannelSplitter::Split], open %s error(%d)", names[c].c_str(), GetLastError());
+					iErrors.fetch_add(1);
+				}
+			}
+
+			//压缩块整块解压到这里再分段解交织，按遇到的最大块增长
+			uint8_t* pRaw = NULL;
+			uint64_t uRawCapacity = 0;
+
+			size_t uIndex;
+			while (iErrors.load(std::memory_order_relaxed) == 0 && (uIndex = uNextPiece.fetch_add(1)) < pieces.size())
+			{
+				const Piece& piece = pieces[uIndex];
+				const uint64_t uPieceBytes = piece.uFrames * uFrameBytes;
+
+				//先让系统把本段读进来，解交织或解压时不再逐页缺页等待
+				WIN32_MEMORY_RANGE_ENTRY range;
+				range.VirtualAddress = (PVOID)(pView + piece.uOffset);
+				range.NumberOfBytes = (SIZE_T)piece.uStoredBytes;
+				PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+
+				const int16_t* pData = (const int16_t *)(pView + piece.uOffset);
+				if (piece.bCompressed)
+				{
+					if (uRawCapacity < uPieceBytes)
+					{
+						if (pRaw)
+							VirtualFree(pRaw, 0, MEM_RELEASE);
+						uRawCapacity = uPieceBytes;
+						pRaw = (uint8_t *)VirtualAlloc(NULL, (SIZE_T)uRawCapacity, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+						if (pRaw == NULL)
+						{
+							uRawCapacity = 0;
+							printfLog(2, "[ChannelSplitter::Split], alloc %llu bytes error(%d)", uPieceBytes, GetLastError());
+							iErrors.fetch_add(1);
+							break;
+						}
+					}
+					if (BlockCompressor::Decompress(pView + piece.uOffset, piece.uStoredBytes, pRaw, (uint32_t)uRawCapacity) < uPieceBytes)
+					{
+						printfLog(2, "[ChannelSplitter::Split], block at %llu of %s is corrupt", piece.uOffset, strInput.c_str());
+						iErrors.fetch_add(1);
+						break;
+					}
+					pData = (const int16_t *)pRaw;
+				}
+
+				//一段可能大于CHUNK_FRAMES(容器块)，按CHUNK_FRAMES分批解交织和写出
+				for (uint64_t uDone = 0; uDone < piece.uFrames && iErrors.load(std::memory_order_relaxed) == 0; uDone += CHUNK_FRAMES)
+				{
+					size_t uCount = (size_t)std::min((uint64_t)CHUNK_FRAMES, piece.uFrames - uDone);
+					Deinterleave(pData + uDone * iChannels, uCount, iChannels, &buffers[0]);
+
+					//直接写时最后一批补齐到扇区整数倍，结束后截断
+					DWORD dwBytes = (DWORD)(uCount * sizeof(int16_t));
+					if (bDirect)
+						dwBytes = (DWORD)((dwBytes + uSector - 1) / uSector * uSector);
+					uint64_t uOffset = (piece.uFirstFrame + uDone) * sizeof(int16_t);
+					for (int c = 0; c < iChannels; c++)
+					{
+						OVERLAPPED ov;
+						memset(&ov, 0, sizeof(ov));
+						ov.Offset = (DWORD)uOffset;
+						ov.OffsetHigh = (DWORD)(uOffset >> 32);
+						DWORD dwWritten = 0;
+						if (!WriteFile(files[c], buffers[c], dwBytes, &dwWritten, &ov) || dwWritten != dwBytes)
+						{
+							printfLog(2, "[ChannelSplitter::Split], write %s at %llu error(%d)", names[c].c_str(), uOffset, GetLastError());
+							iErrors.fetch_add(1);
+							break;
+						}
+					}
+				}
+			}
+
+			if (pRaw)
+				VirtualFree(pRaw, 0, MEM_RELEASE);
+			for (int c = 0; c < iChannels; c++)
+			{
+				if (files[c] != INVALID_HANDLE_VALUE)
+					CloseHandle(files[c]);
+				if (buffers[c])
+					VirtualFree(buffers[c], 0, MEM_RELEASE);
+			}
+		}));
+	}
+
+	for (size_t t = 0; t < threads.size(); t++)
+		threads[t].join();
+
+	UnmapViewOfFile(pView);
+	CloseHandle(hMapping);
+	CloseHandle(hInput);
+
+	//截掉扇区补齐的部分
+	for (int c = 0; c < iChannels && !names[c].empty(); c++)
+	{
+		HANDLE hFile = CreateFileA(names[c].c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (hFile == INVALID_HANDLE_VALUE)
+			continue;
+		FILE_END_OF_FILE_INFO eofInfo;
+		eofInfo.EndOfFile.QuadPart = (LONGLONG)uChannelBytes;
+		SetFileInformationByHandle(hFile, FileEndOfFileInfo, &eofInfo, sizeof(eofInfo));
+		CloseHandle(hFile);
+	}
+
+	if (!bOk || iErrors.load() != 0)
+		return -1;
+
+	ULONGLONG uMs = std::max((ULONGLONG)1, GetTickCount64() - uStartMs);
+	printfLog(4, "[ChannelSplitter::Split], %s %d channels %llu frames %d pieces threads %d %.1f MB/s", strInput.c_str(), iChannels,
+		uFrames, (int)pieces.size(), iThreadCount, (double)fileSize.QuadPart / (1024.0 * 1024.0) / (uMs / 1000.0));
+	return 0;
+}
+
+void ChannelSplitter::Deinterleave(const int16_t* pSrc, size_t uFrames, int iChannels, int16_t** ppDst)
+{
+	if (iChannels == 1)
+	{
+		memcpy(ppDst[0], pSrc, uFrames * sizeof(int16_t));
+		return;
+	}
+	if (iChannels == 2)
+	{
+		Deinterleave2(pSrc, uFrames, ppDst[0], ppDst[1]);
+		return;
+	}
+	if (iChannels == 4)
+	{
+		Deinterleave4(pSrc, uFrames, ppDst);
+		return;
+	}
+
+	for (size_t i = 0; i < uFrames; i++)
+		for (int c = 0; c < iChannels; c++)
+			ppDst[c][i] = pSrc[i * iChannels + c];
+}
+
+void ChannelSplitter::Deinterleave2(const int16_t* pSrc, size_t uFrames, int16_t* pDst0, int16_t* pDst1)
+{
+	//每次8帧：32位内低16位是通道0、高16位是通道1，移位后符号扩展再饱和打包(不会溢出)
+	size_t i = 0;
+	for (; i + 8 <= uFrames; i += 8)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i *)(pSrc + i * 2));
+		__m128i b = _mm_loadu_si128((const __m128i *)(pSrc + i * 2 + 8));
+		__m128i a0 = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+		__m128i b0 = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+		__m128i a1 = _mm_srai_epi32(a, 16);
+		__m128i b1 = _mm_srai_epi32(b, 16);
+		_mm_storeu_si128((__m128i *)(pDst0 + i), _mm_packs_epi32(a0, b0));
+		_mm_storeu_si128((__m128i *)(pDst1 + i), _mm_packs_epi32(a1, b1));
+	}
+	for (; i < uFrames; i++)
+	{
+		pDst0[i] = pSrc[i * 2];
+		pDst1[i] = pSrc[i * 2 + 1];
+	}
+}
+
+void ChannelSplitter::Deinterleave4(const int16_t* pSrc, size_t uFrames, int16_t** ppDst)
+{
+	//每次8帧，三轮unpack把4x8的交织矩阵转置为每通道8个连续采样
+	size_t i = 0;
+	for (; i + 8 <= uFrames; i += 8)
+	{
+		const __m128i* p = (const __m128i *)(pSrc + i * 4);
+		__m128i a = _mm_loadu_si128(p);			//帧0,1
+		__m128i b = _mm_loadu_si128(p + 1);		//帧2,3
+		__m128i c = _mm_loadu_si128(p + 2);		//帧4,5
+		__m128i d = _mm_loadu_si128(p + 3);		//帧6,7
+
+		__m128i t0 = _mm_unpacklo_epi16(a, b);
+		__m128i t1 = _mm_unpackhi_epi16(a, b);
+		__m128i t2 = _mm_unpacklo_epi16(c, d);
+		__m128i t3 = _mm_unpackhi_epi16(c, d);
+
+		__m128i u0 = _mm_unpacklo_epi16(t0, t1);	//帧0~3 通道0,1
+		__m128i u1 = _mm_unpackhi_epi16(t0, t1);	//帧0~3 通道2,3
+		__m128i u2 = _mm_unpacklo_epi16(t2, t3);	//帧4~7 通道0,1
+		__m128i u3 = _mm_unpackhi_epi16(t2, t3);	//帧4~7 通道2,3
+
+		_mm_storeu_si128((__m128i *)(ppDst[0] + i), _mm_unpacklo_epi64(u0, u2));
+		_mm_storeu_si128((__m128i *)(ppDst[1] + i), _mm_unpackhi_epi64(u0, u2));
+		_mm_storeu_si128((__m128i *)(ppDst[2] + i), _mm_unpacklo_epi64(u1, u3));
+		_mm_storeu_si128((__m128i *)(ppDst[3] + i), _mm_unpackhi_epi64(u1, u3));
+	}
+	for (; i < uFrames; i++)
+		for (int ch = 0; ch < 4; ch++)
+			ppDst[ch][i] = pSrc[i * 4 + ch];
+}
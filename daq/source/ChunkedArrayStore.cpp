@@ -0,0 +1,334 @@
+﻿#include "ChunkedArrayStore.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <algorithm>
+
+extern void printfLog(int nLevel, const char * fmt, ...);
+
+ChunkedArrayStore::ChunkedArrayStore()
+:m_iSizeC(0)
+,m_iSizeZ(0)
+,m_iHeight(0)
+,m_iWidth(0)
+,m_iChunkZ(1)
+,m_iChunkY(1)
+,m_iChunkX(1)
+,m_iChunksZ(0)
+,m_iChunksY(0)
+,m_iChunksX(0)
+,m_bCompress(false)
+,m_iMaxJobs(0)
+,m_iMaxT(-1)
+,m_iFailedT(-1)
+,m_bStop(false)
+,m_iMetaT(-1)
+,m_iCompleteT(0)
+,m_uChunksWritten(0)
+,m_uBytesWritten(0)
+{
+}
+
+ChunkedArrayStore::~ChunkedArrayStore()
+{
+	Close();
+}
+
+bool ChunkedArrayStore::Open(const std::string& strDir, int iSizeC, int iSizeZ, int iHeight, int iWidth,
+	int iChunkZ, int iChunkY, int iChunkX, int iThreadCount, bool bCompress)
+{
+	Close();
+
+	if (iSizeC < 1 || iSizeZ < 1 || iHeight < 1 || iWidth < 1)
+		return false;
+	if (iThreadCount < 1)
+		iThreadCount = 1;
+
+	m_strDir = strDir;
+	m_iSizeC = iSizeC;
+	m_iSizeZ = iSizeZ;
+	m_iHeight = iHeight;
+	m_iWidth = iWidth;
+	m_iChunkZ = std::max(1, std::min(iChunkZ, iSizeZ));
+	m_iChunkY = std::max(1, std::min(iChunkY, iHeight));
+	m_iChunkX = std::max(1, std::min(iChunkX, iWidth));
+	m_iChunksZ = (iSizeZ + m_iChunkZ - 1) / m_iChunkZ;
+	m_iChunksY = (iHeight + m_iChunkY - 1) / m_iChunkY;
+	m_iChunksX = (iWidth + m_iChunkX - 1) / m_iChunkX;
+	m_bCompress = bCompress;
+	m_iMaxJobs = std::max(iThreadCount * 4, m_iChunksY * m_iChunksX);
+	m_iMaxT = -1;
+	m_bStop = false;
+	m_iMetaT = -1;
+	m_slabs.clear();
+	m_jobs.clear();
+	m_doneChunks.clear();
+	m_iFailedT = -1;
+	m_iCompleteT.store(0, std::memory_order_relaxed);
+	m_uChunksWritten.store(0, std::memory_order_relaxed);
+	m_uBytesWritten.store(0, std::memory_order_relaxed);
+
+	CreateDirectoryA(m_strDir.c_str(), NULL);
+
+	//.zarray先于任何块写出，时间维为0，读取方此时打开得到空数组
+	if (!WriteMetadata(0))
+		return false;
+
+	for (int i = 0; i < iThreadCount; i++)
+		m_threads.push_back(std::thread(&ChunkedArrayStore::WorkerThread, this));
+
+	printfLog(4, "[ChunkedArrayStore::Open], %s C%d Z%d %dx%d chunk %dx%dx%d threads %d compress %d", strDir.c_str(),
+		iSizeC, iSizeZ, iHeight, iWidth, m_iChunkZ, m_iChunkY, m_iChunkX, iThreadCount, (int)bCompress);
+	return true;
+}
+
+void ChunkedArrayStore::Close()
+{
+	if (m_threads.empty())
+		return;
+
+	//采集中止时未凑齐的段也写出，缺少的层为0
+	for (std::map<uint64_t, std::shared_ptr<Slab> >::iterator it = m_slabs.begin(); it != m_slabs.end(); ++it)
+		SubmitSlab(it->second);
+	m_slabs.clear();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bStop = true;
+	}
+	m_cvJob.notify_all();
+
+	for (size_t i = 0; i < m_threads.size(); i++)
+		m_threads[i].join();
+	m_threads.clear();
+
+	//最后的时间点可能缺少部分块，读取时按fill_value处理；有块写失败时只到失败的时间点之前
+	int iSizeT = std::max(m_iCompleteT.load(std::memory_order_relaxed), m_iMaxT + 1);
+	if (m_iFailedT >= 0 && m_iFailedT < iSizeT)
+	{
+		printfLog(2, "[ChunkedArrayStore::Close], %s chunk write failed at T%d, T%d~T%d not published", m_strDir.c_str(),
+			m_iFailedT, m_iFailedT, iSizeT - 1);
+		iSizeT = m_iFailedT;
+	}
+	WriteMetadata(iSizeT);
+
+	printfLog(4, "[ChunkedArrayStore::Close], %s T%d chunks %llu bytes %llu", m_strDir.c_str(), m_iMaxT + 1,
+		GetChunksWritten(), GetBytesWritten());
+}
+
+bool ChunkedArrayStore::WritePlane(int iT, int iC, int iZ, const uint16_t* pPlane)
+{
+	if (m_threads.empty() || iT < 0 || iC < 0 || iC >= m_iSizeC || iZ < 0 || iZ >= m_iSizeZ)
+		return false;
+
+	int iZChunk = iZ / m_iChunkZ;
+	uint64_t uKey = ((uint64_t)iT << 32) | ((uint64_t)iC << 16) | (uint64_t)iZChunk;
+
+	std::shared_ptr<Slab>& pSlab = m_slabs[uKey];
+	if (!pSlab)
+	{
+		pSlab = std::make_shared<Slab>();
+		pSlab->iT = iT;
+		pSlab->iC = iC;
+		pSlab->iZChunk = iZChunk;
+		pSlab->iPlanes = 0;
+		pSlab->data.assign((size_t)m_iChunkZ * m_iHeight * m_iWidth, 0);
+	}
+
+	size_t uPlane = (size_t)m_iHeight * m_iWidth;
+	memcpy(&pSlab->data[(iZ - iZChunk * m_iChunkZ) * uPlane], pPlane, uPlane * sizeof(uint16_t));
+	pSlab->iPlanes++;
+
+	if (iT > m_iMaxT)
+		m_iMaxT = iT;
+
+	//最后一段可能不足iChunkZ层
+	int iSlabPlanes = std::min(m_iChunkZ, m_iSizeZ - iZChunk * m_iChunkZ);
+	if (pSlab->iPlanes >= iSlabPlanes)
+	{
+		std::shared_ptr<Slab> pFull = pSlab;
+		m_slabs.erase(uKey);
+		SubmitSlab(pFull);
+	}
+	return true;
+}
+
+int ChunkedArrayStore::GetPendingChunks()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return (int)m_jobs.size();
+}
+
+void ChunkedArrayStore::SubmitSlab(const std::shared_ptr<Slab>& pSlab)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_cvSpace.wait(lock, [&]() { return (int)m_jobs.size() < m_iMaxJobs; });
+
+	for (int y = 0; y < m_iChunksY; y++)
+	{
+		for (int x = 0; x < m_iChunksX; x++)
+		{
+			Job job;
+			job.pSlab = pSlab;
+			job.iYChunk = y;
+			job.iXChunk = x;
+			m_jobs.push_back(job);
+		}
+	}
+	lock.unlock();
+	m_cvJob.notify_all();
+}
+
+void ChunkedArrayStore::WorkerThread()
+{
+	std::vector<uint16_t> tile;
+	std::vector<uint8_t> packed;
+	ZlibEncoder encoder;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_cvJob.wait(lock, [&]() { return m_bStop || !m_jobs.empty(); });
+		if (m_jobs.empty())
+			break;
+
+		Job job = m_jobs.front();
+		m_jobs.pop_front();
+		lock.unlock();
+		m_cvSpace.notify_one();
+
+		int iT = job.pSlab->iT;
+		bool bOk = WriteChunk(job, tile, packed, encoder);
+		if (!bOk)
+			printfLog(2, "[ChunkedArrayStore::WorkerThread], chunk %d.%d.%d.%d.%d failed", iT, job.pSlab->iC,
+				job.pSlab->iZChunk, job.iYChunk, job.iXChunk);
+		job.pSlab.reset();
+
+		OnChunkDone(iT, bOk);
+		lock.lock();
+	}
+}
+
+bool ChunkedArrayStore::WriteChunk(const Job& job, std::vector<uint16_t>& tile, std::vector<uint8_t>& packed, ZlibEncoder& encoder)
+{
+	//边缘块也按完整块大小写，超出数组的部分为0
+	const Slab& slab = *job.pSlab;
+	tile.assign((size_t)m_iChunkZ * m_iChunkY * m_iChunkX, 0);
+
+	int iY0 = job.iYChunk * m_iChunkY;
+	int iX0 = job.iXChunk * m_iChunkX;
+	int iRows = std::min(m_iChunkY, m_iHeight - iY0);
+	int iCols = std::min(m_iChunkX, m_iWidth - iX0);
+	for (int z = 0; z < m_iChunkZ; z++)
+	{
+		const uint16_t* pSrc = &slab.data[((size_t)z * m_iHeight + iY0) * m_iWidth + iX0];
+		uint16_t* pDst = &tile[(size_t)z * m_iChunkY * m_iChunkX];
+		for (int y = 0; y < iRows; y++)
+			memcpy(pDst + (size_t)y * m_iChunkX, pSrc + (size_t)y * m_iWidth, iCols * sizeof(uint16_t));
+	}
+
+	const void* pData = &tile[0];
+	uint32_t uBytes = (uint32_t)(tile.size() * sizeof(uint16_t));
+	if (m_bCompress)
+	{
+		packed.resize(ZlibEncoder::CompressBound(uBytes));
+		uBytes = encoder.Compress(&tile[0], uBytes, &packed[0], (uint32_t)packed.size());
+		if (uBytes == 0)
+			return false;
+		pData = &packed[0];
+	}
+
+	char szName[64];
+	snprintf(szName, sizeof(szName), "\\%d.%d.%d.%d.%d", slab.iT, slab.iC, slab.iZChunk, job.iYChunk, job.iXChunk);
+	if (!WriteFileAtomic(m_strDir + szName, pData, uBytes))
+		return false;
+
+	m_uChunksWritten.fetch_add(1, std::memory_order_relaxed);
+	m_uBytesWritten.fetch_add(uBytes, std::memory_order_relaxed);
+	return true;
+}
+
+void ChunkedArrayStore::OnChunkDone(int iT, bool bOk)
+{
+	int iChunksPerT = m_iSizeC * m_iChunksZ * m_iChunksY * m_iChunksX;
+	int iCompleteT = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_doneChunks[iT]++;
+		if (!bOk && (m_iFailedT < 0 || iT < m_iFailedT))
+			m_iFailedT = iT;
+
+		//时间点按顺序推进，前面的时间点没写完时后面的不对外可见；推进到有块写失败的时间点为止
+		iCompleteT = m_iCompleteT.load(std::memory_order_relaxed);
+		std::map<int, int>::iterator it = m_doneChunks.find(iCompleteT);
+		while (it != m_doneChunks.end() && it->second >= iChunksPerT && iCompleteT != m_iFailedT)
+		{
+			m_doneChunks.erase(it);
+			it = m_doneChunks.find(++iCompleteT);
+		}
+		if (iCompleteT == m_iCompleteT.load(std::memory_order_relaxed))
+			return;
+		m_iCompleteT.store(iCompleteT, std::memory_order_relaxed);
+	}
+
+	WriteMetadata(iCompleteT);
+}
+
+bool ChunkedArrayStore::WriteMetadata(int iSizeT)
+{
+	std::lock_guard<std::mutex> lock(m_metaMutex);
+	if (iSizeT <= m_iMetaT)
+		return true;
+
+	char szJson[1024];
+	int iLen = snprintf(szJson, sizeof(szJson),
+		"{\n"
+		"    \"zarr_format\": 2,\n"
+		"    \"shape\": [%d, %d, %d, %d, %d],\n"
+		"    \"chunks\": [1, 1, %d, %d, %d],\n"
+		"    \"dtype\": \"<u2\",\n"
+		"    \"compressor\": %s,\n"
+		"    \"fill_value\": 0,\n"
+		"    \"order\": \"C\",\n"
+		"    \"filters\": null,\n"
+		"    \"dimension_separator\": \".\"\n"
+		"}\n",
+		iSizeT, m_iSizeC, m_iSizeZ, m_iHeight, m_iWidth, m_iChunkZ, m_iChunkY, m_iChunkX,
+		m_bCompress ? "{\"id\": \"zlib\", \"level\": 1}" : "null");
+
+	if (!WriteFileAtomic(m_strDir + "\\.zarray", szJson, (uint32_t)iLen))
+		return false;
+
+	if (m_iMetaT < 0)
+	{
+		const char* pAttrs = "{\n    \"_ARRAY_DIMENSIONS\": [\"t\", \"c\", \"z\", \"y\", \"x\"]\n}\n";
+		WriteFileAtomic(m_strDir + "\\.zattrs", pAttrs, (uint32_t)strlen(pAttrs));
+	}
+
+	m_iMetaT = iSizeT;
+	return true;
+}
+
+bool ChunkedArrayStore::WriteFileAtomic(const std::string& strFileName, const void* pData, uint32_t uBytes)
+{
+	//先写临时文件再改名，读取方看到的文件总是完整的
+	std::string strTemp = strFileName + ".tmp";
+	HANDLE hFile = CreateFileA(strTemp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+	{
+		printfLog(2, "[ChunkedArrayStore::WriteFileAtomic], CreateFile %s error(%d)", strTemp.c_str(), GetLastError());
+		return false;
+	}
+
+	DWORD dwWritten = 0;
+	BOOL bOk = WriteFile(hFile, pData, uBytes, &dwWritten, NULL) && dwWritten == uBytes;
+	CloseHandle(hFile);
+
+	if (!bOk || !MoveFileExA(strTemp.c_str(), strFileName.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		printfLog(2, "[ChunkedArrayStore::WriteFileAtomic], write %s error(%d)", strFileName.c_str(), GetLastError());
+		DeleteFileA(strTemp.c_str());
+		return false;
+	}
+	return true;
+}
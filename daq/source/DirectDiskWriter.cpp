@@ -0,0 +1,441 @@
+﻿#include "DirectDiskWriter.h"
+#include "pub.h"
+
+#include <string.h>
+#include <winioctl.h>
+
+extern void printfLog(int nLevel, const char * fmt, ...);
+
+DirectDiskWriter::DirectDiskWriter()
+:m_hFile(INVALID_HANDLE_VALUE)
+,m_uSectorSize(4096)
+,m_uFileOffset(0)
+,m_uDataEnd(0)
+,m_pTail(NULL)
+,m_uTailBytes(0)
+,m_bPadToSector(false)
+,m_dwChainError(0)
+,m_iHead(0)
+,m_iCount(0)
+,m_pfnCallback(NULL)
+,m_pContext(NULL)
+,m_uBytesWritten(0)
+,m_dThroughputMBps(0)
+,m_uErrorCount(0)
+,m_uWindowStartMs(0)
+,m_uWindowBytes(0)
+{
+}
+
+DirectDiskWriter::~DirectDiskWriter()
+{
+	Close();
+}
+
+uint32_t DirectDiskWriter::QuerySectorSize(const std::string& strFileName)
+{
+	//无缓冲I/O的偏移和长度都必须是扇区的整数倍；4K物理扇区的盘(512e)按逻辑扇区写会在盘内读改写，按物理扇区对齐
+	char szRoot[MAX_PATH] = { 0 };
+	if (!GetVolumePathNameA(strFileName.c_str(), szRoot, MAX_PATH))
+		szRoot[0] = '\0';
+
+	DWORD dwSectorsPerCluster = 0, dwBytesPerSector = 0, dwFreeClusters = 0, dwTotalClusters = 0;
+	uint32_t uLogical = 0;
+	if (GetDiskFreeSpaceA(szRoot[0] ? szRoot : NULL, &dwSectorsPerCluster, &dwBytesPerSector, &dwFreeClusters, &dwTotalClusters))
+		uLogical = dwBytesPerSector;
+
+	//卷设备名 \\?\Volume{GUID} (去掉末尾的反斜杠)，查询存储对齐属性不需要读写权限
+	uint32_t uPhysical = 0;
+	char szVolume[MAX_PATH] = { 0 };
+	if (szRoot[0] && GetVolumeNameForVolumeMountPointA(szRoot, szVolume, MAX_PATH))
+	{
+		size_t uLen = strlen(szVolume);
+		if (uLen > 0 && szVolume[uLen - 1] == '\\')
+			szVolume[uLen - 1] = '\0';
+
+		HANDLE hVolume = CreateFileA(szVolume, 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+		if (hVolume != INVALID_HANDLE_VALUE)
+		{
+			STORAGE_PROPERTY_QUERY query;
+			memset(&query, 0, sizeof(query));
+			query.PropertyId = StorageAccessAlignmentProperty;
+			query.QueryType = PropertyStandardQuery;
+
+			STORAGE_ACCESS_ALIGNMENT_DESCRIPTOR alignment;
+			memset(&alignment, 0, sizeof(alignment));
+			DWORD dwReturned = 0;
+			if (DeviceIoControl(hVolume, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof(query), &alignment, sizeof(alignment), &dwReturned, NULL)
+				&& dwReturned >= sizeof(alignment))
+				uPhysical = alignment.BytesPerPhysicalSector;
+			CloseHandle(hVolume);
+		}
+	}
+
+	uint32_t uSector = uPhysical > uLogical ? uPhysical : uLogical;
+	if (uSector == 0)
+		return 4096;
+	return uSector;
+}
+
+void DirectDiskWriter::CopyStream(uint8_t* pDst, uint64_t uPos, uint32_t uBytes, const uint8_t* pTail, uint32_t uTailBytes,
+	const uint8_t* pData, uint32_t uDataBytes)
+{
+	uint64_t uEnd = uPos + uBytes;
+	if (uPos < uTailBytes)
+	{
+		uint32_t uCopy = (uint32_t)((uEnd < uTailBytes ? uEnd : uTailBytes) - uPos);
+		memcpy(pDst, pTail + uPos, uCopy);
+		pDst += uCopy;
+		uPos += uCopy;
+	}
+
+	uint64_t uDataEnd = (uint64_t)uTailBytes + uDataBytes;
+	if (uPos < uEnd && uPos < uDataEnd)
+	{
+		uint32_t uCopy = (uint32_t)((uEnd < uDataEnd ? uEnd : uDataEnd) - uPos);
+		memcpy(pDst, pData + (uPos - uTailBytes), uCopy);
+		pDst += uCopy;
+		uPos += uCopy;
+	}
+
+	//补齐部分填0
+	if (uPos < uEnd)
+		memset(pDst, 0, (size_t)(uEnd - uPos));
+}
+
+bool DirectDiskWriter::Open(const std::string& strFileName, int iQueueDepth, uint64_t uPreallocBytes)
+{
+	Close();
+
+	if (iQueueDepth < 1)
+		iQueueDepth = 1;
+
+	m_uSectorSize = QuerySectorSize(strFileName);
+
+	m_hFile = CreateFileA(strFileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+		FILE_FLAG_NO_BUFFERING | FILE_FLAG_OVERLAPPED, NULL);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+	{
+		printfLog(2, "[DirectDiskWriter::Open], CreateFile %s error(%d)", strFileName.c_str(), GetLastError());
+		return false;
+	}
+
+	if (uPreallocBytes > 0)
+	{
+		uPreallocBytes = (uPreallocBytes + m_uSectorSize - 1) / m_uSectorSize * m_uSectorSize;
+
+		FILE_ALLOCATION_INFO allocInfo;
+		allocInfo.AllocationSize.QuadPart = (LONGLONG)uPreallocBytes;
+		if (!SetFileInformationByHandle(m_hFile, FileAllocationInfo, &allocInfo, sizeof(allocInfo)))
+			printfLog(2, "[DirectDiskWriter::Open], preallocate %llu bytes error(%d)", uPreallocBytes, GetLastError());
+
+		//NTFS上超出有效数据长度的异步写会被同步执行，有SeManageVolumePrivilege时直接设置有效长度
+		if (pub::EnablePrivilege(SE_MANAGE_VOLUME_NAME))
+		{
+			FILE_END_OF_FILE_INFO eofInfo;
+			eofInfo.EndOfFile.QuadPart = (LONGLONG)uPreallocBytes;
+			if (!SetFileInformationByHandle(m_hFile, FileEndOfFileInfo, &eofInfo, sizeof(eofInfo))
+				|| !SetFileValidData(m_hFile, (LONGLONG)uPreallocBytes))
+				printfLog(4, "[DirectDiskWriter::Open], SetFileValidData error(%d)", GetLastError());
+		}
+		else
+		{
+			printfLog(4, "[DirectDiskWriter::Open], SeManageVolumePrivilege not held, extending writes may be serialized");
+		}
+	}
+
+	m_slots.resize(iQueueDepth);
+	for (int i = 0; i < iQueueDepth; i++)
+	{
+		memset(&m_slots[i].ov, 0, sizeof(OVERLAPPED));
+		m_slots[i].ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+		m_slots[i].iBufferIndex = -1;
+		m_slots[i].bNotify = false;
+		m_slots[i].uBytes = 0;
+		m_slots[i].pBounce = NULL;
+	}
+
+	m_pTail = (uint8_t *)VirtualAlloc(NULL, m_uSectorSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (m_pTail == NULL)
+	{
+		printfLog(2, "[DirectDiskWriter::Open], alloc tail buffer error(%d)", GetLastError());
+		m_strFileName = strFileName;
+		Close();
+		return false;
+	}
+
+	m_strFileName = strFileName;
+	m_uFileOffset = 0;
+	m_uDataEnd = 0;
+	m_uTailBytes = 0;
+	m_dwChainError = 0;
+	m_iHead = 0;
+	m_iCount = 0;
+	m_uBytesWritten.store(0, std::memory_order_relaxed);
+	m_dThroughputMBps.store(0, std::memory_order_relaxed);
+	m_uErrorCount.store(0, std::memory_order_relaxed);
+	m_uWindowStartMs = GetTickCount64();
+	m_uWindowBytes = 0;
+
+	printfLog(4, "[DirectDiskWriter::Open], %s sector %u depth %d prealloc %llu", strFileName.c_str(), m_uSectorSize, iQueueDepth, uPreallocBytes);
+	return true;
+}
+
+void DirectDiskWriter::Close()
+{
+	if (m_hFile == INVALID_HANDLE_VALUE)
+		return;
+
+	Flush();
+	WriteTail();
+
+	//去掉预分配但未写入的部分和尾部扇区的补齐
+	FILE_END_OF_FILE_INFO eofInfo;
+	eofInfo.EndOfFile.QuadPart = (LONGLONG)m_uDataEnd;
+	SetFileInformationByHandle(m_hFile, FileEndOfFileInfo, &eofInfo, sizeof(eofInfo));
+
+	CloseHandle(m_hFile);
+	m_hFile = INVALID_HANDLE_VALUE;
+
+	for (size_t i = 0; i < m_slots.size(); i++)
+	{
+		CloseHandle(m_slots[i].ov.hEvent);
+		if (m_slots[i].pBounce)
+			VirtualFree(m_slots[i].pBounce, 0, MEM_RELEASE);
+	}
+	m_slots.clear();
+
+	if (m_pTail)
+	{
+		VirtualFree(m_pTail, 0, MEM_RELEASE);
+		m_pTail = NULL;
+	}
+	m_uTailBytes = 0;
+
+	printfLog(4, "[DirectDiskWriter::Close], %s written %llu bytes errors %llu", m_strFileName.c_str(),
+		GetBytesWritten(), GetErrorCount());
+}
+
+void DirectDiskWriter::SetCompleteCallback(CompleteCallback pfnCallback, void* pContext)
+{
+	m_pfnCallback = pfnCallback;
+	m_pContext = pContext;
+}
+
+DirectDiskWriter::WriteSlot& DirectDiskWriter::AcquireSlot()
+{
+	if (m_iCount == (int)m_slots.size())
+		ReapOldest(true);
+	return m_slots[(m_iHead + m_iCount) % m_slots.size()];
+}
+
+bool DirectDiskWriter::IssueSlot(WriteSlot& slot, const void* pWrite, uint32_t uBytes, uint64_t uWritePos, int iBufferIndex, bool bNotify)
+{
+	HANDLE hEvent = slot.ov.hEvent;
+	memset(&slot.ov, 0, sizeof(OVERLAPPED));
+	slot.ov.hEvent = hEvent;
+	slot.ov.Offset = (DWORD)uWritePos;
+	slot.ov.OffsetHigh = (DWORD)(uWritePos >> 32);
+	slot.iBufferIndex = iBufferIndex;
+	slot.bNotify = bNotify;
+	slot.uBytes = uBytes;
+
+	if (uBytes > 0 && !WriteFile(m_hFile, pWrite, uBytes, NULL, &slot.ov) && GetLastError() != ERROR_IO_PENDING)
+	{
+		printfLog(2, "[DirectDiskWriter::Submit], WriteFile offset %llu bytes %u error(%d)", uWritePos, uBytes, GetLastError());
+		m_uErrorCount.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	m_iCount++;
+	return true;
+}
+
+bool DirectDiskWriter::Submit(int iBufferIndex, const void* pData, uint32_t uBytes, uint64_t* pOffset)
+{
+	if (m_hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	//暂存尾部加上本次数据组成字节流，从扇区对齐的uWritePos开始写；
+	//补齐模式下补零写到整扇区，否则只写整扇区的部分，余下的成为新的暂存尾部
+	const uint8_t* pSrc = (const uint8_t *)pData;
+	uint64_t uWritePos = m_uFileOffset - m_uTailBytes;
+	uint64_t uTotal = (uint64_t)m_uTailBytes + uBytes;
+	uint64_t uWrite = m_bPadToSector ? (uTotal + m_uSectorSize - 1) / m_uSectorSize * m_uSectorSize
+		: uTotal / m_uSectorSize * m_uSectorSize;
+	uint32_t uNewTail = (uint32_t)(uTotal > uWrite ? uTotal - uWrite : 0);
+
+	//没有暂存尾部且地址对齐时整扇区部分直接从调用者缓存写，其余部分(拼接、未对齐、补齐)分片经中转缓存
+	uint64_t uDirect = 0;
+	if (m_uTailBytes == 0 && (uintptr_t)pData % m_uSectorSize == 0)
+		uDirect = (uint64_t)uBytes / m_uSectorSize * m_uSectorSize;
+
+	bool bOk = true;
+	if (uWrite == 0)
+	{
+		//数据全部暂存，也占一个槽，保持回调顺序
+		bOk = IssueSlot(AcquireSlot(), NULL, 0, uWritePos, iBufferIndex, true);
+	}
+	else if (uDirect > 0)
+	{
+		bOk = IssueSlot(AcquireSlot(), pData, (uint32_t)uDirect, uWritePos, iBufferIndex, uDirect == uWrite);
+	}
+
+	for (uint64_t uPos = uDirect; bOk && uPos < uWrite; )
+	{
+		uint32_t uChunk = (uint32_t)(uWrite - uPos < BOUNCE_BYTES ? uWrite - uPos : BOUNCE_BYTES);
+		WriteSlot& slot = AcquireSlot();
+		if (slot.pBounce == NULL)
+		{
+			slot.pBounce = (uint8_t *)VirtualAlloc(NULL, BOUNCE_BYTES, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+			if (slot.pBounce == NULL)
+			{
+				printfLog(2, "[DirectDiskWriter::Submit], alloc bounce buffer %u bytes error(%d)", (uint32_t)BOUNCE_BYTES, GetLastError());
+				m_uErrorCount.fetch_add(1, std::memory_order_relaxed);
+				bOk = false;
+				break;
+			}
+		}
+
+		CopyStream(slot.pBounce, uPos, uChunk, m_pTail, m_uTailBytes, pSrc, uBytes);
+		bOk = IssueSlot(slot, slot.pBounce, uChunk, uWritePos + uPos, iBufferIndex, uPos + uChunk == uWrite);
+		uPos += uChunk;
+	}
+
+	if (!bOk)
+	{
+		//前面已发出的部分可能还在读调用者的缓存，等它们完成后调用者才能归还；这次提交不回调
+		Flush();
+		m_dwChainError = 0;
+		return false;
+	}
+
+	//调用者的缓存之后只在直写请求中被读取，保存新的暂存尾部
+	if (uWrite == 0)
+		memcpy(m_pTail + m_uTailBytes, pData, uBytes);
+	else if (uNewTail > 0)
+		memcpy(m_pTail, pSrc + (uWrite - m_uTailBytes), uNewTail);
+	m_uTailBytes = uNewTail;
+
+	if (pOffset)
+		*pOffset = m_uFileOffset;
+	m_uDataEnd = uWritePos + uTotal;
+	m_uFileOffset = m_bPadToSector ? uWritePos + uWrite : m_uDataEnd;
+	return true;
+}
+
+bool DirectDiskWriter::WriteTail()
+{
+	if (m_uTailBytes == 0)
+		return true;
+
+	//补零到整扇区写入，Close随后把文件截断到m_uDataEnd
+	memset(m_pTail + m_uTailBytes, 0, m_uSectorSize - m_uTailBytes);
+	uint64_t uWritePos = m_uFileOffset - m_uTailBytes;
+
+	OVERLAPPED ov;
+	memset(&ov, 0, sizeof(ov));
+	ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	ov.Offset = (DWORD)uWritePos;
+	ov.OffsetHigh = (DWORD)(uWritePos >> 32);
+
+	DWORD dwWritten = 0;
+	DWORD dwError = 0;
+	if (!WriteFile(m_hFile, m_pTail, m_uSectorSize, NULL, &ov) && GetLastError() != ERROR_IO_PENDING)
+		dwError = GetLastError();
+	else if (!GetOverlappedResult(m_hFile, &ov, &dwWritten, TRUE))
+		dwError = GetLastError();
+	else if (dwWritten != m_uSectorSize)
+		dwError = ERROR_WRITE_FAULT;
+	CloseHandle(ov.hEvent);
+
+	if (dwError != 0)
+	{
+		printfLog(2, "[DirectDiskWriter::WriteTail], offset %llu bytes %u error(%d)", uWritePos, m_uTailBytes, dwError);
+		m_uErrorCount.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	UpdateThroughput(m_uTailBytes);
+	m_uTailBytes = 0;
+	return true;
+}
+
+bool DirectDiskWriter::ReapOldest(bool bWait)
+{
+	if (m_iCount == 0)
+		return false;
+
+	WriteSlot& slot = m_slots[m_iHead];
+	if (!bWait && !HasOverlappedIoCompleted(&slot.ov))
+		return false;
+
+	//数据全部暂存在尾部时没有发出写请求
+	DWORD dwWritten = 0;
+	DWORD dwError = 0;
+	if (slot.uBytes != 0)
+	{
+		if (!GetOverlappedResult(m_hFile, &slot.ov, &dwWritten, TRUE))
+			dwError = GetLastError();
+		else if (dwWritten != slot.uBytes)
+			dwError = ERROR_WRITE_FAULT;
+	}
+
+	if (dwError != 0)
+	{
+		printfLog(2, "[DirectDiskWriter::ReapOldest], buffer %d written %u of %u error(%d)", slot.iBufferIndex, dwWritten, slot.uBytes, dwError);
+		m_uErrorCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	else
+	{
+		UpdateThroughput(dwWritten);
+	}
+
+	int iBufferIndex = slot.iBufferIndex;
+	bool bNotify = slot.bNotify;
+	m_iHead = (m_iHead + 1) % (int)m_slots.size();
+	m_iCount--;
+
+	//一次提交分成多个请求时，前面请求的错误留到最后一个请求一起报告
+	if (!bNotify)
+	{
+		if (dwError != 0)
+			m_dwChainError = dwError;
+		return true;
+	}
+	if (dwError == 0)
+		dwError = m_dwChainError;
+	m_dwChainError = 0;
+
+	if (m_pfnCallback)
+		m_pfnCallback(m_pContext, iBufferIndex, dwError);
+	return true;
+}
+
+int DirectDiskWriter::Poll()
+{
+	int iReaped = 0;
+	while (ReapOldest(false))
+		iReaped++;
+	return iReaped;
+}
+
+void DirectDiskWriter::Flush()
+{
+	while (m_iCount > 0)
+		ReapOldest(true);
+}
+
+void DirectDiskWriter::UpdateThroughput(uint64_t uBytes)
+{
+	m_uBytesWritten.fetch_add(uBytes, std::memory_order_relaxed);
+	m_uWindowBytes += uBytes;
+
+	ULONGLONG uNow = GetTickCount64();
+	if (uNow - m_uWindowStartMs >= 1000)
+	{
+		m_dThroughputMBps.store((double)m_uWindowBytes / (1024.0 * 1024.0) / ((uNow - m_uWindowStartMs) / 1000.0), std::memory_order_relaxed);
+		m_uWindowStartMs = uNow;
+		m_uWindowBytes = 0;
+	}
+}
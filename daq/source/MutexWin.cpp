@@ -4,10 +4,10 @@
 
 namespace mt {
 
-//
+//互斥锁数据
 struct Mutex::MutexData
 {
-	//ٽ
+	//临界区
 	CRITICAL_SECTION critSection;
 };
 
@@ -0,0 +1,99 @@
+﻿#include "NumaAllocator.h"
+#include "pub.h"
+
+#include <initguid.h>
+#include <setupapi.h>
+#include <devpkey.h>
+
+extern void printfLog(int nLevel, const char * fmt, ...);
+
+//Xilinx XDMA驱动的设备接口GUID
+static const GUID GUID_DEVINTERFACE_XDMA = { 0x74c7e4a9, 0x6d5d, 0x4a70, { 0xbc, 0x0d, 0x20, 0x69, 0x1d, 0xff, 0x9e, 0x99 } };
+
+int NumaAllocator::QueryDeviceNumaNode()
+{
+	ULONG uHighestNode = 0;
+	if (!GetNumaHighestNodeNumber(&uHighestNode) || uHighestNode == 0)
+		return 0;
+
+	HDEVINFO hDevInfo = SetupDiGetClassDevsA(&GUID_DEVINTERFACE_XDMA, NULL, NULL, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+	if (hDevInfo == INVALID_HANDLE_VALUE)
+	{
+		printfLog(2, "[NumaAllocator::QueryDeviceNumaNode], SetupDiGetClassDevs error(%d)", GetLastError());
+		return -1;
+	}
+
+	//有多块卡时取第一块
+	int iNode = -1;
+	SP_DEVINFO_DATA devInfo;
+	devInfo.cbSize = sizeof(devInfo);
+	for (DWORD i = 0; iNode < 0 && SetupDiEnumDeviceInfo(hDevInfo, i, &devInfo); i++)
+	{
+		DEVPROPTYPE propType = 0;
+		LONG lNode = -1;
+		if (SetupDiGetDevicePropertyW(hDevInfo, &devInfo, &DEVPKEY_Numa_Node, &propType, (PBYTE)&lNode, sizeof(lNode), NULL, 0)
+			&& propType == DEVPROP_TYPE_INT32 && lNode >= 0 && (ULONG)lNode <= uHighestNode)
+			iNode = (int)lNode;
+	}
+	SetupDiDestroyDeviceInfoList(hDevInfo);
+
+	if (iNode < 0)
+		printfLog(2, "[NumaAllocator::QueryDeviceNumaNode], NUMA node of XDMA device not found");
+	return iNode;
+}
+
+bool NumaAllocator::EnableLargePages()
+{
+	//账户需要在本地安全策略中被授予"锁定内存页"权限
+	static const bool s_bEnabled = pub::EnablePrivilege(SE_LOCK_MEMORY_NAME) && GetLargePageMinimum() != 0;
+	return s_bEnabled;
+}
+
+uint8_t* NumaAllocator::Allocate(size_t uBytes, int iNode, bool bLargePages, bool* pbLargePages)
+{
+	DWORD dwNode = iNode >= 0 ? (DWORD)iNode : NUMA_NO_PREFERRED_NODE;
+	uint8_t* p = NULL;
+
+	if (pbLargePages)
+		*pbLargePages = false;
+
+	if (bLargePages && EnableLargePages())
+	{
+		//大页分配长度须为大页大小的整数倍；物理内存碎片化时可能失败，改用普通页
+		size_t uLargePage = GetLargePageMinimum();
+		size_t uRounded = (uBytes + uLargePage - 1) / uLargePage * uLargePage;
+		p = (uint8_t *)VirtualAllocExNuma(GetCurrentProcess(), NULL, uRounded, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE, dwNode);
+		if (p)
+		{
+			if (pbLargePages)
+				*pbLargePages = true;
+			return p;
+		}
+	}
+
+	p = (uint8_t *)VirtualAllocExNuma(GetCurrentProcess(), NULL, uBytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE, dwNode);
+	if (p == NULL)
+	{
+		printfLog(2, "[NumaAllocator::Allocate], VirtualAllocExNuma %llu bytes node %d error(%d)", (unsigned long long)uBytes, iNode, GetLastError());
+		return NULL;
+	}
+
+	Prefault(p, uBytes);
+	return p;
+}
+
+void NumaAllocator::Free(void* p)
+{
+	if (p)
+		VirtualFree(p, 0, MEM_RELEASE);
+}
+
+void NumaAllocator::Prefault(uint8_t* p, size_t uBytes)
+{
+	//只读会映射到共享的零页，必须写入才会分配物理页；物理页按首次访问落在首选节点上
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	volatile uint8_t* pTouch = p;
+	for (size_t i = 0; i < uBytes; i += si.dwPageSize)
+		pTouch[i] = 0;
+}
@@ -0,0 +1,365 @@
+﻿#include "OmeTiffWriter.h"
+
+#include <string.h>
+#include <stdio.h>
+
+extern void printfLog(int nLevel, const char * fmt, ...);
+
+//TIFF字段类型
+#define TIFF_ASCII	2
+#define TIFF_SHORT	3
+#define TIFF_LONG	4
+#define TIFF_LONG8	16
+
+static uint8_t* PutEntry(uint8_t* p, uint16_t uTag, uint16_t uType, uint64_t uCount, uint64_t uValue)
+{
+	//BigTIFF的IFD项为20字节，值不超过8字节时直接存放(小端，靠低地址)
+	memcpy(p, &uTag, 2);
+	memcpy(p + 2, &uType, 2);
+	memcpy(p + 4, &uCount, 8);
+	memcpy(p + 12, &uValue, 8);
+	return p + 20;
+}
+
+static std::string XmlEscape(const std::string& str)
+{
+	std::string out;
+	for (size_t i = 0; i < str.size(); i++)
+	{
+		switch (str[i])
+		{
+		case '&': out += "&amp;"; break;
+		case '<': out += "&lt;"; break;
+		case '>': out += "&gt;"; break;
+		case '"': out += "&quot;"; break;
+		default: out += str[i]; break;
+		}
+	}
+	return out;
+}
+
+OmeTiffWriter::OmeTiffWriter()
+:m_hFile(INVALID_HANDLE_VALUE)
+,m_iWidth(0)
+,m_iHeight(0)
+,m_iSizeC(1)
+,m_iSizeZ(1)
+,m_iSizeT(0)
+,m_uFrameBytes(0)
+,m_dPixelUm(0)
+,m_dZStepUm(0)
+,m_pStaging(NULL)
+,m_uStagingUsed(0)
+,m_uFileOffset(0)
+,m_uFrames(0)
+,m_uXmlBytes(0)
+,m_uWindowStartMs(0)
+,m_uWindowBytes(0)
+,m_dThroughputMBps(0)
+{
+}
+
+OmeTiffWriter::~OmeTiffWriter()
+{
+	Close();
+
+	if (m_pStaging)
+		VirtualFree(m_pStaging, 0, MEM_RELEASE);
+}
+
+bool OmeTiffWriter::Open(const std::string& strFileName, int iWidth, int iHeight, int iSizeC, int iSizeZ, int iSizeT, uint64_t uPreallocFrames)
+{
+	Close();
+
+	if (iWidth <= 0 || iHeight <= 0)
+		return false;
+
+	m_iWidth = iWidth;
+	m_iHeight = iHeight;
+	m_iSizeC = iSizeC > 0 ? iSizeC : 1;
+	m_iSizeZ = iSizeZ > 0 ? iSizeZ : 1;
+	m_iSizeT = iSizeT > 0 ? iSizeT : 0;
+	m_uFrameBytes = (uint32_t)iWidth * (uint32_t)iHeight * sizeof(uint16_t);
+	m_strFileName = strFileName;
+	m_uFrames = 0;
+	m_uFileOffset = 0;
+	m_uStagingUsed = 0;
+
+	if (m_pStaging == NULL)
+		m_pStaging = (uint8_t *)VirtualAlloc(NULL, STAGING_BYTES, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (m_pStaging == NULL)
+	{
+		printfLog(2, "[OmeTiffWriter::Open], VirtualAlloc error(%d)", GetLastError());
+		return false;
+	}
+
+	//SizeT未知时先按一个时间点写，关闭时回写
+	uint64_t uPlanned = (uint64_t)m_iSizeC * m_iSizeZ * (m_iSizeT > 0 ? m_iSizeT : 1);
+	std::string strXml = BuildXml(uPlanned);
+	if (strXml.size() + 1 > XML_RESERVE - 16)
+	{
+		printfLog(2, "[OmeTiffWriter::Open], OME-XML too long(%u)", (unsigned)strXml.size());
+		return false;
+	}
+
+	m_hFile = CreateFileA(strFileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+	{
+		printfLog(2, "[OmeTiffWriter::Open], CreateFile %s error(%d)", strFileName.c_str(), GetLastError());
+		return false;
+	}
+
+	if (uPreallocFrames > 0)
+	{
+		FILE_ALLOCATION_INFO allocInfo;
+		allocInfo.AllocationSize.QuadPart = (LONGLONG)FrameOffset(uPreallocFrames);
+		if (!SetFileInformationByHandle(m_hFile, FileAllocationInfo, &allocInfo, sizeof(allocInfo)))
+			printfLog(2, "[OmeTiffWriter::Open], preallocate %llu frames error(%d)", uPreallocFrames, GetLastError());
+	}
+
+	//BigTIFF文件头："II" 43 8 0 第一个IFD的偏移，后面紧跟OME-XML
+	memset(m_pStaging, 0, XML_RESERVE);
+	uint16_t uHeader[4] = { 0x4949, 43, 8, 0 };
+	uint64_t uFirstIfd = IfdOffset(0);
+	memcpy(m_pStaging, uHeader, sizeof(uHeader));
+	memcpy(m_pStaging + 8, &uFirstIfd, sizeof(uFirstIfd));
+	memcpy(m_pStaging + 16, strXml.c_str(), strXml.size() + 1);
+	m_uXmlBytes = (uint32_t)strXml.size() + 1;
+	m_uStagingUsed = XML_RESERVE;
+
+	m_uWindowStartMs = GetTickCount64();
+	m_uWindowBytes = 0;
+	m_dThroughputMBps = 0;
+
+	printfLog(4, "[OmeTiffWriter::Open], %s %dx%d C%d Z%d T%d", strFileName.c_str(), m_iWidth, m_iHeight, m_iSizeC, m_iSizeZ, m_iSizeT);
+	return true;
+}
+
+bool OmeTiffWriter::Close()
+{
+	if (m_hFile == INVALID_HANDLE_VALUE)
+		return true;
+
+	bool bRet = FlushStaging();
+
+	if (bRet && m_uFrames > 0)
+	{
+		//按实际帧数回写OME-XML，长度变化时IFD0的ImageDescription一起回写
+		std::string strXml = BuildXml(m_uFrames);
+		strXml.resize(XML_RESERVE - 16, '\0');
+		m_uXmlBytes = (uint32_t)strlen(strXml.c_str()) + 1;
+		bRet = WriteAt(16, strXml.data(), (uint32_t)strXml.size());
+
+		//最后一帧的IFD链接置0，之后预建的IFD不再可达
+		uint8_t ifd[IFD_BYTES];
+		BuildIfd(0, m_uFrames == 1, ifd);
+		bRet = bRet && WriteAt(IfdOffset(0), ifd, IFD_BYTES);
+		if (m_uFrames > 1)
+		{
+			BuildIfd(m_uFrames - 1, true, ifd);
+			bRet = bRet && WriteAt(IfdOffset(m_uFrames - 1), ifd, IFD_BYTES);
+		}
+	}
+	else if (m_uFrames == 0)
+	{
+		//没有IFD的文件不是合法的TIFF(文件头中第一个IFD的偏移指向文件结尾之外)，直接删除
+		printfLog(2, "[OmeTiffWriter::Close], %s no frame written, file deleted", m_strFileName.c_str());
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+		DeleteFileA(m_strFileName.c_str());
+		return bRet;
+	}
+
+	//去掉预分配但未写入的部分
+	FILE_END_OF_FILE_INFO eofInfo;
+	eofInfo.EndOfFile.QuadPart = (LONGLONG)m_uFileOffset;
+	SetFileInformationByHandle(m_hFile, FileEndOfFileInfo, &eofInfo, sizeof(eofInfo));
+
+	CloseHandle(m_hFile);
+	m_hFile = INVALID_HANDLE_VALUE;
+
+	printfLog(4, "[OmeTiffWriter::Close], %s frames %llu bytes %llu", m_strFileName.c_str(), m_uFrames, m_uFileOffset);
+	return bRet;
+}
+
+bool OmeTiffWriter::WriteFrame(const uint16_t* pFrame)
+{
+	if (m_hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	//帧块的第一帧之前写入整个IFD区
+	if (m_uFrames % IFDS_PER_BLOCK == 0)
+	{
+		const uint32_t uIfdBlockBytes = IFDS_PER_BLOCK * IFD_BYTES;
+		if (STAGING_BYTES - m_uStagingUsed < uIfdBlockBytes && !FlushStaging())
+			return false;
+
+		for (uint64_t i = 0; i < IFDS_PER_BLOCK; i++)
+			BuildIfd(m_uFrames + i, false, m_pStaging + m_uStagingUsed + i * IFD_BYTES);
+		m_uStagingUsed += uIfdBlockBytes;
+	}
+
+	if (!Append(pFrame, m_uFrameBytes))
+		return false;
+
+	m_uFrames++;
+	return true;
+}
+
+uint64_t OmeTiffWriter::BlockOffset(uint64_t uBlock) const
+{
+	uint64_t uBlockBytes = (uint64_t)IFDS_PER_BLOCK * (IFD_BYTES + m_uFrameBytes);
+	return XML_RESERVE + uBlock * uBlockBytes;
+}
+
+uint64_t OmeTiffWriter::FrameOffset(uint64_t uFrame) const
+{
+	return BlockOffset(uFrame / IFDS_PER_BLOCK) + IFDS_PER_BLOCK * IFD_BYTES + (uFrame % IFDS_PER_BLOCK) * m_uFrameBytes;
+}
+
+uint64_t OmeTiffWriter::IfdOffset(uint64_t uFrame) const
+{
+	return BlockOffset(uFrame / IFDS_PER_BLOCK) + (uFrame % IFDS_PER_BLOCK) * IFD_BYTES;
+}
+
+std::string OmeTiffWriter::BuildXml(uint64_t uFrames) const
+{
+	uint64_t uPlanesPerT = (uint64_t)m_iSizeC * m_iSizeZ;
+	uint64_t uSizeT = (uFrames + uPlanesPerT - 1) / uPlanesPerT;
+	if (uSizeT == 0)
+		uSizeT = 1;
+
+	std::string strName = m_strFileName;
+	size_t pos = strName.find_last_of("\\/");
+	if (pos != std::string::npos)
+		strName = strName.substr(pos + 1);
+
+	char buf[512];
+	std::string strXml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+		"<OME xmlns=\"http://www.openmicroscopy.org/Schemas/OME/2016-06\""
+		" xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\""
+		" xsi:schemaLocation=\"http://www.openmicroscopy.org/Schemas/OME/2016-06 http://www.openmicroscopy.org/Schemas/OME/2016-06/ome.xsd\""
+		" Creator=\"TPM\">";
+	strXml += "<Image ID=\"Image:0\" Name=\"" + XmlEscape(strName) + "\">";
+
+	snprintf(buf, sizeof(buf), "<Pixels ID=\"Pixels:0\" DimensionOrder=\"XYCZT\" Type=\"uint16\" SignificantBits=\"16\""
+		" SizeX=\"%d\" SizeY=\"%d\" SizeC=\"%d\" SizeZ=\"%d\" SizeT=\"%llu\" BigEndian=\"false\"",
+		m_iWidth, m_iHeight, m_iSizeC, m_iSizeZ, uSizeT);
+	strXml += buf;
+	if (m_dPixelUm > 0)
+	{
+		snprintf(buf, sizeof(buf), " PhysicalSizeX=\"%g\" PhysicalSizeY=\"%g\"", m_dPixelUm, m_dPixelUm);
+		strXml += buf;
+	}
+	if (m_dZStepUm > 0)
+	{
+		snprintf(buf, sizeof(buf), " PhysicalSizeZ=\"%g\"", m_dZStepUm);
+		strXml += buf;
+	}
+	strXml += ">";
+
+	for (int c = 0; c < m_iSizeC; c++)
+	{
+		snprintf(buf, sizeof(buf), "<Channel ID=\"Channel:0:%d\" SamplesPerPixel=\"1\"", c);
+		strXml += buf;
+		if (c < (int)m_channelNames.size())
+			strXml += " Name=\"" + XmlEscape(m_channelNames[c]) + "\"";
+		strXml += "/>";
+	}
+
+	//帧按IFD顺序连续存放，一个TiffData即可描述全部平面
+	snprintf(buf, sizeof(buf), "<TiffData IFD=\"0\" PlaneCount=\"%llu\"/>", uFrames);
+	strXml += buf;
+	strXml += "</Pixels></Image></OME>";
+	return strXml;
+}
+
+void OmeTiffWriter::BuildIfd(uint64_t uFrame, bool bLast, uint8_t* pDst) const
+{
+	memset(pDst, 0, IFD_BYTES);
+
+	//标签必须按升序排列，只有第一个IFD带ImageDescription(OME-XML)
+	uint64_t uCount = (uFrame == 0) ? 12 : 11;
+	memcpy(pDst, &uCount, 8);
+	uint8_t* p = pDst + 8;
+	p = PutEntry(p, 256, TIFF_LONG, 1, (uint64_t)m_iWidth);			//ImageWidth
+	p = PutEntry(p, 257, TIFF_LONG, 1, (uint64_t)m_iHeight);		//ImageLength
+	p = PutEntry(p, 258, TIFF_SHORT, 1, 16);						//BitsPerSample
+	p = PutEntry(p, 259, TIFF_SHORT, 1, 1);							//Compression: none
+	p = PutEntry(p, 262, TIFF_SHORT, 1, 1);							//Photometric: BlackIsZero
+	if (uFrame == 0)
+		p = PutEntry(p, 270, TIFF_ASCII, m_uXmlBytes, 16);			//ImageDescription
+	p = PutEntry(p, 273, TIFF_LONG8, 1, FrameOffset(uFrame));		//StripOffsets
+	p = PutEntry(p, 277, TIFF_SHORT, 1, 1);							//SamplesPerPixel
+	p = PutEntry(p, 278, TIFF_LONG, 1, (uint64_t)m_iHeight);		//RowsPerStrip
+	p = PutEntry(p, 279, TIFF_LONG8, 1, m_uFrameBytes);				//StripByteCounts
+	p = PutEntry(p, 284, TIFF_SHORT, 1, 1);							//PlanarConfiguration
+	p = PutEntry(p, 339, TIFF_SHORT, 1, 1);							//SampleFormat: uint
+
+	uint64_t uNext = bLast ? 0 : IfdOffset(uFrame + 1);
+	memcpy(p, &uNext, 8);
+}
+
+bool OmeTiffWriter::Append(const void* pData, uint32_t uBytes)
+{
+	if (STAGING_BYTES - m_uStagingUsed < uBytes && !FlushStaging())
+		return false;
+
+	//大于暂存区的帧直接写
+	if (uBytes >= STAGING_BYTES)
+	{
+		DWORD dwWritten = 0;
+		if (!WriteFile(m_hFile, pData, uBytes, &dwWritten, NULL) || dwWritten != uBytes)
+		{
+			printfLog(2, "[OmeTiffWriter::Append], WriteFile error(%d)", GetLastError());
+			return false;
+		}
+		m_uFileOffset += uBytes;
+		m_uWindowBytes += uBytes;
+		return true;
+	}
+
+	memcpy(m_pStaging + m_uStagingUsed, pData, uBytes);
+	m_uStagingUsed += uBytes;
+	return true;
+}
+
+bool OmeTiffWriter::FlushStaging()
+{
+	if (m_uStagingUsed == 0)
+		return true;
+
+	if (!WriteAt(m_uFileOffset, m_pStaging, m_uStagingUsed))
+		return false;
+
+	m_uFileOffset += m_uStagingUsed;
+	m_uWindowBytes += m_uStagingUsed;
+	m_uStagingUsed = 0;
+
+	ULONGLONG uNow = GetTickCount64();
+	if (uNow - m_uWindowStartMs >= 1000)
+	{
+		m_dThroughputMBps = (double)m_uWindowBytes / (1024.0 * 1024.0) / ((uNow - m_uWindowStartMs) / 1000.0);
+		m_uWindowStartMs = uNow;
+		m_uWindowBytes = 0;
+	}
+	return true;
+}
+
+bool OmeTiffWriter::WriteAt(uint64_t uOffset, const void* pData, uint32_t uBytes)
+{
+	//同步句柄上带OVERLAPPED的WriteFile按指定偏移写，完成后文件指针移到写入结尾；
+	//顺序写和关闭时的回写都带偏移，不依赖文件指针的位置
+	OVERLAPPED ov;
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset = (DWORD)uOffset;
+	ov.OffsetHigh = (DWORD)(uOffset >> 32);
+
+	DWORD dwWritten = 0;
+	if (!WriteFile(m_hFile, pData, uBytes, &dwWritten, &ov) || dwWritten != uBytes)
+	{
+		printfLog(2, "[OmeTiffWriter::WriteAt], WriteFile at %llu error(%d)", uOffset, GetLastError());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,145 @@
+﻿#include "PreTriggerGate.h"
+
+extern void printfLog(int nLevel, const char * fmt, ...);
+
+PreTriggerGate::PreTriggerGate()
+:m_bEnable(false)
+,m_uPreBytes(0)
+,m_uPostBytes(0)
+,m_iMaxHeld(0)
+,m_bThreshold(false)
+,m_iThresholdChannel(0)
+,m_iThresholdChannels(1)
+,m_sLevel(0)
+,m_bBelow(false)
+,m_iPending(-1)
+,m_bDrainRequested(false)
+,m_uHeldBytes(0)
+,m_uPostRemain(0)
+,m_bRecording(false)
+,m_uEvents(0)
+,m_uCommitted(0)
+,m_uDiscarded(0)
+{
+}
+
+PreTriggerGate::~PreTriggerGate()
+{
+}
+
+void PreTriggerGate::Configure(bool bEnable, uint64_t uPreBytes, uint64_t uPostBytes, int iMaxHeld)
+{
+	m_uPreBytes = uPreBytes;
+	m_uPostBytes = uPostBytes;
+	m_iMaxHeld = iMaxHeld > 0 ? iMaxHeld : 0;
+	m_iPending.store(-1, std::memory_order_relaxed);
+	m_uEvents.store(0, std::memory_order_relaxed);
+	m_uCommitted.store(0, std::memory_order_relaxed);
+	m_uDiscarded.store(0, std::memory_order_relaxed);
+	m_bEnable.store(bEnable, std::memory_order_release);
+
+	printfLog(4, "[PreTriggerGate::Configure], enable %d pre %llu post %llu max held %d", (int)bEnable, uPreBytes, uPostBytes, m_iMaxHeld);
+}
+
+void PreTriggerGate::SetThreshold(bool bEnable, int iChannel, int iChannels, int16_t sLevel)
+{
+	m_bThreshold = bEnable && iChannels > 0 && iChannel >= 0 && iChannel < iChannels;
+	m_iThresholdChannel = iChannel;
+	m_iThresholdChannels = iChannels;
+	m_sLevel = sLevel;
+	//开始时处于阈值之上不算越过，须先回到阈值之下
+	m_bBelow = false;
+}
+
+void PreTriggerGate::Trigger(int iSource)
+{
+	m_iPending.store(iSource, std::memory_order_release);
+}
+
+bool PreTriggerGate::Offer(int iBufferIndex, const void* pData, uint32_t uBytes, std::vector<int>& commit, std::vector<int>& release)
+{
+	if (m_bThreshold && ScanThreshold(pData, uBytes))
+		Trigger(SOURCE_THRESHOLD);
+
+	bool bStart = false;
+	int iSource = m_iPending.exchange(-1, std::memory_order_acquire);
+	if (iSource >= 0)
+	{
+		uint64_t uEvent = m_uEvents.fetch_add(1, std::memory_order_relaxed);
+		if (!m_bRecording.load(std::memory_order_relaxed))
+		{
+			printfLog(4, "[PreTriggerGate::Offer], event %llu source %d, commit %d pre-trigger buffers (%llu bytes)",
+				uEvent, iSource, (int)m_held.size(), m_uHeldBytes);
+
+			for (size_t i = 0; i < m_held.size(); i++)
+				commit.push_back(m_held[i].iBufferIndex);
+			m_uCommitted.fetch_add(m_uHeldBytes, std::memory_order_relaxed);
+			m_held.clear();
+			m_uHeldBytes = 0;
+			m_bRecording.store(true, std::memory_order_relaxed);
+			bStart = true;
+		}
+		m_uPostRemain = m_uPostBytes;
+	}
+
+	if (m_bRecording.load(std::memory_order_relaxed))
+	{
+		commit.push_back(iBufferIndex);
+		m_uCommitted.fetch_add(uBytes, std::memory_order_relaxed);
+		m_uPostRemain -= uBytes < m_uPostRemain ? uBytes : m_uPostRemain;
+		if (m_uPostRemain == 0)
+			m_bRecording.store(false, std::memory_order_relaxed);
+		return bStart;
+	}
+
+	//保留覆盖预触发长度所需的最少缓存，更早的归还
+	Held held = { iBufferIndex, uBytes };
+	m_held.push_back(held);
+	m_uHeldBytes += uBytes;
+	while (!m_held.empty() && (m_uHeldBytes - m_held.front().uBytes >= m_uPreBytes || (m_iMaxHeld > 0 && (int)m_held.size() > m_iMaxHeld)))
+	{
+		release.push_back(m_held.front().iBufferIndex);
+		m_uHeldBytes -= m_held.front().uBytes;
+		m_uDiscarded.fetch_add(m_held.front().uBytes, std::memory_order_relaxed);
+		m_held.pop_front();
+	}
+	return bStart;
+}
+
+void PreTriggerGate::Drain(std::vector<int>& release)
+{
+	m_bDrainRequested.store(false, std::memory_order_relaxed);
+	for (size_t i = 0; i < m_held.size(); i++)
+		release.push_back(m_held[i].iBufferIndex);
+	m_uDiscarded.fetch_add(m_uHeldBytes, std::memory_order_relaxed);
+	m_held.clear();
+	m_uHeldBytes = 0;
+	m_uPostRemain = 0;
+	m_bRecording.store(false, std::memory_order_relaxed);
+	m_iPending.store(-1, std::memory_order_relaxed);
+}
+
+bool PreTriggerGate::ScanThreshold(const void* pData, uint32_t uBytes)
+{
+	//缓存长度是整帧，阈值通道在每个缓存中的位置相同
+	const int16_t* pSample = (const int16_t *)pData;
+	size_t uCount = uBytes / sizeof(int16_t);
+	if ((size_t)m_iThresholdChannel >= uCount)
+		return false;
+
+	for (size_t i = m_iThresholdChannel; i < uCount; i += m_iThresholdChannels)
+	{
+		if (pSample[i] < m_sLevel)
+		{
+			m_bBelow = true;
+		}
+		else if (m_bBelow)
+		{
+			//已经触发，后面的采样只需要决定缓存结束时的状态
+			size_t uLast = (uCount - 1 - m_iThresholdChannel) / m_iThresholdChannels * m_iThresholdChannels + m_iThresholdChannel;
+			m_bBelow = pSample[uLast] < m_sLevel;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,239 @@
+﻿#include "RawContainer.h"
+#include "BlockCompressor.h"
+
+#include <string.h>
+#include <algorithm>
+
+extern void printfLog(int nLevel, const char * fmt, ...);
+
+static uint64_t CurrentFileTime()
+{
+	FILETIME ft;
+	GetSystemTimeAsFileTime(&ft);
+	return ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+RawContainer::RawContainer()
+:m_pHeader(NULL)
+,m_pFooter(NULL)
+,m_uFooterCapacity(0)
+,m_uSegmentBytes(0)
+,m_fpIndex(NULL)
+{
+}
+
+RawContainer::~RawContainer()
+{
+	Close();
+
+	if (m_pHeader)
+		VirtualFree(m_pHeader, 0, MEM_RELEASE);
+	if (m_pFooter)
+		VirtualFree(m_pFooter, 0, MEM_RELEASE);
+}
+
+bool RawContainer::Create(const std::string& strDataFile, int iFileIndex, const std::string& strConfig, uint32_t uSegmentBytes, uint32_t uSegmentsPerBlock)
+{
+	Close();
+	m_records.clear();
+
+	if (m_pHeader == NULL)
+		m_pHeader = (uint8_t *)VirtualAlloc(NULL, HEADER_BYTES, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (m_pHeader == NULL)
+		return false;
+
+	RAW_CONTAINER_HEADER* pHeader = (RAW_CONTAINER_HEADER *)m_pHeader;
+	memset(pHeader, 0, sizeof(RAW_CONTAINER_HEADER));
+	pHeader->uMagic = HEADER_MAGIC;
+	pHeader->uVersion = 1;
+	pHeader->uHeaderBytes = HEADER_BYTES;
+	pHeader->uFileIndex = (uint32_t)iFileIndex;
+	pHeader->uSegmentBytes = uSegmentBytes;
+	pHeader->uSegmentsPerBlock = uSegmentsPerBlock;
+	pHeader->uCreateTime = CurrentFileTime();
+
+	//配置快照超长时截断，保留结尾的0
+	size_t uConfigBytes = std::min(strConfig.size(), sizeof(pHeader->szConfig) - 1);
+	memcpy(pHeader->szConfig, strConfig.data(), uConfigBytes);
+	pHeader->uConfigBytes = (uint32_t)uConfigBytes;
+
+	m_uSegmentBytes = uSegmentBytes;
+
+	std::string strIndexFile = strDataFile + ".idx";
+	m_fpIndex = fopen(strIndexFile.c_str(), "wb");
+	if (m_fpIndex == NULL)
+		printfLog(2, "[RawContainer::Create], fopen %s error", strIndexFile.c_str());
+
+	return true;
+}
+
+void RawContainer::Close()
+{
+	if (m_fpIndex)
+	{
+		fclose(m_fpIndex);
+		m_fpIndex = NULL;
+	}
+}
+
+uint64_t RawContainer::AddBlock(uint64_t uSequence, uint64_t uFileOffset, const void* pData, uint32_t uStoredBytes, uint64_t uFirstSegment)
+{
+	RAW_INDEX_RECORD record;
+	memset(&record, 0, sizeof(record));
+	record.uSequence = uSequence;
+	record.uFileOffset = uFileOffset;
+	record.uStoredBytes = uStoredBytes;
+	record.uRawBytes = uStoredBytes;
+	record.uTimestamp = CurrentFileTime();
+	record.uFirstSegment = uFirstSegment;
+
+	//压缩块从块头取原始长度
+	const COMPRESSED_BLOCK_HEADER* pBlock = (const COMPRESSED_BLOCK_HEADER *)pData;
+	if (uStoredBytes >= sizeof(COMPRESSED_BLOCK_HEADER) && pBlock->uMagic == BlockCompressor::BLOCK_MAGIC)
+	{
+		record.uRawBytes = pBlock->uRawBytes;
+		record.uFlags |= INDEX_FLAG_COMPRESSED;
+	}
+
+	m_records.push_back(record);
+
+	if (m_fpIndex)
+	{
+		fwrite(&record, sizeof(record), 1, m_fpIndex);
+		fflush(m_fpIndex);
+	}
+
+	return m_uSegmentBytes ? record.uRawBytes / m_uSegmentBytes : 0;
+}
+
+uint64_t RawContainer::GetSegmentCount(const void* pData, uint32_t uStoredBytes) const
+{
+	uint64_t uRawBytes = uStoredBytes;
+	const COMPRESSED_BLOCK_HEADER* pBlock = (const COMPRESSED_BLOCK_HEADER *)pData;
+	if (uStoredBytes >= sizeof(COMPRESSED_BLOCK_HEADER) && pBlock->uMagic == BlockCompressor::BLOCK_MAGIC)
+		uRawBytes = pBlock->uRawBytes;
+
+	return m_uSegmentBytes ? uRawBytes / m_uSegmentBytes : 0;
+}
+
+const void* RawContainer::BuildFooter(uint64_t uIndexOffset, uint32_t& uBytes)
+{
+	uint32_t uIndexBytes = (uint32_t)(m_records.size() * sizeof(RAW_INDEX_RECORD));
+	uBytes = (uIndexBytes + sizeof(RAW_INDEX_FOOTER) + HEADER_BYTES - 1) / HEADER_BYTES * HEADER_BYTES;
+
+	if (m_uFooterCapacity < uBytes)
+	{
+		if (m_pFooter)
+			VirtualFree(m_pFooter, 0, MEM_RELEASE);
+		m_pFooter = (uint8_t *)VirtualAlloc(NULL, uBytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+		m_uFooterCapacity = m_pFooter ? uBytes : 0;
+		if (m_pFooter == NULL)
+		{
+			uBytes = 0;
+			return NULL;
+		}
+	}
+
+	memset(m_pFooter, 0, uBytes);
+	if (uIndexBytes)
+		memcpy(m_pFooter, &m_records[0], uIndexBytes);
+
+	//索引尾放在缓存最后，文件截断到写入长度后正好位于文件末尾
+	RAW_INDEX_FOOTER* pFooter = (RAW_INDEX_FOOTER *)(m_pFooter + uBytes - sizeof(RAW_INDEX_FOOTER));
+	pFooter->uMagic = FOOTER_MAGIC;
+	pFooter->uVersion = 1;
+	pFooter->uRecordCount = m_records.size();
+	pFooter->uIndexOffset = uIndexOffset;
+	return m_pFooter;
+}
+
+bool RawContainer::ReadIndex(const std::string& strDataFile, RAW_CONTAINER_HEADER& header, std::vector<RAW_INDEX_RECORD>& records)
+{
+	records.clear();
+
+	HANDLE hFile = CreateFileA(strDataFile.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	DWORD dwRead = 0;
+	if (!ReadFile(hFile, &header, sizeof(header), &dwRead, NULL) || dwRead != sizeof(header) || header.uMagic != HEADER_MAGIC)
+	{
+		CloseHandle(hFile);
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	RAW_INDEX_FOOTER footer;
+	memset(&footer, 0, sizeof(footer));
+	if (GetFileSizeEx(hFile, &fileSize) && fileSize.QuadPart >= (LONGLONG)(HEADER_BYTES + sizeof(footer)))
+	{
+		LARGE_INTEGER pos;
+		pos.QuadPart = fileSize.QuadPart - sizeof(footer);
+		if (SetFilePointerEx(hFile, pos, NULL, FILE_BEGIN))
+			ReadFile(hFile, &footer, sizeof(footer), &dwRead, NULL);
+	}
+
+	if (footer.uMagic == FOOTER_MAGIC && footer.uRecordCount > 0)
+	{
+		records.resize((size_t)footer.uRecordCount);
+		LARGE_INTEGER pos;
+		pos.QuadPart = (LONGLONG)footer.uIndexOffset;
+		DWORD dwBytes = (DWORD)(records.size() * sizeof(RAW_INDEX_RECORD));
+		if (!SetFilePointerEx(hFile, pos, NULL, FILE_BEGIN) || !ReadFile(hFile, &records[0], dwBytes, &dwRead, NULL) || dwRead != dwBytes)
+			records.clear();
+	}
+	CloseHandle(hFile);
+
+	if (!records.empty() || footer.uMagic == FOOTER_MAGIC)
+		return true;
+
+	//没有索引尾(采集未正常结束)，读旁路索引文件
+	std::string strIndexFile = strDataFile + ".idx";
+	FILE* fp = fopen(strIndexFile.c_str(), "rb");
+	if (fp == NULL)
+		return false;
+
+	RAW_INDEX_RECORD record;
+	while (fread(&record, sizeof(record), 1, fp) == 1)
+		records.push_back(record);
+	fclose(fp);
+	return true;
+}
+
+int RawContainer::FindBlock(const RAW_CONTAINER_HEADER& header, const std::vector<RAW_INDEX_RECORD>& records, uint64_t uSegment)
+{
+	if (records.empty() || uSegment < records[0].uFirstSegment)
+		return -1;
+
+	size_t uBlock = records.size();
+
+	//块大小固定时直接计算块号
+	if (header.uSegmentsPerBlock != 0)
+	{
+		uint64_t uGuess = (uSegment - records[0].uFirstSegment) / header.uSegmentsPerBlock;
+		if (uGuess < records.size() && records[(size_t)uGuess].uFirstSegment <= uSegment
+			&& (uGuess + 1 == records.size() || uSegment < records[(size_t)uGuess + 1].uFirstSegment))
+			uBlock = (size_t)uGuess;
+	}
+
+	//块大小不一致时按首段号二分查找
+	if (uBlock == records.size())
+	{
+		size_t lo = 0, hi = records.size();
+		while (hi - lo > 1)
+		{
+			size_t mid = (lo + hi) / 2;
+			if (records[mid].uFirstSegment <= uSegment)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		uBlock = lo;
+	}
+
+	const RAW_INDEX_RECORD& record = records[uBlock];
+	uint64_t uSegments = header.uSegmentBytes ? record.uRawBytes / header.uSegmentBytes : 0;
+	if (uSegment >= record.uFirstSegment + uSegments)
+		return -1;
+	return (int)uBlock;
+}
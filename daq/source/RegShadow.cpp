@@ -0,0 +1,195 @@
+﻿#include "RegShadow.h"
+#include "QTXdmaApi.h"
+
+extern void printfLog(int nLevel, const char * fmt, ...);
+
+RegShadow& RegShadow::Ins()
+{
+	static RegShadow theIns;
+	return theIns;
+}
+
+RegShadow::RegShadow()
+:m_bEnable(true)
+,m_uReadHits(0)
+,m_uWriteSkips(0)
+{
+	for (int i = 0; i < BASE_BLOCKS * REGS_PER_BLOCK; i++)
+	{
+		m_entries[i].uPolicy.store(POLICY_VOLATILE, std::memory_order_relaxed);
+		m_entries[i].bValid = false;
+		m_entries[i].uValue = 0;
+	}
+	SetDefaultPolicies();
+}
+
+RegShadow::~RegShadow()
+{
+}
+
+void RegShadow::SetDefaultPolicies()
+{
+	static const uint32_t adcCtrl[] = { OFFSET_ADC_CTRL_SAMPLE_RATE, OFFSET_ADC_CTRL_EXTERNAL_REFERENCE };
+	static const uint32_t boardInfo[] = { OFFSET_BDINFO_BDINFO, OFFSET_BDINFO_SOFT_VER, OFFSET_BDINFO_XDMA, OFFSET_BDINFO_ADC, OFFSET_BDINFO_DAC, OFFSET_BDINFO_RDTEST };
+	static const uint32_t dmaAdc[] = { 0x00, 0x04, 0x08, 0x0C, 0x10, 0x14, 0x18, 0x1C, 0x20 };
+	static const uint32_t trigCtrl[] = { 0x00, 0x04, 0x08, 0x0C, 0x14, 0x18, 0x24, 0x28, 0x34, 0x38 };
+	static const uint32_t pcieIntr[] = { OFFSET_PCIE_INTR_INTR_ENABLE, 0x20, 0x24, 0x28, 0x2C };
+	static const uint32_t dacCtrl[] = { 0x10, 0x14, 0x18, 0x20 };
+	static const uint32_t dacCtrl2[] = { 0x00 };
+	static const uint32_t dmaDac[] = { 0x04, 0x14, 0x18, 0x1C, 0x20 };
+
+	static const uint32_t adcCtrlPulse[] = { OFFSET_ADC_CTRL_ADC_ENABLE };
+	static const uint32_t pcieIntrPulse[] = { OFFSET_PCIE_INTR_INTR_CLEAR, OFFSET_PCIE_INTR_START_ADC, OFFSET_PCIE_INTR_START_DAC,
+		OFFSET_PCIE_INTR_STOP_ADC, OFFSET_PCIE_INTR_STOP_DAC, 0x18, 0x30, 0x34, 0x38, 0x3C };
+	static const uint32_t trigCtrlPulse[] = { 0x30 };
+	static const uint32_t dacCtrlPulse[] = { 0x1C };
+
+	struct Group
+	{
+		uint64_t uBase;
+		const uint32_t* pOffsets;
+		size_t uCount;
+		int iPolicy;
+	};
+	const Group groups[] =
+	{
+		{ BASE_ADC_CTRL, adcCtrl, sizeof(adcCtrl) / sizeof(adcCtrl[0]), POLICY_CACHEABLE },
+		{ BASE_BOARD_INFO, boardInfo, sizeof(boardInfo) / sizeof(boardInfo[0]), POLICY_CACHEABLE },
+		{ BASE_DMA_ADC, dmaAdc, sizeof(dmaAdc) / sizeof(dmaAdc[0]), POLICY_CACHEABLE },
+		{ BASE_TRIG_CTRL, trigCtrl, sizeof(trigCtrl) / sizeof(trigCtrl[0]), POLICY_CACHEABLE },
+		{ BASE_PCIE_INTR, pcieIntr, sizeof(pcieIntr) / sizeof(pcieIntr[0]), POLICY_CACHEABLE },
+		{ BASE_DAC_CTRL, dacCtrl, sizeof(dacCtrl) / sizeof(dacCtrl[0]), POLICY_CACHEABLE },
+		{ BASE_DAC_CTRL2, dacCtrl2, sizeof(dacCtrl2) / sizeof(dacCtrl2[0]), POLICY_CACHEABLE },
+		{ BASE_DMA_DAC, dmaDac, sizeof(dmaDac) / sizeof(dmaDac[0]), POLICY_CACHEABLE },
+		{ BASE_ADC_CTRL, adcCtrlPulse, sizeof(adcCtrlPulse) / sizeof(adcCtrlPulse[0]), POLICY_PULSE },
+		{ BASE_PCIE_INTR, pcieIntrPulse, sizeof(pcieIntrPulse) / sizeof(pcieIntrPulse[0]), POLICY_PULSE },
+		{ BASE_TRIG_CTRL, trigCtrlPulse, sizeof(trigCtrlPulse) / sizeof(trigCtrlPulse[0]), POLICY_PULSE },
+		{ BASE_DAC_CTRL, dacCtrlPulse, sizeof(dacCtrlPulse) / sizeof(dacCtrlPulse[0]), POLICY_PULSE },
+	};
+
+	for (size_t g = 0; g < sizeof(groups) / sizeof(groups[0]); g++)
+	{
+		for (size_t i = 0; i < groups[g].uCount; i++)
+			SetPolicy(groups[g].uBase, groups[g].pOffsets[i], groups[g].iPolicy);
+	}
+}
+
+int RegShadow::IndexOf(uint64_t uBase, uint32_t uOffset)
+{
+	if ((uBase & 0xFFF) != 0 || uBase >= (uint64_t)BASE_BLOCKS * 0x1000)
+		return -1;
+	if ((uOffset & 0x3) != 0 || uOffset >= REGS_PER_BLOCK * 4)
+		return -1;
+	return (int)(uBase >> 12) * REGS_PER_BLOCK + (int)(uOffset >> 2);
+}
+
+void RegShadow::Enable(bool bEnable)
+{
+	//重新打开时板卡上的值可能已被旁路的访问改变
+	if (bEnable && !IsEnabled())
+		InvalidateAll();
+	m_bEnable.store(bEnable, std::memory_order_relaxed);
+}
+
+void RegShadow::SetPolicy(uint64_t uBase, uint32_t uOffset, int iPolicy)
+{
+	int iIndex = IndexOf(uBase, uOffset);
+	if (iIndex < 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries[iIndex].uPolicy.store((uint8_t)iPolicy, std::memory_order_relaxed);
+	m_entries[iIndex].bValid = false;
+}
+
+int RegShadow::GetPolicy(uint64_t uBase, uint32_t uOffset) const
+{
+	int iIndex = IndexOf(uBase, uOffset);
+	if (iIndex < 0)
+		return POLICY_VOLATILE;
+	return m_entries[iIndex].uPolicy.load(std::memory_order_relaxed);
+}
+
+bool RegShadow::Lookup(uint64_t uBase, uint32_t uOffset, uint64_t& uValue)
+{
+	if (!IsEnabled() || GetPolicy(uBase, uOffset) != POLICY_CACHEABLE)
+		return false;
+
+	Entry& entry = m_entries[IndexOf(uBase, uOffset)];
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!entry.bValid)
+		return false;
+	uValue = entry.uValue;
+	m_uReadHits.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+bool RegShadow::IsRedundantWrite(uint64_t uBase, uint32_t uOffset, uint64_t uValue)
+{
+	if (!IsEnabled() || GetPolicy(uBase, uOffset) != POLICY_CACHEABLE)
+		return false;
+
+	Entry& entry = m_entries[IndexOf(uBase, uOffset)];
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!entry.bValid || entry.uValue != uValue)
+		return false;
+	m_uWriteSkips.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+bool RegShadow::IsPulseLow(uint64_t uBase, uint32_t uOffset)
+{
+	if (!IsEnabled() || GetPolicy(uBase, uOffset) != POLICY_PULSE)
+		return false;
+
+	Entry& entry = m_entries[IndexOf(uBase, uOffset)];
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!entry.bValid || entry.uValue != 0)
+		return false;
+	m_uWriteSkips.fetch_add(1, std::memory_order_relaxed);
+	return true;
+}
+
+void RegShadow::Store(uint64_t uBase, uint32_t uOffset, uint64_t uValue)
+{
+	if (GetPolicy(uBase, uOffset) == POLICY_VOLATILE)
+		return;
+
+	Entry& entry = m_entries[IndexOf(uBase, uOffset)];
+	std::lock_guard<std::mutex> lock(m_mutex);
+	entry.uValue = uValue;
+	entry.bValid = true;
+}
+
+void RegShadow::Invalidate(uint64_t uBase, uint32_t uOffset)
+{
+	int iIndex = IndexOf(uBase, uOffset);
+	if (iIndex < 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries[iIndex].bValid = false;
+}
+
+void RegShadow::InvalidateBase(uint64_t uBase)
+{
+	int iFirst = IndexOf(uBase, 0);
+	if (iFirst < 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (int i = iFirst; i < iFirst + REGS_PER_BLOCK; i++)
+		m_entries[i].bValid = false;
+}
+
+void RegShadow::InvalidateAll()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (int i = 0; i < BASE_BLOCKS * REGS_PER_BLOCK; i++)
+			m_entries[i].bValid = false;
+	}
+
+	printfLog(4, "[RegShadow::InvalidateAll], read hits %llu write skips %llu",
+		(unsigned long long)GetReadHits(), (unsigned long long)GetWriteSkips());
+}
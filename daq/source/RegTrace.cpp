@@ -0,0 +1,168 @@
+﻿#include "RegTrace.h"
+
+#include <stdio.h>
+#include <string.h>
+
+extern void printfLog(int nLevel, const char * fmt, ...);
+
+RegTrace& RegTrace::Ins()
+{
+	static RegTrace theIns;
+	return theIns;
+}
+
+RegTrace::RegTrace()
+:m_slots(new Slot[DEFAULT_RECORDS])
+,m_uMask(DEFAULT_RECORDS - 1)
+,m_bEnable(true)
+,m_uWritePos(0)
+{
+	for (uint64_t i = 0; i <= m_uMask; i++)
+		m_slots[i].uSeq.store(0, std::memory_order_relaxed);
+
+	//计数值和系统时间在同一时刻取一次，解码时据此换算
+	LARGE_INTEGER freq, tick;
+	FILETIME ft;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&tick);
+	GetSystemTimeAsFileTime(&ft);
+	m_uTickFrequency = (uint64_t)freq.QuadPart;
+	m_uBaseTick = (uint64_t)tick.QuadPart;
+	m_uBaseFileTime = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+RegTrace::~RegTrace()
+{
+}
+
+void RegTrace::Snapshot(std::vector<REG_TRACE_RECORD>& records) const
+{
+	records.clear();
+
+	uint64_t uEnd = m_uWritePos.load(std::memory_order_acquire);
+	uint64_t uBegin = uEnd > m_uMask + 1 ? uEnd - (m_uMask + 1) : 0;
+	records.reserve((size_t)(uEnd - uBegin));
+
+	for (uint64_t pos = uBegin; pos < uEnd; pos++)
+	{
+		const Slot& slot = m_slots[pos & m_uMask];
+		if (slot.uSeq.load(std::memory_order_acquire) != pos + 1)
+			continue;
+
+		REG_TRACE_RECORD record;
+		memcpy(&record, &slot.record, sizeof(record));
+
+		//复制期间被覆盖时丢弃
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.uSeq.load(std::memory_order_relaxed) != pos + 1)
+			continue;
+		records.push_back(record);
+	}
+}
+
+void RegTrace::FillHeader(REG_TRACE_FILE_HEADER& header, uint64_t uCount) const
+{
+	header.uMagic = FILE_MAGIC;
+	header.uVersion = FILE_VERSION;
+	header.uTickFrequency = m_uTickFrequency;
+	header.uBaseTick = m_uBaseTick;
+	header.uBaseFileTime = m_uBaseFileTime;
+	header.uCount = uCount;
+}
+
+bool RegTrace::DumpBinary(const std::string& strFile) const
+{
+	std::vector<REG_TRACE_RECORD> records;
+	Snapshot(records);
+
+	FILE* fp = fopen(strFile.c_str(), "wb");
+	if (fp == NULL)
+	{
+		printfLog(2, "[RegTrace::DumpBinary], open %s failed", strFile.c_str());
+		return false;
+	}
+
+	REG_TRACE_FILE_HEADER header;
+	FillHeader(header, records.size());
+	bool bOk = fwrite(&header, sizeof(header), 1, fp) == 1;
+	if (bOk && !records.empty())
+		bOk = fwrite(&records[0], sizeof(REG_TRACE_RECORD), records.size(), fp) == records.size();
+	fclose(fp);
+
+	printfLog(4, "[RegTrace::DumpBinary], %s, %d records", strFile.c_str(), (int)records.size());
+	return bOk;
+}
+
+bool RegTrace::DumpText(const std::string& strFile) const
+{
+	std::vector<REG_TRACE_RECORD> records;
+	Snapshot(records);
+
+	REG_TRACE_FILE_HEADER header;
+	FillHeader(header, records.size());
+	return WriteText(header, records.empty() ? NULL : &records[0], strFile);
+}
+
+bool RegTrace::DecodeFile(const std::string& strBinaryFile, const std::string& strTextFile)
+{
+	FILE* fp = fopen(strBinaryFile.c_str(), "rb");
+	if (fp == NULL)
+	{
+		printfLog(2, "[RegTrace::DecodeFile], open %s failed", strBinaryFile.c_str());
+		return false;
+	}
+
+	REG_TRACE_FILE_HEADER header;
+	std::vector<REG_TRACE_RECORD> records;
+	bool bOk = fread(&header, sizeof(header), 1, fp) == 1 && header.uMagic == FILE_MAGIC && header.uVersion == FILE_VERSION;
+	if (bOk)
+	{
+		records.resize((size_t)header.uCount);
+		if (!records.empty())
+			bOk = fread(&records[0], sizeof(REG_TRACE_RECORD), records.size(), fp) == records.size();
+	}
+	fclose(fp);
+
+	if (!bOk)
+	{
+		printfLog(2, "[RegTrace::DecodeFile], %s is not a register trace file or is truncated", strBinaryFile.c_str());
+		return false;
+	}
+	return WriteText(header, records.empty() ? NULL : &records[0], strTextFile);
+}
+
+bool RegTrace::WriteText(const REG_TRACE_FILE_HEADER& header, const REG_TRACE_RECORD* pRecords, const std::string& strFile)
+{
+	FILE* fp = fopen(strFile.c_str(), "w");
+	if (fp == NULL)
+	{
+		printfLog(2, "[RegTrace::WriteText], open %s failed", strFile.c_str());
+		return false;
+	}
+
+	fprintf(fp, "time,thread,dir,base,offset,value,result\n");
+	for (uint64_t i = 0; i < header.uCount; i++)
+	{
+		const REG_TRACE_RECORD& r = pRecords[i];
+
+		//计数差换算为100ns，加到基准时间上
+		int64_t iDelta = (int64_t)(r.uTick - header.uBaseTick);
+		int64_t iDelta100ns = header.uTickFrequency ? (int64_t)((double)iDelta * 1e7 / header.uTickFrequency) : 0;
+		uint64_t uFileTime = header.uBaseFileTime + iDelta100ns;
+
+		FILETIME ft, ftLocal;
+		SYSTEMTIME st;
+		ft.dwLowDateTime = (DWORD)uFileTime;
+		ft.dwHighDateTime = (DWORD)(uFileTime >> 32);
+		FileTimeToLocalFileTime(&ft, &ftLocal);
+		FileTimeToSystemTime(&ftLocal, &st);
+
+		fprintf(fp, "%04d-%02d-%02d %02d:%02d:%02d.%07u,%u,%s,0x%x,0x%x,0x%llx,%d\n",
+			st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, (unsigned)(uFileTime % 10000000),
+			r.uThreadId, r.usDirection == DIR_WRITE ? "W" : "R", r.uBase, r.uOffset, (unsigned long long)r.uValue, (int)r.sResult);
+	}
+	fclose(fp);
+
+	printfLog(4, "[RegTrace::WriteText], %s, %llu records", strFile.c_str(), (unsigned long long)header.uCount);
+	return true;
+}
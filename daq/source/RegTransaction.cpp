@@ -0,0 +1,131 @@
+﻿#include "RegTransaction.h"
+#include "RegShadow.h"
+#include "qtxdmaapiinterface.h"
+#include "LogMacros.h"
+
+std::mutex RegTransaction::s_mutex;
+
+RegTransaction::RegTransaction(const char* szName)
+:m_szName(szName)
+,m_iOpCount(0)
+,m_bOverflow(false)
+{
+}
+
+RegTransaction& RegTransaction::Add(int iType, uint64_t uBase, uint32_t uOffset, uint64_t uValue, uint64_t* pValue)
+{
+	if (m_iOpCount >= MAX_OPS)
+	{
+		m_bOverflow = true;
+		return *this;
+	}
+
+	Op& op = m_ops[m_iOpCount++];
+	op.iType = iType;
+	op.uBase = uBase;
+	op.uOffset = uOffset;
+	op.uValue = uValue;
+	op.pValue = pValue;
+	return *this;
+}
+
+RegTransaction& RegTransaction::Write(uint64_t uBase, uint32_t uOffset, uint64_t uValue)
+{
+	return Add(OP_WRITE, uBase, uOffset, uValue, NULL);
+}
+
+RegTransaction& RegTransaction::Pulse(uint64_t uBase, uint32_t uOffset)
+{
+	return Add(OP_PULSE, uBase, uOffset, 0, NULL);
+}
+
+RegTransaction& RegTransaction::Read(uint64_t uBase, uint32_t uOffset, uint64_t* pValue)
+{
+	return Add(OP_READ, uBase, uOffset, 0, pValue);
+}
+
+RegTransaction& RegTransaction::ReadBack(uint64_t uBase, uint32_t uOffset, uint64_t* pValue)
+{
+	return Add(OP_READ_BACK, uBase, uOffset, 0, pValue);
+}
+
+int RegTransaction::Flush(STXDMA_CARDINFO* pCardInfo)
+{
+	if (m_bOverflow)
+	{
+		printfLogReg(2, "[RegTransaction::Flush], %s, more than %d operations, not executed", m_szName, (int)MAX_OPS);
+		m_iOpCount = 0;
+		m_bOverflow = false;
+		return -1;
+	}
+
+	RegShadow& shadow = RegShadow::Ins();
+	LARGE_INTEGER freq, begin, end;
+	QueryPerformanceFrequency(&freq);
+
+	int ret = 0;
+	int iDone = 0;
+	int iCalls = 0;
+	int iSkipped = 0;
+	{
+		std::lock_guard<std::mutex> lock(s_mutex);
+		QueryPerformanceCounter(&begin);
+
+		for (; iDone < m_iOpCount && ret == 0; iDone++)
+		{
+			const Op& op = m_ops[iDone];
+			//命中影子缓存的读写不访问驱动；是否命中由每次调用返回，全局计数会被其他线程的访问改变
+			bool bHit = false;
+			int iIssued = 0;
+			switch (op.iType)
+			{
+			case OP_WRITE:
+				ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(pCardInfo, op.uBase, op.uOffset, op.uValue, &bHit);
+				iIssued = 1;
+				break;
+			case OP_PULSE:
+				//上一次脉冲已以0结束时直接从1开始
+				bHit = shadow.IsPulseLow(op.uBase, op.uOffset);
+				if (!bHit)
+				{
+					ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(pCardInfo, op.uBase, op.uOffset, 0);
+					iIssued++;
+				}
+				if (ret == 0)
+				{
+					ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(pCardInfo, op.uBase, op.uOffset, 1);
+					iIssued++;
+				}
+				if (ret == 0)
+				{
+					ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(pCardInfo, op.uBase, op.uOffset, 0);
+					iIssued++;
+				}
+				break;
+			case OP_READ:
+				ret = QTXdmaApiInterface::Func_QTXdmaReadRegister(pCardInfo, op.uBase, op.uOffset, op.pValue, true, &bHit);
+				iIssued = 1;
+				break;
+			case OP_READ_BACK:
+				ret = QTXdmaApiInterface::Func_QTXdmaReadRegisterDirect(pCardInfo, op.uBase, op.uOffset, op.pValue);
+				iIssued = 1;
+				break;
+			}
+
+			//脉冲省略的是前导0，其余写入照常计入；读写命中时本次没有驱动调用
+			if (bHit)
+				iSkipped++;
+			iCalls += iIssued - (bHit && op.iType != OP_PULSE ? 1 : 0);
+		}
+		QueryPerformanceCounter(&end);
+	}
+
+	//整组只记一条；成功按调试级别记录，中断清除等每次采集都执行的事务默认不写日志
+	int iLevel = ret == 0 ? 5 : 2;
+	LOG_PRINTF_REG(iLevel, "[RegTransaction::Flush], %s, ops %d/%d driver calls %d skipped %d ret %d, %.1f us",
+		m_szName, iDone, m_iOpCount, iCalls, iSkipped, ret,
+		(double)(end.QuadPart - begin.QuadPart) * 1e6 / (double)freq.QuadPart);
+
+	m_iOpCount = 0;
+	return ret;
+}
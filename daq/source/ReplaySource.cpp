@@ -0,0 +1,290 @@
+﻿#include "ReplaySource.h"
+#include "RawContainer.h"
+#include "BlockCompressor.h"
+#include "ThreadFileToDisk.h"
+
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+
+extern void printfLog(int nLevel, const char * fmt, ...);
+
+ReplaySource::ReplaySource()
+:m_hFile(INVALID_HANDLE_VALUE)
+,m_hMapping(NULL)
+,m_pView(NULL)
+,m_uFileSize(0)
+,m_bContainer(false)
+,m_uPrefetched(0)
+,m_dRateMBps(0)
+,m_bLoop(false)
+,m_pfnFinish(NULL)
+,m_pFinishContext(NULL)
+,m_bStop(false)
+,m_bRunning(false)
+,m_uBytes(0)
+,m_uBlocks(0)
+,m_uStalls(0)
+,m_uElapsedMs(0)
+{
+}
+
+ReplaySource::~ReplaySource()
+{
+	Close();
+}
+
+bool ReplaySource::Open(const std::string& strFileName, uint32_t uChunkBytes)
+{
+	Close();
+
+	m_hFile = CreateFileA(strFileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+	{
+		printfLog(2, "[ReplaySource::Open], CreateFile %s error(%d)", strFileName.c_str(), GetLastError());
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(m_hFile, &fileSize) || fileSize.QuadPart == 0)
+	{
+		printfLog(2, "[ReplaySource::Open], %s is empty", strFileName.c_str());
+		Close();
+		return false;
+	}
+	m_uFileSize = (uint64_t)fileSize.QuadPart;
+
+	m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_hMapping != NULL)
+		m_pView = (const uint8_t *)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (m_pView == NULL)
+	{
+		printfLog(2, "[ReplaySource::Open], map %s error(%d)", strFileName.c_str(), GetLastError());
+		Close();
+		return false;
+	}
+
+	m_blocks.clear();
+	m_bContainer = m_uFileSize >= RawContainer::HEADER_BYTES && *(const uint32_t *)m_pView == RawContainer::HEADER_MAGIC;
+	if (m_bContainer)
+	{
+		RAW_CONTAINER_HEADER header;
+		std::vector<RAW_INDEX_RECORD> records;
+		if (!RawContainer::ReadIndex(strFileName, header, records))
+		{
+			printfLog(2, "[ReplaySource::Open], %s has no block index", strFileName.c_str());
+			Close();
+			return false;
+		}
+
+		//异常结束的文件，旁路索引可能记录了未写完的块
+		for (size_t i = 0; i < records.size(); i++)
+		{
+			if (records[i].uFileOffset + records[i].uStoredBytes > m_uFileSize)
+				break;
+			Block block;
+			block.uOffset = records[i].uFileOffset;
+			block.uStoredBytes = records[i].uStoredBytes;
+			block.uRawBytes = records[i].uRawBytes;
+			block.bCompressed = (records[i].uFlags & RawContainer::INDEX_FLAG_COMPRESSED) != 0;
+			m_blocks.push_back(block);
+		}
+	}
+	else
+	{
+		//分块不能超过缓存池的块大小
+		uint32_t uPoolBytes = (uint32_t)ThreadFileToDisk::Ins().GetPoolBlockSize() * 1024 * 1024;
+		if (uChunkBytes == 0 || uChunkBytes > uPoolBytes)
+			uChunkBytes = uPoolBytes;
+		if (uChunkBytes == 0)
+		{
+			printfLog(2, "[ReplaySource::Open], buffer pool not initialized");
+			Close();
+			return false;
+		}
+
+		for (uint64_t uOffset = 0; uOffset < m_uFileSize; uOffset += uChunkBytes)
+		{
+			Block block;
+			block.uOffset = uOffset;
+			block.uStoredBytes = (uint32_t)std::min((uint64_t)uChunkBytes, m_uFileSize - uOffset);
+			block.uRawBytes = block.uStoredBytes;
+			block.bCompressed = false;
+			m_blocks.push_back(block);
+		}
+	}
+
+	printfLog(4, "[ReplaySource::Open], %s %llu bytes %d blocks container %d", strFileName.c_str(), m_uFileSize,
+		(int)m_blocks.size(), (int)m_bContainer);
+	return true;
+}
+
+void ReplaySource::Close()
+{
+	Stop();
+
+	if (m_pView)
+	{
+		UnmapViewOfFile(m_pView);
+		m_pView = NULL;
+	}
+	if (m_hMapping)
+	{
+		CloseHandle(m_hMapping);
+		m_hMapping = NULL;
+	}
+	if (m_hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+	m_blocks.clear();
+	m_bContainer = false;
+	m_uFileSize = 0;
+}
+
+bool ReplaySource::Start(double dRateMBps, bool bLoop)
+{
+	if (m_pView == NULL || m_blocks.empty())
+		return false;
+
+	Stop();
+
+	m_dRateMBps = dRateMBps;
+	m_bLoop = bLoop;
+	m_uPrefetched = 0;
+	m_uBytes.store(0, std::memory_order_relaxed);
+	m_uBlocks.store(0, std::memory_order_relaxed);
+	m_uStalls.store(0, std::memory_order_relaxed);
+	m_uElapsedMs.store(0, std::memory_order_relaxed);
+	m_bStop.store(false, std::memory_order_relaxed);
+	m_bRunning.store(true, std::memory_order_relaxed);
+	m_thread = std::thread(&ReplaySource::ReplayThread, this);
+
+	printfLog(4, "[ReplaySource::Start], rate %.1f MB/s loop %d", dRateMBps, (int)bLoop);
+	return true;
+}
+
+void ReplaySource::Stop()
+{
+	if (!m_thread.joinable())
+		return;
+
+	m_bStop.store(true, std::memory_order_relaxed);
+	m_thread.join();
+
+	printfLog(4, "[ReplaySource::Stop], %llu blocks %llu bytes %.1f MB/s stalls %llu", GetBlocksReplayed(),
+		GetBytesReplayed(), GetThroughputMBps(), GetStallCount());
+}
+
+void ReplaySource::SetFinishCallback(FinishCallback pfnCallback, void* pContext)
+{
+	m_pfnFinish = pfnCallback;
+	m_pFinishContext = pContext;
+}
+
+double ReplaySource::GetThroughputMBps() const
+{
+	uint64_t uMs = m_uElapsedMs.load(std::memory_order_relaxed);
+	return uMs ? (double)GetBytesReplayed() / (1024.0 * 1024.0) / (uMs / 1000.0) : 0;
+}
+
+void ReplaySource::ReplayThread()
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	uint64_t uBytes = 0;
+
+	do
+	{
+		m_uPrefetched = 0;
+		for (size_t i = 0; i < m_blocks.size() && !m_bStop.load(std::memory_order_relaxed); i++)
+		{
+			ReadAhead(m_blocks[i].uOffset);
+
+			if (!FeedBlock(m_blocks[i]))
+				continue;
+
+			uBytes += m_blocks[i].uRawBytes;
+			m_uBytes.store(uBytes, std::memory_order_relaxed);
+			m_uBlocks.fetch_add(1, std::memory_order_relaxed);
+
+			//按数据率回放时，提前的部分等待
+			std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+			if (m_dRateMBps > 0)
+			{
+				std::chrono::microseconds due((int64_t)(uBytes / (m_dRateMBps * 1024.0 * 1024.0) * 1e6));
+				if (due > elapsed)
+				{
+					std::this_thread::sleep_for(due - elapsed);
+					elapsed = std::chrono::steady_clock::now() - start;
+				}
+			}
+			m_uElapsedMs.store((uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), std::memory_order_relaxed);
+		}
+	} while (m_bLoop && !m_bStop.load(std::memory_order_relaxed));
+
+	//回放完整个文件时通知调用者收尾(如写完并关闭回放写出的文件)
+	if (!m_bStop.load(std::memory_order_relaxed) && m_pfnFinish)
+		m_pfnFinish(m_pFinishContext);
+	m_bRunning.store(false, std::memory_order_relaxed);
+}
+
+bool ReplaySource::FeedBlock(const Block& block)
+{
+	ThreadFileToDisk& disk = ThreadFileToDisk::Ins();
+
+	//与中断线程相同：从空闲链表取缓存，池耗尽时等待写盘线程归还
+	int iBufferIndex = -1;
+	disk.CheckFreeBuffer(iBufferIndex);
+	while (iBufferIndex == -1)
+	{
+		if (m_bStop.load(std::memory_order_relaxed))
+			return false;
+		m_uStalls.fetch_add(1, std::memory_order_relaxed);
+		Sleep(1);
+		disk.CheckFreeBuffer(iBufferIndex);
+	}
+
+	databuffer* pBuffer = disk.m_vectorBuffer[iBufferIndex];
+	const uint8_t* pSrc = m_pView + block.uOffset;
+	uint32_t uBytes = 0;
+	if (block.uRawBytes <= (uint32_t)pBuffer->m_iTotalSize)
+	{
+		if (block.bCompressed)
+			uBytes = BlockCompressor::Decompress(pSrc, block.uStoredBytes, pBuffer->m_bufferAddr, (uint32_t)pBuffer->m_iTotalSize);
+		else
+		{
+			memcpy(pBuffer->m_bufferAddr, pSrc, block.uRawBytes);
+			uBytes = block.uRawBytes;
+		}
+	}
+
+	if (uBytes == 0)
+	{
+		printfLog(2, "[ReplaySource::FeedBlock], block at %llu (%u bytes) does not fit buffer of %d bytes or is corrupt",
+			block.uOffset, block.uRawBytes, pBuffer->m_iTotalSize);
+		disk.PushFreeToListPing(iBufferIndex);
+		return false;
+	}
+
+	pBuffer->m_iBufferSize = (int)uBytes;
+	pBuffer->m_bAvailable.store(true, std::memory_order_release);
+	disk.PushAvailToListPing(iBufferIndex);
+	return true;
+}
+
+void ReplaySource::ReadAhead(uint64_t uOffset)
+{
+	//预读窗口剩一半时发起下一段，由系统异步读入页缓存，拷贝时不会等缺页
+	if (m_uPrefetched >= m_uFileSize || m_uPrefetched > uOffset + READ_AHEAD_BYTES / 2)
+		return;
+
+	uint64_t uStart = std::max(m_uPrefetched, uOffset);
+	uint64_t uEnd = std::min(uStart + READ_AHEAD_BYTES, m_uFileSize);
+
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = (PVOID)(m_pView + uStart);
+	range.NumberOfBytes = (SIZE_T)(uEnd - uStart);
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	m_uPrefetched = uEnd;
+}
@@ -0,0 +1,328 @@
+﻿#include "RingStore.h"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+extern void printfLog(int nLevel, const char * fmt, ...);
+
+RingStore::RingStore()
+:m_pBase(NULL)
+,m_uCapacity(0)
+,m_iPolicy(FULL_OVERWRITE)
+,m_hFile(INVALID_HANDLE_VALUE)
+,m_hMapping(NULL)
+,m_uWritePos(0)
+,m_uReservePos(0)
+,m_uOverwritten(0)
+,m_bInterrupt(false)
+{
+	for (int i = 0; i < MAX_CURSOR; i++)
+	{
+		m_uCursorPos[i].store(0, std::memory_order_relaxed);
+		m_bCursorUsed[i].store(false, std::memory_order_relaxed);
+	}
+}
+
+RingStore::~RingStore()
+{
+	Destroy();
+}
+
+bool RingStore::Create(uint64_t uCapacity, int iPolicy, const std::string& strFilePath)
+{
+	Destroy();
+
+	if (uCapacity == 0)
+		return false;
+
+	if (strFilePath.empty())
+	{
+		m_pBase = (uint8_t *)VirtualAlloc(NULL, (SIZE_T)uCapacity, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+		if (m_pBase == NULL)
+		{
+			printfLog(2, "[RingStore::Create], VirtualAlloc %llu bytes error(%d)", uCapacity, GetLastError());
+			return false;
+		}
+	}
+	else
+	{
+		m_hFile = CreateFileA(strFilePath.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (m_hFile == INVALID_HANDLE_VALUE)
+		{
+			printfLog(2, "[RingStore::Create], CreateFile %s error(%d)", strFilePath.c_str(), GetLastError());
+			return false;
+		}
+
+		//映射时文件会被扩展到容量大小
+		m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READWRITE, (DWORD)(uCapacity >> 32), (DWORD)uCapacity, NULL);
+		if (m_hMapping != NULL)
+			m_pBase = (uint8_t *)MapViewOfFile(m_hMapping, FILE_MAP_WRITE, 0, 0, (SIZE_T)uCapacity);
+
+		if (m_pBase == NULL)
+		{
+			printfLog(2, "[RingStore::Create], map %s error(%d)", strFilePath.c_str(), GetLastError());
+			Destroy();
+			return false;
+		}
+	}
+
+	m_uCapacity = uCapacity;
+	m_iPolicy = iPolicy;
+	m_uWritePos.store(0, std::memory_order_relaxed);
+	m_uReservePos.store(0, std::memory_order_relaxed);
+	m_uOverwritten.store(0, std::memory_order_relaxed);
+	m_bInterrupt.store(false, std::memory_order_relaxed);
+	for (int i = 0; i < MAX_CURSOR; i++)
+	{
+		m_uCursorPos[i].store(0, std::memory_order_relaxed);
+		m_bCursorUsed[i].store(false, std::memory_order_relaxed);
+	}
+
+	printfLog(4, "[RingStore::Create], capacity %llu policy %d file %s", uCapacity, iPolicy, strFilePath.c_str());
+	return true;
+}
+
+void RingStore::Destroy()
+{
+	Interrupt();
+
+	if (m_hMapping != NULL)
+	{
+		if (m_pBase != NULL)
+			UnmapViewOfFile(m_pBase);
+		CloseHandle(m_hMapping);
+		m_hMapping = NULL;
+	}
+	else if (m_pBase != NULL)
+	{
+		VirtualFree(m_pBase, 0, MEM_RELEASE);
+	}
+	m_pBase = NULL;
+
+	if (m_hFile != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+	}
+
+	m_uCapacity = 0;
+}
+
+void RingStore::CopyIn(uint64_t uPos, const uint8_t* pSrc, uint64_t uBytes)
+{
+	uint64_t uOffset = uPos % m_uCapacity;
+	uint64_t uFirst = std::min(uBytes, m_uCapacity - uOffset);
+	memcpy(m_pBase + uOffset, pSrc, (size_t)uFirst);
+	if (uBytes > uFirst)
+		memcpy(m_pBase, pSrc + uFirst, (size_t)(uBytes - uFirst));
+}
+
+void RingStore::CopyOut(uint64_t uPos, uint8_t* pDst, uint64_t uBytes) const
+{
+	uint64_t uOffset = uPos % m_uCapacity;
+	uint64_t uFirst = std::min(uBytes, m_uCapacity - uOffset);
+	memcpy(pDst, m_pBase + uOffset, (size_t)uFirst);
+	if (uBytes > uFirst)
+		memcpy(pDst + uFirst, m_pBase, (size_t)(uBytes - uFirst));
+}
+
+uint64_t RingStore::MinCursorPos() const
+{
+	uint64_t uMin = m_uWritePos.load(std::memory_order_relaxed);
+	for (int i = 0; i < MAX_CURSOR; i++)
+	{
+		if (m_bCursorUsed[i].load(std::memory_order_acquire))
+			uMin = std::min(uMin, m_uCursorPos[i].load(std::memory_order_acquire));
+	}
+	return uMin;
+}
+
+bool RingStore::HasCursor() const
+{
+	for (int i = 0; i < MAX_CURSOR; i++)
+	{
+		if (m_bCursorUsed[i].load(std::memory_order_relaxed))
+			return true;
+	}
+	return false;
+}
+
+bool RingStore::Write(const void* pData, uint64_t uBytes)
+{
+	if (m_pBase == NULL)
+		return false;
+
+	//游标从打开时的写位置开始读，没有读者时拷贝的数据不会被读到，直接跳过
+	//持锁检查，与OpenCursor互斥，新游标不会落在未拷贝的区域
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!HasCursor())
+		{
+			uint64_t uEnd = m_uWritePos.load(std::memory_order_relaxed) + uBytes;
+			m_uReservePos.store(uEnd, std::memory_order_relaxed);
+			m_uWritePos.store(uEnd, std::memory_order_release);
+			return true;
+		}
+	}
+
+	const uint8_t* pSrc = (const uint8_t *)pData;
+	uint64_t uPos = m_uWritePos.load(std::memory_order_relaxed);
+
+	if (m_iPolicy == FULL_OVERWRITE && uBytes > m_uCapacity)
+	{
+		//超过容量的部分只保留最后一圈
+		uint64_t uSkip = uBytes - m_uCapacity;
+		pSrc += uSkip;
+		uPos += uSkip;
+		uBytes = m_uCapacity;
+	}
+
+	while (uBytes > 0)
+	{
+		uint64_t uChunk = std::min(uBytes, m_uCapacity);
+
+		if (m_iPolicy == FULL_BLOCK)
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cvSpace.wait(lock, [&]() {
+				return m_bInterrupt.load(std::memory_order_relaxed) || uPos + uChunk - MinCursorPos() <= m_uCapacity;
+			});
+			if (m_bInterrupt.load(std::memory_order_relaxed))
+				return false;
+		}
+
+		//先公布将被覆盖的区域，再拷贝数据；读者拷贝后检查该位置判断数据是否被破坏
+		m_uReservePos.store(uPos + uChunk, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		CopyIn(uPos, pSrc, uChunk);
+
+		uPos += uChunk;
+		pSrc += uChunk;
+		uBytes -= uChunk;
+		m_uWritePos.store(uPos, std::memory_order_release);
+	}
+
+	m_cvData.notify_all();
+	return true;
+}
+
+int RingStore::OpenCursor()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (int i = 0; i < MAX_CURSOR; i++)
+	{
+		if (!m_bCursorUsed[i].load(std::memory_order_relaxed))
+		{
+			m_uCursorPos[i].store(m_uWritePos.load(std::memory_order_acquire), std::memory_order_relaxed);
+			m_bCursorUsed[i].store(true, std::memory_order_release);
+			return i;
+		}
+	}
+	return -1;
+}
+
+void RingStore::CloseCursor(int iCursor)
+{
+	if (iCursor < 0 || iCursor >= MAX_CURSOR)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bCursorUsed[iCursor].store(false, std::memory_order_release);
+	}
+	m_cvSpace.notify_all();
+}
+
+uint64_t RingStore::Available(int iCursor) const
+{
+	if (iCursor < 0 || iCursor >= MAX_CURSOR || !m_bCursorUsed[iCursor].load(std::memory_order_acquire))
+		return 0;
+
+	uint64_t uAvail = m_uWritePos.load(std::memory_order_acquire) - m_uCursorPos[iCursor].load(std::memory_order_relaxed);
+	return std::min(uAvail, m_uCapacity);
+}
+
+uint64_t RingStore::Read(int iCursor, void* pDst, uint64_t uBytes, DWORD uTimeoutMs, uint64_t* pLost)
+{
+	if (pLost)
+		*pLost = 0;
+
+	if (m_pBase == NULL || iCursor < 0 || iCursor >= MAX_CURSOR || !m_bCursorUsed[iCursor].load(std::memory_order_acquire))
+		return 0;
+
+	uint64_t uRead = m_uCursorPos[iCursor].load(std::memory_order_relaxed);
+	uint64_t uWrite = m_uWritePos.load(std::memory_order_acquire);
+
+	if (uWrite == uRead && uTimeoutMs != 0)
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cvData.wait_for(lock, std::chrono::milliseconds(uTimeoutMs), [&]() {
+			return m_bInterrupt.load(std::memory_order_relaxed) || m_uWritePos.load(std::memory_order_acquire) != uRead;
+		});
+		uWrite = m_uWritePos.load(std::memory_order_acquire);
+	}
+
+	uint64_t uLost = 0;
+	if (uWrite - uRead > m_uCapacity)
+	{
+		//游标已被写者套圈
+		uLost = uWrite - m_uCapacity - uRead;
+		uRead = uWrite - m_uCapacity;
+	}
+
+	uint64_t uCount = std::min(uBytes, uWrite - uRead);
+	uint8_t* pOut = (uint8_t *)pDst;
+	if (uCount > 0)
+	{
+		CopyOut(uRead, pOut, uCount);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t uReserve = m_uReservePos.load(std::memory_order_relaxed);
+		if (uReserve > uRead + m_uCapacity)
+		{
+			//拷贝期间开头部分已被覆盖，丢弃这部分
+			uint64_t uBad = std::min(uCount, uReserve - m_uCapacity - uRead);
+			memmove(pOut, pOut + uBad, (size_t)(uCount - uBad));
+			uLost += uBad;
+			uRead += uBad;
+			uCount -= uBad;
+		}
+	}
+
+	m_uCursorPos[iCursor].store(uRead + uCount, std::memory_order_release);
+
+	if (uLost > 0)
+		m_uOverwritten.fetch_add(uLost, std::memory_order_relaxed);
+	if (pLost)
+		*pLost = uLost;
+
+	if (m_iPolicy == FULL_BLOCK)
+	{
+		//持锁一次，避免写者在检查条件和进入等待之间错过通知
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+		}
+		m_cvSpace.notify_one();
+	}
+
+	return uCount;
+}
+
+void RingStore::Interrupt()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bInterrupt.store(true, std::memory_order_relaxed);
+	}
+	m_cvSpace.notify_all();
+	m_cvData.notify_all();
+}
+
+void RingStore::ResetInterrupt()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_bInterrupt.store(false, std::memory_order_relaxed);
+}
@@ -0,0 +1,404 @@
+﻿#include "SegmentFileStore.h"
+
+#include <stdio.h>
+
+extern void printfLog(int nLevel, const char * fmt, ...);
+
+SegmentFileStore::SegmentFileStore()
+:m_iQueueDepth(8)
+,m_uPreallocBytes(0)
+,m_uMaxBytes(0)
+,m_uMaxSeconds(0)
+,m_bContainer(false)
+,m_uSegmentBytes(0)
+,m_uSegmentsPerBlock(0)
+,m_pfnCallback(NULL)
+,m_pContext(NULL)
+,m_pCurrent(NULL)
+,m_uSegmentStartMs(0)
+,m_iSegment(0)
+,m_iSegmentBlocks(0)
+,m_bRotateRequested(false)
+,m_bNextRequested(false)
+,m_uBlockSeq(0)
+,m_uTrigSegment(0)
+,m_bNextWanted(false)
+,m_bNextFailed(false)
+,m_bStop(false)
+,m_uClosedBytes(0)
+{
+}
+
+SegmentFileStore::~SegmentFileStore()
+{
+	Close();
+}
+
+void SegmentFileStore::SetPolicy(uint64_t uMaxBytes, DWORD uMaxSeconds)
+{
+	m_uMaxBytes = uMaxBytes;
+	m_uMaxSeconds = uMaxSeconds;
+}
+
+void SegmentFileStore::SetCompleteCallback(DirectDiskWriter::CompleteCallback pfnCallback, void* pContext)
+{
+	m_pfnCallback = pfnCallback;
+	m_pContext = pContext;
+}
+
+void SegmentFileStore::SetContainer(bool bEnable, const std::string& strConfig, uint32_t uSegmentBytes, uint32_t uSegmentsPerBlock)
+{
+	m_bContainer = bEnable;
+	m_strConfig = strConfig;
+	m_uSegmentBytes = uSegmentBytes;
+	m_uSegmentsPerBlock = uSegmentsPerBlock;
+}
+
+std::string SegmentFileStore::SegmentFileName(int iIndex) const
+{
+	char szName[512] = { 0 };
+	snprintf(szName, sizeof(szName), "%s\\%s_%05d.bin", m_strDir.c_str(), m_strPrefix.c_str(), iIndex);
+	return szName;
+}
+
+bool SegmentFileStore::OpenSegment(Segment& seg, int iIndex)
+{
+	//按大小轮换时预分配整个分段，写入过程中不再扩展文件元数据
+	uint64_t uPrealloc = m_uMaxBytes != 0 ? m_uMaxBytes : m_uPreallocBytes;
+
+	//写完成先经本分段登记索引，再转给调用者的回调
+	std::unique_ptr<SegmentIndex> pIndex(new SegmentIndex());
+	pIndex->pStore = this;
+	std::unique_ptr<DirectDiskWriter> pWriter(new DirectDiskWriter());
+	pWriter->SetCompleteCallback(OnSegmentWriteComplete, pIndex.get());
+	//容器格式按索引定位每块，每块补齐到扇区边界直接写，不需要与下一块拼接
+	pWriter->SetPadToSector(m_bContainer);
+	std::string strFileName = SegmentFileName(iIndex);
+	if (!pWriter->Open(strFileName, m_iQueueDepth, uPrealloc))
+		return false;
+
+	//文件头作为第一次写入
+	if (m_bContainer)
+	{
+		std::unique_ptr<RawContainer> pContainer(new RawContainer());
+		if (pContainer->Create(strFileName, iIndex, m_strConfig, m_uSegmentBytes, m_uSegmentsPerBlock)
+			&& pWriter->Submit(META_BUFFER_INDEX, pContainer->GetHeader(), RawContainer::HEADER_BYTES))
+			pIndex->pContainer = std::move(pContainer);
+		else
+			printfLog(2, "[SegmentFileStore::OpenSegment], write container header %s failed", strFileName.c_str());
+	}
+
+	seg.pWriter = std::move(pWriter);
+	seg.pIndex = std::move(pIndex);
+	seg.iIndex = iIndex;
+	seg.strFileName = strFileName;
+	return true;
+}
+
+bool SegmentFileStore::Open(const std::string& strDir, const std::string& strPrefix, int iQueueDepth, uint64_t uPreallocBytes)
+{
+	Close();
+
+	m_strDir = strDir;
+	m_strPrefix = strPrefix;
+	m_iQueueDepth = iQueueDepth;
+	m_uPreallocBytes = uPreallocBytes;
+	m_strManifest = m_strDir + "\\" + m_strPrefix + "_manifest.csv";
+	CreateDirectoryA(m_strDir.c_str(), NULL);
+
+	if (!OpenSegment(m_current, 0))
+		return false;
+	GetLocalTime(&m_current.tmStart);
+	m_pCurrent = m_current.pWriter.get();
+	m_uSegmentStartMs = GetTickCount64();
+	m_iSegment = 0;
+	m_iSegmentBlocks = 0;
+	m_bRotateRequested = false;
+	m_bNextRequested = false;
+	m_uBlockSeq = 0;
+	m_uTrigSegment = 0;
+	m_uClosedBytes.store(0, std::memory_order_relaxed);
+
+	FILE* fp = fopen(m_strManifest.c_str(), "w");
+	if (fp)
+	{
+		fprintf(fp, "index,file,bytes,start,end\n");
+		fclose(fp);
+	}
+
+	m_bStop = false;
+	m_bNextWanted = false;
+	m_bNextFailed = false;
+	m_thread = std::thread(&SegmentFileStore::BackgroundThread, this);
+
+	printfLog(4, "[SegmentFileStore::Open], %s max bytes %llu max seconds %u", SegmentFileName(0).c_str(), m_uMaxBytes, m_uMaxSeconds);
+	return true;
+}
+
+void SegmentFileStore::Close()
+{
+	if (m_pCurrent == NULL)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_retired.push_back(std::move(m_current));
+		m_bStop = true;
+	}
+	m_pCurrent = NULL;
+	m_cv.notify_all();
+
+	if (m_thread.joinable())
+		m_thread.join();
+
+	//提前创建但未使用的分段直接删除
+	if (m_next.pWriter)
+	{
+		m_next.pWriter->Close();
+		DeleteFileA(m_next.strFileName.c_str());
+		m_next.pWriter.reset();
+		if (m_next.pIndex->pContainer)
+		{
+			m_next.pIndex->pContainer->Close();
+			DeleteFileA((m_next.strFileName + ".idx").c_str());
+		}
+		m_next.pIndex.reset();
+	}
+
+	printfLog(4, "[SegmentFileStore::Close], %d segments %llu bytes", m_iSegment + 1, GetBytesWritten());
+}
+
+bool SegmentFileStore::NeedRotate(uint32_t uBytes) const
+{
+	if (m_iSegmentBlocks == 0)
+		return false;
+
+	if (m_bRotateRequested)
+		return true;
+
+	if (m_uMaxBytes != 0 && m_pCurrent->GetFileOffset() + uBytes > m_uMaxBytes)
+		return true;
+
+	if (m_uMaxSeconds != 0 && GetTickCount64() - m_uSegmentStartMs >= (ULONGLONG)m_uMaxSeconds * 1000)
+		return true;
+
+	return false;
+}
+
+bool SegmentFileStore::NearRotate(uint32_t uBytes) const
+{
+	//按大小：剩余空间不足最大值的1/8或再写两块；按时间：剩余时间不足PRECREATE_LEAD_MS(最长时间较短时取一半)
+	if (m_uMaxBytes != 0 && m_pCurrent->GetFileOffset() + 2 * (uint64_t)uBytes + m_uMaxBytes / 8 > m_uMaxBytes)
+		return true;
+
+	if (m_uMaxSeconds != 0)
+	{
+		ULONGLONG uMaxMs = (ULONGLONG)m_uMaxSeconds * 1000;
+		ULONGLONG uLeadMs = uMaxMs / 2 < PRECREATE_LEAD_MS ? uMaxMs / 2 : PRECREATE_LEAD_MS;
+		if (GetTickCount64() - m_uSegmentStartMs + uLeadMs >= uMaxMs)
+			return true;
+	}
+
+	return false;
+}
+
+void SegmentFileStore::RequestNext()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bNextWanted = true;
+	}
+	m_bNextRequested = true;
+	m_cv.notify_all();
+}
+
+bool SegmentFileStore::Rotate()
+{
+	//未提前请求(如事件触发的轮换)时在这里创建，写线程等待创建完成
+	if (!m_bNextRequested)
+		RequestNext();
+
+	Segment next;
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cv.wait(lock, [&]() { return m_next.pWriter || m_bNextFailed || m_bStop; });
+		if (!m_next.pWriter)
+		{
+			//创建失败，继续写当前分段，下次再试
+			m_bNextFailed = false;
+			m_cv.notify_all();
+			return false;
+		}
+
+		next = std::move(m_next);
+		m_retired.push_back(std::move(m_current));
+		m_iSegment = next.iIndex;//后台线程据此创建再下一个分段
+	}
+
+	m_current = std::move(next);
+	GetLocalTime(&m_current.tmStart);
+	m_pCurrent = m_current.pWriter.get();
+	m_uSegmentStartMs = GetTickCount64();
+	m_iSegmentBlocks = 0;
+	m_bNextRequested = false;
+	m_cv.notify_all();
+	return true;
+}
+
+bool SegmentFileStore::Submit(int iBufferIndex, const void* pData, uint32_t uBytes)
+{
+	if (m_pCurrent == NULL)
+		return false;
+
+	if (NeedRotate(uBytes))
+		Rotate();
+	m_bRotateRequested = false;
+
+	//先记下待登记的块再提交，提交中回收的较早请求按顺序从队首登记
+	SegmentIndex* pIndex = m_current.pIndex.get();
+	if (pIndex->pContainer)
+	{
+		PendingBlock block = { m_uBlockSeq, m_pCurrent->GetFileOffset(), pData, uBytes, m_uTrigSegment };
+		pIndex->pending.push_back(block);
+	}
+
+	if (!m_pCurrent->Submit(iBufferIndex, pData, uBytes))
+	{
+		if (pIndex->pContainer)
+			pIndex->pending.pop_back();
+		return false;
+	}
+
+	//触发段序号按采集顺序分配，写失败的块留下序号空缺
+	if (pIndex->pContainer)
+		m_uTrigSegment += pIndex->pContainer->GetSegmentCount(pData, uBytes);
+	m_uBlockSeq++;
+	m_iSegmentBlocks++;
+
+	//接近轮换条件时才让后台线程创建下一个分段，避免每个分段都多预分配一个文件
+	if (!m_bNextRequested && NearRotate(uBytes))
+		RequestNext();
+	return true;
+}
+
+int SegmentFileStore::Poll()
+{
+	if (m_pCurrent == NULL)
+		return 0;
+	return m_pCurrent->Poll();
+}
+
+uint64_t SegmentFileStore::GetBytesWritten() const
+{
+	uint64_t uBytes = m_uClosedBytes.load(std::memory_order_relaxed);
+	if (m_pCurrent)
+		uBytes += m_pCurrent->GetBytesWritten();
+	return uBytes;
+}
+
+double SegmentFileStore::GetThroughputMBps() const
+{
+	return m_pCurrent ? m_pCurrent->GetThroughputMBps() : 0;
+}
+
+void SegmentFileStore::RetireSegment(Segment& seg)
+{
+	//所有数据块写完并登记后索引才完整，索引区和索引尾写在最后一个数据块之后
+	seg.pWriter->Flush();
+	RawContainer* pContainer = seg.pIndex->pContainer.get();
+	if (pContainer)
+	{
+		uint32_t uFooterBytes = 0;
+		const void* pFooter = pContainer->BuildFooter(seg.pWriter->GetFileOffset(), uFooterBytes);
+		if (pFooter)
+			seg.pWriter->Submit(META_BUFFER_INDEX, pFooter, uFooterBytes);
+	}
+
+	seg.pWriter->Close();
+	if (pContainer)
+		pContainer->Close();
+
+	m_uClosedBytes.fetch_add(seg.pWriter->GetBytesWritten(), std::memory_order_relaxed);
+	AppendManifest(seg);
+}
+
+void SegmentFileStore::AppendManifest(const Segment& seg)
+{
+	SYSTEMTIME tmEnd;
+	GetLocalTime(&tmEnd);
+
+	FILE* fp = fopen(m_strManifest.c_str(), "a");
+	if (fp == NULL)
+	{
+		printfLog(2, "[SegmentFileStore::AppendManifest], fopen %s error", m_strManifest.c_str());
+		return;
+	}
+
+	fprintf(fp, "%d,%s,%llu,%04d-%02d-%02d %02d:%02d:%02d.%03d,%04d-%02d-%02d %02d:%02d:%02d.%03d\n",
+		seg.iIndex, seg.strFileName.c_str(), (unsigned long long)seg.pWriter->GetFileOffset(),
+		seg.tmStart.wYear, seg.tmStart.wMonth, seg.tmStart.wDay, seg.tmStart.wHour, seg.tmStart.wMinute, seg.tmStart.wSecond, seg.tmStart.wMilliseconds,
+		tmEnd.wYear, tmEnd.wMonth, tmEnd.wDay, tmEnd.wHour, tmEnd.wMinute, tmEnd.wSecond, tmEnd.wMilliseconds);
+	fclose(fp);
+}
+
+void SegmentFileStore::OnSegmentWriteComplete(void* pContext, int iBufferIndex, DWORD dwError)
+{
+	SegmentIndex* pIndex = (SegmentIndex *)pContext;
+
+	//文件头和索引尾不登记；数据块按提交顺序完成，只登记已落盘的块
+	if (iBufferIndex != META_BUFFER_INDEX && !pIndex->pending.empty())
+	{
+		PendingBlock block = pIndex->pending.front();
+		pIndex->pending.pop_front();
+		if (dwError == 0)
+			pIndex->pContainer->AddBlock(block.uSequence, block.uOffset, block.pData, block.uBytes, block.uFirstSegment);
+	}
+
+	//回调中调用者可能归还缓存，须在登记之后
+	SegmentFileStore* pStore = pIndex->pStore;
+	if (pStore->m_pfnCallback)
+		pStore->m_pfnCallback(pStore->m_pContext, iBufferIndex, dwError);
+}
+
+void SegmentFileStore::BackgroundThread()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_cv.wait(lock, [&]() { return m_bStop || !m_retired.empty() || (m_bNextWanted && !m_next.pWriter && !m_bNextFailed); });
+
+		//先关闭旧分段，归还其中未完成写请求占用的缓存
+		while (!m_retired.empty())
+		{
+			Segment seg = std::move(m_retired.front());
+			m_retired.pop_front();
+			lock.unlock();
+
+			RetireSegment(seg);
+
+			lock.lock();
+		}
+
+		if (m_bStop)
+			break;
+
+		if (m_bNextWanted && !m_next.pWriter && !m_bNextFailed)
+		{
+			int iIndex = m_iSegment + 1;
+			lock.unlock();
+
+			Segment next;
+			bool bOk = OpenSegment(next, iIndex);
+
+			lock.lock();
+			if (bOk)
+			{
+				m_next = std::move(next);
+				m_bNextWanted = false;
+			}
+			else
+				m_bNextFailed = true;
+			m_cv.notify_all();
+		}
+	}
+}
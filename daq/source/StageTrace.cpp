@@ -0,0 +1,167 @@
+﻿#include "StageTrace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+extern void printfLog(int nLevel, const char * fmt, ...);
+
+std::atomic<bool> StageTrace::s_bEnable(false);
+std::mutex StageTrace::s_mutex;
+std::vector<StageTrace::ThreadBuffer*> StageTrace::s_buffers;
+
+StageTrace::ThreadSlot::~ThreadSlot()
+{
+	if (pBuffer != NULL)
+		pBuffer->bExited.store(true, std::memory_order_release);
+}
+
+StageTrace::ThreadSlot& StageTrace::CurrentSlot()
+{
+	static thread_local ThreadSlot slot;
+	return slot;
+}
+
+void StageTrace::SetThreadName(const char* szName)
+{
+	ThreadSlot& slot = CurrentSlot();
+	strncpy(slot.szName, szName, sizeof(slot.szName) - 1);
+	slot.szName[sizeof(slot.szName) - 1] = '\0';
+
+	if (slot.pBuffer != NULL)
+	{
+		std::lock_guard<std::mutex> lock(s_mutex);
+		memcpy(slot.pBuffer->szName, slot.szName, sizeof(slot.szName));
+	}
+}
+
+StageTrace::ThreadBuffer* StageTrace::AcquireBuffer(ThreadSlot& slot)
+{
+	std::lock_guard<std::mutex> lock(s_mutex);
+	if (s_buffers.size() >= MAX_THREADS)
+		return NULL;
+
+	ThreadBuffer* pBuffer = new ThreadBuffer;
+	pBuffer->dwThreadId = GetCurrentThreadId();
+	memcpy(pBuffer->szName, slot.szName, sizeof(slot.szName));
+	pBuffer->events.reset(new Event[EVENTS_PER_THREAD]);
+	pBuffer->uCount.store(0, std::memory_order_relaxed);
+	pBuffer->uCleared.store(0, std::memory_order_relaxed);
+	pBuffer->bExited.store(false, std::memory_order_relaxed);
+	s_buffers.push_back(pBuffer);
+	return pBuffer;
+}
+
+void StageTrace::AddEvent(const char* szName, uint64_t uBeginTick, uint64_t uEndTick, int64_t iArg)
+{
+	ThreadSlot& slot = CurrentSlot();
+	if (slot.pBuffer == NULL)
+	{
+		slot.pBuffer = AcquireBuffer(slot);
+		if (slot.pBuffer == NULL)
+			return;
+	}
+
+	ThreadBuffer* pBuffer = slot.pBuffer;
+	uint64_t uCount = pBuffer->uCount.load(std::memory_order_relaxed);
+	Event& ev = pBuffer->events[uCount % EVENTS_PER_THREAD];
+	ev.szName = szName;
+	ev.uBegin = uBeginTick;
+	ev.uEnd = uEndTick;
+	ev.iArg = iArg;
+	pBuffer->uCount.store(uCount + 1, std::memory_order_release);
+}
+
+bool StageTrace::ExportJson(const std::string& strFile)
+{
+	FILE* fp = fopen(strFile.c_str(), "w");
+	if (fp == NULL)
+	{
+		printfLog(2, "[StageTrace::ExportJson], open %s failed", strFile.c_str());
+		return false;
+	}
+
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	double dUsPerTick = 1e6 / (double)freq.QuadPart;
+
+	std::lock_guard<std::mutex> lock(s_mutex);
+
+	//各线程的事件先复制出来，复制期间被覆盖的丢弃
+	std::vector<std::vector<Event> > snapshots(s_buffers.size());
+	uint64_t uOrigin = UINT64_MAX;
+	for (size_t t = 0; t < s_buffers.size(); t++)
+	{
+		ThreadBuffer* pBuffer = s_buffers[t];
+		uint64_t uEnd = pBuffer->uCount.load(std::memory_order_acquire);
+		uint64_t uBegin = uEnd > EVENTS_PER_THREAD ? uEnd - EVENTS_PER_THREAD : 0;
+		uBegin = std::max(uBegin, pBuffer->uCleared.load(std::memory_order_relaxed));
+
+		std::vector<Event>& events = snapshots[t];
+		for (uint64_t i = uBegin; i < uEnd; i++)
+			events.push_back(pBuffer->events[i % EVENTS_PER_THREAD]);
+
+		uint64_t uNow = pBuffer->uCount.load(std::memory_order_acquire);
+		uint64_t uValid = uNow > EVENTS_PER_THREAD ? uNow - EVENTS_PER_THREAD : 0;
+		if (uValid > uBegin)
+			events.erase(events.begin(), events.begin() + (size_t)std::min<uint64_t>(uValid - uBegin, events.size()));
+
+		for (size_t i = 0; i < events.size(); i++)
+			uOrigin = std::min(uOrigin, events[i].uBegin);
+	}
+	if (uOrigin == UINT64_MAX)
+		uOrigin = 0;
+
+	size_t uTotal = 0;
+	bool bFirst = true;
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (size_t t = 0; t < s_buffers.size(); t++)
+	{
+		ThreadBuffer* pBuffer = s_buffers[t];
+		if (pBuffer->szName[0] != '\0')
+		{
+			fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":\"%s\"}}",
+				bFirst ? "" : ",\n", (unsigned long)pBuffer->dwThreadId, pBuffer->szName);
+			bFirst = false;
+		}
+
+		const std::vector<Event>& events = snapshots[t];
+		for (size_t i = 0; i < events.size(); i++)
+		{
+			const Event& ev = events[i];
+			fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"daq\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"arg\":%lld}}",
+				bFirst ? "" : ",\n", ev.szName, (unsigned long)pBuffer->dwThreadId,
+				(ev.uBegin - uOrigin) * dUsPerTick, (ev.uEnd - ev.uBegin) * dUsPerTick, (long long)ev.iArg);
+			bFirst = false;
+		}
+		uTotal += events.size();
+	}
+	fprintf(fp, "\n]}\n");
+	bool bOk = ferror(fp) == 0;
+	fclose(fp);
+
+	printfLog(4, "[StageTrace::ExportJson], %s, %d threads %d events", strFile.c_str(), (int)s_buffers.size(), (int)uTotal);
+	return bOk;
+}
+
+void StageTrace::Clear()
+{
+	std::lock_guard<std::mutex> lock(s_mutex);
+
+	//仍在运行的线程只记下当前位置(计数只由本线程修改)，已退出线程的缓存释放
+	std::vector<ThreadBuffer*> alive;
+	for (size_t t = 0; t < s_buffers.size(); t++)
+	{
+		ThreadBuffer* pBuffer = s_buffers[t];
+		if (pBuffer->bExited.load(std::memory_order_acquire))
+		{
+			delete pBuffer;
+		}
+		else
+		{
+			pBuffer->uCleared.store(pBuffer->uCount.load(std::memory_order_acquire), std::memory_order_relaxed);
+			alive.push_back(pBuffer);
+		}
+	}
+	s_buffers.swap(alive);
+}
@@ -4,6 +4,8 @@
 #define WIN32_LEAN_AND_MEAN
 #include "ThreadFileToDisk.h"
 #include "TraceLog.h"
+#include "LogMacros.h"
+#include "StageTrace.h"
 #include "QTXdmaApi.h"
 #include <time.h>
 
@@ -23,22 +25,49 @@ bool ThreadFileToDisk::m_bInterrupt;
 
 VECTOR_BUFFER ThreadFileToDisk::m_vectorBuffer;
 
-LockFreeQueue<int> m_availListPing(1024);
+//写盘线程没有数据也没有未完成请求时的最长等待，新数据到达时立即唤醒，超时只用于检查停止和清空请求
+static const DWORD AVAIL_IDLE_WAIT_MS = 50;
 
-//ڴ棬صָ붼һй
+//申请内存，返回的指针都放入一个链表进行管理
 
 ThreadFileToDisk::ThreadFileToDisk()
-:m_bIsRunPing(false)
+:m_availListPing(MAX_POOL_BLOCKS)
+,m_bIsRunPing(false)
 ,m_bIsRunPong(false)
+,m_bWriteDisk(false)
+,m_iWriteQueueDepth(8)
+,m_uPreallocBytes(0)
+,m_uSegmentMaxBytes(0)
+,m_uSegmentMaxSeconds(0)
+,m_bCompress(false)
+,m_iCompressThreads(4)
+,m_iCompressChannels(4)
+,m_bContainer(false)
+,m_uContainerSegmentBytes(0)
+,m_uContainerSegmentsPerBlock(0)
+,m_bPoolLargePages(false)
+,m_iPoolNumaNode(-1)
+,m_iPoolBlockSizeMB(0)
+,m_iWriterThreads(4)
+,m_pPoolContainerPing(NULL)
+,m_uPoolTrigSegment(0)
+,m_uIngestBytesPing(0)
+,m_uRetiredBytesPing(0)
+,m_uDroppedPing(0)
+,m_iAvailHighWaterPing(0)
+,m_iInUseHighWaterPing(0)
+,m_iSegmentPendingPing(0)
+,m_uStatsIngestBytes(0)
+,m_uStatsRetiredBytes(0)
+,m_uStatsTickMs(0)
+,m_dIngestMBps(0)
+,m_dWriterMBps(0)
 {
  
 }
 
 ThreadFileToDisk::~ThreadFileToDisk()
 {
-    //m_availListPing.clear();
-    m_freeListPing.clear();
-
 	m_availListPong.clear();
 	m_freeListPong.clear();
 }
@@ -49,38 +78,22 @@ ThreadFileToDisk& ThreadFileToDisk::Ins()
 	return theIns;
 }
 
+//从空闲链表取一个缓存，O(1)；池耗尽时iBufferIndex为-1，并计入GetFreeExhaustedCountPing
 void ThreadFileToDisk::CheckFreeBuffer(int& iBufferIndex)
 {
-	iBufferIndex = -1;
+	PopFreeFromListPing(iBufferIndex);
+	if (iBufferIndex != -1)
+		UpdateHighWater(m_iInUseHighWaterPing, m_iBlockSize - m_freeListPing.size());
+}
 
-	for (int i = 0; i < m_iBlockSize; i++)
-	{
-		if (!m_vectorBuffer[i]->m_bAvailable)
-		{
-			iBufferIndex = i;
-			return;
-		}
-	}
+uint64_t ThreadFileToDisk::GetFreeExhaustedCountPing()
+{
+	return m_freeListPing.exhaustedCount();
 }
 
 void ThreadFileToDisk::PopFreeFromListPing(int& iBufferIndex)
 {
-	printfLog(5, "[ThreadFileToDisk::PopFreeFromList], m_freeList size is %d", m_freeListPing.size());
-
-	m_MutexFreePing.Lock();
-
-	if (m_freeListPing.size() > 0)
-	{
-		iBufferIndex = m_freeListPing.front();
-
-		m_freeListPing.pop_front();
-	}
-	else
-	{
-		iBufferIndex = -1;
-	}
-
-	m_MutexFreePing.Unlock();
+	m_freeListPing.pop(iBufferIndex);
 }
 
 void ThreadFileToDisk::PopFreeFromListPong(int& iBufferIndex)
@@ -105,18 +118,14 @@ void ThreadFileToDisk::PopFreeFromListPong(int& iBufferIndex)
 
 void ThreadFileToDisk::PushFreeToListPing(const int& iBufferIndex)
 {
-	printfLog(5, "[ThreadFileToDisk::PushFreeToList], push free buffer...m_freeList size is %d", m_freeListPing.size());
-
-	m_MutexFreePing.Lock();
-
-	m_freeListPing.push_back(iBufferIndex);
+	m_vectorBuffer[iBufferIndex]->m_bAvailable.store(false, std::memory_order_relaxed);
 
-	m_MutexFreePing.Unlock();
+	m_freeListPing.push(iBufferIndex);
 }
 
 void ThreadFileToDisk::PushFreeToListPong(const int& iBufferIndex)
 {
-	printfLog(5, "[ThreadFileToDisk::PushFreeToList], push free buffer...m_freeList size is %d", m_freeListPong.size());
+	LOG_PRINTF(5, "[ThreadFileToDisk::PushFreeToList], push free buffer...m_freeList size is %d", m_freeListPong.size());
 
 	m_MutexFreePong.Lock();
 
@@ -127,39 +136,38 @@ void ThreadFileToDisk::PushFreeToListPong(const int& iBufferIndex)
 
 void ThreadFileToDisk::PopAvailFromListPing(int& iBufferIndex)
 {
-	//printfLog(5, "[ThreadFileToDisk::PopAvailFromList], m_availList size is %d", m_availListPing.size());
-
-	//m_MutexAvailPing.Lock();
-
-	//if (m_availListPing.size() > 0)
-	//{
-	//	iBufferIndex = m_availListPing.front();
-
-	//	m_availListPing.pop_front();
-	//}
-	//else
-	//{
-	//	iBufferIndex = -1;
-	//}
-
-	//m_MutexAvailPing.Unlock();
-	bool bret = m_availListPing.dequeue(iBufferIndex);
-	if (bret == false)
-	{
+	if (!m_availListPing.pop(iBufferIndex))
 		iBufferIndex = -1;
-	}
+}
 
+void ThreadFileToDisk::WaitAvailFromListPing(int& iBufferIndex, DWORD dwTimeoutMs)
+{
+	STAGE_TRACE_SCOPE("AvailWait", dwTimeoutMs);
+	if (!m_availListPing.wait_pop(iBufferIndex, dwTimeoutMs))
+		iBufferIndex = -1;
 }
 
 void ThreadFileToDisk::PushAvailToListPing(const int& iBufferIndex)
 {
 	//printfLog(5, "[ThreadFileToDisk::PushAvailToList], m_availList size is %d", m_availListPing.size());
 
-	m_MutexAvailPing.Lock();
+	//入队后缓存可能立即被写盘线程取走并归还，先取长度
+	uint64_t uBytes = (uint64_t)m_vectorBuffer[iBufferIndex]->m_iBufferSize;
 
-	m_availListPing.enqueue(iBufferIndex);
+	//只有中断(或回放)线程入队，无需加锁
+	STAGE_TRACE_SCOPE("Handoff", iBufferIndex);
+	bool bret = m_availListPing.push(iBufferIndex);
 
-	m_MutexAvailPing.Unlock();
+	//队列满时丢弃这一块，缓存直接归还，否则缓存会永久丢失
+	if (bret == false)
+	{
+		m_uDroppedPing.fetch_add(1, std::memory_order_relaxed);
+		PushFreeToListPing(iBufferIndex);
+		return;
+	}
+
+	m_uIngestBytesPing.fetch_add(uBytes, std::memory_order_relaxed);
+	UpdateHighWater(m_iAvailHighWaterPing, m_availListPing.size());
 }
 
 void ThreadFileToDisk::PopAvailFromListPong(int& iBufferIndex)
@@ -185,7 +193,61 @@ void ThreadFileToDisk::PopAvailFromListPong(int& iBufferIndex)
 int ThreadFileToDisk::GetAvailSizePing()
 {
     //return m_availListPing.size();
-	return 0;
+	return m_availListPing.size();
+}
+
+void ThreadFileToDisk::GetStatsPing(PIPELINE_STATS& stats)
+{
+	m_MutexStats.Lock();
+
+	//间隔太短时速率抖动大，沿用上次的结果
+	ULONGLONG uNow = GetTickCount64();
+	uint64_t uIngest = m_uIngestBytesPing.load(std::memory_order_relaxed);
+	uint64_t uRetired = m_uRetiredBytesPing.load(std::memory_order_relaxed);
+	if (uNow - m_uStatsTickMs >= 500)
+	{
+		double dSeconds = (uNow - m_uStatsTickMs) / 1000.0;
+		m_dIngestMBps = (uIngest - m_uStatsIngestBytes) / (1024.0 * 1024.0) / dSeconds;
+		m_dWriterMBps = (uRetired - m_uStatsRetiredBytes) / (1024.0 * 1024.0) / dSeconds;
+		m_uStatsIngestBytes = uIngest;
+		m_uStatsRetiredBytes = uRetired;
+		m_uStatsTickMs = uNow;
+		m_iDataSpeed = (int)m_dWriterMBps;
+	}
+	stats.dIngestMBps = m_dIngestMBps;
+	stats.dWriterMBps = m_dWriterMBps;
+
+	m_MutexStats.Unlock();
+
+	stats.iFree = GetFreeSizePing();
+	stats.iAvail = GetAvailSizePing();
+	stats.iInUseHighWater = m_iInUseHighWaterPing.load(std::memory_order_relaxed);
+	stats.iAvailHighWater = m_iAvailHighWaterPing.load(std::memory_order_relaxed);
+	stats.uPoolExhausted = GetFreeExhaustedCountPing();
+	stats.uDropped = m_uDroppedPing.load(std::memory_order_relaxed);
+	stats.uRingOverwritten = m_rawRingPing.GetOverwrittenBytes();
+}
+
+void ThreadFileToDisk::ResetStatsPing()
+{
+	m_MutexStats.Lock();
+	m_uDroppedPing.store(0, std::memory_order_relaxed);
+	m_iAvailHighWaterPing.store(0, std::memory_order_relaxed);
+	m_iInUseHighWaterPing.store(0, std::memory_order_relaxed);
+	m_uStatsIngestBytes = m_uIngestBytesPing.load(std::memory_order_relaxed);
+	m_uStatsRetiredBytes = m_uRetiredBytesPing.load(std::memory_order_relaxed);
+	m_uStatsTickMs = GetTickCount64();
+	m_dIngestMBps = 0;
+	m_dWriterMBps = 0;
+	m_iDataSpeed = 0;
+	m_MutexStats.Unlock();
+}
+
+void ThreadFileToDisk::UpdateHighWater(std::atomic<int>& iHighWater, int iValue)
+{
+	int iCur = iHighWater.load(std::memory_order_relaxed);
+	while (iValue > iCur && !iHighWater.compare_exchange_weak(iCur, iValue, std::memory_order_relaxed))
+		;
 }
 
 int ThreadFileToDisk::GetFreeSizePing()
@@ -222,20 +284,28 @@ bool ThreadFileToDisk::StartPing()
 	}
 
 	m_bIsRunPing = true;
-    m_iThreadCount = 30;
+    m_iThreadCount = m_iWriterThreads;
+    ResetStatsPing();
+    //上次StopPing留下的停止标志在写盘线程启动前清除，否则新线程会立即退出
+    m_bInterrupt = false;
+    m_rawRingPing.ResetInterrupt();
+
+    SYSTEMTIME sys;
+    GetLocalTime(&sys);
+    char szSession[64] = { 0 };
+    snprintf(szSession, sizeof(szSession), "%04d%02d%02d_%02d%02d%02d_%03d",
+        sys.wYear, sys.wMonth, sys.wDay, sys.wHour, sys.wMinute, sys.wSecond, sys.wMilliseconds);
+    m_strSessionPing = szSession;
 
     if(m_iFileBlockType != 2){
         //printfLog(5, "[ThreadFileToDisk::Start], multi file mode");
-        for(int i = 0; i < m_iThreadCount; i++){
-            m_hThread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)EventReporter, (LPVOID)i, NULL, &m_ulThreadID);
-        }
+        //单个分发线程保证原始数据环单写者、写盘按到达顺序编号，并行写盘由m_writerPoolPing完成
+        m_hThread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)EventReporter, (LPVOID)0, NULL, &m_ulThreadID);
     }else {
         //printfLog(5, "[ThreadFileToDisk::Start], single file mode");
         m_hThread = CreateThread(NULL, 0, (LPTHREAD_START_ROUTINE)SingleFilePing, (LPVOID)999, NULL, &m_ulThreadID);
     }
 
-    m_bInterrupt = false;
-
 	return true;
 }
 
@@ -268,6 +338,10 @@ bool ThreadFileToDisk::StartPong()
 void ThreadFileToDisk::Interrupt()
 {
     m_bInterrupt = true;
+    //唤醒阻塞在原始数据环上的写者和读者
+    m_rawRingPing.Interrupt();
+    m_rawRingPong.Interrupt();
+    m_availListPing.wake();
 }
 
 bool ThreadFileToDisk::StopPing()
@@ -275,10 +349,14 @@ bool ThreadFileToDisk::StopPing()
 	if(!m_bIsRunPing)
 		return false;
 
-	m_bIsRunPing = false;
-	
-
+	//写盘线程写完可用队列中已有的数据、关闭文件(写索引尾并截断预分配)后才退出
+	//调用前生产者(中断线程或回放)应已停止，否则之后放入的缓存留到下次StartPing再写
+	Interrupt();
+	WaitForSingleObject(m_hThread, INFINITE);
 	CloseHandle(m_hThread);
+	m_hThread = NULL;
+
+	m_bIsRunPing = false;
 
 	return true;
 }
@@ -319,7 +397,48 @@ void ThreadFileToDisk::set_fileBlockType(int iType)
 
 void ThreadFileToDisk::set_toDiskType(int iType)
 {
-    m_iToDiskType = iType;//1ɼ 2д 3д
+    m_iToDiskType = iType;//1触发采集 2单次写盘 3连续写盘
+}
+
+void ThreadFileToDisk::set_diskWriter(bool bEnable, int iQueueDepth, uint64_t uPreallocBytes)
+{
+	m_bWriteDisk = bEnable;
+	m_iWriteQueueDepth = iQueueDepth;
+	m_uPreallocBytes = uPreallocBytes;
+}
+
+void ThreadFileToDisk::set_poolMemory(bool bLargePages, int iNumaNode)
+{
+	m_bPoolLargePages = bLargePages;
+	m_iPoolNumaNode = iNumaNode;
+}
+
+void ThreadFileToDisk::set_writerPool(int iThreadCount)
+{
+	m_iWriterThreads = iThreadCount > 0 ? iThreadCount : 1;
+}
+
+void ThreadFileToDisk::set_segmentPolicy(uint64_t uMaxBytes, DWORD uMaxSeconds)
+{
+	m_uSegmentMaxBytes = uMaxBytes;
+	m_uSegmentMaxSeconds = uMaxSeconds;
+}
+
+void ThreadFileToDisk::set_compression(bool bEnable, int iThreadCount, int iChannels)
+{
+	m_bCompress = bEnable;
+	m_iCompressThreads = iThreadCount;
+	m_iCompressChannels = iChannels;
+}
+
+void ThreadFileToDisk::set_container(bool bEnable, const std::string& strConfig, uint32_t uSegmentBytes, uint32_t uSegmentsPerBlock)
+{
+	m_MutexConfig.Lock();
+	m_bContainer = bEnable;
+	m_strContainerConfig = strConfig;
+	m_uContainerSegmentBytes = uSegmentBytes;
+	m_uContainerSegmentsPerBlock = uSegmentsPerBlock;
+	m_MutexConfig.Unlock();
 }
 
 //UINT ThreadFileToDisk::SingleFilePing(LPVOID lParam)
@@ -346,7 +465,7 @@ void ThreadFileToDisk::set_toDiskType(int iType)
 //		return -1;
 //	}
 //
-//	//qtȡǰ
+//	//qt获取当前秒数
 //
 //	SYSTEMTIME sys;
 //	GetLocalTime(&sys);
@@ -377,7 +496,7 @@ void ThreadFileToDisk::set_toDiskType(int iType)
 //
 //			iBufferCount += (uint64_t)databuf.m_iBufferSize;
 //
-//			//ǵд̣ͷſпռ䣬дΪֹ
+//			//如果是单次写盘，不再释放空闲空间，写满为止
 //			if (m_iToDiskType != 2)
 //				ThreadFileToDisk::Ins().PushFreeToListPing(databuf);
 //			else
@@ -388,7 +507,7 @@ void ThreadFileToDisk::set_toDiskType(int iType)
 //		}
 //		else
 //		{
-//			//printf("Threadid%dûҵõĻ\n");
+//			//printf("Threadid【%d】没有找到可用的缓冲区\n");
 //			Sleep(1);
 //		}
 //
@@ -400,7 +519,7 @@ void ThreadFileToDisk::set_toDiskType(int iType)
 //
 //		if ((iTmpSec - iCurTimeSec) >= 20 && iBufferCount != 0)
 //		{
-//			//д
+//			//计算写入数据量
 //			ThreadFileToDisk::Ins().m_iDataSpeed = (int)(iBufferCount / (1024 * 1024 * (iTmpSec - iCurTimeSec)));
 //			iCurTimeSec = iTmpSec;
 //			iBufferCount = 0;
@@ -408,7 +527,7 @@ void ThreadFileToDisk::set_toDiskType(int iType)
 //
 //		//        if(iTempSecond != iCurSecond && iBufferCount != 0)
 //		//        {
-//		//            //д
+//		//            //计算写入数据量
 //		//            ThreadFileToDisk::Ins().m_iDataSpeed = iBufferCount / (1024 * 1024);
 //		//            iCurSecond = iTempSecond;
 //		//            iBufferCount = 0;
@@ -417,7 +536,7 @@ void ThreadFileToDisk::set_toDiskType(int iType)
 //
 //	CloseHandle(f);
 //
-//	printfLog(5, "[ThreadFileToDisk::SingleFile],رļ %s", datafilename);
+//	printfLog(5, "[ThreadFileToDisk::SingleFile],关闭文件 %s", datafilename);
 //	return 0;
 //}
 
@@ -459,7 +578,7 @@ void ThreadFileToDisk::set_toDiskType(int iType)
 //				
 //				printfLog(5, "written = %d\n", written);
 //
-//				//ǵд̣ͷſпռ䣬дΪֹ
+//				//如果是单次写盘，不再释放空闲空间，写满为止
 //				if (m_iToDiskType != 2)
 //				{
 //					m_vectorBuffer[iBufferIndex]->m_bAvailable = false;
@@ -474,7 +593,7 @@ void ThreadFileToDisk::set_toDiskType(int iType)
 //			}
 //			else
 //			{
-//				//printf("Threadid%dûҵõĻ\n");
+//				//printf("Threadid【%d】没有找到可用的缓冲区\n");
 //				Sleep(1);
 //			}
 //
@@ -482,7 +601,7 @@ void ThreadFileToDisk::set_toDiskType(int iType)
 //		file_wr_cnt = 0;
 //		FlushFileBuffers(f);
 //		CloseHandle(f);
-//		printfLog(5, "[ThreadFileToDisk::SingleFile],رļ %s", datafilename);
+//		printfLog(5, "[ThreadFileToDisk::SingleFile],关闭文件 %s", datafilename);
 //		file_cnt++;
 //
 //	}
@@ -496,44 +615,166 @@ UINT ThreadFileToDisk::SingleFilePing(LPVOID lParam)
 	int file_wr_cnt = 0;
 	ThreadFileToDisk::Ins().m_bIsRunPing = true;
 
+	SegmentFileStore& writer = ThreadFileToDisk::Ins().m_segmentStorePing;
+	BlockCompressor& compressor = ThreadFileToDisk::Ins().m_compressorPing;
+	bool bWriterOpened = false;
+	std::vector<int> commit;
+	StageTrace::SetThreadName("SingleFilePing");
+
 	while (ThreadFileToDisk::Ins().m_bIsRunPing)
 	{
 		if (ThreadFileToDisk::Ins().m_bInterrupt && ThreadFileToDisk::Ins().GetAvailSizePing() == 0)
 			break;
 
 		do {
-			ThreadFileToDisk::Ins().PopAvailFromListPing(iBufferIndex);
+			//有写请求或压缩块未完成时按1ms轮询回收，否则阻塞到新数据到达
+			DWORD dwWait = (ThreadFileToDisk::Ins().m_iSegmentPendingPing.load(std::memory_order_relaxed) > 0 || compressor.GetPendingCount() > 0) ? 1 : AVAIL_IDLE_WAIT_MS;
+			ThreadFileToDisk::Ins().WaitAvailFromListPing(iBufferIndex, dwWait);
 			if (iBufferIndex != -1)
 			{
-				// ȡ buffer ָʹС
+				// 获取 buffer 的指针和大小
 				unsigned char* buffer = ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_bufferAddr;
 				size_t bufferSize = ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_iBufferSize;
 
-				// ӵ m_rawDataPing 
-				int16_t* dataPtr = reinterpret_cast<int16_t*>(buffer);
-				size_t dataCount = bufferSize / sizeof(int16_t);
-				ThreadFileToDisk::Ins().m_rawDataPing.insert(
-					ThreadFileToDisk::Ins().m_rawDataPing.end(),
-					dataPtr,
-					dataPtr + dataCount
-				);
+				// 将数据写入原始数据环，未创建或没有读者时不拷贝
+				ThreadFileToDisk::Ins().m_rawRingPing.Write(buffer, bufferSize);
+
+				//事件触发记录时每段记录单独成文件
+				if (GateBufferPing(iBufferIndex, commit) && writer.IsOpen())
+					writer.RequestRotate();
 
-				if (ThreadFileToDisk::Ins().m_iToDiskType != 2)
+				for (size_t i = 0; i < commit.size(); i++)
 				{
-					ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_bAvailable = false;
+					unsigned char* pCommit = ThreadFileToDisk::Ins().m_vectorBuffer[commit[i]]->m_bufferAddr;
+					uint32_t uCommit = (uint32_t)ThreadFileToDisk::Ins().m_vectorBuffer[commit[i]]->m_iBufferSize;
+
+					//第一块要写盘的数据到达时才创建文件，此时采集配置已经确定，可写入文件头
+					if (!bWriterOpened)
+					{
+						OpenDiskWriterPing();
+						bWriterOpened = true;
+					}
+
+					//压缩时缓存在压缩完成后归还；否则写盘完成后由回调归还，提交失败时直接归还
+					STAGE_TRACE_SCOPE("DiskSubmit", uCommit);
+					if (compressor.IsRunning())
+						compressor.Submit(commit[i], pCommit, uCommit);
+					else if (!writer.IsOpen() || !SubmitSegmentPing(commit[i], pCommit, uCommit))
+						OnDiskWriteCompletePing(NULL, commit[i], 0);
 				}
 				file_wr_cnt++;
 			}
 			else
 			{
-				Sleep(1);
+				if (ThreadFileToDisk::Ins().m_preTriggerPing.IsDrainRequested())
+					ReleaseGatedPing();
+				writer.Poll();
 			}
-		} while (file_wr_cnt < ThreadFileToDisk::Ins().filecount);
+
+			SubmitCompressedPing();
+		} while (file_wr_cnt < ThreadFileToDisk::Ins().filecount && ThreadFileToDisk::Ins().m_bIsRunPing && !ThreadFileToDisk::Ins().m_bInterrupt);
 		file_wr_cnt = 0;
 	}
+
+	//未触发事件而保留的预触发缓存直接归还
+	ReleaseGatedPing();
+
+	//写完已提交的压缩块后再关闭文件，最后停止压缩线程(写盘回调会归还压缩输出缓存)
+	while (compressor.GetPendingCount() > 0)
+	{
+		SubmitCompressedPing();
+		writer.Poll();
+		Sleep(1);
+	}
+	writer.Close();
+	compressor.Stop();
 	return 0;
 }
 
+void ThreadFileToDisk::OpenDiskWriterPing()
+{
+	ThreadFileToDisk& ins = ThreadFileToDisk::Ins();
+	if (!ins.m_bWriteDisk)
+		return;
+
+	ins.m_segmentStorePing.SetPolicy(ins.m_uSegmentMaxBytes, ins.m_uSegmentMaxSeconds);
+	ins.m_segmentStorePing.SetCompleteCallback(OnSegmentWriteCompletePing, NULL);
+	ins.m_MutexConfig.Lock();
+	ins.m_segmentStorePing.SetContainer(ins.m_bContainer, ins.m_strContainerConfig, ins.m_uContainerSegmentBytes, ins.m_uContainerSegmentsPerBlock);
+	ins.m_MutexConfig.Unlock();
+	ins.m_segmentStorePing.Open(m_strFilePathPing, "xdma_ping_" + ins.m_strSessionPing, ins.m_iWriteQueueDepth, ins.m_uPreallocBytes);
+
+	//压缩块在写盘队列和工作线程之间周转，输出缓存数取两者之和再留余量
+	if (ins.m_segmentStorePing.IsOpen() && ins.m_bCompress)
+	{
+		ins.m_compressorPing.SetInputDoneCallback(OnCompressInputDonePing, NULL);
+		ins.m_compressorPing.Start(ins.m_iCompressThreads, ins.m_iCompressChannels, ins.m_iCompressThreads + ins.m_iWriteQueueDepth + 2);
+	}
+}
+
+void ThreadFileToDisk::SubmitCompressedPing()
+{
+	BlockCompressor& compressor = ThreadFileToDisk::Ins().m_compressorPing;
+	if (!compressor.IsRunning())
+		return;
+
+	int iOutputIndex = -1;
+	const void* pFrame = NULL;
+	uint32_t uFrameBytes = 0;
+	while (compressor.PopCompleted(iOutputIndex, pFrame, uFrameBytes))
+	{
+		if (uFrameBytes == 0 || !SubmitSegmentPing(iOutputIndex, pFrame, uFrameBytes))
+			compressor.ReleaseOutput(iOutputIndex);
+	}
+}
+
+bool ThreadFileToDisk::SubmitSegmentPing(int iBufferIndex, const void* pData, uint32_t uBytes)
+{
+	//先计数再提交，完成回调可能在提交返回前由后台线程调用
+	ThreadFileToDisk& ins = ThreadFileToDisk::Ins();
+	ins.m_iSegmentPendingPing.fetch_add(1, std::memory_order_relaxed);
+	if (ins.m_segmentStorePing.Submit(iBufferIndex, pData, uBytes))
+		return true;
+	ins.m_iSegmentPendingPing.fetch_sub(1, std::memory_order_relaxed);
+	return false;
+}
+
+void ThreadFileToDisk::OnSegmentWriteCompletePing(void* pContext, int iBufferIndex, DWORD dwError)
+{
+	//容器文件头和索引尾由分段写盘自己提交，不计数
+	if (iBufferIndex >= 0)
+		ThreadFileToDisk::Ins().m_iSegmentPendingPing.fetch_sub(1, std::memory_order_relaxed);
+	OnDiskWriteCompletePing(pContext, iBufferIndex, dwError);
+}
+
+void ThreadFileToDisk::OnCompressInputDonePing(void* pContext, int iBufferIndex)
+{
+	OnDiskWriteCompletePing(pContext, iBufferIndex, 0);
+}
+
+void ThreadFileToDisk::OnDiskWriteCompletePing(void* pContext, int iBufferIndex, DWORD dwError)
+{
+	//容器文件头和索引尾不占用缓存
+	if (iBufferIndex < 0)
+		return;
+
+	//压缩输出缓存归还给压缩器
+	if (iBufferIndex >= BlockCompressor::OUTPUT_INDEX_BASE)
+	{
+		ThreadFileToDisk::Ins().m_compressorPing.ReleaseOutput(iBufferIndex);
+		return;
+	}
+
+	if (dwError == 0)
+		ThreadFileToDisk::Ins().m_uRetiredBytesPing.fetch_add((uint64_t)m_vectorBuffer[iBufferIndex]->m_iBufferSize, std::memory_order_relaxed);
+
+	//如果是单次写盘，不再释放空闲空间，写满为止
+	if (ThreadFileToDisk::Ins().m_iToDiskType != 2)
+	{
+		ThreadFileToDisk::Ins().PushFreeToListPing(iBufferIndex);
+	}
+}
+
 
 UINT ThreadFileToDisk::SingleFilePong(LPVOID lParam)
 {
@@ -550,18 +791,12 @@ UINT ThreadFileToDisk::SingleFilePong(LPVOID lParam)
 		ThreadFileToDisk::Ins().PopAvailFromListPong(iBufferIndex);
 		if (iBufferIndex != -1)
 		{
-			// ȡ buffer ָʹС
+			// 获取 buffer 的指针和大小
 			unsigned char* buffer = ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_bufferAddr;
 			size_t bufferSize = ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_iBufferSize;
 
-			// ӵ m_rawDataPong 
-			int16_t* dataPtr = reinterpret_cast<int16_t*>(buffer);
-			size_t dataCount = bufferSize / sizeof(int16_t);
-			ThreadFileToDisk::Ins().m_rawDataPong.insert(
-				ThreadFileToDisk::Ins().m_rawDataPong.end(),
-				dataPtr,
-				dataPtr + dataCount
-			);
+			// 将数据写入原始数据环
+			ThreadFileToDisk::Ins().m_rawRingPong.Write(buffer, bufferSize);
 
 			iBufferCount += (uint64_t)bufferSize;
 
@@ -595,7 +830,7 @@ UINT ThreadFileToDisk::SingleFilePong(LPVOID lParam)
 //		return -1;
 //	}
 //
-//	//qtȡǰ
+//	//qt获取当前秒数
 //
 //	SYSTEMTIME sys;
 //	GetLocalTime(&sys);
@@ -629,7 +864,7 @@ UINT ThreadFileToDisk::SingleFilePong(LPVOID lParam)
 //
 //			iBufferCount += (uint64_t)m_vectorBuffer[iBufferIndex]->m_iBufferSize;
 //
-//			//ǵд̣ͷſпռ䣬дΪֹ
+//			//如果是单次写盘，不再释放空闲空间，写满为止
 //			if (m_iToDiskType != 2)
 //				ThreadFileToDisk::Ins().PushFreeToListPong(iBufferIndex);
 //			else
@@ -640,7 +875,7 @@ UINT ThreadFileToDisk::SingleFilePong(LPVOID lParam)
 //		}
 //		else
 //		{
-//			//printf("Threadid%dûҵõĻ\n");
+//			//printf("Threadid【%d】没有找到可用的缓冲区\n");
 //			Sleep(1);
 //		}
 //
@@ -652,7 +887,7 @@ UINT ThreadFileToDisk::SingleFilePong(LPVOID lParam)
 //
 //		if ((iTmpSec - iCurTimeSec) >= 20 && iBufferCount != 0)
 //		{
-//			//д
+//			//计算写入数据量
 //			ThreadFileToDisk::Ins().m_iDataSpeed = (int)(iBufferCount / (1024 * 1024 * (iTmpSec - iCurTimeSec)));
 //			iCurTimeSec = iTmpSec;
 //			iBufferCount = 0;
@@ -660,7 +895,7 @@ UINT ThreadFileToDisk::SingleFilePong(LPVOID lParam)
 //
 //		//        if(iTempSecond != iCurSecond && iBufferCount != 0)
 //		//        {
-//		//            //д
+//		//            //计算写入数据量
 //		//            ThreadFileToDisk::Ins().m_iDataSpeed = iBufferCount / (1024 * 1024);
 //		//            iCurSecond = iTempSecond;
 //		//            iBufferCount = 0;
@@ -669,7 +904,7 @@ UINT ThreadFileToDisk::SingleFilePong(LPVOID lParam)
 //
 //	CloseHandle(f);
 //
-//	printfLog(5, "[ThreadFileToDisk::SingleFile],رļ %s", datafilename);
+//	printfLog(5, "[ThreadFileToDisk::SingleFile],关闭文件 %s", datafilename);
 //	return 0;
 //}
 
@@ -677,37 +912,153 @@ UINT ThreadFileToDisk::EventReporter(LPVOID lParam)
 {
 	int iBufferIndex = -1;
 	int iThreadId = (int)lParam;
+	ThreadFileToDisk& ins = ThreadFileToDisk::Ins();
+	bool bPoolOpened = false;
+	std::vector<int> commit;
+	StageTrace::SetThreadName("EventReporter");
 
-	while (ThreadFileToDisk::Ins().m_bIsRunPing)
+	while (ins.m_bIsRunPing)
 	{
-		ThreadFileToDisk::Ins().PopAvailFromListPing(iBufferIndex);
+		if (ins.m_bInterrupt && ins.GetAvailSizePing() == 0)
+			break;
+
+		//写盘由写盘线程池完成并回调，这里只需等待新数据
+		ins.WaitAvailFromListPing(iBufferIndex, AVAIL_IDLE_WAIT_MS);
 
 		if (iBufferIndex != -1)
 		{
-			// ȡ buffer ָʹС
-			unsigned char* buffer = ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_bufferAddr;
-			size_t bufferSize = ThreadFileToDisk::Ins().m_vectorBuffer[iBufferIndex]->m_iBufferSize;
+			// 获取 buffer 的指针和大小
+			unsigned char* buffer = ins.m_vectorBuffer[iBufferIndex]->m_bufferAddr;
+			size_t bufferSize = ins.m_vectorBuffer[iBufferIndex]->m_iBufferSize;
 
-			// ӵ m_rawDataPing 
-			int16_t* dataPtr = reinterpret_cast<int16_t*>(buffer);
-			size_t dataCount = bufferSize / sizeof(int16_t);
-			ThreadFileToDisk::Ins().m_rawDataPing.insert(
-				ThreadFileToDisk::Ins().m_rawDataPing.end(),
-				dataPtr,
-				dataPtr + dataCount
-			);
+			// 将数据写入原始数据环，只有本线程写；未创建或没有读者时不拷贝
+			ins.m_rawRingPing.Write(buffer, bufferSize);
 
-			if (ThreadFileToDisk::Ins().m_iToDiskType != 2)
-				ThreadFileToDisk::Ins().PushFreeToListPing(iBufferIndex);
+			GateBufferPing(iBufferIndex, commit);
+			for (size_t i = 0; i < commit.size(); i++)
+			{
+				//第一块要写盘的数据到达时才创建文件，此时采集配置已经确定，可写入文件头
+				if (!bPoolOpened)
+				{
+					OpenWriterPoolPing();
+					bPoolOpened = true;
+				}
+
+				//写盘完成后由按序回调归还缓存，未写盘或提交失败时直接归还
+				databuffer* pCommit = ins.m_vectorBuffer[commit[i]];
+				STAGE_TRACE_SCOPE("DiskSubmit", pCommit->m_iBufferSize);
+				if (!ins.m_writerPoolPing.IsOpen() || !ins.m_writerPoolPing.Submit(commit[i], pCommit->m_bufferAddr, (uint32_t)pCommit->m_iBufferSize))
+					OnDiskWriteCompletePing(NULL, commit[i], 0);
+			}
 		}
 		else
 		{
-			Sleep(1);
+			if (ins.m_preTriggerPing.IsDrainRequested())
+				ReleaseGatedPing();
 		}
 	}
+
+	ReleaseGatedPing();
+	CloseWriterPoolPing();
 	return 0;
 }
 
+bool ThreadFileToDisk::GateBufferPing(int iBufferIndex, std::vector<int>& commit)
+{
+	ThreadFileToDisk& ins = ThreadFileToDisk::Ins();
+	PreTriggerGate& gate = ins.m_preTriggerPing;
+
+	commit.clear();
+	if (!gate.IsEnabled())
+	{
+		//关闭事件记录时归还还在保留的预触发缓存
+		ReleaseGatedPing();
+		commit.push_back(iBufferIndex);
+		return false;
+	}
+
+	//只有预触发/后触发窗口内的缓存写盘，其余直接归还
+	std::vector<int> release;
+	bool bStart = gate.Offer(iBufferIndex, ins.m_vectorBuffer[iBufferIndex]->m_bufferAddr,
+		(uint32_t)ins.m_vectorBuffer[iBufferIndex]->m_iBufferSize, commit, release);
+	for (size_t i = 0; i < release.size(); i++)
+		OnDiskWriteCompletePing(NULL, release[i], 0);
+	return bStart;
+}
+
+void ThreadFileToDisk::ReleaseGatedPing()
+{
+	std::vector<int> release;
+	ThreadFileToDisk::Ins().m_preTriggerPing.Drain(release);
+	for (size_t i = 0; i < release.size(); i++)
+		OnDiskWriteCompletePing(NULL, release[i], 0);
+}
+
+void ThreadFileToDisk::OpenWriterPoolPing()
+{
+	ThreadFileToDisk& ins = ThreadFileToDisk::Ins();
+	if (!ins.m_bWriteDisk)
+		return;
+
+	std::string strFileName = m_strFilePathPing + "\\xdma_pool_" + ins.m_strSessionPing + ".bin";
+	ins.m_writerPoolPing.SetCompleteCallback(OnPoolWriteCompletePing, NULL);
+	ins.m_writerPoolPing.SetPadToSector(ins.m_bContainer);
+	if (!ins.m_writerPoolPing.Open(strFileName, ins.m_iWriterThreads, ins.m_uPreallocBytes))
+		return;
+
+	ins.m_uPoolTrigSegment = 0;
+	ins.m_MutexConfig.Lock();
+	if (ins.m_bContainer)
+	{
+		ins.m_pPoolContainerPing = new RawContainer();
+		if (!ins.m_pPoolContainerPing->Create(strFileName, 0, ins.m_strContainerConfig, ins.m_uContainerSegmentBytes, ins.m_uContainerSegmentsPerBlock)
+			|| !ins.m_writerPoolPing.Submit(-1, ins.m_pPoolContainerPing->GetHeader(), RawContainer::HEADER_BYTES))
+		{
+			printfLog(2, "[ThreadFileToDisk::OpenWriterPoolPing], create container %s failed", strFileName.c_str());
+			delete ins.m_pPoolContainerPing;
+			ins.m_pPoolContainerPing = NULL;
+		}
+	}
+	ins.m_MutexConfig.Unlock();
+}
+
+void ThreadFileToDisk::CloseWriterPoolPing()
+{
+	ThreadFileToDisk& ins = ThreadFileToDisk::Ins();
+	if (!ins.m_writerPoolPing.IsOpen())
+		return;
+
+	//所有块按序登记完后索引才完整，再写索引区和索引尾
+	ins.m_writerPoolPing.Flush();
+	if (ins.m_pPoolContainerPing)
+	{
+		uint32_t uFooterBytes = 0;
+		const void* pFooter = ins.m_pPoolContainerPing->BuildFooter(ins.m_writerPoolPing.GetFileOffset(), uFooterBytes);
+		if (pFooter)
+			ins.m_writerPoolPing.Submit(-1, pFooter, uFooterBytes);
+	}
+	ins.m_writerPoolPing.Close();
+
+	if (ins.m_pPoolContainerPing)
+	{
+		ins.m_pPoolContainerPing->Close();
+		delete ins.m_pPoolContainerPing;
+		ins.m_pPoolContainerPing = NULL;
+	}
+}
+
+void ThreadFileToDisk::OnPoolWriteCompletePing(void* pContext, int iBufferIndex, uint64_t uSequence, uint64_t uOffset,
+	const void* pData, uint32_t uBytes, DWORD dwError)
+{
+	ThreadFileToDisk& ins = ThreadFileToDisk::Ins();
+
+	//按提交顺序回调，索引记录与文件中的块顺序一致，且只登记已落盘的块
+	if (iBufferIndex >= 0 && dwError == 0 && ins.m_pPoolContainerPing)
+		ins.m_uPoolTrigSegment += ins.m_pPoolContainerPing->AddBlock((uint64_t)ins.m_pPoolContainerPing->GetBlockCount(), uOffset, pData, uBytes, ins.m_uPoolTrigSegment);
+
+	OnDiskWriteCompletePing(pContext, iBufferIndex, dwError);
+}
+
 //UINT ThreadFileToDisk::EventReporter(LPVOID lParam)
 //{
 //	int iBufferIndex = -1;
@@ -737,7 +1088,7 @@ UINT ThreadFileToDisk::EventReporter(LPVOID lParam)
 //
 //            fclose(fp_data);
 //
-//            //ǵд̣ͷſпռ䣬дΪֹ
+//            //如果是单次写盘，不再释放空闲空间，写满为止
 //            if(m_iToDiskType != 2)
 //                ThreadFileToDisk::Ins().PushFreeToListPing(iBufferIndex);
 //            else
@@ -748,7 +1099,7 @@ UINT ThreadFileToDisk::EventReporter(LPVOID lParam)
 //        }
 //        else
 //        {
-//            //printf("Threadid%dûҵõĻ\n");
+//            //printf("Threadid【%d】没有找到可用的缓冲区\n");
 //            Sleep(1);
 //        }
 //
@@ -758,9 +1109,9 @@ UINT ThreadFileToDisk::EventReporter(LPVOID lParam)
 
 void ThreadFileToDisk::initDataFileBufferPing(int iBlockSize, int iBlockCount, int iTotalSizeGB)
 {
-    //ǵд̣Ƚдڴ棬дӲ̵ģʽʹõbufferΪʹõļڴС
-    //д̣ƵĲɼݣʹõbufferΪ
-    m_freeListPing.clear();
+    //如果是单次写盘，即先将所有数据写入内存，再写到硬盘的模式，使用的buffer数量为使用的计算机内存大小
+    //如果是连续写盘，即无限制的采集数据，使用的buffer数量为
+    m_freeListPing.reset(iBlockCount);
     //m_availListPing.clear();
 	//m_availListPing.set_size(1024);
 
@@ -769,9 +1120,13 @@ void ThreadFileToDisk::initDataFileBufferPing(int iBlockSize, int iBlockCount, i
 	//int iBlockCount = 30;// iGBByte / iBlockSize;
 
 	m_iBlockSize = iBlockCount;
+	m_iPoolBlockSizeMB = iBlockSize;
 
     //printfLog(5, "[ThreadFileToDisk::initDataFileBuffer], iTotalSizeGB is %d iBlockSize size is %d iBlockCount is %d", iGBByte, iBlockSize, iBlockCount);
 
+	int iNode = m_iPoolNumaNode >= 0 ? m_iPoolNumaNode : NumaAllocator::QueryDeviceNumaNode();
+	int iAllocCount = 0, iLargeCount = 0;
+
     for(int i = 0; i < iBlockCount; i++)
     {
 //        if(m_databuffer[i].m_bufferAddr != NULL){
@@ -781,23 +1136,120 @@ void ThreadFileToDisk::initDataFileBufferPing(int iBlockSize, int iBlockCount, i
 
 		if (m_vectorBuffer[i]->m_bufferAddr == NULL)
 		{
-			//m_databufferPong[i].m_bufferAddr = (uint8_t *)VirtualAlloc(NULL, iBlockSize * 1024 * 1024, MEM_COMMIT, PAGE_READWRITE);
-			m_vectorBuffer[i]->m_bufferAddr = (uint8_t *)malloc(iBlockSize * 1024 * 1024);
+			//按页对齐分配，满足无缓冲写盘的扇区对齐要求
+			bool bLargePages = false;
+			m_vectorBuffer[i]->m_bufferAddr = NumaAllocator::Allocate((size_t)iBlockSize * 1024 * 1024, iNode, m_bPoolLargePages, &bLargePages);
+			iAllocCount++;
+			iLargeCount += bLargePages ? 1 : 0;
 		}
 		m_vectorBuffer[i]->m_bAvailable = false;
-		m_vectorBuffer[i]->m_bAllocateMem = true;
+		m_vectorBuffer[i]->m_bAllocateMem = m_vectorBuffer[i]->m_bufferAddr != NULL;
 		m_vectorBuffer[i]->m_iBufferSize = 0;
 		m_vectorBuffer[i]->m_iBufferIndex = i;
 		m_vectorBuffer[i]->m_iTotalSize = iBlockSize * 1024 * 1024;
+    }
+
+	if (iAllocCount > 0)
+		printfLog(4, "[ThreadFileToDisk::initDataFileBufferPing], allocated %d blocks of %d MB on node %d, %d in large pages", iAllocCount, iBlockSize, iNode, iLargeCount);
 
+	//倒序入栈，使0号缓存最先被取出；分配失败的块不入链表，缓存池按实际可用块数计
+	int iUsable = 0;
+	for (int i = iBlockCount - 1; i >= 0; i--)
+	{
+		if (m_vectorBuffer[i]->m_bufferAddr == NULL)
+		{
+			printfLog(2, "[ThreadFileToDisk::initDataFileBufferPing], block %d of %d MB allocation failed", i, iBlockSize);
+			continue;
+		}
 		PushFreeToListPing(m_vectorBuffer[i]->m_iBufferIndex);
-    }
+		iUsable++;
+	}
+	m_iBlockSize = iUsable;
+}
+
+bool ThreadFileToDisk::ResizePool(int iBlockSize, int iBlockCount)
+{
+	if (iBlockSize <= 0 || iBlockCount <= 0)
+		return false;
+
+	if (iBlockCount > MAX_POOL_BLOCKS)
+	{
+		printfLog(2, "[ThreadFileToDisk::ResizePool], %d blocks exceed the avail ring, clamped to %d", iBlockCount, MAX_POOL_BLOCKS);
+		iBlockCount = MAX_POOL_BLOCKS;
+	}
+
+	if (iBlockSize == m_iPoolBlockSizeMB && iBlockCount == m_iBlockSize && (int)m_vectorBuffer.size() == iBlockCount)
+		return true;
+
+	//采集过程中缓存在中断线程、写盘线程和压缩线程之间流转，全部回到空闲链表才能重建
+	if (m_iBlockSize > 0 && m_freeListPing.size() != m_iBlockSize)
+	{
+		printfLog(2, "[ThreadFileToDisk::ResizePool], pool busy, free %d of %d", m_freeListPing.size(), m_iBlockSize);
+		return false;
+	}
+
+	//块大小不变时保留已有的块，否则全部重新分配
+	int iKeep = 0;
+	if (iBlockSize == m_iPoolBlockSizeMB)
+		iKeep = iBlockCount < (int)m_vectorBuffer.size() ? iBlockCount : (int)m_vectorBuffer.size();
+
+	//先分配所有新块，全部成功后才释放旧块；任一块失败时释放已分配的新块，原来的缓存池不变
+	int iNode = m_iPoolNumaNode >= 0 ? m_iPoolNumaNode : NumaAllocator::QueryDeviceNumaNode();
+	std::vector<uint8_t*> fresh;
+	int iLargeCount = 0;
+	for (int i = iKeep; i < iBlockCount; i++)
+	{
+		bool bLargePages = false;
+		uint8_t* pBlock = NumaAllocator::Allocate((size_t)iBlockSize * 1024 * 1024, iNode, m_bPoolLargePages, &bLargePages);
+		if (pBlock == NULL)
+		{
+			printfLog(2, "[ThreadFileToDisk::ResizePool], block %d of %d MB allocation failed, keep current pool", i, iBlockSize);
+			for (size_t j = 0; j < fresh.size(); j++)
+				NumaAllocator::Free(fresh[j]);
+			return false;
+		}
+		fresh.push_back(pBlock);
+		iLargeCount += bLargePages ? 1 : 0;
+	}
+
+	for (size_t i = iKeep; i < m_vectorBuffer.size(); i++)
+	{
+		if (m_vectorBuffer[i] == NULL)
+			continue;
+		NumaAllocator::Free(m_vectorBuffer[i]->m_bufferAddr);
+		m_vectorBuffer[i]->m_bufferAddr = NULL;
+		if ((int)i >= iBlockCount)
+		{
+			delete m_vectorBuffer[i];
+			m_vectorBuffer[i] = NULL;
+		}
+	}
+
+	size_t uOldCount = m_vectorBuffer.size();
+	m_vectorBuffer.resize(iBlockCount, NULL);
+	for (size_t i = uOldCount; i < m_vectorBuffer.size(); i++)
+	{
+		m_vectorBuffer[i] = new databuffer();
+		m_vectorBuffer[i]->m_bufferAddr = NULL;
+		m_vectorBuffer[i]->m_bAvailable = false;
+		m_vectorBuffer[i]->m_bAllocateMem = false;
+		m_vectorBuffer[i]->m_iBufferIndex = (int)i;
+		m_vectorBuffer[i]->m_iBufferSize = 0;
+	}
+	for (int i = iKeep; i < iBlockCount; i++)
+		m_vectorBuffer[i]->m_bufferAddr = fresh[i - iKeep];
+
+	printfLog(4, "[ThreadFileToDisk::ResizePool], allocated %d blocks of %d MB on node %d, %d in large pages", (int)fresh.size(), iBlockSize, iNode, iLargeCount);
+
+	//所有块都已分配，这里只重建空闲链表
+	initDataFileBufferPing(iBlockSize, iBlockCount, 0);
+	return true;
 }
 
 void ThreadFileToDisk::initDataFileBufferPong(int iBlockSize, int iTotalSizeGB)
 {
-	//ǵд̣Ƚдڴ棬дӲ̵ģʽʹõbufferΪʹõļڴС
-	//д̣ƵĲɼݣʹõbufferΪ
+	//如果是单次写盘，即先将所有数据写入内存，再写到硬盘的模式，使用的buffer数量为使用的计算机内存大小
+	//如果是连续写盘，即无限制的采集数据，使用的buffer数量为
 	m_freeListPong.clear();
 	m_availListPong.clear();
 
@@ -807,6 +1259,9 @@ void ThreadFileToDisk::initDataFileBufferPong(int iBlockSize, int iTotalSizeGB)
 
 	//printfLog(5, "[ThreadFileToDisk::initDataFileBuffer], iTotalSizeGB is %d iBlockSize size is %d iBlockCount is %d", iGBByte, iBlockSize, iBlockCount);
 
+	int iNode = m_iPoolNumaNode >= 0 ? m_iPoolNumaNode : NumaAllocator::QueryDeviceNumaNode();
+	int iAllocCount = 0, iLargeCount = 0;
+
 	for (int i = 0; i < iBlockCount; i++)
 	{
 		//        if(m_databuffer[i].m_bufferAddr != NULL){
@@ -816,8 +1271,11 @@ void ThreadFileToDisk::initDataFileBufferPong(int iBlockSize, int iTotalSizeGB)
 
 		if (m_vectorBuffer[i]->m_bufferAddr == NULL)
 		{
-			//m_databufferPong[i].m_bufferAddr = (uint8_t *)VirtualAlloc(NULL, iBlockSize * 1024 * 1024, MEM_COMMIT, PAGE_READWRITE);
-			m_vectorBuffer[i]->m_bufferAddr = (uint8_t *)malloc(iBlockSize * 1024 * 1024);
+			//按页对齐分配，满足无缓冲写盘的扇区对齐要求
+			bool bLargePages = false;
+			m_vectorBuffer[i]->m_bufferAddr = NumaAllocator::Allocate((size_t)iBlockSize * 1024 * 1024, iNode, m_bPoolLargePages, &bLargePages);
+			iAllocCount++;
+			iLargeCount += bLargePages ? 1 : 0;
 		}
 		m_vectorBuffer[i]->m_bAvailable = false;
 		m_vectorBuffer[i]->m_bAllocateMem = true;
@@ -827,5 +1285,23 @@ void ThreadFileToDisk::initDataFileBufferPong(int iBlockSize, int iTotalSizeGB)
 
 		PushFreeToListPong(m_vectorBuffer[i]->m_iBufferIndex);
 	}
+
+	printfLog(4, "[ThreadFileToDisk::initDataFileBufferPong], allocated %d blocks of %d MB on node %d, %d in large pages", iAllocCount, iBlockSize, iNode, iLargeCount);
 }
 
+bool ThreadFileToDisk::initRawRing(uint64_t uCapacity, int iPolicy, const std::string& strFilePath)
+{
+	if (m_bIsRunPing || m_bIsRunPong)
+	{
+		printfLog(2, "[ThreadFileToDisk::initRawRing], ring can not be resized while running");
+		return false;
+	}
+
+	//pong通道不使用原始数据环，未创建时Write直接返回
+	if (uCapacity == 0)
+	{
+		m_rawRingPing.Destroy();
+		return true;
+	}
+	return m_rawRingPing.Create(uCapacity, iPolicy, strFilePath);
+}
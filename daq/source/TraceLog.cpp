@@ -17,6 +17,13 @@ DWORD WINAPI ThreadFun_DeleteExpiredFile(LPVOID parm )
 	return 0;
 }
 
+DWORD WINAPI ThreadFun_AsyncWriter(LPVOID parm )
+{
+	Log_TraceLog* pLog = (Log_TraceLog*) parm ;
+	pLog->AsyncWorking();
+	return 0;
+}
+
 std::string Log_TraceLog::GetLogName()
 {
 	return m_Logname;
@@ -73,6 +80,21 @@ Log_TraceLog::Log_TraceLog(std::string fname,bool bAddDateInFileName)
 	m_Handle = fopen(m_Logname.data(),"a+");
 	
 	m_Thread = NULL;
+
+	m_bAsync = false;
+	m_bAsyncStop = false;
+	m_bAsyncDone = false;
+	m_pAsyncRing = NULL;
+	m_uAsyncMask = 0;
+	m_uAsyncWrite = 0;
+	m_uAsyncRead = 0;
+	m_uAsyncDropped = 0;
+	m_iAsyncInFlight = 0;
+	m_uAsyncDroppedReported = 0;
+	m_pAsyncBatch = NULL;
+	m_uAsyncFileSize = 0;
+	m_hAsyncEvent = NULL;
+	m_hAsyncThread = NULL;
 }
 
 Log_TraceLog::Log_TraceLog(std::string fname,long level,unsigned long maxsize)
@@ -109,17 +131,45 @@ Log_TraceLog::Log_TraceLog(std::string fname,long level,unsigned long maxsize)
 
 	m_Thread = NULL;
 
+	m_bAsync = false;
+	m_bAsyncStop = false;
+	m_bAsyncDone = false;
+	m_pAsyncRing = NULL;
+	m_uAsyncMask = 0;
+	m_uAsyncWrite = 0;
+	m_uAsyncRead = 0;
+	m_uAsyncDropped = 0;
+	m_iAsyncInFlight = 0;
+	m_uAsyncDroppedReported = 0;
+	m_pAsyncBatch = NULL;
+	m_uAsyncFileSize = 0;
+	m_hAsyncEvent = NULL;
+	m_hAsyncThread = NULL;
+
 	//m_Thread = ::CreateThread(NULL, 0, &ThreadFun_DeleteExpiredFile, this, 0, &m_ThreadID );
 }
 
 void Log_TraceLog::LogTime(long level)
 {
-	if(!m_Handle) 
-		return;
-	
 	if(!Passed(level)) 
 		return ;
 
+	if(AsyncEnter())
+	{
+		size_t pos;
+		AsyncRecord* rec = AsyncClaim(pos);
+		if(rec)
+		{
+			rec->iLength = 0;
+			AsyncPublish(rec, pos, level, ASYNC_KIND_TIMEONLY);
+		}
+		AsyncLeave();
+		return;
+	}
+
+	if(!m_Handle) 
+		return;
+
 	CLog_SingleLock SingleLock(&m_Lock);
 	SingleLock.Lock();
 
@@ -132,11 +182,21 @@ void Log_TraceLog::LogTime(long level)
 
 void Log_TraceLog::TraceInfo(long level, const char *format ,...)
 {
-	if(!m_Handle) 
-		return;
-	
 	if(!Passed(level)) 
 		return ;
+
+	if(AsyncEnter())
+	{
+		va_list mark;
+		va_start(mark,format);
+		AsyncPush(level, ASYNC_KIND_NOTIME, format, mark);
+		va_end(mark);
+		AsyncLeave();
+		return;
+	}
+
+	if(!m_Handle) 
+		return;
 	
 	CLog_SingleLock SingleLock(&m_Lock);
 	SingleLock.Lock();
@@ -159,81 +219,43 @@ void Log_TraceLog::TraceInfo(long level, const char *format ,...)
 	//fstat(m_Handle->_file,&buf);
 
 	int size = _filelength(_fileno(m_Handle));
-	
-	std::string strDateString = GetDateString();
-	
-	if(strDateString != m_strCurDate)
-	{
-		fclose(m_Handle);
-		
-		char driver[256],dir[256],filename[256],ext[256];
-		_splitpath((LPCSTR)m_Logname.c_str(),driver, dir, filename, ext); 
-		
-		std::string backname;
-		std::stringstream stream;
-		
-		stream << driver;
-		stream << dir;
-		stream << m_strPrefix;
-		stream << "-";
-		stream << strDateString;
-		stream << ext;
-		
-		m_Logname = stream.str();
-		
-		m_Handle = fopen(m_Logname.data(),"a+");
-		
-		m_strCurDate = strDateString;
-	}
-	
-    if((unsigned)size > m_MaxSize)//־ļ־ļСʱлļ
-	{
-		fclose(m_Handle);
-		
-		char driver[256],dir[256],filename[256],ext[256];
-		_splitpath((LPCSTR)m_Logname.c_str(),driver, dir, filename, ext); 
-		
-		std::string backname;
-		std::stringstream stream;
-		
-		stream << driver;
-		stream << dir;
-		stream << filename;
-		stream << "-";
-		stream << GetTimeString();
-		stream << ext;
-		
-		backname = stream.str();
-		
-		rename(m_Logname.data(), backname.data());
-		
-		m_Handle = fopen(m_Logname.data(),"a+");
-	}
+
+	RotateFile(size);
 }
 
 void Log_TraceLog::Trace(long level, const char *format ,...)
 {
-	if(!m_Handle) 
-		return;
-	
+	va_list mark;
+	va_start(mark,format);
+	TraceV(level, format, mark);
+	va_end(mark);
+}
+
+void Log_TraceLog::TraceV(long level, const char *format, va_list args)
+{
 	if(!Passed(level)) 
 		return ;
 
+	if(AsyncEnter())
+	{
+		AsyncPush(level, ASYNC_KIND_TIME, format, args);
+		AsyncLeave();
+		return;
+	}
+
+	if(!m_Handle) 
+		return;
+
 	CLog_SingleLock SingleLock(&m_Lock);
 	SingleLock.Lock();
 
-	va_list mark;
-	va_start(mark,format);
-	
 	std::string tmpstring = GetDateTimeString(TIMESTRING_UNNORMAL);
 	fprintf(m_Handle,"[%s]",(LPCTSTR) tmpstring.c_str());
 
-	vfprintf(m_Handle ,format , mark);
+	vfprintf(m_Handle ,format , args);
 	
 	fprintf(m_Handle,"\n");
 
-	va_end(mark);
-
  	fflush(m_Handle);
 
 	//struct stat buf;
@@ -241,6 +263,12 @@ void Log_TraceLog::Trace(long level, const char *format ,...)
 
 	int size = _filelength(_fileno(m_Handle));
 
+	RotateFile(size);
+}
+
+//按日期或大小切换日志文件，调用者持有m_Lock
+void Log_TraceLog::RotateFile(int size)
+{
 	std::string strDateString = GetDateString();
 
 	if(strDateString != m_strCurDate)
@@ -267,7 +295,7 @@ void Log_TraceLog::Trace(long level, const char *format ,...)
 		m_strCurDate = strDateString;
 	}
 
-    if((unsigned)size > m_MaxSize)//־ļ־ļСʱлļ
+    if((unsigned)size > m_MaxSize)//单个日志文件超出最大日志文件大小时切换文件
 	{
 		fclose(m_Handle);
 		
@@ -294,12 +322,22 @@ void Log_TraceLog::Trace(long level, const char *format ,...)
 
 void Log_TraceLog::TraceNoTime(long level, const char *format ,...)
 {
-	if(!m_Handle) 
-		return;
-	
 	if(!Passed(level)) 
 		return ;
 
+	if(AsyncEnter())
+	{
+		va_list mark;
+		va_start(mark,format);
+		AsyncPush(level, ASYNC_KIND_NOTIME, format, mark);
+		va_end(mark);
+		AsyncLeave();
+		return;
+	}
+
+	if(!m_Handle) 
+		return;
+
 	CLog_SingleLock SingleLock(&m_Lock);
 	SingleLock.Lock();
 
@@ -335,6 +373,32 @@ Log_TraceLog::~Log_TraceLog()
 	//TRACE("Log_TraceLog::~Log_TraceLog\n");
 	::CloseHandle( m_Thread );
 
+	//没有调用StopAsync时，可能处在DLL卸载的加载器锁内，不能等待线程句柄，只等后台线程写完的标志；
+	//进程退出时后台线程已被终止，由这里写出剩余记录
+	if(m_hAsyncThread != NULL)
+	{
+		m_bAsync.store(false, std::memory_order_release);
+		m_bAsyncStop.store(true, std::memory_order_release);
+		SetEvent(m_hAsyncEvent);
+
+		DWORD dwExitCode = STILL_ACTIVE;
+		for(int i = 0; i < 1000 && !m_bAsyncDone.load(std::memory_order_acquire); i++)
+		{
+			if(!GetExitCodeThread(m_hAsyncThread, &dwExitCode) || dwExitCode != STILL_ACTIVE)
+				break;
+			Sleep(1);
+		}
+		if(!m_bAsyncDone.load(std::memory_order_acquire) && dwExitCode != STILL_ACTIVE)
+			AsyncDrain();
+
+		::CloseHandle(m_hAsyncThread);
+		m_hAsyncThread = NULL;
+	}
+	if(m_hAsyncEvent != NULL)
+		::CloseHandle(m_hAsyncEvent);
+	delete [] m_pAsyncRing;
+	delete [] m_pAsyncBatch;
+
 	Sleep( 100 );
 	
 	if(m_Handle)
@@ -427,19 +491,19 @@ std::string Log_TraceLog::GetTraceLevelTypeString()
 	switch( m_Level ) 
 	{
 	case 1:
-		strRetVal = "ش־";//"ش־";
+		strRetVal = "严重错误日志";//"严重错误日志";
 		break;
 	case 2:
-		strRetVal = "ʧ־";//"ʧ־";
+		strRetVal = "失败日志";//"失败日志";
 		break;
 	case 3:
-		strRetVal = "Ϣ־";//"Ϣ־";
+		strRetVal = "警告信息日志";//"警告信息日志";
 		break;
 	case 4:
-		strRetVal = "һϢ־";//"һϢ־";
+		strRetVal = "一般信息日志";//"一般信息日志";
 		break;
 	case 5:
-		strRetVal = "־";//"־";
+		strRetVal = "调试日志";//"调试日志";
 		break;
 	default:
 		{
@@ -454,10 +518,10 @@ std::string Log_TraceLog::GetTraceLevelTypeString()
 }
 
 /****************************************************************************
-:Working()
-:
-ֵ:
-: 3 ѭһΣ޸ʱ뵱ǰʱȽϣ 7 ־ɾ
+函数名:Working()
+参数:
+返回数值:
+函数功能描述: 3 分钟循环一次，把修改时间与当前时间比较，超过 7 天的日志删除。
 *****************************************************************************/
 
 void Log_TraceLog::Working()
@@ -486,13 +550,13 @@ void Log_TraceLog::Working()
 
 		if( (hFile = _findfirst( strFileFindPath.c_str(), &c_file )) != -1L )
 		{
-			//if((c_file.attrib & _A_SUBDIR) && (c_file.name[0] != '.'))//ļеĻд
+			//if((c_file.attrib & _A_SUBDIR) && (c_file.name[0] != '.'))//如果是文件夹的话进行处理
 			//{
 			//}
 
 			while( _findnext( hFile, &c_file ) == 0 )
 			{
-				if(!(c_file.attrib & _A_SUBDIR) && !(c_file.name[0] != '.'))//ļеĻд
+				if(!(c_file.attrib & _A_SUBDIR) && !(c_file.name[0] != '.'))//如果是文件夹的话进行处理
 				{
 					strFileName = c_file.name;
 
@@ -500,7 +564,7 @@ void Log_TraceLog::Working()
 
 					tmFileCreateTime = c_file.time_create;
 
-					if((tmCurrTime - tmFileCreateTime) > 7 *60*60*24 )	//ɾ 7 ־
+					if((tmCurrTime - tmFileCreateTime) > 7 *60*60*24 )	//删除掉超过 7 天的日志
 					{
 						if(strFileName != m_Logname )
 						{
@@ -516,4 +580,213 @@ void Log_TraceLog::Working()
 		
 		Sleep( 3*1000*60 );
 	}
-}
\ No newline at end of file
+}
+
+bool Log_TraceLog::StartAsync(int iRecordCount)
+{
+	CLog_SingleLock SingleLock(&m_Lock);
+	SingleLock.Lock();
+
+	if(m_hAsyncThread != NULL)
+		return true;
+
+	//环只分配一次，停止后再开启沿用原来的位置
+	if(m_pAsyncRing == NULL)
+	{
+		size_t capacity = 2;
+		while(capacity < (size_t)iRecordCount)
+			capacity <<= 1;
+
+		m_pAsyncRing = new AsyncRecord[capacity];
+		for(size_t i = 0; i < capacity; i++)
+			m_pAsyncRing[i].uSeq.store(i, std::memory_order_relaxed);
+		m_uAsyncMask = capacity - 1;
+		m_uAsyncWrite.store(0, std::memory_order_relaxed);
+		m_uAsyncRead.store(0, std::memory_order_relaxed);
+
+		m_pAsyncBatch = new char[ASYNC_BATCH_BYTES];
+		m_hAsyncEvent = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+	}
+
+	m_uAsyncFileSize = m_Handle ? _filelength(_fileno(m_Handle)) : 0;
+	m_bAsyncStop.store(false, std::memory_order_relaxed);
+	m_bAsyncDone.store(false, std::memory_order_relaxed);
+
+	m_hAsyncThread = ::CreateThread(NULL, 0, &ThreadFun_AsyncWriter, this, 0, NULL);
+	if(m_hAsyncThread == NULL)
+		return false;
+
+	m_bAsync.store(true, std::memory_order_release);
+	return true;
+}
+
+void Log_TraceLog::StopAsync()
+{
+	if(m_hAsyncThread == NULL)
+		return;
+
+	//之后进入的调用线程走同步写；已经进入的调用线程写完记录后才离开，
+	//等计数归零再让后台线程退出，它最后一次写出时这些记录都已发布
+	m_bAsync.store(false, std::memory_order_seq_cst);
+	while(m_iAsyncInFlight.load(std::memory_order_seq_cst) != 0)
+		SwitchToThread();
+
+	m_bAsyncStop.store(true, std::memory_order_release);
+	SetEvent(m_hAsyncEvent);
+	WaitForSingleObject(m_hAsyncThread, INFINITE);
+	::CloseHandle(m_hAsyncThread);
+	m_hAsyncThread = NULL;
+}
+
+void Log_TraceLog::AsyncWorking()
+{
+	while(!m_bAsyncStop.load(std::memory_order_acquire))
+	{
+		WaitForSingleObject(m_hAsyncEvent, ASYNC_FLUSH_MS);
+		AsyncDrain();
+	}
+
+	AsyncDrain();
+	m_bAsyncDone.store(true, std::memory_order_release);
+}
+
+bool Log_TraceLog::AsyncEnter()
+{
+	//先计数再检查开关，与StopAsync先关开关再读计数配对：
+	//要么这里看到开关已关、走同步写，要么StopAsync看到计数、等这次写完
+	m_iAsyncInFlight.fetch_add(1, std::memory_order_seq_cst);
+	if(m_bAsync.load(std::memory_order_seq_cst))
+		return true;
+
+	m_iAsyncInFlight.fetch_sub(1, std::memory_order_release);
+	return false;
+}
+
+void Log_TraceLog::AsyncLeave()
+{
+	m_iAsyncInFlight.fetch_sub(1, std::memory_order_release);
+}
+
+Log_TraceLog::AsyncRecord* Log_TraceLog::AsyncClaim(size_t& pos)
+{
+	pos = m_uAsyncWrite.load(std::memory_order_relaxed);
+	for(;;)
+	{
+		AsyncRecord* rec = &m_pAsyncRing[pos & m_uAsyncMask];
+		size_t seq = rec->uSeq.load(std::memory_order_acquire);
+		intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+		if(dif == 0)
+		{
+			if(m_uAsyncWrite.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed, std::memory_order_relaxed))
+				return rec;
+		}
+		else if(dif < 0)
+		{
+			//环满，丢弃这一条，不阻塞调用线程
+			m_uAsyncDropped.fetch_add(1, std::memory_order_relaxed);
+			SetEvent(m_hAsyncEvent);
+			return NULL;
+		}
+		else
+		{
+			pos = m_uAsyncWrite.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+void Log_TraceLog::AsyncPublish(AsyncRecord* rec, size_t pos, long level, int kind)
+{
+	GetSystemTimeAsFileTime(&rec->ftTime);
+	rec->lLevel = level;
+	rec->iKind = kind;
+	rec->uSeq.store(pos + 1, std::memory_order_release);
+
+	//错误日志尽快落盘；环过半时提前唤醒后台线程，其余等定时批量写
+	if(level <= 2 || pos - m_uAsyncRead.load(std::memory_order_relaxed) >= m_uAsyncMask / 2)
+		SetEvent(m_hAsyncEvent);
+}
+
+void Log_TraceLog::AsyncPush(long level, int kind, const char *format, va_list args)
+{
+	size_t pos;
+	AsyncRecord* rec = AsyncClaim(pos);
+	if(!rec)
+		return;
+
+	int len = _vsnprintf(rec->szText, ASYNC_TEXT_BYTES - 1, format, args);
+	//超长时截断
+	if(len < 0 || len > ASYNC_TEXT_BYTES - 1)
+		len = ASYNC_TEXT_BYTES - 1;
+	rec->szText[len] = '\0';
+	rec->iLength = len;
+
+	AsyncPublish(rec, pos, level, kind);
+}
+
+void Log_TraceLog::AsyncDrain()
+{
+	if(m_pAsyncRing == NULL)
+		return;
+
+	CLog_SingleLock SingleLock(&m_Lock);
+	SingleLock.Lock();
+
+	size_t pos = m_uAsyncRead.load(std::memory_order_relaxed);
+	size_t used = 0;
+	bool bMore = true;
+
+	while(bMore)
+	{
+		AsyncRecord& rec = m_pAsyncRing[pos & m_uAsyncMask];
+		bMore = rec.uSeq.load(std::memory_order_acquire) == pos + 1;
+
+		if(bMore)
+		{
+			SYSTEMTIME st;
+			FILETIME ftLocal;
+			FileTimeToLocalFileTime(&rec.ftTime, &ftLocal);
+			FileTimeToSystemTime(&ftLocal, &st);
+
+			char* p = m_pAsyncBatch + used;
+			if(rec.iKind == ASYNC_KIND_TIME)
+				used += sprintf(p, "[%02d-%02d %02d:%02d:%02d.%03d]", st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, st.wMilliseconds);
+			else if(rec.iKind == ASYNC_KIND_TIMEONLY)
+				used += sprintf(p, "[%04d-%02d-%02d %02d:%02d:%02d]", st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+
+			memcpy(m_pAsyncBatch + used, rec.szText, rec.iLength);
+			used += rec.iLength;
+			m_pAsyncBatch[used++] = '\n';
+
+			rec.uSeq.store(pos + m_uAsyncMask + 1, std::memory_order_release);
+			pos++;
+			m_uAsyncRead.store(pos, std::memory_order_release);
+		}
+		else
+		{
+			unsigned long long dropped = m_uAsyncDropped.load(std::memory_order_relaxed);
+			if(dropped != m_uAsyncDroppedReported)
+			{
+				std::string tmpstring = GetDateTimeString(TIMESTRING_UNNORMAL);
+				used += sprintf(m_pAsyncBatch + used, "[%s]log ring full, %llu records dropped\n", tmpstring.c_str(), dropped - m_uAsyncDroppedReported);
+				m_uAsyncDroppedReported = dropped;
+			}
+		}
+
+		//批满或没有更多记录时一次写出
+		if(used > 0 && (!bMore || used + ASYNC_TEXT_BYTES + 64 > ASYNC_BATCH_BYTES))
+		{
+			if(m_Handle)
+			{
+				fwrite(m_pAsyncBatch, 1, used, m_Handle);
+				fflush(m_Handle);
+				m_uAsyncFileSize += (unsigned long)used;
+
+				FILE* handle = m_Handle;
+				RotateFile((int)m_uAsyncFileSize);
+				if(m_Handle != handle)
+					m_uAsyncFileSize = m_Handle ? _filelength(_fileno(m_Handle)) : 0;
+			}
+			used = 0;
+		}
+	}
+}
@@ -0,0 +1,155 @@
+﻿#include "WaitStrategy.h"
+
+#include <string.h>
+
+WaitStrategy::WaitStrategy()
+:m_iMode(MODE_SPIN)
+,m_iSpinCount(DEFAULT_SPIN_COUNT)
+,m_iYieldCount(DEFAULT_YIELD_COUNT)
+,m_dwMaxSleepMs(DEFAULT_MAX_SLEEP_MS)
+,m_uIdleCount(0)
+,m_dwSleepMs(1)
+,m_uWaitBegin(0)
+,m_uIdleBegin(0)
+,m_bCancel(false)
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	m_dUsPerTick = 1e6 / (double)freq.QuadPart;
+	ResetStats();
+}
+
+void WaitStrategy::SetMode(int iMode, int iSpinCount, int iYieldCount, DWORD dwMaxSleepMs)
+{
+	m_iMode = (iMode >= MODE_SPIN && iMode <= MODE_ADAPTIVE) ? iMode : MODE_SPIN;
+	m_iSpinCount = iSpinCount > 0 ? iSpinCount : 0;
+	m_iYieldCount = iYieldCount > 0 ? iYieldCount : 0;
+	m_dwMaxSleepMs = dwMaxSleepMs > 0 ? dwMaxSleepMs : 1;
+}
+
+void WaitStrategy::Begin()
+{
+	m_uIdleCount = 0;
+	m_dwSleepMs = 1;
+	m_uWaitBegin = Now();
+	m_uIdleBegin = m_uWaitBegin;
+}
+
+void WaitStrategy::Idle()
+{
+	m_uIdleBegin = Now();
+	uint64_t uIdle = m_uIdleCount++;
+
+	switch (m_iMode)
+	{
+	case MODE_YIELD:
+		if (!SwitchToThread())
+			YieldProcessor();
+		break;
+	case MODE_SLEEP:
+		SleepBackoff();
+		break;
+	case MODE_ADAPTIVE:
+		if (uIdle < (uint64_t)m_iSpinCount)
+			YieldProcessor();
+		else if (uIdle < (uint64_t)m_iSpinCount + m_iYieldCount)
+		{
+			if (!SwitchToThread())
+				YieldProcessor();
+		}
+		else
+			SleepBackoff();
+		break;
+	default:
+		YieldProcessor();
+		break;
+	}
+}
+
+void WaitStrategy::SleepBackoff()
+{
+	Sleep(m_dwSleepMs);
+	m_dwSleepMs = m_dwSleepMs * 2 > m_dwMaxSleepMs ? m_dwMaxSleepMs : m_dwSleepMs * 2;
+}
+
+void WaitStrategy::End()
+{
+	uint64_t uNow = Now();
+	uint64_t uLatency = m_uIdleCount > 0 ? uNow - m_uIdleBegin : 0;
+
+	double dUs = uLatency * m_dUsPerTick;
+	int iBucket = 0;
+	while (iBucket < LATENCY_BUCKETS - 1 && dUs >= (double)(1ull << iBucket))
+		iBucket++;
+
+	m_histogram[iBucket].fetch_add(1, std::memory_order_relaxed);
+	m_uWaits.fetch_add(1, std::memory_order_relaxed);
+	m_uPolls.fetch_add(m_uIdleCount + 1, std::memory_order_relaxed);
+	m_uWaitTicks.fetch_add(uNow - m_uWaitBegin, std::memory_order_relaxed);
+	if (uLatency > m_uMaxLatencyTicks.load(std::memory_order_relaxed))
+		m_uMaxLatencyTicks.store(uLatency, std::memory_order_relaxed);
+}
+
+double WaitStrategy::PercentileUs(double dFraction, uint64_t uCount) const
+{
+	uint64_t uTarget = (uint64_t)(dFraction * uCount);
+	uint64_t uSum = 0;
+	for (int i = 0; i < LATENCY_BUCKETS; i++)
+	{
+		uSum += m_histogram[i].load(std::memory_order_relaxed);
+		if (uSum > uTarget)
+			return i == 0 ? 1.0 : (double)(1ull << i);
+	}
+	return (double)(1ull << (LATENCY_BUCKETS - 1));
+}
+
+void WaitStrategy::GetStats(WAIT_STATS& stats) const
+{
+	memset(&stats, 0, sizeof(stats));
+	uint64_t uWaits = m_uWaits.load(std::memory_order_relaxed);
+	stats.uWaits = uWaits;
+	if (uWaits == 0)
+		return;
+
+	stats.dPollsPerWait = (double)m_uPolls.load(std::memory_order_relaxed) / uWaits;
+	stats.dAvgWaitUs = m_uWaitTicks.load(std::memory_order_relaxed) * m_dUsPerTick / uWaits;
+	stats.dLatencyMaxUs = m_uMaxLatencyTicks.load(std::memory_order_relaxed) * m_dUsPerTick;
+	//桶上界不超过实测最大值
+	stats.dLatencyP50Us = PercentileUs(0.5, uWaits);
+	stats.dLatencyP99Us = PercentileUs(0.99, uWaits);
+	if (stats.dLatencyP50Us > stats.dLatencyMaxUs)
+		stats.dLatencyP50Us = stats.dLatencyMaxUs;
+	if (stats.dLatencyP99Us > stats.dLatencyMaxUs)
+		stats.dLatencyP99Us = stats.dLatencyMaxUs;
+}
+
+void WaitStrategy::ResetStats()
+{
+	m_uWaits.store(0, std::memory_order_relaxed);
+	m_uPolls.store(0, std::memory_order_relaxed);
+	m_uWaitTicks.store(0, std::memory_order_relaxed);
+	m_uMaxLatencyTicks.store(0, std::memory_order_relaxed);
+	for (int i = 0; i < LATENCY_BUCKETS; i++)
+		m_histogram[i].store(0, std::memory_order_relaxed);
+}
+
+const char* WaitStrategy::ModeName(int iMode)
+{
+	switch (iMode)
+	{
+	case MODE_YIELD: return "Yield";
+	case MODE_SLEEP: return "Sleep";
+	case MODE_ADAPTIVE: return "Adaptive";
+	default: return "Spin";
+	}
+}
+
+int WaitStrategy::ParseMode(const char* szName)
+{
+	for (int i = MODE_SPIN; i <= MODE_ADAPTIVE; i++)
+	{
+		if (strcmp(szName, ModeName(i)) == 0)
+			return i;
+	}
+	return MODE_SPIN;
+}
@@ -0,0 +1,405 @@
+﻿#include "WriterPool.h"
+#include "DirectDiskWriter.h"
+#include "pub.h"
+#include "StageTrace.h"
+
+#include <string.h>
+
+extern void printfLog(int nLevel, const char * fmt, ...);
+
+WriterPool::WriterPool()
+:m_hFile(INVALID_HANDLE_VALUE)
+,m_uSectorSize(4096)
+,m_iMaxPending(0)
+,m_pfnCallback(NULL)
+,m_pContext(NULL)
+,m_uFileOffset(0)
+,m_uDataEnd(0)
+,m_uSubmitSeq(0)
+,m_uBlockSeq(0)
+,m_pTail(NULL)
+,m_uTailBytes(0)
+,m_bPadToSector(false)
+,m_uNextComplete(0)
+,m_bDelivering(false)
+,m_dwChainError(0)
+,m_bStop(false)
+,m_uBytesWritten(0)
+,m_uErrorCount(0)
+,m_uOpenMs(0)
+{
+}
+
+WriterPool::~WriterPool()
+{
+	Close();
+}
+
+bool WriterPool::Open(const std::string& strFileName, int iThreadCount, uint64_t uPreallocBytes)
+{
+	Close();
+
+	if (iThreadCount < 1)
+		iThreadCount = 1;
+
+	m_uSectorSize = DirectDiskWriter::QuerySectorSize(strFileName);
+
+	m_hFile = CreateFileA(strFileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+	{
+		printfLog(2, "[WriterPool::Open], CreateFile %s error(%d)", strFileName.c_str(), GetLastError());
+		return false;
+	}
+
+	if (uPreallocBytes > 0)
+	{
+		uPreallocBytes = (uPreallocBytes + m_uSectorSize - 1) / m_uSectorSize * m_uSectorSize;
+
+		FILE_ALLOCATION_INFO allocInfo;
+		allocInfo.AllocationSize.QuadPart = (LONGLONG)uPreallocBytes;
+		if (!SetFileInformationByHandle(m_hFile, FileAllocationInfo, &allocInfo, sizeof(allocInfo)))
+			printfLog(2, "[WriterPool::Open], preallocate %llu bytes error(%d)", uPreallocBytes, GetLastError());
+
+		//并行写不同偏移时，超出有效数据长度的写会被串行化
+		if (pub::EnablePrivilege(SE_MANAGE_VOLUME_NAME))
+		{
+			FILE_END_OF_FILE_INFO eofInfo;
+			eofInfo.EndOfFile.QuadPart = (LONGLONG)uPreallocBytes;
+			if (!SetFileInformationByHandle(m_hFile, FileEndOfFileInfo, &eofInfo, sizeof(eofInfo))
+				|| !SetFileValidData(m_hFile, (LONGLONG)uPreallocBytes))
+				printfLog(4, "[WriterPool::Open], SetFileValidData error(%d)", GetLastError());
+		}
+	}
+
+	m_pTail = (uint8_t *)VirtualAlloc(NULL, m_uSectorSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	m_uTailBytes = 0;
+	if (m_pTail == NULL)
+	{
+		printfLog(2, "[WriterPool::Open], alloc tail buffer error(%d)", GetLastError());
+		Close();
+		return false;
+	}
+
+	//同步句柄上的I/O按文件对象串行执行，每个工作线程单独打开一个句柄才能真正并行
+	for (int i = 0; i < iThreadCount; i++)
+	{
+		HANDLE hWorker = CreateFileA(strFileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+			FILE_FLAG_NO_BUFFERING, NULL);
+		if (hWorker == INVALID_HANDLE_VALUE)
+		{
+			printfLog(2, "[WriterPool::Open], open worker handle %d error(%d)", i, GetLastError());
+			Close();
+			return false;
+		}
+		m_workerFiles.push_back(hWorker);
+	}
+
+	m_strFileName = strFileName;
+	m_iMaxPending = iThreadCount * 2;
+	m_uFileOffset = 0;
+	m_uDataEnd = 0;
+	m_uSubmitSeq = 0;
+	m_uBlockSeq = 0;
+	m_uNextComplete = 0;
+	m_bDelivering = false;
+	m_dwChainError = 0;
+	m_bStop = false;
+	m_jobs.clear();
+	m_done.clear();
+	m_uBytesWritten.store(0, std::memory_order_relaxed);
+	m_uErrorCount.store(0, std::memory_order_relaxed);
+	m_uOpenMs = GetTickCount64();
+
+	for (int i = 0; i < iThreadCount; i++)
+		m_threads.push_back(std::thread(&WriterPool::WorkerThread, this, m_workerFiles[i]));
+
+	printfLog(4, "[WriterPool::Open], %s sector %u threads %d prealloc %llu", strFileName.c_str(), m_uSectorSize, iThreadCount, uPreallocBytes);
+	return true;
+}
+
+void WriterPool::Close()
+{
+	if (m_hFile == INVALID_HANDLE_VALUE)
+		return;
+
+	if (!m_threads.empty())
+	{
+		Flush();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_bStop = true;
+		}
+		m_cvJob.notify_all();
+
+		for (size_t i = 0; i < m_threads.size(); i++)
+			m_threads[i].join();
+		m_threads.clear();
+	}
+
+	WriteTail();
+	for (size_t i = 0; i < m_workerFiles.size(); i++)
+		CloseHandle(m_workerFiles[i]);
+	m_workerFiles.clear();
+
+	for (size_t i = 0; i < m_bounces.size(); i++)
+		VirtualFree(m_bounces[i], 0, MEM_RELEASE);
+	m_bounces.clear();
+	if (m_pTail)
+	{
+		VirtualFree(m_pTail, 0, MEM_RELEASE);
+		m_pTail = NULL;
+	}
+	m_uTailBytes = 0;
+
+	//去掉预分配但未写入的部分和尾部扇区的补齐
+	FILE_END_OF_FILE_INFO eofInfo;
+	eofInfo.EndOfFile.QuadPart = (LONGLONG)m_uDataEnd;
+	SetFileInformationByHandle(m_hFile, FileEndOfFileInfo, &eofInfo, sizeof(eofInfo));
+
+	CloseHandle(m_hFile);
+	m_hFile = INVALID_HANDLE_VALUE;
+
+	printfLog(4, "[WriterPool::Close], %s written %llu bytes errors %llu %.1f MB/s", m_strFileName.c_str(),
+		GetBytesWritten(), GetErrorCount(), GetThroughputMBps());
+}
+
+void WriterPool::SetCompleteCallback(CompleteCallback pfnCallback, void* pContext)
+{
+	m_pfnCallback = pfnCallback;
+	m_pContext = pContext;
+}
+
+bool WriterPool::Submit(int iBufferIndex, const void* pData, uint32_t uBytes, uint64_t* pOffset)
+{
+	if (m_threads.empty())
+		return false;
+
+	//暂存尾部加上本次数据组成字节流，从扇区对齐的位置开始写；
+	//补齐模式下补零写到整扇区，否则只写整扇区的部分，余下的成为新的暂存尾部
+	const uint8_t* pSrc = (const uint8_t *)pData;
+	uint64_t uWritePos = m_uFileOffset - m_uTailBytes;
+	uint64_t uTotal = (uint64_t)m_uTailBytes + uBytes;
+	uint64_t uWrite = m_bPadToSector ? (uTotal + m_uSectorSize - 1) / m_uSectorSize * m_uSectorSize
+		: uTotal / m_uSectorSize * m_uSectorSize;
+	uint32_t uNewTail = (uint32_t)(uTotal > uWrite ? uTotal - uWrite : 0);
+
+	//没有暂存尾部且地址对齐时整扇区部分直接从调用者缓存写，其余部分分片经中转缓存
+	uint64_t uDirect = 0;
+	if (m_uTailBytes == 0 && (uintptr_t)pData % m_uSectorSize == 0)
+		uDirect = (uint64_t)uBytes / m_uSectorSize * m_uSectorSize;
+
+	Job job;
+	job.iBufferIndex = iBufferIndex;
+	job.pData = pData;
+	job.uBytes = uBytes;
+	job.uBlockSeq = m_uBlockSeq;
+	job.uOffset = m_uFileOffset;
+	job.dwError = 0;
+	job.pBounce = NULL;
+
+	bool bOk = true;
+	if (uWrite == 0)
+		QueueJob(job, NULL, 0, uWritePos, true);
+	else if (uDirect > 0)
+		QueueJob(job, pData, (uint32_t)uDirect, uWritePos, uDirect == uWrite);
+
+	for (uint64_t uPos = uDirect; uPos < uWrite; )
+	{
+		uint32_t uChunk = (uint32_t)(uWrite - uPos < DirectDiskWriter::BOUNCE_BYTES ? uWrite - uPos : DirectDiskWriter::BOUNCE_BYTES);
+		job.pBounce = TakeBounce();
+		if (job.pBounce == NULL)
+		{
+			printfLog(2, "[WriterPool::Submit], alloc bounce buffer %u bytes error(%d)", (uint32_t)DirectDiskWriter::BOUNCE_BYTES, GetLastError());
+			m_uErrorCount.fetch_add(1, std::memory_order_relaxed);
+			bOk = false;
+			break;
+		}
+
+		DirectDiskWriter::CopyStream(job.pBounce, uPos, uChunk, m_pTail, m_uTailBytes, pSrc, uBytes);
+		QueueJob(job, job.pBounce, uChunk, uWritePos + uPos, uPos + uChunk == uWrite);
+		uPos += uChunk;
+	}
+
+	if (!bOk)
+	{
+		//已排队的部分可能还在读调用者的缓存，等它们完成后调用者才能归还；这次提交不回调
+		Flush();
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_dwChainError = 0;
+		return false;
+	}
+
+	//调用者的缓存之后只在直写请求中被读取，保存新的暂存尾部
+	if (uWrite == 0)
+		memcpy(m_pTail + m_uTailBytes, pData, uBytes);
+	else if (uNewTail > 0)
+		memcpy(m_pTail, pSrc + (uWrite - m_uTailBytes), uNewTail);
+	m_uTailBytes = uNewTail;
+
+	if (pOffset)
+		*pOffset = m_uFileOffset;
+	m_uDataEnd = uWritePos + uTotal;
+	m_uFileOffset = m_bPadToSector ? uWritePos + uWrite : m_uDataEnd;
+	m_uBlockSeq++;
+	return true;
+}
+
+void WriterPool::QueueJob(Job& job, const void* pWrite, uint32_t uWriteBytes, uint64_t uWriteOffset, bool bNotify)
+{
+	job.pWrite = pWrite;
+	job.uWriteBytes = uWriteBytes;
+	job.uWriteOffset = uWriteOffset;
+	job.bNotify = bNotify;
+
+	{
+		//未回调的请求(包括已写完但在等前面请求的)达到上限时等待
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cvDone.wait(lock, [&]() { return m_uSubmitSeq - m_uNextComplete < (uint64_t)m_iMaxPending; });
+		job.uSequence = m_uSubmitSeq++;
+		m_jobs.push_back(job);
+	}
+	m_cvJob.notify_one();
+	job.pBounce = NULL;
+}
+
+uint8_t* WriterPool::TakeBounce()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_bounces.empty())
+		{
+			uint8_t* pBounce = m_bounces.back();
+			m_bounces.pop_back();
+			return pBounce;
+		}
+	}
+	return (uint8_t *)VirtualAlloc(NULL, DirectDiskWriter::BOUNCE_BYTES, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+}
+
+void WriterPool::WriteTail()
+{
+	if (m_uTailBytes == 0 || m_workerFiles.empty())
+		return;
+
+	//补零到整扇区写入，Close随后把文件截断到m_uDataEnd
+	memset(m_pTail + m_uTailBytes, 0, m_uSectorSize - m_uTailBytes);
+	uint64_t uWritePos = m_uFileOffset - m_uTailBytes;
+	OVERLAPPED ov;
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset = (DWORD)uWritePos;
+	ov.OffsetHigh = (DWORD)(uWritePos >> 32);
+
+	DWORD dwWritten = 0;
+	if (!WriteFile(m_workerFiles[0], m_pTail, m_uSectorSize, &dwWritten, &ov) || dwWritten != m_uSectorSize)
+	{
+		printfLog(2, "[WriterPool::WriteTail], offset %llu bytes %u error(%d)", uWritePos, m_uTailBytes, GetLastError());
+		m_uErrorCount.fetch_add(1, std::memory_order_relaxed);
+	}
+	else
+	{
+		m_uBytesWritten.fetch_add(m_uTailBytes, std::memory_order_relaxed);
+	}
+	m_uTailBytes = 0;
+}
+
+void WriterPool::Flush()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_cvDone.wait(lock, [&]() { return m_uNextComplete == m_uSubmitSeq && !m_bDelivering; });
+}
+
+double WriterPool::GetThroughputMBps() const
+{
+	ULONGLONG uMs = GetTickCount64() - m_uOpenMs;
+	return uMs ? (double)GetBytesWritten() / (1024.0 * 1024.0) / (uMs / 1000.0) : 0;
+}
+
+void WriterPool::WorkerThread(HANDLE hFile)
+{
+	StageTrace::SetThreadName("WriterPool");
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_cvJob.wait(lock, [&]() { return m_bStop || !m_jobs.empty(); });
+		if (m_jobs.empty())
+			break;
+
+		Job job = m_jobs.front();
+		m_jobs.pop_front();
+		lock.unlock();
+
+		//同步句柄上带OVERLAPPED的WriteFile按指定偏移写；数据全部暂存在尾部时不写
+		OVERLAPPED ov;
+		memset(&ov, 0, sizeof(ov));
+		ov.Offset = (DWORD)job.uWriteOffset;
+		ov.OffsetHigh = (DWORD)(job.uWriteOffset >> 32);
+
+		DWORD dwWritten = 0;
+		if (job.uWriteBytes > 0)
+		{
+			STAGE_TRACE_SCOPE("DiskWrite", job.uWriteBytes);
+			if (!WriteFile(hFile, job.pWrite, job.uWriteBytes, &dwWritten, &ov))
+				job.dwError = GetLastError();
+			else if (dwWritten != job.uWriteBytes)
+				job.dwError = ERROR_WRITE_FAULT;
+		}
+
+		if (job.dwError != 0)
+		{
+			printfLog(2, "[WriterPool::WorkerThread], buffer %d offset %llu written %u of %u error(%d)", job.iBufferIndex,
+				job.uWriteOffset, dwWritten, job.uWriteBytes, job.dwError);
+			m_uErrorCount.fetch_add(1, std::memory_order_relaxed);
+		}
+		else
+		{
+			m_uBytesWritten.fetch_add(dwWritten, std::memory_order_relaxed);
+		}
+
+		Complete(job);
+		lock.lock();
+	}
+}
+
+void WriterPool::Complete(const Job& job)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done[job.uSequence] = job;
+	if (job.pBounce)
+		m_bounces.push_back(job.pBounce);
+
+	//已有线程在按序回调时由它继续往下取，保证回调不并发且不乱序
+	if (m_bDelivering)
+		return;
+	m_bDelivering = true;
+
+	std::map<uint64_t, Job>::iterator it = m_done.find(m_uNextComplete);
+	while (it != m_done.end())
+	{
+		Job next = it->second;
+		m_done.erase(it);
+		lock.unlock();
+
+		//一次提交分成多个请求时，前面请求的错误留到最后一个请求一起报告
+		if (!next.bNotify)
+		{
+			if (next.dwError != 0)
+				m_dwChainError = next.dwError;
+		}
+		else
+		{
+			DWORD dwError = next.dwError != 0 ? next.dwError : m_dwChainError;
+			m_dwChainError = 0;
+			if (m_pfnCallback)
+				m_pfnCallback(m_pContext, next.iBufferIndex, next.uBlockSeq, next.uOffset, next.pData, next.uBytes, dwError);
+		}
+
+		lock.lock();
+		m_uNextComplete++;
+		it = m_done.find(m_uNextComplete);
+	}
+
+	m_bDelivering = false;
+	lock.unlock();
+	m_cvDone.notify_all();
+}
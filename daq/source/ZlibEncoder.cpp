@@ -0,0 +1,205 @@
+﻿#include "ZlibEncoder.h"
+
+#include <string.h>
+
+namespace
+{
+	const uint16_t s_lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	const uint8_t s_lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	const uint16_t s_distBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+		4097, 6145, 8193, 12289, 16385, 24577 };
+	const uint8_t s_distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	//deflate按低位在前输出，Huffman码按高位在前，写入前先反转
+	class BitWriter
+	{
+	public:
+		BitWriter(uint8_t* pDst, uint32_t uDstBytes) : m_pDst(pDst), m_uDstBytes(uDstBytes), m_uPos(0), m_uBits(0), m_iCount(0), m_bOverflow(false) {}
+
+		void Put(uint32_t uValue, int iBits)
+		{
+			m_uBits |= (uint64_t)uValue << m_iCount;
+			m_iCount += iBits;
+			while (m_iCount >= 8)
+			{
+				PutByte((uint8_t)m_uBits);
+				m_uBits >>= 8;
+				m_iCount -= 8;
+			}
+		}
+
+		void PutCode(uint32_t uCode, int iBits)
+		{
+			uint32_t uReversed = 0;
+			for (int i = 0; i < iBits; i++)
+				uReversed |= ((uCode >> i) & 1) << (iBits - 1 - i);
+			Put(uReversed, iBits);
+		}
+
+		void Align()
+		{
+			if (m_iCount > 0)
+				Put(0, 8 - m_iCount);
+		}
+
+		void PutByte(uint8_t uByte)
+		{
+			if (m_uPos < m_uDstBytes)
+				m_pDst[m_uPos++] = uByte;
+			else
+				m_bOverflow = true;
+		}
+
+		uint32_t GetBytes() const { return m_bOverflow ? 0 : m_uPos; }
+
+	private:
+		uint8_t* m_pDst;
+		uint32_t m_uDstBytes;
+		uint32_t m_uPos;
+		uint64_t m_uBits;
+		int m_iCount;
+		bool m_bOverflow;
+	};
+
+	//固定Huffman表(RFC 1951 3.2.6)
+	void PutLiteral(BitWriter& writer, uint32_t uSymbol)
+	{
+		if (uSymbol < 144)
+			writer.PutCode(0x30 + uSymbol, 8);
+		else if (uSymbol < 256)
+			writer.PutCode(0x190 + uSymbol - 144, 9);
+		else if (uSymbol < 280)
+			writer.PutCode(uSymbol - 256, 7);
+		else
+			writer.PutCode(0xC0 + uSymbol - 280, 8);
+	}
+
+	void PutMatch(BitWriter& writer, uint32_t uLength, uint32_t uDistance)
+	{
+		int iLen = 28;
+		while (s_lengthBase[iLen] > uLength)
+			iLen--;
+		PutLiteral(writer, 257 + iLen);
+		writer.Put(uLength - s_lengthBase[iLen], s_lengthExtra[iLen]);
+
+		int iDist = 29;
+		while (s_distBase[iDist] > uDistance)
+			iDist--;
+		writer.PutCode(iDist, 5);
+		writer.Put(uDistance - s_distBase[iDist], s_distExtra[iDist]);
+	}
+
+	inline uint32_t Hash3(const uint8_t* p)
+	{
+		uint32_t uValue = p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+		return (uValue * 2654435761u) >> (32 - ZlibEncoder::HASH_BITS);
+	}
+
+	uint32_t Adler32(const uint8_t* p, uint32_t uBytes)
+	{
+		uint32_t a = 1, b = 0;
+		while (uBytes > 0)
+		{
+			//5552字节内累加不会溢出
+			uint32_t uRun = uBytes < 5552 ? uBytes : 5552;
+			uBytes -= uRun;
+			while (uRun-- > 0)
+			{
+				a += *p++;
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+		}
+		return (b << 16) | a;
+	}
+}
+
+ZlibEncoder::ZlibEncoder()
+{
+}
+
+uint32_t ZlibEncoder::CompressBound(uint32_t uBytes)
+{
+	//固定Huffman表下字面值最长9位；加zlib头、块头和校验
+	return uBytes + uBytes / 8 + 16;
+}
+
+uint32_t ZlibEncoder::Compress(const void* pSrc, uint32_t uBytes, void* pDst, uint32_t uDstBytes)
+{
+	const uint8_t* pIn = (const uint8_t *)pSrc;
+	BitWriter writer((uint8_t *)pDst, uDstBytes);
+
+	//CMF=0x78(deflate，32K窗口)，FLG=0x01(最快压缩级别，校验位使头部为31的倍数)
+	writer.PutByte(0x78);
+	writer.PutByte(0x01);
+
+	//整块作为一个固定Huffman块：BFINAL=1，BTYPE=01
+	writer.Put(1, 1);
+	writer.Put(1, 2);
+
+	m_head.assign((size_t)1 << HASH_BITS, -1);
+	m_prev.resize(WINDOW_BYTES);
+
+	uint32_t uPos = 0;
+	while (uPos < uBytes)
+	{
+		uint32_t uBestLen = 0;
+		uint32_t uBestDist = 0;
+		if (uPos + MIN_MATCH <= uBytes)
+		{
+			uint32_t uHash = Hash3(pIn + uPos);
+			uint32_t uMaxLen = uBytes - uPos < MAX_MATCH ? uBytes - uPos : MAX_MATCH;
+			int32_t iCand = m_head[uHash];
+			for (int iChain = 0; iChain < MAX_CHAIN && iCand >= 0 && uPos - (uint32_t)iCand <= WINDOW_BYTES; iChain++)
+			{
+				const uint8_t* pCand = pIn + iCand;
+				uint32_t uLen = 0;
+				while (uLen < uMaxLen && pCand[uLen] == pIn[uPos + uLen])
+					uLen++;
+				if (uLen > uBestLen)
+				{
+					uBestLen = uLen;
+					uBestDist = uPos - (uint32_t)iCand;
+					if (uLen == uMaxLen)
+						break;
+				}
+				int32_t iPrev = m_prev[iCand % WINDOW_BYTES];
+				if (iPrev >= iCand)
+					break;
+				iCand = iPrev;
+			}
+		}
+
+		uint32_t uAdvance = 1;
+		if (uBestLen >= MIN_MATCH)
+		{
+			PutMatch(writer, uBestLen, uBestDist);
+			uAdvance = uBestLen;
+		}
+		else
+		{
+			PutLiteral(writer, pIn[uPos]);
+		}
+
+		//匹配覆盖的位置也登记到哈希链，后面的数据可以引用
+		for (uint32_t i = 0; i < uAdvance; i++, uPos++)
+		{
+			if (uPos + MIN_MATCH > uBytes)
+				continue;
+			uint32_t uHash = Hash3(pIn + uPos);
+			m_prev[uPos % WINDOW_BYTES] = m_head[uHash];
+			m_head[uHash] = (int32_t)uPos;
+		}
+	}
+
+	PutLiteral(writer, 256);
+	writer.Align();
+
+	uint32_t uAdler = Adler32(pIn, uBytes);
+	writer.PutByte((uint8_t)(uAdler >> 24));
+	writer.PutByte((uint8_t)(uAdler >> 16));
+	writer.PutByte((uint8_t)(uAdler >> 8));
+	writer.PutByte((uint8_t)uAdler);
+	return writer.GetBytes();
+}
@@ -34,13 +34,11 @@ void QT_BoardGetCardInfo()
 
 int QT_BoardSetPerTrigger(uint32_t pre_trig_length)
 {
-	int ret = 0;
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x28, pre_trig_length);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x2C, 1);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x30, 0);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x30, 1);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x30, 0);
-	return ret;
+	RegTransaction trans("SetPerTrigger");
+	trans.Write(BASE_TRIG_CTRL, 0x28, pre_trig_length)
+		.Write(BASE_TRIG_CTRL, 0x2C, 1)
+		.Pulse(BASE_TRIG_CTRL, 0x30);
+	return trans.Flush(&pstCardInfo);
 }
 
 int QT_BoardSetFrameheader(uint32_t frameheaderenable)
@@ -52,23 +50,24 @@ int QT_BoardSetFrameheader(uint32_t frameheaderenable)
 
 int  QT_BoardSetTransmitMode(int transmitpoints, int transmittimes)
 {
-	int ret = 0;
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, 0x00, transmitpoints);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, 0x20, transmittimes);
-	return ret;
+	RegTransaction trans("SetTransmitMode");
+	trans.Write(BASE_DMA_ADC, 0x00, transmitpoints)
+		.Write(BASE_DMA_ADC, 0x20, transmittimes);
+	return trans.Flush(&pstCardInfo);
 }
 
 int QT_BoardSetClockMode(uint32_t clockmode)
 {
 	int ret = 0;
+	//按板卡上的实际值判断，只有值变化时才写入并产生更新脉冲
 	uint64_t readclockbackvalue = 0;
-	QTXdmaApiInterface::Func_QTXdmaReadRegister(&pstCardInfo, 0x2000, 0x04, &readclockbackvalue);
+	QTXdmaApiInterface::Func_QTXdmaReadRegisterDirect(&pstCardInfo, 0x2000, 0x04, &readclockbackvalue);
 	if (clockmode != readclockbackvalue)
 	{
-		QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, 0x2000, 0x04, clockmode);
-		QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, 0x2000, 0x08, 0);
-		QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, 0x2000, 0x08, 1);
-		QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, 0x2000, 0x08, 0);
+		RegTransaction trans("SetClockMode");
+		trans.Write(0x2000, 0x04, clockmode)
+			.Pulse(0x2000, 0x08);
+		ret = trans.Flush(&pstCardInfo);
 		Sleep(50);
 	}
 	return ret;
@@ -84,153 +83,164 @@ int QT_BoardSetInterruptSwitch()
 
 int QT_BoardSetADCStart()
 {
-	int ret = 0;
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x08, 0);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x08, 1);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x08, 0);
-	return ret;
+	RegTransaction trans("SetADCStart");
+	trans.Pulse(BASE_PCIE_INTR, 0x08);
+	return trans.Flush(&pstCardInfo);
 }
 
 int QT_BoardSetInterruptClear()
 {
-	int ret = 0;
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x04, 0);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x04, 1);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x04, 0);
-	return ret;
+	RegTransaction trans("SetInterruptClear");
+	trans.Pulse(BASE_PCIE_INTR, 0x04);
+	return trans.Flush(&pstCardInfo);
 }
 
 int QT_BoardSetADCStop()
 {
-	int ret = 0;
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x10, 0);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x10, 1);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x10, 0);
+	RegTransaction trans("SetADCStop");
+	trans.Pulse(BASE_PCIE_INTR, 0x10);
+	int ret = trans.Flush(&pstCardInfo);
+	//停止采集后DMA参数块和中断使能可能被板卡复位，缓存值不再可信；
+	//作废后再次启动时这些寄存器都会重新写入，不会因与缓存相同而被跳过
+	RegShadow::Ins().InvalidateBase(BASE_DMA_ADC);
+	RegShadow::Ins().Invalidate(BASE_PCIE_INTR, OFFSET_PCIE_INTR_INTR_ENABLE);
 	return ret;
 }
 
-void QT_BoardInterruptGatherType()
+int QT_BoardInterruptGatherType(WaitStrategy* pWait)
 {
 	uint32_t inpoint = 0;
+	if (pWait)
+		pWait->Begin();
 	do {
+		if (pWait && pWait->IsCancelled())
+			return -1;
 		inpoint = QTXdmaGetOneEvent(&pstCardInfo);
-		if (inpoint == 1)
-		{
-			QT_BoardSetInterruptClear();
-		}
+		if (inpoint != 1 && pWait)
+			pWait->Idle();
 	} while (inpoint != 1);
+	//发现就绪即结束计时，不含清中断的时间
+	if (pWait)
+		pWait->End();
+	QT_BoardSetInterruptClear();
+	return 0;
 }
 
-void QT_BoardPollingGatherType()
+int QT_BoardPollingGatherType(WaitStrategy* pWait)
 {
 	uint64_t uTriggerpoint = 0;
+	if (pWait)
+		pWait->Begin();
 	do
 	{
+		if (pWait && pWait->IsCancelled())
+			return -1;
 		QTXdmaApiInterface::Func_QTXdmaReadRegister(&pstCardInfo, BASE_PCIE_INTR, 0x1C, &uTriggerpoint, false);
-		if (uTriggerpoint == 1) {
-			QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, OFFSET_PCIE_INTR_INTR_CLEAR, 0);
-			QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, OFFSET_PCIE_INTR_INTR_CLEAR, 1);
-			QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, OFFSET_PCIE_INTR_INTR_CLEAR, 0);
-		}
+		if (uTriggerpoint != 1 && pWait)
+			pWait->Idle();
 	} while (uTriggerpoint != 1);
+	if (pWait)
+		pWait->End();
+	QT_BoardSetInterruptClear();
+	return 0;
 }
 
 int QT_BoardSetSoftReset()
 {
-	int ret = 0;
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x18, 0);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x18, 1);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x18, 0);
+	RegTransaction trans("SetSoftReset");
+	trans.Pulse(BASE_PCIE_INTR, 0x18);
+	int ret = trans.Flush(&pstCardInfo);
+	//复位后寄存器回到默认值，影子缓存作废
+	RegShadow::Ins().InvalidateAll();
 	return ret;
 }
 
 int QT_BoardSetStdSingleDMAParameter(uint32_t once_trig_bytes, uint32_t DMATotolbytes)
 {
-	int ret = 0;
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, 0x14, 4 * 1024 * 1024);//DMA单次搬运的长度
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x34, once_trig_bytes / 64 * 64);//设置单次触发长度
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, 0x18, DMATotolbytes / 64 * 64);//每一次触发的长度 如果是触发式采集应该注意触发频率和单次采集长度的大小关系 单次采集长度<触发频率理论采集长度
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, 0x1c, DMATotolbytes / 64 * 64);//xdma传输段长(byte) 一般为触发次数* 单次触发长度
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, 0x04, 0);//乒乓操作第一块地址
-	return ret;
+	RegTransaction trans("SetStdSingleDMAParameter");
+	trans.Write(BASE_DMA_ADC, 0x14, 4 * 1024 * 1024)//DMA单次搬运的长度
+		.Write(BASE_TRIG_CTRL, 0x34, once_trig_bytes / 64 * 64)//设置单次触发长度
+		.Write(BASE_DMA_ADC, 0x18, DMATotolbytes / 64 * 64)//每一次触发的长度 如果是触发式采集应该注意触发频率和单次采集长度的大小关系 单次采集长度<触发频率理论采集长度
+		.Write(BASE_DMA_ADC, 0x1c, DMATotolbytes / 64 * 64)//xdma传输段长(byte) 一般为触发次数* 单次触发长度
+		.Write(BASE_DMA_ADC, 0x04, 0);//乒乓操作第一块地址
+	return trans.Flush(&pstCardInfo);
 }
 
 int QT_BoardSetStdMultiDMAParameter(uint32_t once_trig_bytes, uint32_t DMATotolbytes)
 {
-	int ret = 0;
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, 0x14, 4 * 1024 * 1024);//DMA单次搬运的长度
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x34, once_trig_bytes / 64 * 64);//设置单次触发长度
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, 0x18, DMATotolbytes / 64 * 64);//每一次触发的长度 如果是触发式采集应该注意触发频率和单次采集长度的大小关系 单次采集长度<触发频率理论采集长度
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, 0x1c, DMATotolbytes / 64 * 64);//xdma传输段长(byte) 一般为触发次数* 单次触发长度
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, 0x04, 0);//乒乓操作第一块地址
-	return ret;
+	RegTransaction trans("SetStdMultiDMAParameter");
+	trans.Write(BASE_DMA_ADC, 0x14, 4 * 1024 * 1024)//DMA单次搬运的长度
+		.Write(BASE_TRIG_CTRL, 0x34, once_trig_bytes / 64 * 64)//设置单次触发长度
+		.Write(BASE_DMA_ADC, 0x18, DMATotolbytes / 64 * 64)//每一次触发的长度 如果是触发式采集应该注意触发频率和单次采集长度的大小关系 单次采集长度<触发频率理论采集长度
+		.Write(BASE_DMA_ADC, 0x1c, DMATotolbytes / 64 * 64)//xdma传输段长(byte) 一般为触发次数* 单次触发长度
+		.Write(BASE_DMA_ADC, 0x04, 0);//乒乓操作第一块地址
+	return trans.Flush(&pstCardInfo);
 }
 
 int QT_BoardSetFifoSingleDMAParameter(uint32_t once_trig_bytes, uint32_t DMATotolbytes)
 {
-	int ret = 0;
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, 0x14, 4 * 1024 * 1024);//DMA单次搬运的长度
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x34, once_trig_bytes / 64 * 64);//设置单次触发长度
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, 0x18, DMATotolbytes / 64 * 64);//每一次触发的长度 如果是触发式采集应该注意触发频率和单次采集长度的大小关系 单次采集长度<触发频率理论采集长度
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, 0x1c, DMATotolbytes / 64 * 64);//xdma传输段长(byte) 一般为触发次数* 单次触发长度
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, OFFSET_DMA_ADC_BASEADDR0_LOW, 0);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, OFFSET_DMA_ADC_BASEADDR0_HIGH, 0);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, OFFSET_DMA_ADC_BASEADDR1_LOW, 0x80000000);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, OFFSET_DMA_ADC_BASEADDR1_HIGH, 0);
-	return ret;
+	RegTransaction trans("SetFifoSingleDMAParameter");
+	trans.Write(BASE_DMA_ADC, 0x14, 4 * 1024 * 1024)//DMA单次搬运的长度
+		.Write(BASE_TRIG_CTRL, 0x34, once_trig_bytes / 64 * 64)//设置单次触发长度
+		.Write(BASE_DMA_ADC, 0x18, DMATotolbytes / 64 * 64)//每一次触发的长度 如果是触发式采集应该注意触发频率和单次采集长度的大小关系 单次采集长度<触发频率理论采集长度
+		.Write(BASE_DMA_ADC, 0x1c, DMATotolbytes / 64 * 64)//xdma传输段长(byte) 一般为触发次数* 单次触发长度
+		.Write(BASE_DMA_ADC, OFFSET_DMA_ADC_BASEADDR0_LOW, 0)
+		.Write(BASE_DMA_ADC, OFFSET_DMA_ADC_BASEADDR0_HIGH, 0)
+		.Write(BASE_DMA_ADC, OFFSET_DMA_ADC_BASEADDR1_LOW, 0x80000000)
+		.Write(BASE_DMA_ADC, OFFSET_DMA_ADC_BASEADDR1_HIGH, 0);
+	return trans.Flush(&pstCardInfo);
 }
 
 int QT_BoardSetFifoMultiDMAParameter(uint32_t once_trig_bytes, uint32_t DMATotolbytes)
 {
-	int ret = 0;
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, 0x14, 4 * 1024 * 1024);//DMA单次搬运的长度
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x34, once_trig_bytes / 64 * 64);//设置单次触发长度
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, 0x18, DMATotolbytes / 64 * 64);//每一次触发的长度 如果是触发式采集应该注意触发频率和单次采集长度的大小关系 单次采集长度<触发频率理论采集长度
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, 0x1c, DMATotolbytes / 64 * 64);//xdma传输段长(byte) 一般为触发次数* 单次触发长度
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, OFFSET_DMA_ADC_BASEADDR0_LOW, 0);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, OFFSET_DMA_ADC_BASEADDR0_HIGH, 0);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, OFFSET_DMA_ADC_BASEADDR1_LOW, 0x0);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_ADC, OFFSET_DMA_ADC_BASEADDR1_HIGH, 0x1);
-	return ret;
+	RegTransaction trans("SetFifoMultiDMAParameter");
+	trans.Write(BASE_DMA_ADC, 0x14, 4 * 1024 * 1024)//DMA单次搬运的长度
+		.Write(BASE_TRIG_CTRL, 0x34, once_trig_bytes / 64 * 64)//设置单次触发长度
+		.Write(BASE_DMA_ADC, 0x18, DMATotolbytes / 64 * 64)//每一次触发的长度 如果是触发式采集应该注意触发频率和单次采集长度的大小关系 单次采集长度<触发频率理论采集长度
+		.Write(BASE_DMA_ADC, 0x1c, DMATotolbytes / 64 * 64)//xdma传输段长(byte) 一般为触发次数* 单次触发长度
+		.Write(BASE_DMA_ADC, OFFSET_DMA_ADC_BASEADDR0_LOW, 0)
+		.Write(BASE_DMA_ADC, OFFSET_DMA_ADC_BASEADDR0_HIGH, 0)
+		.Write(BASE_DMA_ADC, OFFSET_DMA_ADC_BASEADDR1_LOW, 0x0)
+		.Write(BASE_DMA_ADC, OFFSET_DMA_ADC_BASEADDR1_HIGH, 0x1);
+	return trans.Flush(&pstCardInfo);
 }
 
 int QT_BoardSoftTrigger()
 {
-	int ret = 0;
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x00, 0);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x04, 1);
-	return ret;
+	RegTransaction trans("SoftTrigger");
+	trans.Write(BASE_TRIG_CTRL, 0x00, 0)
+		.Write(BASE_TRIG_CTRL, 0x04, 1);
+	return trans.Flush(&pstCardInfo);
 }
 
 int QT_BoardInternalPulseTrigger(int counts, int pulse_period, int pulse_width)
 {
-	int ret = 0;
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x00, 1);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x04, counts);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x08, pulse_period / 10);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x0C, pulse_width / 10);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x10, 1);
-	return ret;
+	RegTransaction trans("InternalPulseTrigger");
+	trans.Write(BASE_TRIG_CTRL, 0x00, 1)
+		.Write(BASE_TRIG_CTRL, 0x04, counts)
+		.Write(BASE_TRIG_CTRL, 0x08, pulse_period / 10)
+		.Write(BASE_TRIG_CTRL, 0x0C, pulse_width / 10)
+		.Write(BASE_TRIG_CTRL, 0x10, 1);
+	return trans.Flush(&pstCardInfo);
 }
 
 int QT_BoardExternalTrigger(int mode, int counts)
 {
-	int ret = 0;
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x00, mode);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x04, counts);
-	return ret;
-
+	RegTransaction trans("ExternalTrigger");
+	trans.Write(BASE_TRIG_CTRL, 0x00, mode)
+		.Write(BASE_TRIG_CTRL, 0x04, counts);
+	return trans.Flush(&pstCardInfo);
 }
 
 int QT_BoardChannelTrigger(int mode, int counts, int channelID, int rasing_codevalue, int falling_codevalue)
 {
-	int ret = 0;
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x00, mode);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x04, counts);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x24, channelID);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x14, rasing_codevalue);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_TRIG_CTRL, 0x18, falling_codevalue);
-	return ret;
+	RegTransaction trans("ChannelTrigger");
+	trans.Write(BASE_TRIG_CTRL, 0x00, mode)
+		.Write(BASE_TRIG_CTRL, 0x04, counts)
+		.Write(BASE_TRIG_CTRL, 0x24, channelID)
+		.Write(BASE_TRIG_CTRL, 0x14, rasing_codevalue)
+		.Write(BASE_TRIG_CTRL, 0x18, falling_codevalue);
+	return trans.Flush(&pstCardInfo);
 }
 
 int phase_inc(double bitWidth, double ddsInputClockMHz, double ddsOutputFreqMHz, uint32_t *ctrlWord)
@@ -273,13 +283,13 @@ int phase_offset(double bitWidth, double ddsInputClockMHz, double ddsOutputFreqM
 
 int QT_BoardSetDacPhaseAndFreq(uint64_t freq, uint64_t phase_inc)
 {
-	int ret = 0;
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DAC_CTRL, 0x14, freq);
-	ret = QTXdmaApiInterface::Func_QTXdmaReadRegister(&pstCardInfo, BASE_DAC_CTRL, 0x14, &freq);
+	RegTransaction trans("SetDacPhaseAndFreq");
+	trans.Write(BASE_DAC_CTRL, 0x14, freq)
+		.ReadBack(BASE_DAC_CTRL, 0x14, &freq)
+		.Write(BASE_DAC_CTRL, 0x18, phase_inc)
+		.ReadBack(BASE_DAC_CTRL, 0x18, &phase_inc);
+	int ret = trans.Flush(&pstCardInfo);
 	printf("%lld\n", freq);
-
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DAC_CTRL, 0x18, phase_inc);
-	ret = QTXdmaApiInterface::Func_QTXdmaReadRegister(&pstCardInfo, BASE_DAC_CTRL, 0x18, &phase_inc);
 	printf("%lld\n", phase_inc);
 	return ret;
 }
@@ -287,38 +297,29 @@ int QT_BoardSetDacPhaseAndFreq(uint64_t freq, uint64_t phase_inc)
 
 int QT_BoardUpdateTheOutputFrequency()
 {
-	int ret = 0;
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DAC_CTRL, 0x1C, 0);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DAC_CTRL, 0x1C, 1);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DAC_CTRL, 0x1C, 0);
-	return ret;
+	RegTransaction trans("UpdateTheOutputFrequency");
+	trans.Pulse(BASE_DAC_CTRL, 0x1C);
+	return trans.Flush(&pstCardInfo);
 }
 int QT_BoardSetDaPlayStart(bool enable)
 {
-	int ret = 0;
+	RegTransaction trans("SetDaPlayStart");
 	if (enable)
 	{
-		QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x0C, 0);
-		QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x0C, 1);
-		QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x0C, 0);
+		trans.Pulse(BASE_PCIE_INTR, 0x0C);
 	}
 	else
 	{
 		//DDS播放置为0
-		QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DAC_CTRL, 0x14, 0);
-		QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DAC_CTRL, 0x18, 1);
-
-		QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DAC_CTRL, 0x1c, 0);
-		QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DAC_CTRL, 0x1c, 1);
-		QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DAC_CTRL, 0x1c, 0);
+		trans.Write(BASE_DAC_CTRL, 0x14, 0)
+			.Write(BASE_DAC_CTRL, 0x18, 1)
+			.Pulse(BASE_DAC_CTRL, 0x1c);
 
 		//上位机下发停止播放指令
-		QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x14, 0x0);
-		QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x14, 0x1);
-		QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x14, 0x0);
-
+		trans.Pulse(BASE_PCIE_INTR, 0x14);
 	}
-	return ret;
+	trans.Flush(&pstCardInfo);
+	return 0;
 }
 
 int QT_BoardSetDacPlaySourceSelect(uint32_t sourceId)
@@ -337,12 +338,12 @@ int QT_BoardSetDacPlayChannelSelect(uint32_t channelId)
 
 int QT_BoardSetDACLoopRead(int enable, uint32_t count)
 {
-	int ret = 0;
 	int eenable = enable ? 1 : 0;
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_DAC, 0x00, 0);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_DAC, 0x1C, eenable);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_DAC, 0x20, count);
-	return ret;
+	RegTransaction trans("SetDACLoopRead");
+	trans.Write(BASE_DMA_DAC, 0x00, 0)
+		.Write(BASE_DMA_DAC, 0x1C, eenable)
+		.Write(BASE_DMA_DAC, 0x20, count);
+	return trans.Flush(&pstCardInfo);
 }
 
 int QT_BoardSetDacTriggerMode(uint32_t triggermode)
@@ -354,11 +355,12 @@ int QT_BoardSetDacTriggerMode(uint32_t triggermode)
 
 int QT_BoardSetDacRegister(uint32_t uWriteStartAddr, uint32_t uPlaySize)
 {
-	int ret = 0;
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_DAC, 0x00, 0);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_DAC, 0x04, uWriteStartAddr);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_DAC, 0x14, 4 * 1024 * 1024);
-	ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_DMA_DAC, 0x18, uPlaySize);
+	RegTransaction trans("SetDacRegister");
+	trans.Write(BASE_DMA_DAC, 0x00, 0)
+		.Write(BASE_DMA_DAC, 0x04, uWriteStartAddr)
+		.Write(BASE_DMA_DAC, 0x14, 4 * 1024 * 1024)
+		.Write(BASE_DMA_DAC, 0x18, uPlaySize);
+	trans.Flush(&pstCardInfo);
 	return 0;
 }
 
@@ -367,42 +369,37 @@ int QT_BoardSetOffset(int channel_id, int offset_value)
 	int ret = 0;
 	//将电压值转换成偏置寄存器下发数值
 	uint32_t single_offset_reg = 0;
-	//根据界面设置去获取偏置并下发
+	//根据界面设置去获取偏置并下发，偏置值和更新脉冲在同一事务中
+	RegTransaction trans("SetOffset");
 	if (channel_id == 1)
 	{
 		single_offset_reg = (uint32_t)((double)((double)2.5 - offset_value) * 8192 / (double)2.5 - 169);
-		ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x20, single_offset_reg);
-		ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x30, 0);
-		ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x30, 1);
-		ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x30, 0);
+		trans.Write(BASE_PCIE_INTR, 0x20, single_offset_reg)
+			.Pulse(BASE_PCIE_INTR, 0x30);
 	}
 	else if (channel_id == 2)
 	{
 		single_offset_reg = (uint32_t)((double)((double)2.5 - offset_value) * 8192 / (double)2.5 - 175);
-		ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x24, single_offset_reg);
-		ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x34, 0);
-		ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x34, 1);
-		ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x34, 0);
+		trans.Write(BASE_PCIE_INTR, 0x24, single_offset_reg)
+			.Pulse(BASE_PCIE_INTR, 0x34);
 	}
 	else if (channel_id == 3)
 	{
 		single_offset_reg = (uint32_t)((double)((double)2.5 - offset_value) * 8192 / (double)2.5 - 157);
-		ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x28, single_offset_reg);
-		ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x38, 0);
-		ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x38, 1);
-		ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x38, 0);
+		trans.Write(BASE_PCIE_INTR, 0x28, single_offset_reg)
+			.Pulse(BASE_PCIE_INTR, 0x38);
 	}
 	else if (channel_id == 4)
 	{
 		single_offset_reg = (uint32_t)((double)((double)2.5 - offset_value) * 8192 / (double)2.5 - 195);
-		ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x2c, single_offset_reg);
-		ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x3c, 0);
-		ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x3c, 1);
-		ret = QTXdmaApiInterface::Func_QTXdmaWriteRegister(&pstCardInfo, BASE_PCIE_INTR, 0x3c, 0);
+		trans.Write(BASE_PCIE_INTR, 0x2c, single_offset_reg)
+			.Pulse(BASE_PCIE_INTR, 0x3c);
 	}
 	else
 	{
 		puts("Wrong channel id!");
+		return ret;
 	}
+	ret = trans.Flush(&pstCardInfo);
 	return ret;
 }
\ No newline at end of file
@@ -1,25 +1,26 @@
 #include "pub.h"
+#include <windows.h>
 #include <sstream>
 
-//iҪתʮwidthתĿȣλ0
+//i要转化的十进制整数，width转化后的宽度，位数不足则补0
 std::string pub::dec2hex(int i, int width)
 {
-	std::stringstream ioss;     //ַ
-	std::string s_temp;         //תַ
-	ioss << std::hex << i;      //ʮʽ
+	std::stringstream ioss;     //定义字符串流
+	std::string s_temp;         //存放转化后字符
+	ioss << std::hex << i;      //以十六制形式输出
 	ioss >> s_temp;
 
 	if (width > s_temp.size())
 	{
-		std::string s_0(width - s_temp.size(), '0');      //λ0
-		s_temp = s_0 + s_temp;                            //ϲ
+		std::string s_0(width - s_temp.size(), '0');      //位数不够则补0
+		s_temp = s_0 + s_temp;                            //合并
 	}
 
-	std::string s = s_temp.substr(s_temp.length() - width, s_temp.length());    //ȡwidthλ
+	std::string s = s_temp.substr(s_temp.length() - width, s_temp.length());    //取右width位
 	return s;
 }
 
-string pub::DecIntToHexStr(long long num)			//ʮʮַת
+string pub::DecIntToHexStr(long long num)			//十进制整数到十六进制字符的转换
 {
 	string str;
 	long long Temp = num / 16;
@@ -34,10 +35,32 @@ string pub::DecIntToHexStr(long long num)			//ʮ
 }
 
 
-string pub::DecStrToHexStr(string str)			//ʮַʮַת
+string pub::DecStrToHexStr(string str)			//十进制字符到十六进制字符转换
 {
 	long long Dec = 0;
 	for (int i = 0; i < str.size(); ++i)
 		Dec = Dec * 10 + str[i] - '0';
 	return DecIntToHexStr(Dec);
 }
+
+bool pub::EnablePrivilege(const char* szPrivilege)
+{
+	HANDLE hToken = NULL;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &hToken))
+		return false;
+
+	TOKEN_PRIVILEGES tp;
+	tp.PrivilegeCount = 1;
+	tp.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	if (!LookupPrivilegeValueA(NULL, szPrivilege, &tp.Privileges[0].Luid))
+	{
+		CloseHandle(hToken);
+		return false;
+	}
+
+	//AdjustTokenPrivileges在未授予时也返回TRUE，需检查GetLastError
+	BOOL bRet = AdjustTokenPrivileges(hToken, FALSE, &tp, 0, NULL, NULL);
+	DWORD dwErr = GetLastError();
+	CloseHandle(hToken);
+	return bRet && dwErr == ERROR_SUCCESS;
+}
@@ -1,6 +1,8 @@
 ﻿#include "qtxdmaapiinterface.h"
 
 #include "TraceLog.h"
+#include "RegTrace.h"
+#include "RegShadow.h"
 
 Log_TraceLog g_LogReg(std::string("./logs/KunchiUpperMonitorReg.log"));
 Log_TraceLog * pLogReg = &g_LogReg;
@@ -9,16 +11,14 @@ extern void printfLog(int nLevel, const char * fmt, ...);
 
 void printfLogReg(int nLevel, const char * fmt, ...)
 {
-	if (pLogReg == NULL)
+	//级别未通过时不格式化
+	if (pLogReg == NULL || !pLogReg->Passed(nLevel))
 		return;
 
-	char buf[1024];
 	va_list list;
 	va_start(list, fmt);
-	vsprintf_s(buf, fmt, list);
+	pLogReg->TraceV(nLevel, fmt, list);
 	va_end(list);
-
-	pLogReg->Trace(nLevel, buf);
 }
 
 QTXdmaApiInterface::QTXdmaApiInterface()
@@ -26,26 +26,66 @@ QTXdmaApiInterface::QTXdmaApiInterface()
 
 }
 
-int QTXdmaApiInterface::Func_QTXdmaReadRegister(STXDMA_CARDINFO *g_stCardInfo, uint64_t base, uint32_t offset, uint64_t *value, bool bWrilteLog)
+int QTXdmaApiInterface::Func_QTXdmaReadRegister(STXDMA_CARDINFO *g_stCardInfo, uint64_t base, uint32_t offset, uint64_t *value, bool bWrilteLog, bool *pbCached)
 {
+    if(pbCached)
+        *pbCached = false;
     if(!g_stCardInfo){
         printfLogReg(5, "QTXdmaApiInterface::Func_QTXdmaReadRegister, g_stCardInfo is NULL");
         return -1;
     }
 
+    //配置寄存器已有缓存值时不访问板卡
+    if(value && RegShadow::Ins().Lookup(base, offset, *value))
+    {
+        if(pbCached)
+            *pbCached = true;
+        return 0;
+    }
+
+    return Func_QTXdmaReadRegisterDirect(g_stCardInfo, base, offset, value, bWrilteLog);
+}
+
+int QTXdmaApiInterface::Func_QTXdmaReadRegisterDirect(STXDMA_CARDINFO *g_stCardInfo, uint64_t base, uint32_t offset, uint64_t *value, bool bWrilteLog)
+{
+    if(!g_stCardInfo){
+        printfLogReg(5, "QTXdmaApiInterface::Func_QTXdmaReadRegisterDirect, g_stCardInfo is NULL");
+        return -1;
+    }
+
+    int ret = QTXdmaReadRegister(g_stCardInfo, base, offset, value);
+    if(ret == 0 && value)
+        RegShadow::Ins().Store(base, offset, *value);
+
+    //寄存器访问只写二进制跟踪环，需要时导出解码
     if(bWrilteLog)
-        printfLogReg(5, "[QTXdmaApiInterface::Func_QTXdmaReadRegister], base 0x%x, offset 0x%x", base, offset);
+        RegTrace::Ins().Record(RegTrace::DIR_READ, base, offset, value ? *value : 0, ret);
 
-    return QTXdmaReadRegister(g_stCardInfo, base, offset, value);
+    return ret;
 }
 
-int QTXdmaApiInterface::Func_QTXdmaWriteRegister(STXDMA_CARDINFO *g_stCardInfo, uint64_t base, uint32_t offset, uint64_t value)
+int QTXdmaApiInterface::Func_QTXdmaWriteRegister(STXDMA_CARDINFO *g_stCardInfo, uint64_t base, uint32_t offset, uint64_t value, bool *pbSkipped)
 {
+    if(pbSkipped)
+        *pbSkipped = false;
     if(!g_stCardInfo){
         printfLogReg(5, "QTXdmaApiInterface::Func_QTXdmaWriteRegister, g_stCardInfo is NULL");
         return -1;
     }
 
-    printfLogReg(5, "[QTXdmaApiInterface::Func_QTXdmaWriteRegister], base 0x%x, offset 0x%x, value 0x%x", base, offset, value);
-    return QTXdmaWriteRegister(g_stCardInfo, base, offset, value);
+    //写入值与板卡上的值相同时跳过
+    if(RegShadow::Ins().IsRedundantWrite(base, offset, value))
+    {
+        if(pbSkipped)
+            *pbSkipped = true;
+        return 0;
+    }
+
+    int ret = QTXdmaWriteRegister(g_stCardInfo, base, offset, value);
+    if(ret == 0)
+        RegShadow::Ins().Store(base, offset, value);
+    else
+        RegShadow::Ins().Invalidate(base, offset);
+    RegTrace::Ins().Record(RegTrace::DIR_WRITE, base, offset, value, ret);
+    return ret;
 }